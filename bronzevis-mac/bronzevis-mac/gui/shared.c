@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
 
 /* Vendored BRONZESIM core.
    shared.c lives in bronzevis-mac/bronzevis-mac/gui/, so ../bronzesim/src is adjacent. */
@@ -42,6 +44,8 @@
 #include "../../../src/brz_world.h"
 #include "../../../src/brz_settlement.h"
 #include "../../../src/brz_agent.h"
+#include "../../../src/brz_sim.h"
+#include "../../../src/brz_frame.h"
 #include "../../../src/brz_util.h"
 
 /* Fixed output surface (requested): 1024 x 800 RGBA(ish)
@@ -52,54 +56,34 @@
 
 static unsigned char outputBuffer[ SCREEN_SIZE ];
 
-/* ---------------- config helpers ---------------- */
-
-static const ParamDef* cfg_find_param(const ParsedConfig* cfg, const char* key)
-{
-    for(size_t i=0;i<cfg->params.len;i++){
-        const ParamDef* p = (const ParamDef*)brz_vec_cat(&cfg->params, i);
-        if(p->key && brz_streq(p->key, key)) return p;
-    }
-    return NULL;
-}
-
-static int cfg_get_int(const ParsedConfig* cfg, const char* key, int defv)
-{
-    const ParamDef* p = cfg_find_param(cfg, key);
-    if(!p) return defv;
-    if(p->has_svalue) return defv;
-    return (int)(p->value);
-}
-
 /* ---------------- realtime sim state ---------------- */
 
+/* The sim runs days on its own thread as fast as it can and publishes a
+   frame after each one; the UI thread renders the latest frame on its
+   tick. World height, sea level and settlement positions never change
+   once the sim is built, so the renderer reads them from rt.sim directly;
+   everything that moves comes from the frame. */
 typedef struct {
     int ready;
 
     ParsedConfig cfg;
     int cfg_loaded;
 
-    BrzWorld world;
-    int world_inited;
+    BrzSim sim;
+    int sim_inited;
+    int threads;        /* sim { threads } */
 
-    BrzSettlement* setts;
-    int sett_n;
+    BrzFrameChannel frames;
+    int frames_inited;
 
-    BrzAgent* agents;
-    int agent_n;
+    pthread_t thread;
+    int thread_running;
+    int stop;           /* set (atomically) to end the sim thread */
 
-    BrzRng rng;
-    size_t res_n;
-    size_t item_n;
+    unsigned char (*voc_rgb)[3]; /* [vocations] vocation_color */
 
     int map_w;
     int map_h;
-
-    unsigned long day;
-
-    /* pacing: Swift passes milliseconds as ticks */
-    unsigned long last_ms;
-    unsigned long accum_ms;
 } BrzRealtime;
 
 static BrzRealtime rt;
@@ -274,14 +258,75 @@ static void vocation_color(const VocationDef* voc, unsigned char* r, unsigned ch
     *b = (unsigned char)(80 + ((h >> 16) & 0x7F));
 }
 
+/* Terrain and settlements only change with the tags (or the height debug
+   toggle), so they are rasterized once into terrainBuffer. A frame then
+   restores the pixels under the last frame's sprites from it and draws
+   the agents on top, which costs O(agents) instead of O(pixels). */
+static unsigned char terrainBuffer[ SCREEN_SIZE ];
+
+typedef struct {
+    int valid;          /* terrainBuffer matches the fields below */
+    int show_height;
+    uint32_t tags_gen;
+    int day;            /* day outputBuffer shows */
+    BrzPos* prev_pos;   /* [prev_cap] agent tiles drawn into outputBuffer */
+    int prev_cap, prev_n;
+    int hud_w;          /* width of the HUD bar drawn */
+
+    /* density mode, for more agents than sim { lod_agents N } (default
+       10000): a tile with agents is painted in its dominant vocation's
+       color, brighter the more agents stand on it. The dominant vocation
+       is a one-pass majority vote, exact whenever one holds a majority. */
+    int lod;
+    uint32_t* bin_n;    /* [tiles] agents on the tile, 0 between frames */
+    uint32_t* bin_voc;  /* [tiles] vote candidate */
+    uint32_t* bin_vote; /* [tiles] its vote margin */
+    uint32_t* tiles;    /* [tiles] painted tiles, prev_n of them */
+} RenderCache;
+
+static RenderCache rc;
+
+static void rc_reset(void)
+{
+    free(rc.prev_pos);
+    free(rc.bin_n);
+    free(rc.bin_voc);
+    free(rc.bin_vote);
+    free(rc.tiles);
+    memset(&rc, 0, sizeof(rc));
+}
+
 /* ---------------- sim lifecycle ---------------- */
 
+static bool rt_publish_day(void* ctx, BrzSim* sim)
+{
+    (void)ctx;
+    brz_sim_sync(sim);
+    brz_frame_capture(brz_frames_back(&rt.frames), sim);
+    brz_frames_publish(&rt.frames);
+    return !__atomic_load_n(&rt.stop, __ATOMIC_ACQUIRE);
+}
+
+static void* rt_sim_main(void* arg)
+{
+    (void)arg;
+    if(brz_sim_run_days(&rt.sim, INT_MAX - 1, rt.threads, rt_publish_day, NULL) != 0)
+        fprintf(stderr, "bronzevis: sim stopped on an error at day %d\n", rt.sim.day);
+    return NULL;
+}
+
 static void rt_shutdown(void)
 {
-    if(rt.agents){ brz_agents_free(rt.agents, rt.agent_n); rt.agents = NULL; }
-    if(rt.setts){ brz_settlements_free(rt.setts, rt.sett_n); rt.setts = NULL; }
-    if(rt.world_inited){ brz_world_free(&rt.world); rt.world_inited = 0; }
+    if(rt.thread_running){
+        __atomic_store_n(&rt.stop, 1, __ATOMIC_RELEASE);
+        pthread_join(rt.thread, NULL);
+        rt.thread_running = 0;
+    }
+    if(rt.frames_inited){ brz_frames_free(&rt.frames); rt.frames_inited = 0; }
+    if(rt.sim_inited){ brz_sim_free(&rt.sim); rt.sim_inited = 0; }
     if(rt.cfg_loaded){ brz_cfg_free(&rt.cfg); rt.cfg_loaded = 0; }
+    free(rt.voc_rgb);
+    rc_reset();
 
     memset(&rt, 0, sizeof(rt));
 }
@@ -303,88 +348,95 @@ int brz_shared_load_config(const char* path)
     }
     rt.cfg_loaded = 1;
 
-    rt.res_n  = kind_table_count(&rt.cfg.resource_kinds);
-    rt.item_n = kind_table_count(&rt.cfg.item_kinds);
-
     /* For realtime rendering, defaults target a ~160x125 tile map (fits 1024x800 at 6px tiles). */
-    rt.map_w = cfg_get_int(&rt.cfg, "sim_map_w", 160);
-    rt.map_h = cfg_get_int(&rt.cfg, "sim_map_h", 125);
+    rt.map_w = brz_cfg_get_int(&rt.cfg, "sim_map_w", 160);
+    rt.map_h = brz_cfg_get_int(&rt.cfg, "sim_map_h", 125);
     rt.map_w = (rt.map_w < 8) ? 8 : rt.map_w;
     rt.map_h = (rt.map_h < 8) ? 8 : rt.map_h;
     rt.map_w = (rt.map_w > 512) ? 512 : rt.map_w;
     rt.map_h = (rt.map_h > 512) ? 512 : rt.map_h;
+    rt.threads = brz_cfg_get_int(&rt.cfg, "sim_threads", 0);
 
-    rt.agent_n = (rt.cfg.agent_count > 0) ? rt.cfg.agent_count : (int)rt.cfg.vocations.len;
-    if(rt.agent_n <= 0) rt.agent_n = 32;
-
-    rt.sett_n = (rt.cfg.settlement_count > 0) ? rt.cfg.settlement_count : 1;
-    if(rt.sett_n <= 0) rt.sett_n = 1;
-
-    if(brz_world_init(&rt.world, &rt.cfg, rt.map_w, rt.map_h, rt.res_n) != 0){
-        fprintf(stderr, "brz_shared_load_config: world init failed\n");
+    if(!brz_cfg_set_num(&rt.cfg, "sim_map_w", rt.map_w) || !brz_cfg_set_num(&rt.cfg, "sim_map_h", rt.map_h)){
+        fprintf(stderr, "brz_shared_load_config: OOM\n");
         rt_shutdown();
         return 3;
     }
-    rt.world_inited = 1;
+    if(brz_sim_init(&rt.sim, &rt.cfg) != 0){
+        fprintf(stderr, "brz_shared_load_config: sim init failed\n");
+        rt_shutdown();
+        return 3;
+    }
+    rt.sim_inited = 1;
 
-    if(brz_settlements_alloc(&rt.setts, rt.sett_n, rt.res_n, rt.item_n) != 0){
-        fprintf(stderr, "brz_shared_load_config: settlement alloc failed\n");
+    if(brz_frames_init(&rt.frames, &rt.sim) != 0){
+        fprintf(stderr, "brz_shared_load_config: frame alloc failed\n");
         rt_shutdown();
         return 4;
     }
+    rt.frames_inited = 1;
+    rc.lod = rt.sim.agents.n > brz_cfg_get_int(&rt.cfg, "sim_lod_agents", 10000);
+    if(rc.lod){
+        const size_t tn = (size_t)rt.map_w * (size_t)rt.map_h;
+        rc.bin_n    = (uint32_t*)calloc(tn, sizeof(uint32_t));
+        rc.bin_voc  = (uint32_t*)calloc(tn, sizeof(uint32_t));
+        rc.bin_vote = (uint32_t*)calloc(tn, sizeof(uint32_t));
+        rc.tiles    = (uint32_t*)calloc(tn, sizeof(uint32_t));
+        if(!rc.bin_n || !rc.bin_voc || !rc.bin_vote || !rc.tiles){
+            fprintf(stderr, "brz_shared_load_config: OOM\n");
+            rt_shutdown();
+            return 4;
+        }
+    }else{
+        rc.prev_pos = (BrzPos*)calloc((size_t)(rt.sim.agents.n > 0 ? rt.sim.agents.n : 1), sizeof(BrzPos));
+        rc.prev_cap = rc.prev_pos ? rt.sim.agents.n : 0;
+    }
+    brz_frame_capture(brz_frames_back(&rt.frames), &rt.sim);
+    brz_frames_publish(&rt.frames);
 
-    brz_settlements_place(rt.setts, rt.sett_n, rt.map_w, rt.map_h, rt.cfg.seed ? rt.cfg.seed : 0xC0FFEEu);
-    brz_world_stamp_fields_around_settlements(&rt.world, rt.setts, rt.sett_n, 8);
-
-    if(brz_agents_alloc_and_spawn(&rt.agents, rt.agent_n, &rt.cfg,
-                                  rt.setts, rt.sett_n,
-                                  rt.res_n, rt.item_n,
-                                  rt.cfg.seed ? rt.cfg.seed : 0xC0FFEEu) != 0){
-        fprintf(stderr, "brz_shared_load_config: agent alloc failed\n");
+    const size_t voc_n = rt.cfg.vocations.len;
+    rt.voc_rgb = (unsigned char (*)[3])calloc(voc_n ? voc_n : 1, sizeof(*rt.voc_rgb));
+    if(!rt.voc_rgb){
+        fprintf(stderr, "brz_shared_load_config: OOM\n");
         rt_shutdown();
         return 5;
     }
-
-    /* population count */
-    for(int si=0; si<rt.sett_n; si++) rt.setts[si].population = 0;
-    for(int ai=0; ai<rt.agent_n; ai++){
-        int h = rt.agents[ai].home_settlement;
-        if(h>=0 && h<rt.sett_n) rt.setts[h].population++;
+    for(size_t v=0; v<voc_n; v++){
+        const VocationDef* voc = (const VocationDef*)brz_vec_at(&rt.cfg.vocations, v);
+        vocation_color(voc, &rt.voc_rgb[v][0], &rt.voc_rgb[v][1], &rt.voc_rgb[v][2]);
     }
 
-    brz_rng_seed(&rt.rng, rt.cfg.seed ? rt.cfg.seed : 0xC0FFEEu);
-
+    if(pthread_create(&rt.thread, NULL, rt_sim_main, NULL) != 0){
+        fprintf(stderr, "brz_shared_load_config: cannot start the sim thread\n");
+        rt_shutdown();
+        return 6;
+    }
+    rt.thread_running = 1;
     rt.ready = 1;
-    rt.day = 1;
-    rt.last_ms = 0;
-    rt.accum_ms = 0;
 
     return 0;
 }
 
 /* ---------------- rendering ---------------- */
 
-static void rt_render(void)
+/* copy a rectangle of terrainBuffer back into outputBuffer */
+static void restore_rect(int x0, int y0, int w, int h)
 {
-    if(!rt.ready){
-        rt_clear_frame(25, 25, 25);
-        return;
-    }
-
-    /* Map-to-screen transform */
-    int tile_px = 1;
-    if(rt.map_w > 0 && rt.map_h > 0){
-        int tx = FB_W / rt.map_w;
-        int ty = FB_H / rt.map_h;
-        tile_px = (tx < ty) ? tx : ty;
-        if(tile_px < 1) tile_px = 1;
+    int x1 = x0 + w;
+    int y1 = y0 + h;
+    if(x0 < 0) x0 = 0;
+    if(y0 < 0) y0 = 0;
+    if(x1 > FB_W) x1 = FB_W;
+    if(y1 > FB_H) y1 = FB_H;
+    if(x1 <= x0) return;
+    for(int y=y0; y<y1; y++){
+        size_t at = ((size_t)y * (size_t)FB_W + (size_t)x0) * 4u;
+        memcpy(&outputBuffer[at], &terrainBuffer[at], (size_t)(x1 - x0) * 4u);
     }
+}
 
-    int map_px_w = rt.map_w * tile_px;
-    int map_px_h = rt.map_h * tile_px;
-    int off_x = (FB_W - map_px_w) / 2;
-    int off_y = (FB_H - map_px_h) / 2;
-
+static void rt_render_terrain(const BrzFrame* f, int tile_px, int off_x, int off_y)
+{
     /* Background outside map */
     rt_clear_frame(18, 18, 18);
 
@@ -392,9 +444,9 @@ static void rt_render(void)
     for(int y=0; y<rt.map_h; y++){
         for(int x=0; x<rt.map_w; x++){
             size_t idx = (size_t)y*(size_t)rt.map_w + (size_t)x;
-            uint16_t tags = rt.world.tags ? rt.world.tags[idx] : 0;
-            uint8_t  hgt  = rt.world.height ? rt.world.height[idx] : 0;
-            uint8_t  sea  = rt.world.sea_level;
+            uint16_t tags = f->tags[idx];
+            uint8_t  hgt  = rt.sim.world.height ? rt.sim.world.height[idx] : 0;
+            uint8_t  sea  = rt.sim.world.sea_level;
 
             unsigned char r,g,b;
             height_ramp_color(tags, hgt, sea, g_show_height, &r, &g, &b);
@@ -409,69 +461,144 @@ static void rt_render(void)
             fill_rect(off_x + x*tile_px, off_y + y*tile_px, tile_px, tile_px, r, g, b);
         }
     }
-/* Settlements */
-    for(int i=0; i<rt.sett_n; i++){
-        int sx = off_x + rt.setts[i].pos.x * tile_px;
-        int sy = off_y + rt.setts[i].pos.y * tile_px;
+
+    /* Settlements */
+    for(int i=0; i<rt.sim.sett_n; i++){
+        int sx = off_x + rt.sim.setts[i].pos.x * tile_px;
+        int sy = off_y + rt.sim.setts[i].pos.y * tile_px;
         fill_rect(sx-1, sy-1, tile_px+2, tile_px+2, 0, 0, 0);
         fill_rect(sx,   sy,   tile_px,   tile_px,   240, 240, 240);
     }
 
-    /* Agents */
-    for(int i=0; i<rt.agent_n; i++){
-        const BrzAgent* a = &rt.agents[i];
-        int ax = off_x + a->pos.x * tile_px + tile_px/2;
-        int ay = off_y + a->pos.y * tile_px + tile_px/2;
-        unsigned char r,g,b;
-        vocation_color(a->voc, &r, &g, &b);
-        for(int dy=-1; dy<=1; dy++)
-            for(int dx=-1; dx<=1; dx++)
-                set_px(ax+dx, ay+dy, r, g, b);
+    memcpy(terrainBuffer, outputBuffer, sizeof(terrainBuffer));
+}
+
+/* Simple HUD strip: day count as a bright bar that grows */
+static void rt_render_hud(const BrzFrame* f)
+{
+    int w = (int)((unsigned)f->day % (unsigned)FB_W);
+    if(w < 8) w = 8;
+    fill_rect(0, 0, w, 3, 255, 255, 255);
+    rc.hud_w = w;
+    rc.day = f->day;
+}
+
+/* bin the agents by tile in one pass, then paint the occupied tiles */
+static void rt_render_density(const BrzFrame* f, int tile_px, int off_x, int off_y)
+{
+    int n = 0;
+    for(int i=0; i<f->agent_n; i++){
+        BrzPos p = f->agent_pos[i];
+        if((unsigned)p.x >= (unsigned)rt.map_w || (unsigned)p.y >= (unsigned)rt.map_h) continue;
+        uint32_t t = (uint32_t)p.y * (uint32_t)rt.map_w + (uint32_t)p.x;
+        uint32_t v = f->agent_voc[i];
+        if(rc.bin_n[t]++ == 0){
+            rc.tiles[n++] = t;
+            rc.bin_voc[t] = v;
+            rc.bin_vote[t] = 1;
+        }else if(rc.bin_voc[t] == v){
+            rc.bin_vote[t]++;
+        }else if(--rc.bin_vote[t] == 0){
+            rc.bin_voc[t] = v;
+            rc.bin_vote[t] = 1;
+        }
     }
 
-    /* Simple HUD strip: day count as a bright bar that grows */
-    {
-        int w = (int)(rt.day % (unsigned)FB_W);
-        if(w < 8) w = 8;
-        fill_rect(0, 0, w, 3, 255, 255, 255);
+    for(int k=0; k<n; k++){
+        uint32_t t = rc.tiles[k];
+        /* 1 agent is dim, 16 or more full brightness */
+        uint32_t c = rc.bin_n[t];
+        unsigned scale = c >= 16u ? 256u : 96u + c * 10u;
+        const unsigned char* rgb = rt.voc_rgb[rc.bin_voc[t]];
+        fill_rect(off_x + (int)(t % (uint32_t)rt.map_w) * tile_px, off_y + (int)(t / (uint32_t)rt.map_w) * tile_px,
+                  tile_px, tile_px,
+                  (unsigned char)((rgb[0] * scale) >> 8), (unsigned char)((rgb[1] * scale) >> 8),
+                  (unsigned char)((rgb[2] * scale) >> 8));
+        rc.bin_n[t] = 0;
     }
+    rc.prev_n = n;
 }
 
-/* ---------------- exported API (Swift calls these) ---------------- */
-
-void brz_shared_cycle(unsigned long ticks)
+static void rt_render(const BrzFrame* f)
 {
-    /* ticks is milliseconds from Swift */
-    const unsigned long STEP_MS = 250;   /* 4 sim-days per second */
-    const unsigned long MAX_CATCHUP_STEPS = 8;
-
-    if(!rt.ready){
-        rt_render();
+    if(!rt.ready || !f || f->day < 0){
+        rc.valid = 0;
+        rt_clear_frame(25, 25, 25);
         return;
     }
 
-    if(rt.last_ms == 0){
-        rt.last_ms = ticks;
+    /* Map-to-screen transform */
+    int tile_px = 1;
+    if(rt.map_w > 0 && rt.map_h > 0){
+        int tx = FB_W / rt.map_w;
+        int ty = FB_H / rt.map_h;
+        tile_px = (tx < ty) ? tx : ty;
+        if(tile_px < 1) tile_px = 1;
+    }
+
+    int map_px_w = rt.map_w * tile_px;
+    int map_px_h = rt.map_h * tile_px;
+    int off_x = (FB_W - map_px_w) / 2;
+    int off_y = (FB_H - map_px_h) / 2;
+
+    if(!rc.valid || rc.show_height != g_show_height || rc.tags_gen != f->tags_gen){
+        rt_render_terrain(f, tile_px, off_x, off_y);
+        rc.valid = 1;
+        rc.show_height = g_show_height;
+        rc.tags_gen = f->tags_gen;
+        rc.prev_n = 0;
+        rc.hud_w = 0;
+    }else if(rc.day == f->day){
+        return; /* outputBuffer already shows this frame */
+    }else{
+        /* erase the last frame's sprites */
+        for(int i=0; i<rc.prev_n; i++){
+            if(rc.lod){
+                int t = (int)rc.tiles[i];
+                restore_rect(off_x + (t % rt.map_w) * tile_px, off_y + (t / rt.map_w) * tile_px, tile_px, tile_px);
+            }else{
+                BrzPos p = rc.prev_pos[i];
+                restore_rect(off_x + p.x * tile_px + tile_px/2 - 1, off_y + p.y * tile_px + tile_px/2 - 1, 3, 3);
+            }
+        }
+        restore_rect(0, 0, rc.hud_w, 3);
+        rc.prev_n = 0;
     }
 
-    unsigned long dt = (ticks >= rt.last_ms) ? (ticks - rt.last_ms) : 0;
-    rt.last_ms = ticks;
-    rt.accum_ms += dt;
-
-    unsigned long steps = 0;
-    while(rt.accum_ms >= STEP_MS && steps < MAX_CATCHUP_STEPS){
-        /* One sim "day" */
-        brz_world_step_regen(&rt.world, rt.res_n);
-        brz_settlements_begin_day(rt.setts, rt.sett_n);
-        for(int i=0;i<rt.agent_n;i++)
-            brz_agent_step(&rt.agents[i], &rt.cfg, &rt.world, rt.setts, rt.sett_n, &rt.rng);
-
-        rt.day++;
-        rt.accum_ms -= STEP_MS;
-        steps++;
+    if(rc.lod){
+        rt_render_density(f, tile_px, off_x, off_y);
+        rt_render_hud(f);
+        return;
     }
 
-    rt_render();
+    /* Agents */
+    for(int i=0; i<f->agent_n; i++){
+        BrzPos p = f->agent_pos[i];
+        int ax = off_x + p.x * tile_px + tile_px/2;
+        int ay = off_y + p.y * tile_px + tile_px/2;
+        const unsigned char* c = rt.voc_rgb[f->agent_voc[i]];
+        unsigned char r = c[0], g = c[1], b = c[2];
+        for(int dy=-1; dy<=1; dy++)
+            for(int dx=-1; dx<=1; dx++)
+                set_px(ax+dx, ay+dy, r, g, b);
+    }
+    if(f->agent_n <= rc.prev_cap){
+        memcpy(rc.prev_pos, f->agent_pos, (size_t)f->agent_n * sizeof(BrzPos));
+        rc.prev_n = f->agent_n;
+    }else{
+        rc.valid = 0; /* no room to remember them: redraw in full next time */
+    }
+
+    rt_render_hud(f);
+}
+
+/* ---------------- exported API (Swift calls these) ---------------- */
+
+void brz_shared_cycle(unsigned long ticks)
+{
+    /* the sim thread sets the pace; a tick only draws its latest day */
+    (void)ticks;
+    rt_render(rt.ready ? brz_frames_latest(&rt.frames) : NULL);
 }
 
 void brz_shared_init(unsigned long random)
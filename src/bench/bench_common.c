@@ -0,0 +1,196 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+#endif
+#include "bench_common.h"
+#include "brz_util.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+BenchOptions g_bench = { NULL, "..", 1 };
+
+typedef struct {
+    char* name;
+    const char* unit;
+    double items;
+    int n;
+    double min, median, p99, mean;
+} BenchResult;
+
+static BenchResult* g_results;
+static int g_result_n;
+static int g_result_cap;
+
+double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+bool bench_begin(BenchCase* c, const char* name, int samples, double items, const char* unit)
+{
+    memset(c, 0, sizeof(*c));
+    if(g_bench.filter && !strstr(name, g_bench.filter)) return false;
+    c->name = name;
+    c->unit = unit;
+    c->items = items;
+    c->n = samples / (g_bench.scale_div > 0 ? g_bench.scale_div : 1);
+    if(c->n < 3) c->n = 3;
+    c->samples = (double*)malloc((size_t)c->n * sizeof(double));
+    if(!c->samples){
+        fprintf(stderr, "Error: OOM in %s\n", name);
+        return false;
+    }
+    fprintf(stderr, "%-28s ", name);
+    fflush(stderr);
+    return true;
+}
+
+bool bench_next(const BenchCase* c)
+{
+    return c->done < c->n;
+}
+
+void bench_sample(BenchCase* c, double seconds)
+{
+    if(c->done < c->n) c->samples[c->done++] = seconds;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void bench_end(BenchCase* c)
+{
+    int n = c->done;
+    if(n == 0){ free(c->samples); fprintf(stderr, "no samples\n"); return; }
+    qsort(c->samples, (size_t)n, sizeof(double), cmp_double);
+
+    BenchResult r;
+    memset(&r, 0, sizeof(r));
+    r.unit = c->unit;
+    r.items = c->items;
+    r.n = n;
+    r.min = c->samples[0];
+    r.median = (n & 1) ? c->samples[n/2] : 0.5 * (c->samples[n/2 - 1] + c->samples[n/2]);
+    int rank = (int)ceil(0.99 * (double)n); /* nearest rank */
+    r.p99 = c->samples[rank - 1];
+    double sum = 0;
+    for(int i=0;i<n;i++) sum += c->samples[i];
+    r.mean = sum / n;
+    free(c->samples);
+    c->samples = NULL;
+
+    fprintf(stderr, "median %10.3f ms  min %10.3f ms  p99 %10.3f ms\n",
+            r.median * 1e3, r.min * 1e3, r.p99 * 1e3);
+
+    if(g_result_n == g_result_cap){
+        int cap = g_result_cap ? g_result_cap * 2 : 16;
+        BenchResult* grown = (BenchResult*)realloc(g_results, (size_t)cap * sizeof(BenchResult));
+        if(!grown){ fprintf(stderr, "Error: OOM keeping %s\n", c->name); return; }
+        g_results = grown;
+        g_result_cap = cap;
+    }
+    r.name = brz_strdup(c->name);
+    if(!r.name){ fprintf(stderr, "Error: OOM keeping %s\n", c->name); return; }
+    g_results[g_result_n++] = r;
+}
+
+bool bench_write_json(FILE* f)
+{
+#ifdef BRZ_RES_FLOAT
+    const char* res = "float";
+#else
+    const char* res = "double";
+#endif
+    fprintf(f, "{\n  \"suite\": \"bronzesim\",\n  \"schema\": 1,\n");
+    fprintf(f, "  \"build\": { \"res_type\": \"%s\", \"quick\": %s },\n", res,
+            g_bench.scale_div > 1 ? "true" : "false");
+    fprintf(f, "  \"results\": [");
+    for(int i=0;i<g_result_n;i++){
+        const BenchResult* r = &g_results[i];
+        fprintf(f, "%s\n    { \"name\": \"%s\", \"samples\": %d, \"seconds\": { \"min\": %.9f, \"median\": %.9f, "
+                   "\"p99\": %.9f, \"mean\": %.9f }",
+                i ? "," : "", r->name, r->n, r->min, r->median, r->p99, r->mean);
+        if(r->unit && r->items > 0)
+            fprintf(f, ", \"items\": %.0f, \"item\": \"%s\", \"items_per_s\": %.1f",
+                    r->items, r->unit, r->median > 0 ? r->items / r->median : 0.0);
+        fprintf(f, " }");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return !ferror(f);
+}
+
+void bench_free_results(void)
+{
+    for(int i=0;i<g_result_n;i++) free(g_results[i].name);
+    free(g_results);
+    g_results = NULL;
+    g_result_n = g_result_cap = 0;
+}
+
+#if !defined(_WIN32)
+static int g_saved_stderr = -1;
+
+void bench_mute_stderr(void)
+{
+    if(g_saved_stderr >= 0) return;
+    fflush(stderr);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if(null_fd < 0) return;
+    g_saved_stderr = dup(2);
+    if(g_saved_stderr >= 0) dup2(null_fd, 2);
+    close(null_fd);
+}
+
+void bench_unmute_stderr(void)
+{
+    if(g_saved_stderr < 0) return;
+    fflush(stderr);
+    dup2(g_saved_stderr, 2);
+    close(g_saved_stderr);
+    g_saved_stderr = -1;
+}
+#else
+void bench_mute_stderr(void){}
+void bench_unmute_stderr(void){}
+#endif
+
+const char* bench_data_path(char* buf, size_t n, const char* name)
+{
+    snprintf(buf, n, "%s/%s", g_bench.data_dir, name);
+    return buf;
+}
+
+char* bench_temp_copy(const char* src)
+{
+    size_t len = 0;
+    char* text = brz_read_entire_file(src, &len);
+    if(!text) return NULL;
+    const char* tmpdir = getenv("TMPDIR");
+    if(!tmpdir) tmpdir = "/tmp";
+    char buf[512];
+    for(int attempt=0; attempt<50; attempt++){
+        snprintf(buf, sizeof(buf), "%s/brzbench_%u_%d.bronze", tmpdir, (unsigned)(uintptr_t)&len, attempt);
+        FILE* f = fopen(buf, "rb");
+        if(f){ fclose(f); continue; }
+        f = fopen(buf, "wb");
+        if(!f) continue;
+        bool ok = fwrite(text, 1, len, f) == len;
+        ok = (fclose(f) == 0) && ok;
+        free(text);
+        if(!ok){ remove(buf); return NULL; }
+        return brz_strdup(buf);
+    }
+    free(text);
+    return NULL;
+}
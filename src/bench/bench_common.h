@@ -0,0 +1,69 @@
+#ifndef BRZ_BENCH_COMMON_H
+#define BRZ_BENCH_COMMON_H
+
+/*
+ * bench_common.h/.c - timing harness for the benchmark suite
+ *
+ * A case collects one wall-clock sample per repetition and reports the
+ * min, median, p99 and mean over them; the results of all cases are
+ * written out together as JSON (bench_write_json).
+ *
+ * Usage:
+ *   BenchCase c;
+ *   if(bench_begin(&c, "regen/80x40", 50, 80*40, "tiles")){
+ *       while(bench_next(&c)){
+ *           ... untimed setup ...
+ *           double t0 = bench_now();
+ *           ... measured work ...
+ *           bench_sample(&c, bench_now() - t0);
+ *       }
+ *       bench_end(&c);
+ *   }
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct {
+    const char* name;
+    const char* unit;  /* what 'items' counts, e.g. "agents" */
+    double items;      /* work per sample, for the throughput column */
+    int n;             /* samples wanted */
+    int done;
+    double* samples;   /* seconds */
+} BenchCase;
+
+/* options shared by every case, set from the command line */
+typedef struct {
+    const char* filter;   /* only cases whose name contains this */
+    const char* data_dir; /* where example*.bronze live */
+    int scale_div;        /* divides sample counts (--quick) */
+} BenchOptions;
+
+extern BenchOptions g_bench;
+
+/* monotonic seconds */
+double bench_now(void);
+
+/* false when the case is filtered out (or on OOM, with a message) */
+bool bench_begin(BenchCase* c, const char* name, int samples, double items, const char* unit);
+bool bench_next(const BenchCase* c);
+void bench_sample(BenchCase* c, double seconds);
+/* compute the statistics and keep them for bench_write_json */
+void bench_end(BenchCase* c);
+
+bool bench_write_json(FILE* f);
+void bench_free_results(void);
+
+/* Send stderr to /dev/null until bench_unmute_stderr, so that parse
+   warnings neither flood the terminal nor cost terminal time. */
+void bench_mute_stderr(void);
+void bench_unmute_stderr(void);
+
+/* "data_dir/name" in buf */
+const char* bench_data_path(char* buf, size_t n, const char* name);
+/* Copy of src at a fresh temp path, so that no .bronzec image sits next
+   to it; malloc'd path or NULL. */
+char* bench_temp_copy(const char* src);
+
+#endif /* BRZ_BENCH_COMMON_H */
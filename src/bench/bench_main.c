@@ -0,0 +1,282 @@
+#include "bench_common.h"
+#include "brz_cfgimage.h"
+#include "brz_kinds.h"
+#include "brz_land.h"
+#include "brz_parser.h"
+#include "brz_settlement.h"
+#include "brz_agent.h"
+#include "brz_sim.h"
+#include "brz_snapshot.h"
+#include "brz_util.h"
+#include "brz_world.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Scaling scenarios. Every case uses fixed seeds, so two runs of the same
+   build do the same work and only the timings differ. */
+
+static bool load_example(const char* name, ParsedConfig* cfg)
+{
+    char path[1024];
+    brz_cfg_init(cfg);
+    bench_mute_stderr();
+    bool ok = brz_parse_file(bench_data_path(path, sizeof(path), name), cfg);
+    bench_unmute_stderr();
+    if(ok) return true;
+    fprintf(stderr, "Error: cannot load %s (see --data)\n", path);
+    brz_cfg_free(cfg);
+    return false;
+}
+
+/* ---------------- parsing ---------------- */
+
+static void bench_parse(const char* case_name, const char* file, int samples)
+{
+    char path[1024];
+    BenchCase c;
+    if(!bench_begin(&c, case_name, samples, 0, NULL)) return;
+    /* parse a copy, so that a .bronzec image next to the original is not taken */
+    char* copy = bench_temp_copy(bench_data_path(path, sizeof(path), file));
+    if(!copy){ fprintf(stderr, "cannot read %s\n", path); free(c.samples); return; }
+    bench_mute_stderr();
+    while(bench_next(&c)){
+        ParsedConfig cfg;
+        double t0 = bench_now();
+        brz_cfg_init(&cfg);
+        bool ok = brz_parse_file(copy, &cfg);
+        brz_cfg_free(&cfg);
+        bench_sample(&c, bench_now() - t0);
+        if(!ok) break;
+    }
+    bench_unmute_stderr();
+    bench_end(&c);
+    remove(copy);
+    free(copy);
+}
+
+static void bench_image_load(const char* case_name, const char* file, int samples)
+{
+    char path[1024], img[1100];
+    BenchCase c;
+    if(!bench_begin(&c, case_name, samples, 0, NULL)) return;
+    char* copy = bench_temp_copy(bench_data_path(path, sizeof(path), file));
+    size_t n = 0;
+    char* text = copy ? brz_read_entire_file(copy, &n) : NULL;
+    bench_mute_stderr(); /* the image replays the link warnings */
+    bool ok = text && brz_parse_image_path(copy, img, sizeof(img)) && brz_compile_file(copy, img);
+    if(ok){
+        uint64_t h = brz_cfg_source_hash(text, n);
+        while(bench_next(&c)){
+            ParsedConfig cfg;
+            char err[128];
+            double t0 = bench_now();
+            brz_cfg_init(&cfg);
+            ok = brz_cfg_image_load(&cfg, img, h, n, err, sizeof(err));
+            brz_cfg_free(&cfg);
+            bench_sample(&c, bench_now() - t0);
+            if(!ok){ bench_unmute_stderr(); fprintf(stderr, "%s\n", err); break; }
+        }
+        remove(img);
+    }
+    bench_unmute_stderr();
+    bench_end(&c);
+    if(copy) remove(copy);
+    free(text);
+    free(copy);
+}
+
+/* ---------------- land ---------------- */
+
+static void bench_land(int samples)
+{
+    BenchCase c;
+    if(!bench_begin(&c, "land/generate", samples, (double)BRZ_LAND_DIM * BRZ_LAND_DIM, "tiles")) return;
+    BrzLand* land = (BrzLand*)malloc(sizeof(BrzLand));
+    while(land && bench_next(&c)){
+        double t0 = bench_now();
+        brz_land_seed(land, 1337, 7331);
+        brz_land_generate(land);
+        bench_sample(&c, bench_now() - t0);
+    }
+    bench_end(&c);
+    free(land);
+}
+
+/* ---------------- regeneration ----------------
+   Before each sample 2% of the tiles lose some of every resource, roughly
+   what a busy day of gathering does, so the sparse sweep has work left. */
+
+static void bench_regen(const ParsedConfig* cfg, int w, int h, int samples)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "regen/%dx%d", w, h);
+    BenchCase c;
+    if(!bench_begin(&c, name, samples, (double)w * h, "tiles")) return;
+    const size_t res_n = kind_table_count(&cfg->resource_kinds);
+    BrzWorld world;
+    if(brz_world_init_seed(&world, cfg, 1337, w, h, res_n) != 0){
+        fprintf(stderr, "world init failed\n");
+        free(c.samples);
+        return;
+    }
+    BrzRng rng;
+    brz_rng_seed(&rng, 42);
+    const int hits = (w * h) / 50;
+    while(bench_next(&c)){
+        for(int i=0;i<hits;i++){
+            BrzPos p = { brz_rng_range(&rng, 0, w - 1), brz_rng_range(&rng, 0, h - 1) };
+            for(size_t r=0;r<res_n;r++) brz_world_take(&world, p, res_n, (int)r, 0.5);
+        }
+        double t0 = bench_now();
+        brz_world_step_regen(&world, res_n);
+        bench_sample(&c, bench_now() - t0);
+    }
+    bench_end(&c);
+    brz_world_free(&world);
+}
+
+/* ---------------- agents ---------------- */
+
+/* example.bronze with agent_n agents, a few days in */
+static bool warm_sim(BrzSim* sim, ParsedConfig* cfg, int agent_n)
+{
+    cfg->agent_count = agent_n;
+    if(brz_sim_init(sim, cfg) != 0) return false;
+    if(brz_sim_run_days(sim, 3, 0, NULL, NULL) != 0){ brz_sim_free(sim); return false; }
+    return true;
+}
+
+static void bench_agents(ParsedConfig* cfg, int agent_n, const char* label, int samples)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "agent_step/%s", label);
+    BenchCase c;
+    if(!bench_begin(&c, name, samples, (double)agent_n, "agents")) return;
+    BrzSim sim;
+    if(!warm_sim(&sim, cfg, agent_n)){ fprintf(stderr, "sim init failed\n"); free(c.samples); return; }
+    const size_t res_n = kind_table_count(&cfg->resource_kinds);
+    while(bench_next(&c)){
+        brz_world_step_regen(&sim.world, res_n);
+        brz_settlements_begin_day(sim.setts, sim.sett_n);
+        double t0 = bench_now();
+        for(int i=0;i<sim.agents.n;i++)
+            brz_agent_step(&sim.agents, i, cfg, &sim.world, sim.setts, sim.sett_n, &sim.rng);
+        brz_trades_clear(&sim.agents, sim.setts, sim.sett_n);
+        bench_sample(&c, bench_now() - t0);
+        sim.day++;
+    }
+    bench_end(&c);
+    brz_sim_free(&sim);
+}
+
+/* ---------------- snapshots ----------------
+   Capture plus serialization into a temp file, as the writer does it. */
+
+static void bench_snapshot(ParsedConfig* cfg, bool binary, int samples)
+{
+    const int agent_n = 10000;
+    BenchCase c;
+    if(!bench_begin(&c, binary ? "snapshot/bin_10k" : "snapshot/json_10k", samples, agent_n, "agents")) return;
+    BrzSim sim;
+    if(!warm_sim(&sim, cfg, agent_n)){ fprintf(stderr, "sim init failed\n"); free(c.samples); return; }
+    while(bench_next(&c)){
+        FILE* f = tmpfile();
+        if(!f){ fprintf(stderr, "cannot create a temp file\n"); break; }
+        BrzSnapshot snap;
+        double t0 = bench_now();
+        bool ok = brz_snapshot_capture(&snap, cfg, &sim.world, sim.setts, sim.sett_n, &sim.agents, sim.day);
+        ok = ok && (binary ? brz_snapshot_write_bin(&snap, f) : brz_snapshot_write_json(&snap, f));
+        ok = (fflush(f) == 0) && ok;
+        bench_sample(&c, bench_now() - t0);
+        brz_snapshot_free(&snap);
+        fclose(f);
+        if(!ok){ fprintf(stderr, "snapshot failed\n"); break; }
+    }
+    bench_end(&c);
+    brz_sim_free(&sim);
+}
+
+/* ---------------- driver ---------------- */
+
+static void usage(const char* exe)
+{
+    printf("Usage: %s [--quick] [--filter TEXT] [--data DIR] [-o FILE]\n", exe);
+    printf("  --quick        a tenth of the samples, for smoke runs\n");
+    printf("  --filter TEXT  only cases whose name contains TEXT (e.g. regen/, agent_step/10k)\n");
+    printf("  --data DIR     directory holding example.bronze and example_large.bronze (default ..)\n");
+    printf("  -o FILE        write the JSON results to FILE instead of stdout\n");
+    printf("Progress and a summary per case go to stderr.\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* out_path = NULL;
+    for(int i=1;i<argc;i++)
+    {
+        if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if(!strcmp(argv[i], "--quick"))
+        {
+            g_bench.scale_div = 10;
+        }
+        else if(!strcmp(argv[i], "--filter") && i+1 < argc)
+        {
+            g_bench.filter = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--data") && i+1 < argc)
+        {
+            g_bench.data_dir = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-o") && i+1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Error: unknown or incomplete option '%s'\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* fixed land, not whatever a cache directory holds */
+    brz_land_set_cache_dir(NULL);
+
+    ParsedConfig cfg;
+    if(!load_example("example.bronze", &cfg)) return 1;
+
+    bench_parse("parse/example", "example.bronze", 200);
+    bench_parse("parse/example_large", "example_large.bronze", 100);
+    bench_image_load("image_load/example_large", "example_large.bronze", 100);
+    bench_land(20);
+    bench_regen(&cfg, 80, 40, 500);
+    bench_regen(&cfg, 160, 80, 300);
+    bench_regen(&cfg, 512, 512, 100);
+    bench_agents(&cfg, 1000, "1k", 300);
+    bench_agents(&cfg, 10000, "10k", 100);
+    bench_agents(&cfg, 100000, "100k", 30);
+    bench_snapshot(&cfg, false, 30);
+    bench_snapshot(&cfg, true, 30);
+    brz_cfg_free(&cfg);
+
+    FILE* f = out_path ? fopen(out_path, "w") : stdout;
+    if(!f)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", out_path);
+        bench_free_results();
+        return 1;
+    }
+    bool ok = bench_write_json(f);
+    if(out_path) ok = (fclose(f) == 0) && ok;
+    bench_free_results();
+    if(!ok)
+    {
+        fprintf(stderr, "Error: cannot write results\n");
+        return 1;
+    }
+    if(out_path) fprintf(stderr, "Results written to %s\n", out_path);
+    return 0;
+}
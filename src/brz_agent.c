@@ -1,328 +1,309 @@
 
 #include "brz_agent.h"
 #include "brz_kinds.h"
+#include "brz_profile.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
-#include <ctype.h>
 
-/* ---- Small expression evaluator and DSL executor ported from old brz_sim.c ---- */
+/* Working copy of one agent while it steps. Scalars are loaded from the
+   store and written back afterwards; inventories point into the slabs. */
+typedef struct {
+    uint32_t id;
+    const VocationDef* voc;
+    BrzPos pos;
+    BrzPos target;
+    int has_target;
+    int home_settlement;
+    double hunger;
+    double fatigue;
+    double* res_inv;
+    double* item_inv;
+    size_t res_n;
+    size_t item_n;
+    double* tally;  /* where the totals deltas go: the store's pend, or the log's tally */
+    uint64_t* rule_mask; /* pick_rule scratch: the store's, or the log's */
+} BrzAgent;
+
+static void agent_load(const BrzAgentStore* s, int i, BrzAgent* a){
+    a->id = (uint32_t)i;
+    a->voc = brz_agents_voc(s, i);
+    a->pos = s->pos[i];
+    a->target = s->target[i];
+    a->has_target = s->has_target[i];
+    a->home_settlement = s->home[i];
+    a->hunger = s->hunger[i];
+    a->fatigue = s->fatigue[i];
+    a->res_inv = brz_agents_res(s, i);
+    a->item_inv = brz_agents_item(s, i);
+    a->res_n = s->res_n;
+    a->item_n = s->item_n;
+    a->tally = s->pend;
+    a->rule_mask = s->rule_mask;
+}
 
-static double clamp01(double v){ if(v<0) return 0; if(v>1) return 1; return v; }
+/* totals slots: hunger, fatigue, resources, items */
+#define TOT_HUNGER 0
+#define TOT_FATIGUE 1
+#define TOT_RES(rid) (2 + (size_t)(rid))
+#define TOT_ITEM(a, iid) (2 + (a)->res_n + (size_t)(iid))
 
-static void ex_skip(const char** s){ while(**s && isspace((unsigned char)**s)) (*s)++; }
-static int ex_peek_word(const char* s, const char* w){
-    ex_skip(&s);
-    size_t n=strlen(w);
-    return strncmp(s,w,n)==0 && (s[n]==0 || isspace((unsigned char)s[n]) || s[n]==')' || s[n]=='(');
-}
-static int ex_consume_word(const char** s, const char* w){
-    ex_skip(s);
-    size_t n=strlen(w);
-    if(strncmp(*s,w,n)==0){ *s += n; return 1; }
-    return 0;
-}
-static int ex_read_ident(const char** s, char* out, int out_n){
-    ex_skip(s);
-    int i=0;
-    if(!(isalpha((unsigned char)**s) || **s=='_')) return 0;
-    while(**s && (isalnum((unsigned char)**s) || **s=='_' || **s=='.')){
-        if(i<out_n-1) out[i++] = **s;
-        (*s)++;
-    }
-    out[i]=0;
-    return 1;
-}
-static int ex_read_num(const char** s, double* out){
-    ex_skip(s);
-    char* end=NULL;
-    double v = strtod(*s,&end);
-    if(end==*s) return 0;
-    *out=v; *s=end; return 1;
-}
-static int ex_read_op(const char** s, char* op2){
-    ex_skip(s);
-    if(strncmp(*s,">=",2)==0 || strncmp(*s,"<=",2)==0 || strncmp(*s,"==",2)==0 || strncmp(*s,"!=",2)==0){
-        op2[0]=(*s)[0]; op2[1]=(*s)[1]; op2[2]=0; *s += 2; return 1;
-    }
-    if(**s=='>'||**s=='<'){
-        op2[0]=**s; op2[1]=0; (*s)++; return 1;
-    }
-    return 0;
+static void agent_tally(const BrzAgent* a, size_t slot, double d){
+    a->tally[slot] += d;
 }
 
-static double agent_var(const BrzAgent* a, const ParsedConfig* cfg, const char* name){
-    (void)cfg;
-    if(brz_streq(name,"hunger")) return a->hunger;
-    if(brz_streq(name,"fatigue")) return a->fatigue;
-    return 0.0;
+static void agent_save(BrzAgentStore* s, int i, const BrzAgent* a){
+    if(a->hunger != s->hunger[i]) agent_tally(a, TOT_HUNGER, a->hunger - s->hunger[i]);
+    if(a->fatigue != s->fatigue[i]) agent_tally(a, TOT_FATIGUE, a->fatigue - s->fatigue[i]);
+    s->pos[i] = a->pos;
+    s->target[i] = a->target;
+    s->has_target[i] = (uint8_t)(a->has_target != 0);
+    s->home[i] = a->home_settlement;
+    s->hunger[i] = a->hunger;
+    s->fatigue[i] = a->fatigue;
 }
 
-static int eval_cmp_or_prob(const char** s, const BrzAgent* a, const ParsedConfig* cfg, BrzRng* rng){
-    /* Supports:
-       - hunger < 0.5
-       - fatigue >= 0.2
-       - chance(0.3)
-    */
-    ex_skip(s);
-    if(ex_consume_word(s,"chance")){
-        ex_skip(s);
-        if(**s=='('){ (*s)++; }
-        double p=0;
-        if(!ex_read_num(s,&p)) return 0;
-        ex_skip(s);
-        if(**s==')') (*s)++;
-        int roll = (int)(brz_rng_u32(rng)%10000u);
-        int thresh = (int)(clamp01(p)*10000.0);
-        return roll < thresh;
-    }
+/* ---- DSL executor ported from old brz_sim.c ---- */
 
-    char ident[128];
-    if(!ex_read_ident(s,ident,sizeof(ident))) return 0;
-
-    double lhs = agent_var(a,cfg,ident);
-    char op2[3]={0};
-    if(!ex_read_op(s,op2)) return lhs!=0.0; /* truthy */
-    double rhs=0;
-    if(!ex_read_num(s,&rhs)) return 0;
-
-    if(strcmp(op2,">")==0) return lhs>rhs;
-    if(strcmp(op2,"<")==0) return lhs<rhs;
-    if(strcmp(op2,">=")==0) return lhs>=rhs;
-    if(strcmp(op2,"<=")==0) return lhs<=rhs;
-    if(strcmp(op2,"==")==0) return lhs==rhs;
-    if(strcmp(op2,"!=")==0) return lhs!=rhs;
-    return 0;
-}
+static double clamp01(double v){ if(v<0) return 0; if(v>1) return 1; return v; }
 
-static int eval_atom(const char** s, const BrzAgent* a, const ParsedConfig* cfg, BrzRng* rng){
-    ex_skip(s);
-    if(**s=='('){ (*s)++; int v = eval_cmp_or_prob(s,a,cfg,rng); ex_skip(s); if(**s==')') (*s)++; return v; }
-    return eval_cmp_or_prob(s,a,cfg,rng);
-}
-static int eval_and(const char** s, const BrzAgent* a, const ParsedConfig* cfg, BrzRng* rng){
-    int v = eval_atom(s,a,cfg,rng);
-    for(;;){
-        if(ex_peek_word(*s,"and")){ ex_consume_word(s,"and"); v = v && eval_atom(s,a,cfg,rng); }
-        else break;
-    }
-    return v;
-}
-static int eval_or(const char** s, const BrzAgent* a, const ParsedConfig* cfg, BrzRng* rng){
-    int v = eval_and(s,a,cfg,rng);
-    for(;;){
-        if(ex_peek_word(*s,"or")){ ex_consume_word(s,"or"); v = v || eval_and(s,a,cfg,rng); }
-        else break;
-    }
-    return v;
-}
-static int eval_when_expr(const char* expr, const BrzAgent* a, const ParsedConfig* cfg, BrzRng* rng){
-    if(!expr || !expr[0]) return 1;
-    const char* s = expr;
-    int v = eval_or(&s,a,cfg,rng);
-    return v ? 1 : 0;
+/* rule/stmt 'when' programs are compiled by brz_cfg_link; see brz_expr.h */
+static int eval_when(const BrzExpr* prog, const BrzAgent* a, BrzRng* rng){
+    double vars[BRZ_EXPR_VAR_COUNT];
+    vars[BRZ_EXPR_VAR_HUNGER]  = a->hunger;
+    vars[BRZ_EXPR_VAR_FATIGUE] = a->fatigue;
+    BRZ_PROF_COUNT(BRZ_PROF_EXPR_EVALS, 1);
+    return brz_expr_eval(prog, vars, rng);
 }
 
 /* ---- Inventory helpers ---- */
 
-static int res_id(const ParsedConfig* cfg, const char* name){
-    return kind_table_find(&cfg->resource_kinds, name);
+/* every inventory write goes through these, so the totals follow */
+static void agent_set_res(BrzAgent* a, int rid, double v){
+    if(v != a->res_inv[rid]) agent_tally(a, TOT_RES(rid), v - a->res_inv[rid]);
+    a->res_inv[rid] = v;
 }
-static int item_id(const ParsedConfig* cfg, const char* name){
-    return kind_table_find(&cfg->item_kinds, name);
+static void agent_set_item(BrzAgent* a, int iid, double v){
+    if(v != a->item_inv[iid]) agent_tally(a, TOT_ITEM(a, iid), v - a->item_inv[iid]);
+    a->item_inv[iid] = v;
 }
-
 static void agent_add_res(BrzAgent* a, int rid, double amt){
     if(rid<0 || (size_t)rid>=a->res_n) return;
-    a->res_inv[rid] += amt;
-    if(a->res_inv[rid] < 0) a->res_inv[rid] = 0;
+    double v = a->res_inv[rid] + amt;
+    agent_set_res(a, rid, v < 0 ? 0 : v);
 }
 static void agent_add_item(BrzAgent* a, int iid, double amt){
     if(iid<0 || (size_t)iid>=a->item_n) return;
-    a->item_inv[iid] += amt;
-    if(a->item_inv[iid] < 0) a->item_inv[iid] = 0;
-}
-
-/* ---- Recipes (hardcoded, uses available kinds) ---- */
-static int craft_with_recipes(BrzAgent* a, const ParsedConfig* cfg, const char* item_name, double n){
-    int out = item_id(cfg, item_name);
-    if(out < 0) return 0;
-
-    /* bronze: copper + tin + charcoal (per unit) */
-    if(brz_streq(item_name,"bronze")){
-        int cu = res_id(cfg,"copper");
-        int sn = res_id(cfg,"tin");
-        int ch = res_id(cfg,"charcoal");
-        if(cu>=0 && sn>=0 && ch>=0){
-            double maxn = n;
-            if(a->res_inv[cu] < maxn) maxn = a->res_inv[cu];
-            if(a->res_inv[sn] < maxn) maxn = a->res_inv[sn];
-            if(a->res_inv[ch] < maxn) maxn = a->res_inv[ch];
-            if(maxn <= 0) return 1; /* craft failed but recipe known */
-            a->res_inv[cu] -= maxn;
-            a->res_inv[sn] -= maxn;
-            a->res_inv[ch] -= maxn;
-            agent_add_item(a, out, maxn);
-            return 1;
-        }
-        return 0;
+    double v = a->item_inv[iid] + amt;
+    agent_set_item(a, iid, v < 0 ? 0 : v);
+}
+
+/* ---- Deferred effects ----
+   In deferred mode an agent never writes shared state while stepping:
+   world takes and settlement-side inventory changes are appended to a log
+   and applied by brz_intents_commit, in log order. */
+
+static void log_push(BrzIntentLog* log, const BrzIntent* in){
+    if(!brz_vec_push(&log->intents, in)) log->oom = true;
+}
+
+static void fx_take(BrzAgent* a, BrzWorld* world, int rid, double n, BrzIntentLog* log){
+    if(!log){
+        double taken = brz_world_take(world, a->pos, a->res_n, rid, n);
+        agent_add_res(a, rid, taken);
+        return;
     }
+    if(a->pos.x<0||a->pos.y<0||a->pos.x>=world->w||a->pos.y>=world->h) return;
+    BrzIntent in;
+    memset(&in, 0, sizeof(in));
+    in.agent = a->id;
+    in.kind = BRZ_INTENT_TAKE;
+    in.where = a->pos.y*world->w + a->pos.x;
+    in.id = rid;
+    in.amt = n;
+    log_push(log, &in);
+}
 
-    /* charcoal item: wood -> charcoal (resource) or item? We'll treat as resource if exists. */
-    if(brz_streq(item_name,"charcoal")){
-        int wood = res_id(cfg,"wood");
-        int charcoal_res = res_id(cfg,"charcoal");
-        if(wood>=0 && charcoal_res>=0){
-            double maxn = n;
-            if(a->res_inv[wood] < maxn) maxn = a->res_inv[wood];
-            if(maxn <= 0) return 1;
-            a->res_inv[wood] -= maxn;
-            agent_add_res(a, charcoal_res, maxn);
-            return 1;
-        }
-        /* fall through */
+/* settlement side of a trade: take the goods, pay out what stock allows */
+static void settle_trade(const BrzAgentStore* agents, BrzSettlement* s, const BrzTradeOrder* o){
+    BRZ_PROF_T0(t0);
+    double* res_inv = brz_agents_res(agents, (int)o->agent);
+    double* item_inv = brz_agents_item(agents, (int)o->agent);
+    if(o->give_is_item) s->item_inv[o->give] += o->give_amt;
+    else                s->res_inv[o->give]  += o->give_amt;
+    if(o->want_r>=0){
+        double pay = o->want_amt;
+        if(s->res_inv[o->want_r] < pay) pay = s->res_inv[o->want_r];
+        s->res_inv[o->want_r] -= pay;
+        const double v = res_inv[o->want_r] + pay;
+        agents->pend[TOT_RES(o->want_r)] += v - res_inv[o->want_r];
+        res_inv[o->want_r] = v;
+    }else if(o->want_i>=0){
+        double pay = o->want_amt;
+        if(s->item_inv[o->want_i] < pay) pay = s->item_inv[o->want_i];
+        s->item_inv[o->want_i] -= pay;
+        const double v = item_inv[o->want_i] + pay;
+        agents->pend[2 + agents->res_n + (size_t)o->want_i] += v - item_inv[o->want_i];
+        item_inv[o->want_i] = v;
     }
+    BRZ_PROF_COUNT(BRZ_PROF_TRADES, 1);
+    BRZ_PROF_T1(BRZ_PROF_TRADE, t0);
+}
 
-    /* pottery: clay -> pottery item */
-    if(brz_streq(item_name,"pottery")){
-        int clay = res_id(cfg,"clay");
-        if(clay>=0){
-            double maxn = n;
-            if(a->res_inv[clay] < 2*maxn) maxn = a->res_inv[clay]/2;
-            if(maxn <= 0) return 1;
-            a->res_inv[clay] -= 2*maxn;
-            agent_add_item(a, out, maxn);
-            return 1;
-        }
-        return 0;
+/* Trades are queued at the settlement (serial step) or logged (deferred
+   step) and only settled by brz_trades_clear. */
+static void fx_trade(BrzAgent* a, BrzSettlement* setts, int si, int give_is_item, int give,
+                     int want_r, int want_i, double give_amt, double want_amt, BrzIntentLog* log){
+    if(!log){
+        BrzTradeOrder o;
+        memset(&o, 0, sizeof(o));
+        o.agent = a->id;
+        o.give_is_item = (uint8_t)give_is_item;
+        o.give = give;
+        o.want_r = want_r;
+        o.want_i = want_i;
+        o.give_amt = give_amt;
+        o.want_amt = want_amt;
+        brz_settlement_queue_trade(&setts[si], &o);
+        return;
     }
+    BrzIntent in;
+    memset(&in, 0, sizeof(in));
+    in.agent = a->id;
+    in.kind = BRZ_INTENT_TRADE;
+    in.where = si;
+    in.id = give;
+    in.give_is_item = (uint8_t)give_is_item;
+    in.want_r = want_r;
+    in.want_i = want_i;
+    in.amt = give_amt;
+    in.want_amt = want_amt;
+    log_push(log, &in);
+}
 
-    return 0;
+/* eat one unit of grain (else fish) from a settlement store; returns satiation */
+static double settle_eat(const ParsedConfig* cfg, BrzSettlement* s){
+    int grain = cfg->known.r_grain;
+    int fish  = cfg->known.r_fish;
+    if(grain>=0 && s->res_inv[grain] > 0){ s->res_inv[grain]-=1; return 0.2; }
+    if(fish>=0 && s->res_inv[fish] > 0){ s->res_inv[fish]-=1; return 0.2; }
+    return 0.0;
 }
 
-/* ---- Action execution against world/settlements ---- */
+static void fx_deliver(BrzAgent* a, BrzSettlement* setts, int si, int rid, double amt, BrzIntentLog* log){
+    if(!log){
+        setts[si].res_inv[rid] += amt;
+        return;
+    }
+    BrzIntent in;
+    memset(&in, 0, sizeof(in));
+    in.agent = a->id;
+    in.kind = BRZ_INTENT_DELIVER;
+    in.where = si;
+    in.id = rid;
+    in.amt = amt;
+    log_push(log, &in);
+}
 
-static uint16_t tag_for_move_target(const char* arg0){
-    if(!arg0) return BRZ_TAG_FOREST;
-    if(brz_streq(arg0,"coast")) return BRZ_TAG_COAST;
-    if(brz_streq(arg0,"field")) return BRZ_TAG_FIELD;
-    if(brz_streq(arg0,"forest")) return BRZ_TAG_FOREST;
-    if(brz_streq(arg0,"claypit")) return BRZ_TAG_CLAYPIT;
-    if(brz_streq(arg0,"mine_copper")) return BRZ_TAG_MINE_CU;
-    if(brz_streq(arg0,"mine_tin")) return BRZ_TAG_MINE_SN;
-    return BRZ_TAG_FOREST;
-}
-
-static uint16_t tag_for_resource(const char* resname){
-    if(!resname) return 0;
-    if(brz_streq(resname,"fish")) return BRZ_TAG_COAST;
-    if(brz_streq(resname,"grain")) return BRZ_TAG_FIELD;
-    if(brz_streq(resname,"wood")) return BRZ_TAG_FOREST;
-    if(brz_streq(resname,"clay")) return BRZ_TAG_CLAYPIT;
-    if(brz_streq(resname,"copper")) return BRZ_TAG_MINE_CU;
-    if(brz_streq(resname,"tin")) return BRZ_TAG_MINE_SN;
-    if(brz_streq(resname,"charcoal")) return BRZ_TAG_FOREST;
-    if(brz_streq(resname,"fire")) return BRZ_TAG_FIRE;
-    return 0;
+/* ---- Recipes (cfg->recipes, indexed by item id at link time) ---- */
+
+/* Craft up to n of item out with its recipe: as many as the scarcest input
+   allows. Returns 0 when the item has no recipe. Only the agent's own
+   inventory is touched, so this is safe in the parallel step. */
+static int craft_with_recipes(BrzAgent* a, const ParsedConfig* cfg, int out, double n){
+    const RecipeDef* r = brz_cfg_recipe(cfg, out);
+    if(!r) return 0;
+    const RecipeInput* in = brz_cfg_recipe_inputs(cfg, r);
+
+    double maxn = n;
+    for(uint32_t k=0;k<r->in_n;k++){
+        const double have = in[k].is_item ? a->item_inv[in[k].id] : a->res_inv[in[k].id];
+        const double q = have / in[k].ratio;
+        if(q < maxn) maxn = q;
+    }
+    if(maxn <= 0) return 1; /* craft failed but recipe known */
+
+    for(uint32_t k=0;k<r->in_n;k++){
+        if(in[k].is_item) agent_set_item(a, in[k].id, a->item_inv[in[k].id] - in[k].ratio*maxn);
+        else              agent_set_res(a, in[k].id, a->res_inv[in[k].id] - in[k].ratio*maxn);
+    }
+    if(r->out_is_item) agent_add_item(a, r->out, maxn);
+    else               agent_add_res(a, r->out, maxn);
+    return 1;
 }
 
+/* ---- Action execution against world/settlements ---- */
+
 static int agent_at_settlement(const BrzAgent* a, const BrzSettlement* s){
     return brz_dist_manhattan(a->pos, s->pos) <= 1;
 }
 
 static void exec_op(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world,
-                    BrzSettlement* setts, int sett_n, const OpDef* op, BrzRng* rng)
+                    BrzSettlement* setts, int sett_n, const OpDef* op, BrzRng* rng,
+                    BrzIntentLog* log)
 {
     (void)rng;
-    const char* opname = op->op ? op->op : "";
-    const char* arg0 = op->a0 ? op->a0 : "";
-    const char* arg1 = op->a1 ? op->a1 : "";
     double n = (op->has_n0 ? op->n0 : 1.0);
+    BRZ_PROF_T0(t0);
 
-    if(brz_streq(opname, "gather"))
+    switch(op->code)
+    {
+    case BRZ_OP_GATHER:
     {
-        int rid = res_id(cfg, arg0);
+        int rid = op->rid0;
         if(rid >= 0){
-            uint16_t need = tag_for_resource(arg0);
+            uint16_t need = op->tag;
             if(need){
                 if(!(brz_world_tags_at(world, a->pos) & need)){
                     /* set target toward nearest suitable tile */
                     a->target = brz_world_find_nearest_tag(world, a->pos, need, 32);
                     a->has_target = 1;
                 }else{
-                    double taken = brz_world_take(world, a->pos, a->res_n, rid, n);
-                    agent_add_res(a, rid, taken);
+                    fx_take(a, world, rid, n, log);
                 }
             }else{
-                double taken = brz_world_take(world, a->pos, a->res_n, rid, n);
-                agent_add_res(a, rid, taken);
+                fx_take(a, world, rid, n, log);
             }
         }
         a->fatigue += 0.04 + 0.005 * n;
         a->hunger  += 0.02;
+        break;
     }
-    else if(brz_streq(opname, "craft"))
-    {
+    case BRZ_OP_CRAFT:
         /* crafting mostly at settlement, but allow anywhere */
-        if(!craft_with_recipes(a, cfg, arg0, n)){
-            int iid = item_id(cfg, arg0);
-            if(iid >= 0) agent_add_item(a, iid, n);
+        if(!craft_with_recipes(a, cfg, op->iid0, n)){
+            if(op->iid0 >= 0) agent_add_item(a, op->iid0, n);
         }
         a->fatigue += 0.05 + 0.01 * n;
         a->hunger  += 0.02;
-    }
-    else if(brz_streq(opname, "trade"))
+        break;
+    case BRZ_OP_TRADE:
     {
         /* trade give(arg0) for want(arg1) through settlement market */
-        int si = brz_find_nearest_settlement(setts, sett_n, a->pos);
+        int si = brz_world_nearest_settlement(world, setts, sett_n, a->pos);
         if(si >= 0 && agent_at_settlement(a, &setts[si])){
-            BrzSettlement* s = &setts[si];
-            int give_r = res_id(cfg,arg0);
-            int want_r = res_id(cfg,arg1);
-            int give_i = item_id(cfg,arg0);
-            int want_i = item_id(cfg,arg1);
+            const BrzSettlement* s = &setts[si];
+            int give_r = op->rid0;
+            int want_r = op->rid1;
+            int give_i = op->iid0;
+            int want_i = op->iid1;
 
             double give_amt = 1.0;
+            double pw = (want_r>=0) ? s->res_price[want_r]
+                                    : (want_i>=0 ? s->item_price[want_i] : 1.0);
             if(give_r>=0 && a->res_inv[give_r] >= give_amt){
-                double pg = brz_settlement_price_res(s, give_r);
-                double pw = (want_r>=0) ? brz_settlement_price_res(s, want_r)
-                                        : (want_i>=0 ? brz_settlement_price_item(s, want_i) : 1.0);
+                double pg = s->res_price[give_r];
                 double want_amt = (pw>0? (give_amt*pg/pw) : 0.0);
                 if(want_amt <= 0) want_amt = 0;
-                /* settlement accepts give */
-                a->res_inv[give_r] -= give_amt;
-                s->res_inv[give_r] += give_amt;
-                /* settlement pays out want if stock */
-                if(want_r>=0){
-                    double pay = want_amt;
-                    if(s->res_inv[want_r] < pay) pay = s->res_inv[want_r];
-                    s->res_inv[want_r] -= pay;
-                    a->res_inv[want_r] += pay;
-                }else if(want_i>=0){
-                    double pay = want_amt;
-                    if(s->item_inv[want_i] < pay) pay = s->item_inv[want_i];
-                    s->item_inv[want_i] -= pay;
-                    a->item_inv[want_i] += pay;
-                }
+                /* settlement accepts give and pays out want if stock */
+                agent_set_res(a, give_r, a->res_inv[give_r] - give_amt);
+                fx_trade(a, setts, si, 0, give_r, want_r, want_i, give_amt, want_amt, log);
             }else if(give_i>=0 && a->item_inv[give_i] >= give_amt){
-                double pg = brz_settlement_price_item(s, give_i);
-                double pw = (want_r>=0) ? brz_settlement_price_res(s, want_r)
-                                        : (want_i>=0 ? brz_settlement_price_item(s, want_i) : 1.0);
+                double pg = s->item_price[give_i];
                 double want_amt = (pw>0? (give_amt*pg/pw) : 0.0);
-                a->item_inv[give_i] -= give_amt;
-                s->item_inv[give_i] += give_amt;
-                if(want_r>=0){
-                    double pay = want_amt;
-                    if(s->res_inv[want_r] < pay) pay = s->res_inv[want_r];
-                    s->res_inv[want_r] -= pay;
-                    a->res_inv[want_r] += pay;
-                }else if(want_i>=0){
-                    double pay = want_amt;
-                    if(s->item_inv[want_i] < pay) pay = s->item_inv[want_i];
-                    s->item_inv[want_i] -= pay;
-                    a->item_inv[want_i] += pay;
-                }
+                agent_set_item(a, give_i, a->item_inv[give_i] - give_amt);
+                fx_trade(a, setts, si, 1, give_i, want_r, want_i, give_amt, want_amt, log);
             }
         }else{
             /* move toward nearest settlement */
@@ -333,47 +314,50 @@ static void exec_op(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world,
         }
         a->fatigue += 0.02;
         a->hunger  += 0.01;
+        break;
     }
-    else if(brz_streq(opname, "rest"))
-    {
+    case BRZ_OP_REST:
         a->fatigue -= 0.1;
         if(a->fatigue < 0) a->fatigue = 0;
         a->hunger += 0.01;
-    }
-    else if(brz_streq(opname, "move_to") || brz_streq(opname, "roam") || brz_streq(opname,"wander"))
-    {
-        uint16_t t = tag_for_move_target(arg0);
+        break;
+    case BRZ_OP_MOVE:
         if(!a->has_target || brz_dist_manhattan(a->pos,a->target) == 0){
-            a->target = brz_world_find_nearest_tag(world, a->pos, t, 32);
+            a->target = brz_world_find_nearest_tag(world, a->pos, op->tag, 32);
             a->has_target = 1;
         }
         a->pos = brz_step_toward(a->pos, a->target);
         if(brz_dist_manhattan(a->pos,a->target)==0) a->has_target = 0;
         a->fatigue += 0.04;
         a->hunger  += 0.01;
+        break;
+    case BRZ_OP_NONE:
+    default:
+        return;
     }
+    BRZ_PROF_T1((BrzProfPhase)(BRZ_PROF_OP_GATHER + (op->code - BRZ_OP_GATHER)), t0);
 }
 
 
 /* statement execution */
 
 static void exec_stmt(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world, BrzSettlement* setts, int sett_n,
-                      const StmtDef* st, BrzRng* rng);
+                      const StmtDef* st, BrzRng* rng, BrzIntentLog* log);
 
 static void exec_stmts_vec(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world, BrzSettlement* setts, int sett_n,
-                           const BrzVec* stmts, BrzRng* rng)
+                           const BrzVec* stmts, BrzRng* rng, BrzIntentLog* log)
 {
     for(size_t i=0;i<stmts->len;i++){
         const StmtDef* st = (const StmtDef*)brz_vec_cat(stmts, i);
-        exec_stmt(a, cfg, world, setts, sett_n, st, rng);
+        exec_stmt(a, cfg, world, setts, sett_n, st, rng, log);
     }
 }
 
 static void exec_stmt(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world, BrzSettlement* setts, int sett_n,
-                      const StmtDef* st, BrzRng* rng)
+                      const StmtDef* st, BrzRng* rng, BrzIntentLog* log)
 {
     if(st->kind == ST_OP){
-        exec_op(a, cfg, world, setts, sett_n, &st->as.op, rng);
+        exec_op(a, cfg, world, setts, sett_n, &st->as.op, rng, log);
     }else if(st->kind == ST_CHANCE){
         /* percent 0..100 */
         double pct = st->as.chance.chance_pct;
@@ -382,31 +366,40 @@ static void exec_stmt(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world, Brz
         int roll = (int)(brz_rng_u32(rng)%10000u);
         int thr = (int)((pct/100.0)*10000.0);
         if(roll < thr){
-            exec_stmts_vec(a, cfg, world, setts, sett_n, &st->as.chance.body, rng);
+            exec_stmts_vec(a, cfg, world, setts, sett_n, &st->as.chance.body, rng, log);
         }
     }else if(st->kind == ST_WHEN){
-        if(eval_when_expr(st->as.when_stmt.when_expr, a, cfg, rng)){
-            exec_stmts_vec(a, cfg, world, setts, sett_n, &st->as.when_stmt.body, rng);
+        if(eval_when(&st->as.when_stmt.prog, a, rng)){
+            exec_stmts_vec(a, cfg, world, setts, sett_n, &st->as.when_stmt.body, rng, log);
         }
     }
 }
 
 /* auto-eat from own resources and settlement */
-static void agent_auto_eat(BrzAgent* a, const ParsedConfig* cfg, BrzSettlement* setts, int sett_n)
+static void agent_auto_eat(BrzAgent* a, const ParsedConfig* cfg, BrzSettlement* setts, int sett_n,
+                           BrzIntentLog* log)
 {
-    int grain = res_id(cfg,"grain");
-    int fish  = res_id(cfg,"fish");
+    int grain = cfg->known.r_grain;
+    int fish  = cfg->known.r_fish;
     int si = (sett_n>0) ? a->home_settlement : -1;
 
     if(a->hunger > 0.7)
     {
         double eat = 0.0;
-        if(grain>=0 && a->res_inv[grain] > 0){ eat = 0.2; a->res_inv[grain] -= 1; }
-        else if(fish>=0 && a->res_inv[fish] > 0){ eat = 0.2; a->res_inv[fish] -= 1; }
+        if(grain>=0 && a->res_inv[grain] > 0){ eat = 0.2; agent_set_res(a, grain, a->res_inv[grain] - 1); }
+        else if(fish>=0 && a->res_inv[fish] > 0){ eat = 0.2; agent_set_res(a, fish, a->res_inv[fish] - 1); }
 
         if(eat<=0.0 && si>=0 && agent_at_settlement(a,&setts[si])){
-            if(grain>=0 && setts[si].res_inv[grain] > 0){ setts[si].res_inv[grain]-=1; eat=0.2; }
-            else if(fish>=0 && setts[si].res_inv[fish] > 0){ setts[si].res_inv[fish]-=1; eat=0.2; }
+            if(!log){
+                eat = settle_eat(cfg, &setts[si]);
+            }else{
+                BrzIntent in;
+                memset(&in, 0, sizeof(in));
+                in.agent = a->id;
+                in.kind = BRZ_INTENT_EAT;
+                in.where = si;
+                log_push(log, &in);
+            }
         }
         a->hunger -= eat;
         if(a->hunger < 0) a->hunger = 0;
@@ -414,7 +407,7 @@ static void agent_auto_eat(BrzAgent* a, const ParsedConfig* cfg, BrzSettlement*
 }
 
 /* auto-rest: when at home settlement, reduce fatigue (keeps agents active long-term) */
-static void agent_auto_rest(BrzAgent* a, BrzSettlement* setts, int sett_n)
+static void agent_auto_rest(BrzAgent* a, const BrzSettlement* setts, int sett_n)
 {
     if(sett_n<=0) return;
     int si = a->home_settlement;
@@ -430,100 +423,189 @@ static void agent_auto_rest(BrzAgent* a, BrzSettlement* setts, int sett_n)
 }
 
 
-/* rule selection: first matching 'when' or fallback first */
+/* ---- rule selection ----
+   Each rule's 'when' is decided once: threshold-box rules through the
+   vocation's sorted threshold groups, GUARDED/OPAQUE ones in rule order
+   (so chance() draws happen in a fixed order). One draw then picks among
+   the matches by weight; when only the always-matching rules are left,
+   that draw goes to the vocation's alias table instead of a walk. */
 
-/* weighted rule selection among matching whens (or all if no when) */
+/* leading entries of a threshold group that value x satisfies */
+static size_t thr_prefix(const BrzRuleThreshold* t, size_t n, double x, bool upper)
+{
+    size_t lo = 0, hi = n;
+    while(lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        double b = t[mid].bound;
+        bool ok = upper ? (b > x || (b == x && !t[mid].open))
+                        : (b < x || (b == x && !t[mid].open));
+        if(ok) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* weighted rule selection among matching whens */
 static const RuleDef* pick_rule(const BrzAgent* a, const ParsedConfig* cfg, BrzRng* rng)
 {
     (void)cfg;
-    if(!a->voc) return NULL;
-
+    const VocationDef* v = a->voc;
+    if(!v || v->rules.len == 0) return NULL;
+    const size_t n = v->rules.len;
+    const RuleDef* rules = (const RuleDef*)v->rules.data;
+
+    double vars[BRZ_EXPR_VAR_COUNT];
+    vars[BRZ_EXPR_VAR_HUNGER]  = a->hunger;
+    vars[BRZ_EXPR_VAR_FATIGUE] = a->fatigue;
+
+    /* a->rule_mask holds a bit for every rule of the largest vocation */
+    uint64_t* mask = a->rule_mask;
+    memset(mask, 0, (n + 63) / 64 * sizeof(uint64_t));
     double total_w = 0.0;
-    /* first pass: compute total weight of matching rules */
-    for(size_t i=0;i<a->voc->rules.len;i++){
-        const RuleDef* r = (const RuleDef*)brz_vec_cat(&a->voc->rules, i);
-        int ok = 1;
-        if(r->when_expr && r->when_expr[0]){
-            ok = eval_when_expr(r->when_expr, a, cfg, rng);
-        }
-        if(ok){
-            int w = (r->weight > 0) ? r->weight : 1;
-            total_w += (double)w;
+
+    const BrzRuleThreshold* thr = (const BrzRuleThreshold*)v->thresholds.data;
+    for(int g=0; g<BRZ_RULE_THR_GROUPS; g++){
+        const BrzRuleThreshold* t = thr + v->thr_group[g];
+        size_t k = thr_prefix(t, v->thr_group[g+1] - v->thr_group[g], vars[g / 2], (g & 1) != 0);
+        for(size_t j=0;j<k;j++){
+            const RuleDef* r = &rules[t[j].rule];
+            BRZ_PROF_COUNT(BRZ_PROF_EXPR_EVALS, 1);
+            if(!brz_expr_box_holds(&r->guard, vars)) continue;
+            mask[t[j].rule / 64] |= (uint64_t)1 << (t[j].rule % 64);
+            total_w += (double)brz_rule_weight(r);
         }
     }
-    if(total_w <= 0.0) return NULL;
-
-    double pick = (double)(brz_rng_u32(rng)%100000u) / 100000.0 * total_w;
-    double cur = 0.0;
-    for(size_t i=0;i<a->voc->rules.len;i++){
-        const RuleDef* r = (const RuleDef*)brz_vec_cat(&a->voc->rules, i);
-        int ok = 1;
-        if(r->when_expr && r->when_expr[0]){
-            ok = eval_when_expr(r->when_expr, a, cfg, rng);
-        }
-        if(ok){
-            int w = (r->weight > 0) ? r->weight : 1;
-            cur += (double)w;
-            if(cur >= pick) return r;
+    const uint32_t* run = (const uint32_t*)v->run_rules.data;
+    for(size_t j=0;j<v->run_rules.len;j++){
+        const uint32_t i = run[j];
+        const RuleDef* r = &rules[i];
+        if(r->match == BRZ_EXPR_SHAPE_GUARDED && !brz_expr_box_holds(&r->guard, vars)) continue;
+        if(!eval_when(&r->when_prog, a, rng)) continue;
+        mask[i / 64] |= (uint64_t)1 << (i % 64);
+        total_w += (double)brz_rule_weight(r);
+    }
+
+    const RuleDef* picked = NULL;
+    if(total_w == 0.0){
+        if(v->always.len > 0) picked = &rules[brz_voc_sample_always(v, brz_rng_u32(rng))];
+    }else{
+        const BrzRuleAlias* al = (const BrzRuleAlias*)v->always.data;
+        for(size_t j=0;j<v->always.len;j++) mask[al[j].rule / 64] |= (uint64_t)1 << (al[j].rule % 64);
+        total_w += v->always_w;
+        double pick = (double)(brz_rng_u32(rng)%100000u) / 100000.0 * total_w;
+        double cur = 0.0;
+        for(size_t i=0;i<n;i++){
+            if(!((mask[i / 64] >> (i % 64)) & 1u)) continue;
+            picked = &rules[i];
+            cur += (double)brz_rule_weight(picked);
+            if(cur >= pick) break;
         }
     }
-    /* fallback */
-    return (const RuleDef*)brz_vec_cat(&a->voc->rules, 0);
+    return picked;
 }
 
 
 
-int brz_agents_alloc_and_spawn(BrzAgent** out, int agent_n, const ParsedConfig* cfg,
+int brz_agents_alloc(BrzAgentStore* out, int agent_n, const ParsedConfig* cfg,
+                     size_t res_n, size_t item_n)
+{
+    memset(out, 0, sizeof(*out));
+    if(agent_n <= 0) return 0;
+    size_t n = (size_t)agent_n;
+    out->n = agent_n;
+    out->res_n = res_n;
+    out->item_n = item_n;
+    out->voc_table = (const VocationDef*)cfg->vocations.data;
+    out->pos        = (BrzPos*)calloc(n, sizeof(BrzPos));
+    out->target     = (BrzPos*)calloc(n, sizeof(BrzPos));
+    out->has_target = (uint8_t*)calloc(n, sizeof(uint8_t));
+    out->home       = (int32_t*)calloc(n, sizeof(int32_t));
+    out->voc        = (uint32_t*)calloc(n, sizeof(uint32_t));
+    out->hunger     = (double*)calloc(n, sizeof(double));
+    out->fatigue    = (double*)calloc(n, sizeof(double));
+    out->res        = (double*)calloc(n * (res_n ? res_n : 1), sizeof(double));
+    out->item       = (double*)calloc(n * (item_n ? item_n : 1), sizeof(double));
+    out->tot        = (BrzSum*)calloc(2 + res_n + item_n, sizeof(BrzSum));
+    out->pend       = (double*)calloc(2 + res_n + item_n, sizeof(double));
+    out->rule_mask_words = brz_cfg_rule_mask_words(cfg);
+    out->rule_mask  = (uint64_t*)calloc(out->rule_mask_words, sizeof(uint64_t));
+    if(!out->pos || !out->target || !out->has_target || !out->home || !out->voc ||
+       !out->hunger || !out->fatigue || !out->res || !out->item || !out->tot || !out->pend ||
+       !out->rule_mask) return 1;
+    return 0;
+}
+
+void brz_agents_recount(BrzAgentStore* s){
+    const size_t slots = 2 + s->res_n + s->item_n;
+    double* t = (double*)calloc(slots, sizeof(double));
+    if(!t) return;
+    for(int i=0;i<s->n;i++){
+        const double* inv_r = brz_agents_res(s, i);
+        const double* inv_i = brz_agents_item(s, i);
+        t[TOT_HUNGER] += s->hunger[i];
+        t[TOT_FATIGUE] += s->fatigue[i];
+        for(size_t r=0;r<s->res_n;r++) t[2 + r] += inv_r[r];
+        for(size_t k=0;k<s->item_n;k++) t[2 + s->res_n + k] += inv_i[k];
+    }
+    for(size_t k=0;k<slots;k++){ s->tot[k].s = t[k]; s->tot[k].c = 0.0; s->pend[k] = 0.0; }
+    free(t);
+}
+
+void brz_agents_fold_totals(BrzAgentStore* s){
+    const size_t slots = 2 + s->res_n + s->item_n;
+    for(size_t k=0;k<slots;k++){
+        if(s->pend[k] != 0.0) brz_sum_add(&s->tot[k], s->pend[k]);
+        s->pend[k] = 0.0;
+    }
+}
+
+int brz_agents_alloc_and_spawn(BrzAgentStore* out, int agent_n, const ParsedConfig* cfg,
                                const BrzSettlement* setts, int sett_n,
                                size_t res_n, size_t item_n, unsigned seed)
 {
-    *out = (BrzAgent*)calloc((size_t)agent_n, sizeof(BrzAgent));
-    if(!*out) return 1;
+    if(brz_agents_alloc(out, agent_n, cfg, res_n, item_n) != 0) return 1;
+    if(agent_n <= 0) return 0;
 
     BrzRng rng; brz_rng_seed(&rng, seed?seed:0xC0FFEEu);
 
     for(int i=0;i<agent_n;i++){
-        BrzAgent* a = &(*out)[i];
-        a->id = (uint32_t)i;
-        a->voc = (const VocationDef*)brz_vec_cat(&cfg->vocations, (size_t)i % cfg->vocations.len);
-        a->home_settlement = (sett_n>0) ? (i % sett_n) : 0;
-        a->pos = (sett_n>0) ? setts[a->home_settlement].pos : (BrzPos){ brz_rng_range(&rng,0,50), brz_rng_range(&rng,0,50) };
-        a->hunger = 0.3 + 0.4*(double)(brz_rng_u32(&rng)%1000u)/1000.0;
-        a->fatigue = 0.2;
-        a->res_n = res_n; a->item_n = item_n;
-        a->res_inv = (double*)calloc(res_n, sizeof(double));
-        a->item_inv = (double*)calloc(item_n, sizeof(double));
-        if(!a->res_inv || !a->item_inv) return 1;
+        out->voc[i] = (uint32_t)((size_t)i % cfg->vocations.len);
+        out->home[i] = (sett_n>0) ? (i % sett_n) : 0;
+        out->pos[i] = (sett_n>0) ? setts[out->home[i]].pos : (BrzPos){ brz_rng_range(&rng,0,50), brz_rng_range(&rng,0,50) };
+        out->hunger[i] = 0.3 + 0.4*(double)(brz_rng_u32(&rng)%1000u)/1000.0;
+        out->fatigue[i] = 0.2;
     }
+    brz_agents_recount(out);
     return 0;
 }
 
-void brz_agents_free(BrzAgent* agents, int agent_n){
+void brz_agents_free(BrzAgentStore* agents){
     if(!agents) return;
-    for(int i=0;i<agent_n;i++){
-        free(agents[i].res_inv);
-        free(agents[i].item_inv);
-    }
-    free(agents);
+    free(agents->pos);
+    free(agents->target);
+    free(agents->has_target);
+    free(agents->home);
+    free(agents->voc);
+    free(agents->hunger);
+    free(agents->fatigue);
+    free(agents->res);
+    free(agents->item);
+    free(agents->tot);
+    free(agents->pend);
+    free(agents->rule_mask);
+    memset(agents, 0, sizeof(*agents));
 }
 
-void brz_agent_step(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world,
-                    BrzSettlement* setts, int sett_n, BrzRng* rng)
+/* baseline drift (daily metabolism + rest)
+   NOTE: fatigue naturally recovers a bit each day; hard work re-adds fatigue. */
+static void agent_metabolize(BrzAgent* a)
 {
-    /* baseline drift (daily metabolism + rest)
-       NOTE: fatigue naturally recovers a bit each day; hard work re-adds fatigue. */
     a->hunger  = clamp01(a->hunger + 0.02);
     a->fatigue = clamp01(a->fatigue + 0.01 - 0.015);
+}
 
-    /* execute one rule per day */
-    const RuleDef* r = pick_rule(a, cfg, rng);
-    if(r && r->do_task){
-        TaskDef* t = brz_voc_find_task((VocationDef*)a->voc, r->do_task);
-        if(t){
-            exec_stmts_vec(a, cfg, world, setts, sett_n, &t->stmts, rng);
-        }
-    }
-
+/* the rule-independent rest of the day: walk, stay on the map, rest at home */
+static void agent_travel(BrzAgent* a, int w, int h, const BrzSettlement* setts, int sett_n)
+{
     /* movement toward target if set */
     if(a->has_target){
         a->pos = brz_step_toward(a->pos, a->target);
@@ -531,26 +613,239 @@ void brz_agent_step(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world,
     }
 
     /* clamp positions */
-    a->pos.x = brz_clamp_i(a->pos.x, 0, world->w-1);
-    a->pos.y = brz_clamp_i(a->pos.y, 0, world->h-1);
+    a->pos.x = brz_clamp_i(a->pos.x, 0, w-1);
+    a->pos.y = brz_clamp_i(a->pos.y, 0, h-1);
 
     agent_auto_rest(a, setts, sett_n);
-    agent_auto_eat(a, cfg, setts, sett_n);
+}
+
+static void agent_step(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world,
+                       BrzSettlement* setts, int sett_n, BrzRng* rng, BrzIntentLog* log)
+{
+    agent_metabolize(a);
+
+    /* execute one rule per day */
+    BRZ_PROF_T0(t_rule);
+    const RuleDef* r = pick_rule(a, cfg, rng);
+    BRZ_PROF_T1(BRZ_PROF_RULE, t_rule);
+    if(r && r->task){
+        exec_stmts_vec(a, cfg, world, setts, sett_n, &r->task->stmts, rng, log);
+    }
+
+    agent_travel(a, world->w, world->h, setts, sett_n);
+    agent_auto_eat(a, cfg, setts, sett_n, log);
 
     /* deliver some gathered food to home settlement when at home */
     int si = (sett_n>0) ? a->home_settlement : -1;
     if(si>=0 && agent_at_settlement(a,&setts[si])){
-        int grain = res_id(cfg,"grain");
-        int fish  = res_id(cfg,"fish");
+        int grain = cfg->known.r_grain;
+        int fish  = cfg->known.r_fish;
         if(grain>=0 && a->res_inv[grain] > 2){
             double move = floor(a->res_inv[grain] - 2);
-            a->res_inv[grain] -= move;
-            setts[si].res_inv[grain] += move;
+            agent_set_res(a, grain, a->res_inv[grain] - move);
+            fx_deliver(a, setts, si, grain, move, log);
         }
         if(fish>=0 && a->res_inv[fish] > 2){
             double move = floor(a->res_inv[fish] - 2);
-            a->res_inv[fish] -= move;
-            setts[si].res_inv[fish] += move;
+            agent_set_res(a, fish, a->res_inv[fish] - move);
+            fx_deliver(a, setts, si, fish, move, log);
+        }
+    }
+}
+
+void brz_agent_step(BrzAgentStore* agents, int i, const ParsedConfig* cfg, BrzWorld* world,
+                    BrzSettlement* setts, int sett_n, BrzRng* rng)
+{
+    BRZ_PROF_T0(t0);
+    BrzAgent a;
+    agent_load(agents, i, &a);
+    agent_step(&a, cfg, world, setts, sett_n, rng, NULL);
+    agent_save(agents, i, &a);
+    BRZ_PROF_T1(BRZ_PROF_STEP, t0);
+}
+
+void brz_agent_step_deferred(BrzAgentStore* agents, int i, const ParsedConfig* cfg, BrzWorld* world,
+                             BrzSettlement* setts, int sett_n, BrzRng* rng, BrzIntentLog* log)
+{
+    BRZ_PROF_T0(t0);
+    const size_t slots = 2 + agents->res_n + agents->item_n;
+    if(log->tally_n != slots){
+        double* t = (double*)realloc(log->tally, slots * sizeof(double));
+        if(!t){ log->oom = true; return; }
+        memset(t, 0, slots * sizeof(double));
+        log->tally = t;
+        log->tally_n = slots;
+    }
+    if(log->rule_mask_words < agents->rule_mask_words){
+        uint64_t* m = (uint64_t*)realloc(log->rule_mask, agents->rule_mask_words * sizeof(uint64_t));
+        if(!m){ log->oom = true; return; }
+        log->rule_mask = m;
+        log->rule_mask_words = agents->rule_mask_words;
+    }
+    BrzAgent a;
+    agent_load(agents, i, &a);
+    a.tally = log->tally;
+    a.rule_mask = log->rule_mask;
+    agent_step(&a, cfg, world, setts, sett_n, rng, log);
+    agent_save(agents, i, &a);
+    BRZ_PROF_T1(BRZ_PROF_STEP, t0);
+}
+
+/* ---- quiet days ----
+   A day is quiet when agent_step would pick no rule without drawing, not
+   eat and not deliver: all it does is metabolize and travel, from the
+   agent's own scalars and the fixed settlement positions. Such days can
+   be replayed later, in any order relative to other agents, with the
+   same result. */
+
+bool brz_voc_may_idle(const VocationDef* v)
+{
+    if(!v) return true;
+    if(v->always.len > 0) return false;
+    const RuleDef* rules = (const RuleDef*)v->rules.data;
+    for(size_t i=0;i<v->rules.len;i++)
+        if(rules[i].match == BRZ_EXPR_SHAPE_OPAQUE || rules[i].match == BRZ_EXPR_SHAPE_ALWAYS) return false;
+    return true;
+}
+
+/* no rule can match at vars (only called when brz_voc_may_idle holds) */
+static bool rules_idle(const VocationDef* v, const double* vars)
+{
+    if(!v) return true;
+    const RuleDef* rules = (const RuleDef*)v->rules.data;
+    for(size_t i=0;i<v->rules.len;i++){
+        const RuleDef* r = &rules[i];
+        if(r->match == BRZ_EXPR_SHAPE_NEVER) continue;
+        if(brz_expr_box_holds(&r->guard, vars)) return false;
+    }
+    return true;
+}
+
+/* one quiet day on a; false (a unchanged) when the day is not quiet */
+static bool agent_quiet_day(BrzAgent* a, const ParsedConfig* cfg, int w, int h,
+                            const BrzSettlement* setts, int sett_n)
+{
+    BrzAgent c = *a;
+    agent_metabolize(&c);
+    double vars[BRZ_EXPR_VAR_COUNT];
+    vars[BRZ_EXPR_VAR_HUNGER]  = c.hunger;
+    vars[BRZ_EXPR_VAR_FATIGUE] = c.fatigue;
+    if(!rules_idle(c.voc, vars)) return false;
+    agent_travel(&c, w, h, setts, sett_n);
+    if(c.hunger > 0.7) return false; /* agent_auto_eat */
+    int si = (sett_n>0) ? c.home_settlement : -1;
+    if(si>=0 && agent_at_settlement(&c, &setts[si])){
+        int grain = cfg->known.r_grain;
+        int fish  = cfg->known.r_fish;
+        if((grain>=0 && c.res_inv[grain] > 2) || (fish>=0 && c.res_inv[fish] > 2)) return false;
+    }
+    *a = c;
+    return true;
+}
+
+int brz_agent_quiet_days(const BrzAgentStore* agents, int i, const ParsedConfig* cfg,
+                         const BrzWorld* world, const BrzSettlement* setts, int sett_n, int max_days)
+{
+    BrzAgent a;
+    agent_load(agents, i, &a);
+    int k = 0;
+    while(k < max_days && agent_quiet_day(&a, cfg, world->w, world->h, setts, sett_n)) k++;
+    return k;
+}
+
+int brz_agent_skip_days(BrzAgentStore* agents, int i, const ParsedConfig* cfg,
+                        const BrzWorld* world, const BrzSettlement* setts, int sett_n, int days)
+{
+    BrzAgent a;
+    agent_load(agents, i, &a);
+    int k = 0;
+    while(k < days && agent_quiet_day(&a, cfg, world->w, world->h, setts, sett_n)) k++;
+    agent_save(agents, i, &a);
+    return k;
+}
+
+/* ---- intent log ---- */
+
+void brz_intent_log_init(BrzIntentLog* log){
+    brz_vec_init(&log->intents, sizeof(BrzIntent));
+    log->tally = NULL;
+    log->tally_n = 0;
+    log->rule_mask = NULL;
+    log->rule_mask_words = 0;
+    log->oom = false;
+}
+
+void brz_intent_log_destroy(BrzIntentLog* log){
+    brz_vec_destroy(&log->intents);
+    free(log->tally);
+    free(log->rule_mask);
+    log->tally = NULL;
+    log->tally_n = 0;
+    log->rule_mask = NULL;
+    log->rule_mask_words = 0;
+    log->oom = false;
+}
+
+void brz_intent_log_clear(BrzIntentLog* log){
+    brz_vec_clear(&log->intents);
+    if(log->tally) memset(log->tally, 0, log->tally_n * sizeof(double));
+    log->oom = false;
+}
+
+void brz_intents_commit(const BrzIntentLog* log, BrzAgentStore* agents, const ParsedConfig* cfg,
+                        BrzWorld* world, BrzSettlement* setts)
+{
+    for(size_t k=0;k<log->tally_n;k++)
+        if(log->tally[k] != 0.0) brz_sum_add(&agents->tot[k], log->tally[k]);
+    for(size_t i=0;i<log->intents.len;i++){
+        const BrzIntent* in = (const BrzIntent*)brz_vec_cat(&log->intents, i);
+        BrzAgent view;
+        BrzAgent* a = &view;
+        agent_load(agents, (int)in->agent, a);
+        switch((BrzIntentKind)in->kind){
+            case BRZ_INTENT_TAKE: {
+                double t = brz_world_take_tile(world, (size_t)in->where, a->res_n, in->id, in->amt);
+                agent_add_res(a, in->id, t);
+                break;
+            }
+            case BRZ_INTENT_TRADE: {
+                BrzTradeOrder o;
+                memset(&o, 0, sizeof(o));
+                o.agent = in->agent;
+                o.give_is_item = in->give_is_item;
+                o.give = in->id;
+                o.want_r = in->want_r;
+                o.want_i = in->want_i;
+                o.give_amt = in->amt;
+                o.want_amt = in->want_amt;
+                brz_settlement_queue_trade(&setts[in->where], &o);
+                break;
+            }
+            case BRZ_INTENT_EAT:
+                a->hunger -= settle_eat(cfg, &setts[in->where]);
+                if(a->hunger < 0) a->hunger = 0;
+                break;
+            case BRZ_INTENT_DELIVER:
+                setts[in->where].res_inv[in->id] += in->amt;
+                break;
         }
+        agent_save(agents, (int)in->agent, a);
+    }
+}
+
+/* ---- market clearing ---- */
+
+bool brz_trades_clear(BrzAgentStore* agents, BrzSettlement* setts, int sett_n)
+{
+    bool ok = true;
+    for(int si=0; si<sett_n; si++){
+        BrzSettlement* s = &setts[si];
+        const BrzTradeOrder* o = (const BrzTradeOrder*)s->orders.data;
+        for(size_t k=0;k<s->orders.len;k++) settle_trade(agents, s, &o[k]);
+        brz_vec_clear(&s->orders);
+        if(s->orders_oom) ok = false;
+        s->orders_oom = false;
     }
+    brz_agents_fold_totals(agents);
+    return ok;
 }
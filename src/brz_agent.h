@@ -7,29 +7,138 @@
 #include "brz_world.h"
 #include "brz_settlement.h"
 #include "brz_util.h"
+#include <stdbool.h>
 #include <stddef.h>
 
-typedef struct BrzAgent {
-    uint32_t id;
-    const VocationDef* voc;
-    BrzPos pos;
-    BrzPos target;
-    int has_target;
-    int home_settlement;
-    double hunger;
-    double fatigue;
-    double* res_inv;   /* [res_n] */
-    double* item_inv;  /* [item_n] */
+/*
+ * Agent store (structure of arrays)
+ *
+ * Agent i is the i-th entry of every array; its id is i. Hot scalars live in
+ * parallel arrays and all inventories in two slabs of agent_n*res_n and
+ * agent_n*item_n doubles, so there is no per-agent allocation.
+ * Use the accessors below rather than indexing the slabs directly.
+ */
+typedef struct BrzAgentStore {
+    int n;
     size_t res_n;
     size_t item_n;
-} BrzAgent;
 
-int  brz_agents_alloc_and_spawn(BrzAgent** out, int agent_n, const ParsedConfig* cfg,
+    BrzPos*  pos;
+    BrzPos*  target;
+    uint8_t* has_target;
+    int32_t* home;      /* home settlement index */
+    uint32_t* voc;      /* index into voc_table */
+    double*  hunger;
+    double*  fatigue;
+
+    double*  res;       /* [n*res_n]  */
+    double*  item;      /* [n*item_n] */
+
+    /* running totals over all agents: hunger, fatigue, then every resource
+       and every item. Stepping, commits and trade clearing add their
+       deltas to pend, which brz_trades_clear folds into tot once a day;
+       see brz_agents_total_* and brz_agents_recount. */
+    BrzSum*  tot;       /* [2 + res_n + item_n] */
+    double*  pend;      /* [2 + res_n + item_n] */
+
+    const VocationDef* voc_table; /* cfg->vocations, not owned */
+
+    /* rule-match mask for the serial step, one bit per rule of the
+       largest vocation; the parallel step uses its log's */
+    uint64_t* rule_mask; /* [rule_mask_words] */
+    size_t rule_mask_words;
+} BrzAgentStore;
+
+static inline double* brz_agents_res(const BrzAgentStore* s, int i){ return &s->res[(size_t)i * s->res_n]; }
+static inline double* brz_agents_item(const BrzAgentStore* s, int i){ return &s->item[(size_t)i * s->item_n]; }
+static inline const VocationDef* brz_agents_voc(const BrzAgentStore* s, int i){ return &s->voc_table[s->voc[i]]; }
+
+/* O(1) sums over all agents. Sleeping agents (brz_sched.h) only count
+   once synced. Code that writes the arrays directly must call
+   brz_agents_recount afterwards. */
+static inline double brz_agents_total(const BrzAgentStore* s, size_t slot){ return brz_sum_value(&s->tot[slot]) + s->pend[slot]; }
+static inline double brz_agents_total_hunger(const BrzAgentStore* s){ return brz_agents_total(s, 0); }
+static inline double brz_agents_total_fatigue(const BrzAgentStore* s){ return brz_agents_total(s, 1); }
+static inline double brz_agents_total_res(const BrzAgentStore* s, size_t rid){ return brz_agents_total(s, 2 + rid); }
+static inline double brz_agents_total_item(const BrzAgentStore* s, size_t iid){ return brz_agents_total(s, 2 + s->res_n + iid); }
+void brz_agents_recount(BrzAgentStore* agents);
+void brz_agents_fold_totals(BrzAgentStore* agents);
+
+/* returns 0 on success (out is zeroed first; free with brz_agents_free either way) */
+int  brz_agents_alloc(BrzAgentStore* out, int agent_n, const ParsedConfig* cfg,
+                      size_t res_n, size_t item_n);
+int  brz_agents_alloc_and_spawn(BrzAgentStore* out, int agent_n, const ParsedConfig* cfg,
                                 const BrzSettlement* setts, int sett_n,
                                 size_t res_n, size_t item_n, unsigned seed);
-void brz_agents_free(BrzAgent* agents, int agent_n);
+void brz_agents_free(BrzAgentStore* agents);
 
-void brz_agent_step(BrzAgent* a, const ParsedConfig* cfg, BrzWorld* world,
+void brz_agent_step(BrzAgentStore* agents, int i, const ParsedConfig* cfg, BrzWorld* world,
                     BrzSettlement* setts, int sett_n, BrzRng* rng);
 
+/* ---- quiet days (event-driven scheduling, brz_sched.h) ----
+   A quiet day picks no rule, eats nothing and delivers nothing; it only
+   drifts hunger and fatigue and moves the agent toward its target, so it
+   reads and writes nothing but the agent. Vocations with always-matching
+   or opaque rules (run to tell, e.g. chance()) never have one.
+   brz_agent_quiet_days counts the quiet days ahead of agent i's stored
+   state, up to max_days; brz_agent_skip_days applies up to `days` of them
+   exactly as brz_agent_step would and returns how many it applied. */
+bool brz_voc_may_idle(const VocationDef* v);
+int  brz_agent_quiet_days(const BrzAgentStore* agents, int i, const ParsedConfig* cfg,
+                          const BrzWorld* world, const BrzSettlement* setts, int sett_n, int max_days);
+int  brz_agent_skip_days(BrzAgentStore* agents, int i, const ParsedConfig* cfg,
+                         const BrzWorld* world, const BrzSettlement* setts, int sett_n, int days);
+
+/* ---- deferred stepping (parallel day step) ----
+   brz_agent_step_deferred behaves like brz_agent_step but only writes the
+   agent itself; it reads world and settlements as they were at the start
+   of the phase and logs every shared-state effect instead. Committing the
+   logs in agent-id order makes the outcome independent of how agents were
+   spread across threads. */
+
+typedef enum {
+    BRZ_INTENT_TAKE = 0, /* world_take(where = tile index, id = rid, amt) -> agent */
+    BRZ_INTENT_TRADE,    /* queue a trade at settlement 'where': amt of id for want_amt */
+    BRZ_INTENT_EAT,      /* eat one grain/fish from settlement 'where' */
+    BRZ_INTENT_DELIVER   /* settlement 'where' receives amt of rid 'id' */
+} BrzIntentKind;
+
+typedef struct {
+    uint32_t agent;        /* index in the agent store */
+    uint8_t kind;          /* BrzIntentKind */
+    uint8_t give_is_item;  /* TRADE: id is an item id */
+    int32_t where;
+    int32_t id;
+    int32_t want_r, want_i;
+    double amt;
+    double want_amt;
+} BrzIntent;
+
+typedef struct {
+    BrzVec intents;  /* BrzIntent, in the order the effects happened */
+    double* tally;   /* [2 + res_n + item_n] the logged agents' changes to the store totals */
+    size_t tally_n;
+    uint64_t* rule_mask; /* [rule_mask_words] pick_rule scratch, sized like the store's */
+    size_t rule_mask_words;
+    bool oom;        /* a push failed; the log is incomplete */
+} BrzIntentLog;
+
+void brz_intent_log_init(BrzIntentLog* log);
+void brz_intent_log_destroy(BrzIntentLog* log);
+void brz_intent_log_clear(BrzIntentLog* log);
+
+void brz_agent_step_deferred(BrzAgentStore* agents, int i, const ParsedConfig* cfg, BrzWorld* world,
+                             BrzSettlement* setts, int sett_n, BrzRng* rng, BrzIntentLog* log);
+void brz_intents_commit(const BrzIntentLog* log, BrzAgentStore* agents, const ParsedConfig* cfg,
+                        BrzWorld* world, BrzSettlement* setts);
+
+/* ---- market clearing ----
+   Trades do not touch settlement stock while agents step: both stepping
+   modes queue them at their settlement, priced at the day's prices
+   (brz_settlements_begin_day). After the agent phase brz_trades_clear
+   settles each settlement's queue in agent order, paying out what stock
+   allows, and folds the day's totals deltas (brz_agents_fold_totals).
+   Returns false if a queue ran out of memory (its trades are lost). */
+bool brz_trades_clear(BrzAgentStore* agents, BrzSettlement* setts, int sett_n);
+
 #endif
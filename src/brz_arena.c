@@ -0,0 +1,155 @@
+#include "brz_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16u
+#define ARENA_CHUNK (64u * 1024u)
+
+struct BrzArenaChunk {
+    BrzArenaChunk* next;
+    size_t size; /* usable bytes after the header */
+    size_t used;
+};
+
+/* header rounded up so chunk data starts aligned */
+#define CHUNK_HEAD ((sizeof(BrzArenaChunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void brz_arena_init(BrzArena* a)
+{
+    a->head = NULL;
+    a->bytes = 0;
+}
+
+void brz_arena_destroy(BrzArena* a)
+{
+    BrzArenaChunk* c = a->head;
+    while(c){
+        BrzArenaChunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = NULL;
+    a->bytes = 0;
+}
+
+void* brz_arena_alloc(BrzArena* a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if(size == 0) size = ARENA_ALIGN;
+    BrzArenaChunk* c = a->head;
+    if(!c || c->size - c->used < size){
+        /* oversized requests get a chunk of their own behind the current
+           one, so the space left in the current chunk is not wasted */
+        size_t want = size > ARENA_CHUNK / 4 ? size : ARENA_CHUNK;
+        BrzArenaChunk* n = (BrzArenaChunk*)malloc(CHUNK_HEAD + want);
+        if(!n) return NULL;
+        n->size = want;
+        n->used = 0;
+        if(c && want != ARENA_CHUNK){
+            n->next = c->next;
+            c->next = n;
+        }else{
+            n->next = c;
+            a->head = n;
+        }
+        c = n;
+    }
+    void* p = (char*)c + CHUNK_HEAD + c->used;
+    c->used += size;
+    a->bytes += size;
+    return p;
+}
+
+char* brz_arena_strndup(BrzArena* a, const char* s, size_t n)
+{
+    char* out = (char*)brz_arena_alloc(a, n + 1);
+    if(!out) return NULL;
+    if(n) memcpy(out, s, n);
+    out[n] = 0;
+    return out;
+}
+
+/* ---------- interning ---------- */
+
+/* FNV-1a */
+static uint32_t str_hash(const char* s, size_t n)
+{
+    uint32_t h = 2166136261u;
+    for(size_t i=0;i<n;i++){ h ^= (unsigned char)s[i]; h *= 16777619u; }
+    return h;
+}
+
+void brz_strtab_init(BrzStrTab* t)
+{
+    t->slots = NULL;
+    t->cap = 0;
+    t->n = 0;
+}
+
+void brz_strtab_destroy(BrzStrTab* t)
+{
+    free(t->slots);
+    brz_strtab_init(t);
+}
+
+/* keep the load factor <= 1/2 */
+static bool strtab_grow(BrzStrTab* t)
+{
+    size_t cap = t->cap ? t->cap * 2 : 256;
+    BrzStrSlot* slots = (BrzStrSlot*)calloc(cap, sizeof(BrzStrSlot));
+    if(!slots) return false;
+    for(size_t i=0;i<t->cap;i++){
+        const BrzStrSlot* s = &t->slots[i];
+        if(!s->s) continue;
+        size_t j = s->hash & (cap - 1);
+        while(slots[j].s) j = (j + 1) & (cap - 1);
+        slots[j] = *s;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->cap = cap;
+    return true;
+}
+
+/* slot holding s[0..n), or the empty slot where it belongs */
+static BrzStrSlot* strtab_find(BrzStrTab* t, const char* s, size_t n, uint32_t h)
+{
+    size_t mask = t->cap - 1;
+    size_t i = h & mask;
+    for(;;){
+        BrzStrSlot* slot = &t->slots[i];
+        if(!slot->s) return slot;
+        if(slot->hash == h && slot->len == n && memcmp(slot->s, s, n) == 0) return slot;
+        i = (i + 1) & mask;
+    }
+}
+
+const char* brz_strtab_intern(BrzStrTab* t, BrzArena* a, const char* s, size_t n)
+{
+    if(n > UINT32_MAX) return NULL;
+    if((t->n + 1) * 2 > t->cap && !strtab_grow(t)) return NULL;
+    uint32_t h = str_hash(s, n);
+    BrzStrSlot* slot = strtab_find(t, s, n, h);
+    if(slot->s) return slot->s;
+    char* copy = brz_arena_strndup(a, s, n);
+    if(!copy) return NULL;
+    slot->s = copy;
+    slot->len = (uint32_t)n;
+    slot->hash = h;
+    t->n++;
+    return copy;
+}
+
+bool brz_strtab_adopt(BrzStrTab* t, const char* s, size_t n)
+{
+    if(!s || s[n] != 0 || n > UINT32_MAX) return false;
+    if((t->n + 1) * 2 > t->cap && !strtab_grow(t)) return false;
+    uint32_t h = str_hash(s, n);
+    BrzStrSlot* slot = strtab_find(t, s, n, h);
+    if(slot->s) return slot->s == s;
+    slot->s = s;
+    slot->len = (uint32_t)n;
+    slot->hash = h;
+    t->n++;
+    return true;
+}
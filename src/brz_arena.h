@@ -0,0 +1,59 @@
+#ifndef BRZ_ARENA_H
+#define BRZ_ARENA_H
+
+/*
+ * brz_arena.h/.c - bump allocator and string interning
+ *
+ * A BrzArena hands out memory from a list of large chunks and frees it all
+ * at once in brz_arena_destroy; there is no per-allocation free. A
+ * BrzStrTab interns strings into an arena, so equal strings share one
+ * NUL-terminated copy and can be compared by pointer.
+ *
+ * Usage:
+ *   BrzArena a;  BrzStrTab st;
+ *   brz_arena_init(&a);  brz_strtab_init(&st);
+ *   const char* s = brz_strtab_intern(&st, &a, src + off, len);
+ *   brz_strtab_destroy(&st);  brz_arena_destroy(&a);
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct BrzArenaChunk BrzArenaChunk;
+
+typedef struct BrzArena {
+    BrzArenaChunk* head; /* chunk being filled; older chunks follow */
+    size_t bytes;        /* total handed out, for stats */
+} BrzArena;
+
+void  brz_arena_init(BrzArena* a);
+void  brz_arena_destroy(BrzArena* a);
+
+/* size bytes aligned for any scalar type; NULL on OOM */
+void* brz_arena_alloc(BrzArena* a, size_t size);
+/* copy of s[0..n) plus NUL; NULL on OOM */
+char* brz_arena_strndup(BrzArena* a, const char* s, size_t n);
+
+typedef struct {
+    const char* s;
+    uint32_t len;
+    uint32_t hash;
+} BrzStrSlot;
+
+typedef struct BrzStrTab {
+    BrzStrSlot* slots; /* open addressing, s == NULL is empty */
+    size_t cap;        /* power of two, or 0 */
+    size_t n;
+} BrzStrTab;
+
+void        brz_strtab_init(BrzStrTab* t);
+void        brz_strtab_destroy(BrzStrTab* t);
+/* the interned copy of s[0..n), allocated in a on first sight; NULL on OOM */
+const char* brz_strtab_intern(BrzStrTab* t, BrzArena* a, const char* s, size_t n);
+/* register s[0..n) (NUL-terminated, kept alive by the caller) as the
+   interned copy without copying it; false on OOM or when an equal string
+   is already interned elsewhere */
+bool        brz_strtab_adopt(BrzStrTab* t, const char* s, size_t n);
+
+#endif /* BRZ_ARENA_H */
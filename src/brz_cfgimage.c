@@ -0,0 +1,523 @@
+#include "brz_cfgimage.h"
+#include "brz_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMG_ALIGN 16u
+#define IMG_BYTE_ORDER 0x01020304u
+
+static const char k_img_magic[8] = { 'B','R','Z','C','F','G','I',0 };
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;   /* IMG_BYTE_ORDER as written by the compiling host */
+    uint64_t layout;       /* img_layout() of the compiling build */
+    uint64_t src_hash;
+    uint64_t src_len;
+    uint64_t image_size;   /* bytes in the block */
+    uint64_t reloc_n;      /* block offsets of pointers to rebase */
+    uint64_t owner_n;      /* block offsets of BrzVec.arena fields */
+    uint64_t block_sum;    /* brz_hash64 of the block */
+    uint64_t table_sum;    /* brz_hash64 of the reloc + owner tables */
+} ImgHeader;
+
+/* first object in the block */
+typedef struct {
+    uint32_t seed;
+    int years;
+    int agent_count;
+    int settlement_count;
+    BrzKnownKinds known;
+    BrzVec params;
+    BrzVec vocations;
+    BrzVec warnings;
+    BrzVec recipes;
+    BrzVec recipe_in;
+    BrzVec recipe_of;
+    bool has_recipes;
+    const char** res_names;
+    size_t res_n;
+    const char** item_names;
+    size_t item_n;
+    BrzStrSlot* strings;  /* the interned set */
+    size_t string_n;
+} ImgRoot;
+
+static bool img_fail(char* err, size_t err_n, const char* msg)
+{
+    if(err && err_n) snprintf(err, err_n, "%s", msg);
+    return false;
+}
+
+/* changes with any edit to the structs stored in an image */
+static uint64_t img_layout(void)
+{
+    const uint64_t v[] = {
+        sizeof(void*), sizeof(size_t), sizeof(int), sizeof(double),
+        sizeof(ImgRoot), sizeof(BrzVec), sizeof(BrzStrSlot), sizeof(BrzKnownKinds),
+        sizeof(ParamDef), sizeof(VocationDef), sizeof(TaskDef), sizeof(RuleDef),
+        sizeof(StmtDef), sizeof(OpDef), sizeof(BrzExpr), sizeof(BrzExprIns),
+        offsetof(BrzVec, arena), offsetof(StmtDef, as), offsetof(OpDef, code),
+        offsetof(RuleDef, when_prog), offsetof(RuleDef, task), offsetof(RuleDef, guard),
+        offsetof(VocationDef, thresholds), sizeof(BrzRuleThreshold), offsetof(ParamDef, svalue),
+        offsetof(VocationDef, run_rules), offsetof(VocationDef, always), sizeof(BrzRuleAlias),
+        offsetof(StmtDef, as.when_stmt.prog), offsetof(StmtDef, as.chance.body),
+        sizeof(RecipeDef), sizeof(RecipeInput), offsetof(RecipeDef, makes), offsetof(RecipeInput, id)
+    };
+    return brz_hash64(v, sizeof(v));
+}
+
+uint64_t brz_cfg_source_hash(const char* src, size_t n)
+{
+    return brz_hash64(src, n);
+}
+
+/* ---------------- write ---------------- */
+
+/* The block is built by offset: b->data moves as it grows, so nothing
+   keeps a pointer into it across an allocation. */
+typedef struct {
+    uint8_t* data;
+    size_t len, cap;
+    BrzVec relocs;  /* uint64_t */
+    BrzVec owners;  /* uint64_t */
+    /* source string -> offset of its copy */
+    const char** map_key;
+    uint64_t* map_off;
+    size_t map_cap, map_n;
+    bool oom;
+} ImgBuf;
+
+static uint64_t img_alloc(ImgBuf* b, size_t size, size_t align)
+{
+    if(b->oom) return 0;
+    size_t off = (b->len + align - 1) & ~(align - 1);
+    size_t end = off + size;
+    if(end > b->cap)
+    {
+        size_t cap = b->cap ? b->cap : 64u * 1024u;
+        while(cap < end) cap *= 2;
+        uint8_t* p = (uint8_t*)realloc(b->data, cap);
+        if(!p){ b->oom = true; return 0; }
+        b->data = p;
+        b->cap = cap;
+    }
+    memset(b->data + b->len, 0, end - b->len);
+    b->len = end;
+    return off;
+}
+
+static void img_set_ptr(ImgBuf* b, uint64_t slot, uint64_t target)
+{
+    if(b->oom) return;
+    uintptr_t v = (uintptr_t)target;
+    memcpy(b->data + slot, &v, sizeof(v));
+    if(!brz_vec_push(&b->relocs, &slot)) b->oom = true;
+}
+
+static void img_set_null(ImgBuf* b, uint64_t slot)
+{
+    if(b->oom) return;
+    memset(b->data + slot, 0, sizeof(void*));
+}
+
+static size_t img_ptr_hash(const void* p, size_t mask)
+{
+    uint64_t h = (uint64_t)(uintptr_t)p * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) & mask;
+}
+
+static bool img_map_grow(ImgBuf* b)
+{
+    size_t cap = b->map_cap ? b->map_cap * 2 : 1024;
+    const char** key = (const char**)calloc(cap, sizeof(char*));
+    uint64_t* off = (uint64_t*)malloc(cap * sizeof(uint64_t));
+    if(!key || !off){ free((void*)key); free(off); return false; }
+    for(size_t i=0;i<b->map_cap;i++)
+    {
+        if(!b->map_key[i]) continue;
+        size_t j = img_ptr_hash(b->map_key[i], cap - 1);
+        while(key[j]) j = (j + 1) & (cap - 1);
+        key[j] = b->map_key[i];
+        off[j] = b->map_off[i];
+    }
+    free((void*)b->map_key);
+    free(b->map_off);
+    b->map_key = key;
+    b->map_off = off;
+    b->map_cap = cap;
+    return true;
+}
+
+/* offset of the one copy of s in the block; strings are shared by
+   pointer, as interned strings are */
+static uint64_t img_string(ImgBuf* b, const char* s)
+{
+    if(b->oom) return 0;
+    if((b->map_n + 1) * 2 > b->map_cap && !img_map_grow(b)){ b->oom = true; return 0; }
+    size_t mask = b->map_cap - 1;
+    size_t i = img_ptr_hash(s, mask);
+    while(b->map_key[i])
+    {
+        if(b->map_key[i] == s) return b->map_off[i];
+        i = (i + 1) & mask;
+    }
+    size_t n = strlen(s);
+    uint64_t off = img_alloc(b, n + 1, 1);
+    if(b->oom) return 0;
+    memcpy(b->data + off, s, n + 1);
+    b->map_key[i] = s;
+    b->map_off[i] = off;
+    b->map_n++;
+    return off;
+}
+
+static void img_str_field(ImgBuf* b, uint64_t slot, const char* s)
+{
+    if(!s){ img_set_null(b, slot); return; }
+    uint64_t off = img_string(b, s);
+    img_set_ptr(b, slot, off);
+}
+
+/* copies v's elements and writes its header at slot; returns the offset
+   of the elements for the caller to fix up */
+static uint64_t img_vec(ImgBuf* b, uint64_t slot, const BrzVec* v)
+{
+    uint64_t data = 0;
+    size_t bytes = v->len * v->elem_size;
+    if(v->len)
+    {
+        data = img_alloc(b, bytes, IMG_ALIGN);
+        if(b->oom) return 0;
+        memcpy(b->data + data, v->data, bytes);
+    }
+    BrzVec h;
+    memset(&h, 0, sizeof(h));
+    h.len = h.cap = v->len;
+    h.elem_size = v->elem_size;
+    memcpy(b->data + slot, &h, sizeof(h));
+    if(v->len) img_set_ptr(b, slot + offsetof(BrzVec, data), data);
+    uint64_t owner = slot + offsetof(BrzVec, arena);
+    if(!b->oom && !brz_vec_push(&b->owners, &owner)) b->oom = true;
+    return data;
+}
+
+static void img_expr(ImgBuf* b, uint64_t slot, const BrzExpr* e)
+{
+    if(e->len <= 0 || !e->code)
+    {
+        img_set_null(b, slot + offsetof(BrzExpr, code));
+        return;
+    }
+    size_t bytes = (size_t)e->len * sizeof(BrzExprIns);
+    uint64_t off = img_alloc(b, bytes, IMG_ALIGN);
+    if(b->oom) return;
+    memcpy(b->data + off, e->code, bytes);
+    img_set_ptr(b, slot + offsetof(BrzExpr, code), off);
+}
+
+static void img_stmts(ImgBuf* b, uint64_t slot, const BrzVec* stmts)
+{
+    uint64_t data = img_vec(b, slot, stmts);
+    for(size_t i=0;i<stmts->len && !b->oom;i++)
+    {
+        const StmtDef* st = (const StmtDef*)brz_vec_cat(stmts, i);
+        uint64_t at = data + i * sizeof(StmtDef);
+        switch(st->kind)
+        {
+            case ST_OP:
+                img_str_field(b, at + offsetof(StmtDef, as.op.op), st->as.op.op);
+                img_str_field(b, at + offsetof(StmtDef, as.op.a0), st->as.op.a0);
+                img_str_field(b, at + offsetof(StmtDef, as.op.a1), st->as.op.a1);
+                img_str_field(b, at + offsetof(StmtDef, as.op.a2), st->as.op.a2);
+                break;
+            case ST_CHANCE:
+                img_stmts(b, at + offsetof(StmtDef, as.chance.body), &st->as.chance.body);
+                break;
+            case ST_WHEN:
+                img_str_field(b, at + offsetof(StmtDef, as.when_stmt.when_expr), st->as.when_stmt.when_expr);
+                img_expr(b, at + offsetof(StmtDef, as.when_stmt.prog), &st->as.when_stmt.prog);
+                img_stmts(b, at + offsetof(StmtDef, as.when_stmt.body), &st->as.when_stmt.body);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void img_vocation(ImgBuf* b, uint64_t at, const VocationDef* v)
+{
+    img_str_field(b, at + offsetof(VocationDef, name), v->name);
+    uint64_t rules = img_vec(b, at + offsetof(VocationDef, rules), &v->rules);
+    uint64_t tasks = img_vec(b, at + offsetof(VocationDef, tasks), &v->tasks);
+    img_vec(b, at + offsetof(VocationDef, thresholds), &v->thresholds);
+    img_vec(b, at + offsetof(VocationDef, run_rules), &v->run_rules);
+    img_vec(b, at + offsetof(VocationDef, always), &v->always);
+    for(size_t i=0;i<v->rules.len && !b->oom;i++)
+    {
+        const RuleDef* r = (const RuleDef*)brz_vec_cat(&v->rules, i);
+        uint64_t rat = rules + i * sizeof(RuleDef);
+        img_str_field(b, rat + offsetof(RuleDef, name), r->name);
+        img_str_field(b, rat + offsetof(RuleDef, when_expr), r->when_expr);
+        img_str_field(b, rat + offsetof(RuleDef, do_task), r->do_task);
+        img_expr(b, rat + offsetof(RuleDef, when_prog), &r->when_prog);
+        const TaskDef* t0 = (const TaskDef*)v->tasks.data;
+        if(r->task && r->task >= t0 && r->task < t0 + v->tasks.len)
+            img_set_ptr(b, rat + offsetof(RuleDef, task), tasks + (uint64_t)(r->task - t0) * sizeof(TaskDef));
+        else
+            img_set_null(b, rat + offsetof(RuleDef, task));
+    }
+    for(size_t i=0;i<v->tasks.len && !b->oom;i++)
+    {
+        const TaskDef* t = (const TaskDef*)brz_vec_cat(&v->tasks, i);
+        uint64_t tat = tasks + i * sizeof(TaskDef);
+        img_str_field(b, tat + offsetof(TaskDef, name), t->name);
+        img_stmts(b, tat + offsetof(TaskDef, stmts), &t->stmts);
+    }
+}
+
+static void img_names(ImgBuf* b, uint64_t slot, const KindTable* kt)
+{
+    size_t n = kind_table_count(kt);
+    if(n == 0){ img_set_null(b, slot); return; }
+    uint64_t arr = img_alloc(b, n * sizeof(char*), IMG_ALIGN);
+    for(size_t i=0;i<n && !b->oom;i++)
+        img_str_field(b, arr + i * sizeof(char*), kind_table_name(kt, (int)i));
+    img_set_ptr(b, slot, arr);
+}
+
+static void img_build(ImgBuf* b, const ParsedConfig* cfg)
+{
+    uint64_t root = img_alloc(b, sizeof(ImgRoot), IMG_ALIGN);
+    if(b->oom) return;
+    ImgRoot r;
+    memset(&r, 0, sizeof(r));
+    r.seed = cfg->seed;
+    r.years = cfg->years;
+    r.agent_count = cfg->agent_count;
+    r.settlement_count = cfg->settlement_count;
+    r.known = cfg->known;
+    r.res_n = kind_table_count(&cfg->resource_kinds);
+    r.item_n = kind_table_count(&cfg->item_kinds);
+    r.string_n = cfg->strings.n;
+    r.has_recipes = cfg->has_recipes;
+    memcpy(b->data + root, &r, sizeof(r));
+
+    /* interned strings first, so they sit together at the front */
+    if(cfg->strings.n)
+    {
+        uint64_t slots = img_alloc(b, cfg->strings.n * sizeof(BrzStrSlot), IMG_ALIGN);
+        size_t k = 0;
+        for(size_t i=0;i<cfg->strings.cap && !b->oom;i++)
+        {
+            const BrzStrSlot* s = &cfg->strings.slots[i];
+            if(!s->s) continue;
+            uint64_t at = slots + k++ * sizeof(BrzStrSlot);
+            memcpy(b->data + at, s, sizeof(*s));
+            img_str_field(b, at + offsetof(BrzStrSlot, s), s->s);
+        }
+        img_set_ptr(b, root + offsetof(ImgRoot, strings), slots);
+    }
+    img_names(b, root + offsetof(ImgRoot, res_names), &cfg->resource_kinds);
+    img_names(b, root + offsetof(ImgRoot, item_names), &cfg->item_kinds);
+
+    uint64_t params = img_vec(b, root + offsetof(ImgRoot, params), &cfg->params);
+    for(size_t i=0;i<cfg->params.len && !b->oom;i++)
+    {
+        const ParamDef* p = (const ParamDef*)brz_vec_cat(&cfg->params, i);
+        uint64_t at = params + i * sizeof(ParamDef);
+        img_str_field(b, at + offsetof(ParamDef, key), p->key);
+        img_str_field(b, at + offsetof(ParamDef, svalue), p->svalue);
+    }
+
+    uint64_t warnings = img_vec(b, root + offsetof(ImgRoot, warnings), &cfg->warnings);
+    for(size_t i=0;i<cfg->warnings.len && !b->oom;i++)
+        img_str_field(b, warnings + i * sizeof(char*), *(const char* const*)brz_vec_cat(&cfg->warnings, i));
+
+    uint64_t recipes = img_vec(b, root + offsetof(ImgRoot, recipes), &cfg->recipes);
+    for(size_t i=0;i<cfg->recipes.len && !b->oom;i++)
+    {
+        const RecipeDef* rd = (const RecipeDef*)brz_vec_cat(&cfg->recipes, i);
+        uint64_t at = recipes + i * sizeof(RecipeDef);
+        img_str_field(b, at + offsetof(RecipeDef, item), rd->item);
+        img_str_field(b, at + offsetof(RecipeDef, makes), rd->makes);
+    }
+    uint64_t inputs = img_vec(b, root + offsetof(ImgRoot, recipe_in), &cfg->recipe_in);
+    for(size_t i=0;i<cfg->recipe_in.len && !b->oom;i++)
+        img_str_field(b, inputs + i * sizeof(RecipeInput) + offsetof(RecipeInput, name),
+                      ((const RecipeInput*)brz_vec_cat(&cfg->recipe_in, i))->name);
+    img_vec(b, root + offsetof(ImgRoot, recipe_of), &cfg->recipe_of);
+
+    uint64_t vocs = img_vec(b, root + offsetof(ImgRoot, vocations), &cfg->vocations);
+    for(size_t i=0;i<cfg->vocations.len && !b->oom;i++)
+        img_vocation(b, vocs + i * sizeof(VocationDef), (const VocationDef*)brz_vec_cat(&cfg->vocations, i));
+}
+
+bool brz_cfg_image_write(const ParsedConfig* cfg, uint64_t src_hash, uint64_t src_len,
+                         const char* path, char* err, size_t err_n)
+{
+    if(!cfg || !path) return img_fail(err, err_n, "no config or path");
+
+    ImgBuf b;
+    memset(&b, 0, sizeof(b));
+    brz_vec_init(&b.relocs, sizeof(uint64_t));
+    brz_vec_init(&b.owners, sizeof(uint64_t));
+    img_build(&b, cfg);
+
+    bool ok = !b.oom;
+    if(!ok) img_fail(err, err_n, "out of memory");
+    if(ok)
+    {
+        ImgHeader hd;
+        memset(&hd, 0, sizeof(hd));
+        memcpy(hd.magic, k_img_magic, sizeof(hd.magic));
+        hd.version = BRZ_CFG_IMAGE_VERSION;
+        hd.byte_order = IMG_BYTE_ORDER;
+        hd.layout = img_layout();
+        hd.src_hash = src_hash;
+        hd.src_len = src_len;
+        hd.image_size = b.len;
+        hd.reloc_n = b.relocs.len;
+        hd.owner_n = b.owners.len;
+        hd.block_sum = brz_hash64(b.data, b.len);
+        /* the two tables are read back as one array */
+        ok = brz_vec_reserve(&b.relocs, b.relocs.len + b.owners.len);
+        if(ok && b.owners.len)
+            memcpy((uint64_t*)b.relocs.data + b.relocs.len, b.owners.data, b.owners.len * sizeof(uint64_t));
+        size_t table_n = b.relocs.len + b.owners.len;
+        if(!ok) img_fail(err, err_n, "out of memory");
+        else
+        {
+            hd.table_sum = brz_hash64(b.relocs.data, table_n * sizeof(uint64_t));
+            FILE* f = fopen(path, "wb");
+            if(!f) ok = img_fail(err, err_n, "cannot open for writing");
+            else
+            {
+                ok = fwrite(&hd, sizeof(hd), 1, f) == 1 &&
+                     fwrite(b.data, 1, b.len, f) == b.len &&
+                     (table_n == 0 || fwrite(b.relocs.data, sizeof(uint64_t), table_n, f) == table_n);
+                ok = (fclose(f) == 0) && ok;
+                if(!ok){ remove(path); img_fail(err, err_n, "write failed"); }
+            }
+        }
+    }
+
+    free(b.data);
+    free((void*)b.map_key);
+    free(b.map_off);
+    brz_vec_destroy(&b.relocs);
+    brz_vec_destroy(&b.owners);
+    return ok;
+}
+
+/* ---------------- load ---------------- */
+
+static bool img_adopt(ParsedConfig* cfg, const ImgRoot* r)
+{
+    for(size_t i=0;i<r->res_n;i++)
+        if(kind_table_add(&cfg->resource_kinds, r->res_names[i]) != (int)i) return false;
+    for(size_t i=0;i<r->item_n;i++)
+        if(kind_table_add(&cfg->item_kinds, r->item_names[i]) != (int)i) return false;
+    for(size_t i=0;i<r->string_n;i++)
+        if(!brz_strtab_adopt(&cfg->strings, r->strings[i].s, r->strings[i].len)) return false;
+    return true;
+}
+
+/* back to an empty config after a failed load (the block stays in the arena) */
+static void img_unadopt(ParsedConfig* cfg)
+{
+    brz_vec_init_arena(&cfg->params, sizeof(ParamDef), &cfg->arena);
+    brz_vec_init_arena(&cfg->vocations, sizeof(VocationDef), &cfg->arena);
+    brz_vec_init_arena(&cfg->warnings, sizeof(const char*), &cfg->arena);
+    brz_vec_init_arena(&cfg->recipes, sizeof(RecipeDef), &cfg->arena);
+    brz_vec_init_arena(&cfg->recipe_in, sizeof(RecipeInput), &cfg->arena);
+    brz_vec_init_arena(&cfg->recipe_of, sizeof(int32_t), &cfg->arena);
+    cfg->has_recipes = false;
+    kind_table_destroy(&cfg->resource_kinds);
+    kind_table_destroy(&cfg->item_kinds);
+    kind_table_init(&cfg->resource_kinds);
+    kind_table_init(&cfg->item_kinds);
+    brz_strtab_destroy(&cfg->strings);
+}
+
+bool brz_cfg_image_load(ParsedConfig* cfg, const char* path, uint64_t src_hash, uint64_t src_len,
+                        char* err, size_t err_n)
+{
+    if(!cfg || !path) return img_fail(err, err_n, "no config or path");
+    FILE* f = fopen(path, "rb");
+    if(!f) return img_fail(err, err_n, "cannot open");
+
+    ImgHeader hd;
+    bool ok = fread(&hd, sizeof(hd), 1, f) == 1;
+    if(!ok) img_fail(err, err_n, "truncated header");
+    else if(memcmp(hd.magic, k_img_magic, sizeof(hd.magic)) != 0) ok = img_fail(err, err_n, "not a config image");
+    else if(hd.version != BRZ_CFG_IMAGE_VERSION) ok = img_fail(err, err_n, "image version differs");
+    else if(hd.byte_order != IMG_BYTE_ORDER || hd.layout != img_layout())
+        ok = img_fail(err, err_n, "image was built by an incompatible binary");
+    else if(hd.src_hash != src_hash || hd.src_len != src_len)
+        ok = img_fail(err, err_n, "source changed since the image was built");
+    else if(hd.image_size < sizeof(ImgRoot) || hd.image_size > ((uint64_t)1 << 40) ||
+            hd.reloc_n > hd.image_size / sizeof(void*) || hd.owner_n > hd.image_size / sizeof(BrzVec))
+        ok = img_fail(err, err_n, "bad image header");
+    if(!ok){ fclose(f); return false; }
+
+    size_t size = (size_t)hd.image_size;
+    size_t table_n = (size_t)(hd.reloc_n + hd.owner_n);
+    uint8_t* base = (uint8_t*)brz_arena_alloc(&cfg->arena, size);
+    uint64_t* table = (uint64_t*)malloc((table_n ? table_n : 1) * sizeof(uint64_t));
+    if(!base || !table) ok = img_fail(err, err_n, "out of memory");
+    else if(fread(base, 1, size, f) != size || fread(table, sizeof(uint64_t), table_n, f) != table_n)
+        ok = img_fail(err, err_n, "truncated image");
+    else if(brz_hash64(base, size) != hd.block_sum || brz_hash64(table, table_n * sizeof(uint64_t)) != hd.table_sum)
+        ok = img_fail(err, err_n, "checksum mismatch");
+    fclose(f);
+
+    /* rebase: every listed slot holds an offset into the block */
+    for(size_t i=0;ok && i<table_n;i++)
+    {
+        uint64_t off = table[i];
+        if(off % sizeof(void*) != 0 || off > size - sizeof(void*)){ ok = img_fail(err, err_n, "bad relocation"); break; }
+        uintptr_t v;
+        if(i < hd.reloc_n)
+        {
+            memcpy(&v, base + off, sizeof(v));
+            if(v >= size){ ok = img_fail(err, err_n, "bad relocation"); break; }
+            v = (uintptr_t)(base + v);
+        }
+        else v = (uintptr_t)&cfg->arena;
+        memcpy(base + off, &v, sizeof(v));
+    }
+    free(table);
+    if(!ok) return false;
+
+    ImgRoot r;
+    memcpy(&r, base, sizeof(r));
+    if(!img_adopt(cfg, &r))
+    {
+        img_unadopt(cfg);
+        return img_fail(err, err_n, "out of memory");
+    }
+    cfg->seed = r.seed;
+    cfg->years = r.years;
+    cfg->agent_count = r.agent_count;
+    cfg->settlement_count = r.settlement_count;
+    cfg->known = r.known;
+    cfg->params = r.params;
+    cfg->vocations = r.vocations;
+    cfg->warnings = r.warnings;
+    cfg->recipes = r.recipes;
+    cfg->recipe_in = r.recipe_in;
+    cfg->recipe_of = r.recipe_of;
+    cfg->has_recipes = r.has_recipes;
+    if(!brz_cfg_reindex_params(cfg))
+    {
+        img_unadopt(cfg);
+        return img_fail(err, err_n, "out of memory");
+    }
+
+    for(size_t i=0;i<cfg->warnings.len;i++)
+        fprintf(stderr, "%s\n", *(const char* const*)brz_vec_cat(&cfg->warnings, i));
+    return true;
+}
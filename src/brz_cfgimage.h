@@ -0,0 +1,44 @@
+#ifndef BRZ_CFGIMAGE_H
+#define BRZ_CFGIMAGE_H
+
+#include "brz_dsl.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * brz_cfgimage.h/.c - precompiled config images (.bronzec)
+ *
+ * An image is the linked ParsedConfig written out as one relocatable
+ * block: params, vocations with their tasks, rules and statements, the
+ * recipe tables, the compiled 'when' programs, kind names, the interned
+ * strings and the link warnings. Every pointer in the block is stored as
+ * an offset from its start and listed in a relocation table. Loading
+ * reads the block into the config arena in one piece, adds the base
+ * address to each listed slot and rebuilds the kind and string tables;
+ * nothing is lexed, parsed or compiled.
+ *
+ * The header records the hash and length of the source the image was
+ * built from, and a fingerprint of the struct layout. An image whose
+ * source or layout differs is refused, so callers can fall back to
+ * parsing (brz_parse_file does this transparently).
+ *
+ * Bump BRZ_CFG_IMAGE_VERSION whenever the parser or brz_cfg_link produce
+ * different results for the same source.
+ */
+
+#define BRZ_CFG_IMAGE_VERSION 4u
+
+uint64_t brz_cfg_source_hash(const char* src, size_t n);
+
+/* cfg must be linked; src_hash/src_len identify the source it came from */
+bool brz_cfg_image_write(const ParsedConfig* cfg, uint64_t src_hash, uint64_t src_len,
+                         const char* path, char* err, size_t err_n);
+
+/* cfg must be freshly initialized. On success the link warnings stored in
+   the image are printed to stderr again. On failure err holds the reason
+   and cfg is still empty (the arena may hold an unused block). */
+bool brz_cfg_image_load(ParsedConfig* cfg, const char* path, uint64_t src_hash, uint64_t src_len,
+                        char* err, size_t err_n);
+
+#endif /* BRZ_CFGIMAGE_H */
@@ -0,0 +1,482 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L /* fileno, mmap */
+#endif
+#include "brz_checkpoint.h"
+#include "brz_kinds.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define CK_ALIGN 64u
+#define CK_BYTE_ORDER 0x01020304u
+
+static const char k_ck_magic[8] = { 'B','R','Z','C','K','P','T',0 };
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;  /* CK_BYTE_ORDER as written by the saving host */
+    uint32_t res_size;    /* sizeof(brz_res_t) */
+    uint32_t section_n;
+    int32_t  day;
+    uint32_t rng_state;
+    int32_t  w, h;
+    uint32_t res_n, item_n, voc_n, sett_n, agent_n;
+    uint32_t sea_level;
+    uint64_t dirty_n;
+} CkHeader;
+
+typedef struct {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+} CkSection;
+
+typedef enum {
+    CK_NAMES = 1,     /* res, item, voc names, each NUL terminated */
+    CK_TAGS,
+    CK_HEIGHT,
+    CK_RES,
+    CK_CAP,
+    CK_DIRTY,
+    CK_SETT_NAME,
+    CK_SETT_POS,
+    CK_SETT_POP,
+    CK_SETT_RES,
+    CK_SETT_ITEM,
+    CK_AG_POS,
+    CK_AG_TARGET,
+    CK_AG_HAS_TARGET,
+    CK_AG_HOME,
+    CK_AG_VOC,
+    CK_AG_HUNGER,
+    CK_AG_FATIGUE,
+    CK_AG_RES,
+    CK_AG_ITEM,
+    CK_SECTION_COUNT
+} CkSectionId;
+
+typedef struct {
+    const void* data;
+    size_t size;
+} CkBlob;
+
+static uint64_t ck_align(uint64_t v)
+{
+    return (v + CK_ALIGN - 1u) & ~(uint64_t)(CK_ALIGN - 1u);
+}
+
+/* ---------------- save ---------------- */
+
+static bool ck_append_name(char** buf, size_t* len, size_t* cap, const char* s)
+{
+    size_t n = strlen(s ? s : "") + 1;
+    if(*len + n > *cap){
+        size_t nc = *cap ? *cap * 2 : 256;
+        while(nc < *len + n) nc *= 2;
+        char* nb = (char*)realloc(*buf, nc);
+        if(!nb) return false;
+        *buf = nb;
+        *cap = nc;
+    }
+    memcpy(*buf + *len, s ? s : "", n);
+    *len += n;
+    return true;
+}
+
+static char* ck_names(const ParsedConfig* cfg, size_t* out_len)
+{
+    char* buf = NULL;
+    size_t len = 0, cap = 0;
+    bool ok = true;
+    size_t rn = kind_table_count(&cfg->resource_kinds), in = kind_table_count(&cfg->item_kinds);
+    for(size_t i=0;i<rn && ok;i++) ok = ck_append_name(&buf, &len, &cap, kind_table_name(&cfg->resource_kinds, (int)i));
+    for(size_t i=0;i<in && ok;i++) ok = ck_append_name(&buf, &len, &cap, kind_table_name(&cfg->item_kinds, (int)i));
+    for(size_t i=0;i<cfg->vocations.len && ok;i++){
+        const VocationDef* v = (const VocationDef*)brz_vec_cat(&cfg->vocations, i);
+        ok = ck_append_name(&buf, &len, &cap, v->name);
+    }
+    if(!ok || !buf){ free(buf); return NULL; }
+    *out_len = len;
+    return buf;
+}
+
+bool brz_sim_checkpoint_save(const BrzSim* sim, const char* path)
+{
+    const ParsedConfig* cfg = sim->cfg;
+    const BrzWorld* w = &sim->world;
+    const BrzAgentStore* a = &sim->agents;
+    const size_t tiles = (size_t)w->w * (size_t)w->h;
+    const size_t res_n = kind_table_count(&cfg->resource_kinds);
+    const size_t item_n = kind_table_count(&cfg->item_kinds);
+    const size_t sn = (size_t)sim->sett_n, an = (size_t)a->n;
+    if(w->chunks) return false; /* only flat worlds have whole planes to write */
+
+    /* settlements keep per-settlement inventories; gather them into columns */
+    size_t names_len = 0;
+    char* names = ck_names(cfg, &names_len);
+    char*    s_name = (char*)calloc(sn ? sn : 1, 64);
+    BrzPos*  s_pos  = (BrzPos*)calloc(sn ? sn : 1, sizeof(BrzPos));
+    int32_t* s_pop  = (int32_t*)calloc(sn ? sn : 1, sizeof(int32_t));
+    double*  s_res  = (double*)calloc(sn*res_n > 0 ? sn*res_n : 1, sizeof(double));
+    double*  s_item = (double*)calloc(sn*item_n > 0 ? sn*item_n : 1, sizeof(double));
+    /* a cap table is written out as the cap planes it stands for */
+    brz_res_t* caps = w->cap;
+    if(!caps){
+        caps = (brz_res_t*)malloc(tiles*res_n > 0 ? tiles*res_n*sizeof(brz_res_t) : 1);
+        if(caps){
+            for(size_t r=0;r<res_n;r++)
+                for(size_t t=0;t<tiles;t++) caps[r*tiles + t] = brz_world_cap_tile(w, t, (int)r);
+        }
+    }
+    bool ok = names && s_name && s_pos && s_pop && s_res && s_item && caps;
+    if(ok){
+        for(size_t i=0;i<sn;i++){
+            memcpy(s_name + i*64, sim->setts[i].name, 64);
+            s_pos[i] = sim->setts[i].pos;
+            s_pop[i] = sim->setts[i].population;
+            if(res_n) memcpy(&s_res[i*res_n], sim->setts[i].res_inv, res_n*sizeof(double));
+            if(item_n) memcpy(&s_item[i*item_n], sim->setts[i].item_inv, item_n*sizeof(double));
+        }
+    }
+
+    CkBlob blobs[CK_SECTION_COUNT];
+    memset(blobs, 0, sizeof(blobs));
+    blobs[CK_NAMES]         = (CkBlob){ names, names_len };
+    blobs[CK_TAGS]          = (CkBlob){ w->tags, tiles*sizeof(uint16_t) };
+    blobs[CK_HEIGHT]        = (CkBlob){ w->height, tiles };
+    blobs[CK_RES]           = (CkBlob){ w->res, tiles*res_n*sizeof(brz_res_t) };
+    blobs[CK_CAP]           = (CkBlob){ caps, tiles*res_n*sizeof(brz_res_t) };
+    blobs[CK_DIRTY]         = (CkBlob){ w->dirty, w->dirty_n*sizeof(uint32_t) };
+    blobs[CK_SETT_NAME]     = (CkBlob){ s_name, sn*64 };
+    blobs[CK_SETT_POS]      = (CkBlob){ s_pos, sn*sizeof(BrzPos) };
+    blobs[CK_SETT_POP]      = (CkBlob){ s_pop, sn*sizeof(int32_t) };
+    blobs[CK_SETT_RES]      = (CkBlob){ s_res, sn*res_n*sizeof(double) };
+    blobs[CK_SETT_ITEM]     = (CkBlob){ s_item, sn*item_n*sizeof(double) };
+    blobs[CK_AG_POS]        = (CkBlob){ a->pos, an*sizeof(BrzPos) };
+    blobs[CK_AG_TARGET]     = (CkBlob){ a->target, an*sizeof(BrzPos) };
+    blobs[CK_AG_HAS_TARGET] = (CkBlob){ a->has_target, an };
+    blobs[CK_AG_HOME]       = (CkBlob){ a->home, an*sizeof(int32_t) };
+    blobs[CK_AG_VOC]        = (CkBlob){ a->voc, an*sizeof(uint32_t) };
+    blobs[CK_AG_HUNGER]     = (CkBlob){ a->hunger, an*sizeof(double) };
+    blobs[CK_AG_FATIGUE]    = (CkBlob){ a->fatigue, an*sizeof(double) };
+    blobs[CK_AG_RES]        = (CkBlob){ a->res, an*res_n*sizeof(double) };
+    blobs[CK_AG_ITEM]       = (CkBlob){ a->item, an*item_n*sizeof(double) };
+
+    CkHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, k_ck_magic, sizeof(hd.magic));
+    hd.version = BRZ_CHECKPOINT_VERSION;
+    hd.byte_order = CK_BYTE_ORDER;
+    hd.res_size = (uint32_t)sizeof(brz_res_t);
+    hd.section_n = CK_SECTION_COUNT - 1;
+    hd.day = sim->day;
+    hd.rng_state = sim->rng.state;
+    hd.w = w->w;
+    hd.h = w->h;
+    hd.res_n = (uint32_t)res_n;
+    hd.item_n = (uint32_t)item_n;
+    hd.voc_n = (uint32_t)cfg->vocations.len;
+    hd.sett_n = (uint32_t)sn;
+    hd.agent_n = (uint32_t)an;
+    hd.sea_level = w->sea_level;
+    hd.dirty_n = w->dirty_n;
+
+    CkSection table[CK_SECTION_COUNT - 1];
+    uint64_t at = ck_align(sizeof(hd) + sizeof(table));
+    for(int id=1; id<CK_SECTION_COUNT; id++){
+        CkSection* sec = &table[id-1];
+        sec->id = (uint32_t)id;
+        sec->reserved = 0;
+        sec->offset = at;
+        sec->size = blobs[id].size;
+        at = ck_align(at + sec->size);
+    }
+
+    /* write next to the target and rename, so a crash never leaves a torn file */
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = ok ? fopen(tmp, "wb") : NULL;
+    if(f){
+        static const uint8_t zeros[CK_ALIGN] = { 0 };
+        uint64_t pos = 0;
+        ok = fwrite(&hd, sizeof(hd), 1, f) == 1 && fwrite(table, sizeof(table), 1, f) == 1;
+        pos = sizeof(hd) + sizeof(table);
+        for(int id=1; ok && id<CK_SECTION_COUNT; id++){
+            const CkSection* sec = &table[id-1];
+            size_t pad = (size_t)(sec->offset - pos);
+            if(pad && fwrite(zeros, 1, pad, f) != pad) ok = false;
+            if(ok && sec->size && fwrite(blobs[id].data, 1, (size_t)sec->size, f) != sec->size) ok = false;
+            pos = sec->offset + sec->size;
+        }
+        if(fclose(f) != 0) ok = false;
+        if(ok && rename(tmp, path) != 0) ok = false;
+        if(!ok) remove(tmp);
+    }else{
+        ok = false;
+    }
+
+    free(names);
+    free(s_name);
+    free(s_pos);
+    free(s_pop);
+    free(s_res);
+    free(s_item);
+    if(caps != w->cap) free(caps);
+    return ok;
+}
+
+/* ---------------- load ---------------- */
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    void* map;       /* mmap base, or NULL when data was read into memory */
+    size_t map_size;
+} CkFile;
+
+static bool ck_open(CkFile* cf, const char* path)
+{
+    memset(cf, 0, sizeof(*cf));
+#if !defined(_WIN32)
+    FILE* f = fopen(path, "rb");
+    if(!f) return false;
+    struct stat st;
+    if(fstat(fileno(f), &st) == 0 && st.st_size > 0){
+        void* m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if(m != MAP_FAILED){
+            cf->map = m;
+            cf->map_size = (size_t)st.st_size;
+            cf->data = (const uint8_t*)m;
+            cf->size = (size_t)st.st_size;
+            fclose(f);
+            return true;
+        }
+    }
+    fclose(f);
+#endif
+    size_t n = 0;
+    char* buf = brz_read_entire_file(path, &n);
+    if(!buf) return false;
+    cf->data = (const uint8_t*)buf;
+    cf->size = n;
+    return true;
+}
+
+static void ck_close(CkFile* cf)
+{
+#if !defined(_WIN32)
+    if(cf->map){
+        munmap(cf->map, cf->map_size);
+        memset(cf, 0, sizeof(*cf));
+        return;
+    }
+#endif
+    free((void*)cf->data);
+    memset(cf, 0, sizeof(*cf));
+}
+
+static bool ck_fail(char* err, size_t err_n, const char* msg)
+{
+    if(err && err_n) snprintf(err, err_n, "%s", msg);
+    return false;
+}
+
+/* next NUL-terminated name from the names section, or NULL when exhausted */
+static const char* ck_next_name(const char** p, const char* end)
+{
+    if(*p >= end) return NULL;
+    const char* s = *p;
+    const char* z = (const char*)memchr(s, 0, (size_t)(end - s));
+    if(!z) return NULL;
+    *p = z + 1;
+    return s;
+}
+
+static bool ck_check_names(const ParsedConfig* cfg, const char* names, size_t len,
+                           char* err, size_t err_n)
+{
+    const char* p = names;
+    const char* end = names + len;
+    for(size_t i=0;i<kind_table_count(&cfg->resource_kinds);i++){
+        const char* nm = ck_next_name(&p, end);
+        const char* want = kind_table_name(&cfg->resource_kinds, (int)i);
+        if(!nm || strcmp(nm, want ? want : "") != 0) return ck_fail(err, err_n, "resource kinds differ from the config");
+    }
+    for(size_t i=0;i<kind_table_count(&cfg->item_kinds);i++){
+        const char* nm = ck_next_name(&p, end);
+        const char* want = kind_table_name(&cfg->item_kinds, (int)i);
+        if(!nm || strcmp(nm, want ? want : "") != 0) return ck_fail(err, err_n, "item kinds differ from the config");
+    }
+    for(size_t i=0;i<cfg->vocations.len;i++){
+        const char* nm = ck_next_name(&p, end);
+        const VocationDef* v = (const VocationDef*)brz_vec_cat(&cfg->vocations, i);
+        if(!nm || strcmp(nm, v->name ? v->name : "") != 0) return ck_fail(err, err_n, "vocations differ from the config");
+    }
+    return true;
+}
+
+static bool ck_load_image(BrzSim* sim, const ParsedConfig* cfg, const CkFile* cf,
+                          char* err, size_t err_n)
+{
+    CkHeader hd;
+    if(cf->size < sizeof(hd)) return ck_fail(err, err_n, "not a bronzesim checkpoint");
+    memcpy(&hd, cf->data, sizeof(hd));
+    if(memcmp(hd.magic, k_ck_magic, sizeof(hd.magic)) != 0) return ck_fail(err, err_n, "not a bronzesim checkpoint");
+    if(hd.version != BRZ_CHECKPOINT_VERSION) return ck_fail(err, err_n, "unsupported checkpoint version");
+    if(hd.byte_order != CK_BYTE_ORDER) return ck_fail(err, err_n, "checkpoint was written on a host with another byte order");
+    if(hd.res_size != sizeof(brz_res_t)) return ck_fail(err, err_n, "checkpoint resource grid type differs from this build (RES_FLOAT)");
+
+    const size_t res_n = kind_table_count(&cfg->resource_kinds);
+    const size_t item_n = kind_table_count(&cfg->item_kinds);
+    if(hd.res_n != res_n || hd.item_n != item_n || hd.voc_n != cfg->vocations.len)
+        return ck_fail(err, err_n, "kinds or vocations differ from the config");
+    if(hd.w <= 0 || hd.h <= 0 || hd.section_n < CK_SECTION_COUNT - 1)
+        return ck_fail(err, err_n, "corrupt checkpoint header");
+    const size_t tiles = (size_t)hd.w * (size_t)hd.h;
+    const size_t sn = hd.sett_n, an = hd.agent_n;
+    if(hd.dirty_n > tiles) return ck_fail(err, err_n, "corrupt checkpoint header");
+
+    /* expected size of every section */
+    uint64_t want[CK_SECTION_COUNT];
+    memset(want, 0, sizeof(want));
+    want[CK_TAGS] = tiles*sizeof(uint16_t);
+    want[CK_HEIGHT] = tiles;
+    want[CK_RES] = want[CK_CAP] = tiles*res_n*sizeof(brz_res_t);
+    want[CK_DIRTY] = hd.dirty_n*sizeof(uint32_t);
+    want[CK_SETT_NAME] = sn*64;
+    want[CK_SETT_POS] = sn*sizeof(BrzPos);
+    want[CK_SETT_POP] = sn*sizeof(int32_t);
+    want[CK_SETT_RES] = sn*res_n*sizeof(double);
+    want[CK_SETT_ITEM] = sn*item_n*sizeof(double);
+    want[CK_AG_POS] = want[CK_AG_TARGET] = an*sizeof(BrzPos);
+    want[CK_AG_HAS_TARGET] = an;
+    want[CK_AG_HOME] = an*sizeof(int32_t);
+    want[CK_AG_VOC] = an*sizeof(uint32_t);
+    want[CK_AG_HUNGER] = want[CK_AG_FATIGUE] = an*sizeof(double);
+    want[CK_AG_RES] = an*res_n*sizeof(double);
+    want[CK_AG_ITEM] = an*item_n*sizeof(double);
+
+    const uint8_t* sec[CK_SECTION_COUNT];
+    uint64_t sec_size[CK_SECTION_COUNT];
+    memset(sec, 0, sizeof(sec));
+    memset(sec_size, 0, sizeof(sec_size));
+    if((uint64_t)cf->size < sizeof(hd) + (uint64_t)hd.section_n*sizeof(CkSection))
+        return ck_fail(err, err_n, "truncated checkpoint");
+    for(uint32_t i=0;i<hd.section_n;i++){
+        CkSection s;
+        memcpy(&s, cf->data + sizeof(hd) + i*sizeof(CkSection), sizeof(s));
+        if(s.offset > cf->size || s.size > cf->size - s.offset) return ck_fail(err, err_n, "truncated checkpoint");
+        if(s.id == 0 || s.id >= CK_SECTION_COUNT) continue; /* from a newer writer */
+        sec[s.id] = cf->data + s.offset;
+        sec_size[s.id] = s.size;
+    }
+    for(int id=1; id<CK_SECTION_COUNT; id++){
+        if(!sec[id]) return ck_fail(err, err_n, "checkpoint is missing a section");
+        if(id != CK_NAMES && sec_size[id] != want[id]) return ck_fail(err, err_n, "checkpoint section has the wrong size");
+    }
+    if(!ck_check_names(cfg, (const char*)sec[CK_NAMES], (size_t)sec_size[CK_NAMES], err, err_n))
+        return false;
+
+    /* validate indexes before anything uses them */
+    for(size_t i=0;i<an;i++){
+        uint32_t v;
+        memcpy(&v, sec[CK_AG_VOC] + i*sizeof(uint32_t), sizeof(v));
+        if(v >= hd.voc_n) return ck_fail(err, err_n, "corrupt agent vocation");
+        /* agents index setts[home] and step toward target on the map;
+           without settlements home is unused and spawned as 0 */
+        int32_t home;
+        memcpy(&home, sec[CK_AG_HOME] + i*sizeof(int32_t), sizeof(home));
+        if(sn > 0 ? (home < 0 || (uint64_t)home >= sn) : home != 0)
+            return ck_fail(err, err_n, "corrupt agent home");
+        BrzPos pos, target;
+        memcpy(&pos, sec[CK_AG_POS] + i*sizeof(BrzPos), sizeof(pos));
+        memcpy(&target, sec[CK_AG_TARGET] + i*sizeof(BrzPos), sizeof(target));
+        if(pos.x < 0 || pos.y < 0 || pos.x >= hd.w || pos.y >= hd.h ||
+           target.x < 0 || target.y < 0 || target.x >= hd.w || target.y >= hd.h)
+            return ck_fail(err, err_n, "corrupt agent position");
+    }
+    for(size_t i=0;i<hd.dirty_n;i++){
+        uint32_t t;
+        memcpy(&t, sec[CK_DIRTY] + i*sizeof(uint32_t), sizeof(t));
+        if(t >= tiles) return ck_fail(err, err_n, "corrupt regen state");
+    }
+
+    /* world */
+    BrzWorld* w = &sim->world;
+    if(brz_world_alloc(w, hd.w, hd.h, res_n) != 0) return ck_fail(err, err_n, "out of memory");
+    memcpy(w->tags, sec[CK_TAGS], (size_t)want[CK_TAGS]);
+    memcpy(w->height, sec[CK_HEIGHT], (size_t)want[CK_HEIGHT]);
+    memcpy(w->res, sec[CK_RES], (size_t)want[CK_RES]);
+    memcpy(w->cap, sec[CK_CAP], (size_t)want[CK_CAP]);
+    memcpy(w->dirty, sec[CK_DIRTY], (size_t)want[CK_DIRTY]);
+    w->dirty_n = (size_t)hd.dirty_n;
+    memset(w->dirty_mark, 0, tiles);
+    for(size_t i=0;i<w->dirty_n;i++) w->dirty_mark[w->dirty[i]] = 1;
+    w->sea_level = (uint8_t)hd.sea_level;
+    brz_world_apply_config(w, cfg, res_n);
+    brz_world_recount(w, res_n);
+    if(brz_world_index_tags(w) != 0) return ck_fail(err, err_n, "out of memory");
+
+    /* settlements */
+    sim->sett_n = (int)sn;
+    if(brz_settlements_alloc(&sim->setts, (int)sn, res_n, item_n) != 0) return ck_fail(err, err_n, "out of memory");
+    for(size_t i=0;i<sn;i++){
+        BrzSettlement* s = &sim->setts[i];
+        memcpy(s->name, sec[CK_SETT_NAME] + i*64, 64);
+        s->name[63] = 0;
+        memcpy(&s->pos, sec[CK_SETT_POS] + i*sizeof(BrzPos), sizeof(BrzPos));
+        int32_t pop;
+        memcpy(&pop, sec[CK_SETT_POP] + i*sizeof(int32_t), sizeof(pop));
+        s->population = pop;
+        if(res_n) memcpy(s->res_inv, sec[CK_SETT_RES] + i*res_n*sizeof(double), res_n*sizeof(double));
+        if(item_n) memcpy(s->item_inv, sec[CK_SETT_ITEM] + i*item_n*sizeof(double), item_n*sizeof(double));
+    }
+    if(brz_world_index_settlements(w, sim->setts, (int)sn) != 0 ||
+       brz_world_flow_prepare_cfg(w, cfg) != 0) return ck_fail(err, err_n, "out of memory");
+
+    /* agents */
+    BrzAgentStore* a = &sim->agents;
+    if(brz_agents_alloc(a, (int)an, cfg, res_n, item_n) != 0) return ck_fail(err, err_n, "out of memory");
+    if(an){
+        memcpy(a->pos, sec[CK_AG_POS], (size_t)want[CK_AG_POS]);
+        memcpy(a->target, sec[CK_AG_TARGET], (size_t)want[CK_AG_TARGET]);
+        memcpy(a->has_target, sec[CK_AG_HAS_TARGET], (size_t)want[CK_AG_HAS_TARGET]);
+        memcpy(a->home, sec[CK_AG_HOME], (size_t)want[CK_AG_HOME]);
+        memcpy(a->voc, sec[CK_AG_VOC], (size_t)want[CK_AG_VOC]);
+        memcpy(a->hunger, sec[CK_AG_HUNGER], (size_t)want[CK_AG_HUNGER]);
+        memcpy(a->fatigue, sec[CK_AG_FATIGUE], (size_t)want[CK_AG_FATIGUE]);
+        memcpy(a->res, sec[CK_AG_RES], (size_t)want[CK_AG_RES]);
+        memcpy(a->item, sec[CK_AG_ITEM], (size_t)want[CK_AG_ITEM]);
+    }
+    brz_agents_recount(a);
+
+    sim->rng.state = hd.rng_state;
+    sim->day = hd.day;
+    sim->seed = brz_sim_seed(cfg->seed);
+    return true;
+}
+
+bool brz_sim_checkpoint_load(BrzSim* sim, const ParsedConfig* cfg, const char* path,
+                             char* err, size_t err_n)
+{
+    memset(sim, 0, sizeof(*sim));
+    if(err && err_n) err[0] = 0;
+    sim->cfg = cfg;
+
+    CkFile cf;
+    if(!ck_open(&cf, path)) return ck_fail(err, err_n, "cannot read file");
+    bool ok = ck_load_image(sim, cfg, &cf, err, err_n);
+    ck_close(&cf);
+    if(!ok){
+        brz_sim_free(sim);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef BRZ_CHECKPOINT_H
+#define BRZ_CHECKPOINT_H
+
+#include "brz_sim.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * brz_checkpoint.h/.c - save and restore a BrzSim
+ *
+ * A checkpoint holds the whole run state after sim->day: world tiles,
+ * resources and the regen dirty set, settlements, every agent column
+ * (vocations as indexes into cfg->vocations), the serial rng and the day.
+ * Resuming from it continues bit-for-bit like the uninterrupted run.
+ *
+ * The file is a native-endian image: a header, a section table, then one
+ * 64-byte aligned raw array per section. Loading maps the file and copies
+ * each section in place without parsing.
+ *
+ * Loading needs a config with the same kinds and vocations (checked by
+ * name). World size, tiles and the population come from the checkpoint.
+ * Regen rates and sim { regen } are taken from the config being resumed,
+ * so sweeps can fork from one warmed-up state.
+ *
+ * Only flat worlds can be saved (save fails for sim { world chunked });
+ * a resumed world is always flat. Caps are saved as planes, and a resumed
+ * world keeps them in planes (sim { caps plane }).
+ */
+
+#define BRZ_CHECKPOINT_VERSION 1u
+
+bool brz_sim_checkpoint_save(const BrzSim* sim, const char* path);
+
+/* On failure sim is left empty and err holds the reason */
+bool brz_sim_checkpoint_load(BrzSim* sim, const ParsedConfig* cfg, const char* path,
+                             char* err, size_t err_n);
+
+#endif /* BRZ_CHECKPOINT_H */
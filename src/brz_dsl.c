@@ -1,5 +1,9 @@
 #include "brz_dsl.h"
 #include "brz_util.h"
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -23,6 +27,7 @@ top_level_block     := world_block
                     | kinds_block
                     | resources_block
                     | items_block
+                    | recipes_block
                     | vocations_block
                     | compat_block ;
 
@@ -32,6 +37,7 @@ world_block          := 'world' block_open { world_stmt } block_close ;
 kinds_block          := 'kinds' block_open { kind_def } block_close ;
 resources_block      := 'resources' block_open { resource_def } block_close ;
 items_block          := 'items' block_open { item_def } block_close ;
+recipes_block        := 'recipes' block_open { recipe_def } block_close ;
 
 vocations_block      := 'vocations' block_open { vocation_def } block_close ;
 vocation_def         := 'vocation' identifier block_open { vocation_member } block_close ;
@@ -53,6 +59,11 @@ kind_def             := identifier ';' ;
 resource_def         := identifier ':' identifier ';' ;
 item_def             := identifier ':' identifier ';' ;
 
+# Crafting <item> uses <ratio> of each input per unit made. 'makes' names
+# the kind produced when it is not <item> itself.
+recipe_def           := identifier block_open { recipe_stmt } block_close ;
+recipe_stmt          := identifier number | 'makes' identifier ;
+
 # ----- Rule / task language -----
 
 rule_stmt            := when_block
@@ -100,138 +111,504 @@ compat_stmt          := identifier { identifier | number | string | ':' | ';' |
 DSL_GRAMMAR_END
 */
 
-static void op_free(OpDef* op)
+/* Everything a config owns lives in its arena: strings, the definition
+   vectors and the compiled expressions. Teardown releases the arena's
+   chunks without walking the definitions. */
+
+static bool copy_stmts(BrzVec* dst, const BrzVec* src, BrzArena* a)
+{
+    if(!brz_vec_copy_arena(dst, src, a)) return false;
+    /* nested bodies follow their parent list, in statement order */
+    for(size_t i=0;i<dst->len;i++)
+    {
+        StmtDef* st = (StmtDef*)brz_vec_at(dst, i);
+        switch(st->kind)
+        {
+            case ST_CHANCE:
+                if(!copy_stmts(&st->as.chance.body, &st->as.chance.body, a)) return false;
+                break;
+            case ST_WHEN:
+                if(!copy_stmts(&st->as.when_stmt.body, &st->as.when_stmt.body, a)) return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+bool brz_cfg_add_vocation(ParsedConfig* cfg, const VocationDef* voc)
+{
+    if(!cfg || !voc) return false;
+    BrzArena* a = &cfg->arena;
+
+    VocationDef v = *voc;
+    if(!brz_vec_copy_arena(&v.rules, &voc->rules, a)) return false;
+    if(!brz_vec_copy_arena(&v.tasks, &voc->tasks, a)) return false;
+    for(size_t i=0;i<v.tasks.len;i++)
+    {
+        TaskDef* t = (TaskDef*)brz_vec_at(&v.tasks, i);
+        if(!copy_stmts(&t->stmts, &t->stmts, a)) return false;
+    }
+    /* threshold index is rebuilt by brz_cfg_link */
+    brz_vec_init_arena(&v.thresholds, sizeof(BrzRuleThreshold), a);
+    memset(v.thr_group, 0, sizeof(v.thr_group));
+    brz_vec_init_arena(&v.run_rules, sizeof(uint32_t), a);
+    brz_vec_init_arena(&v.always, sizeof(BrzRuleAlias), a);
+    v.always_w = 0.0;
+    /* rule->task pointed into the source vocation */
+    for(size_t i=0;i<v.rules.len;i++)
+    {
+        RuleDef* r = (RuleDef*)brz_vec_at(&v.rules, i);
+        if(r->task) r->task = brz_voc_find_task(&v, r->do_task);
+    }
+    return brz_vec_push(&cfg->vocations, &v);
+}
+
+void brz_cfg_init(ParsedConfig* cfg)
+{
+    if(!cfg) return;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->seed = 0xC0FFEEu;
+    cfg->years = 60;
+    cfg->agent_count = 0;
+    cfg->settlement_count = 0;
+    kind_table_init(&cfg->resource_kinds);
+    kind_table_init(&cfg->item_kinds);
+    brz_arena_init(&cfg->arena);
+    brz_strtab_init(&cfg->strings);
+    brz_vec_init_arena(&cfg->params, sizeof(ParamDef), &cfg->arena);
+    brz_vec_init_arena(&cfg->vocations, sizeof(VocationDef), &cfg->arena);
+    brz_vec_init_arena(&cfg->warnings, sizeof(const char*), &cfg->arena);
+    brz_vec_init_arena(&cfg->recipes, sizeof(RecipeDef), &cfg->arena);
+    brz_vec_init_arena(&cfg->recipe_in, sizeof(RecipeInput), &cfg->arena);
+    brz_vec_init_arena(&cfg->recipe_of, sizeof(int32_t), &cfg->arena);
+    cfg->known.r_grain = cfg->known.r_fish = cfg->known.r_wood = cfg->known.r_clay = -1;
+    cfg->known.r_copper = cfg->known.r_tin = cfg->known.r_charcoal = -1;
+    cfg->known.i_bronze = cfg->known.i_charcoal = cfg->known.i_pottery = -1;
+}
+
+void brz_cfg_free(ParsedConfig* cfg)
+{
+    if(!cfg) return;
+
+    kind_table_destroy(&cfg->resource_kinds);
+    kind_table_destroy(&cfg->item_kinds);
+
+    free(cfg->param_index);
+    brz_strtab_destroy(&cfg->strings);
+    brz_arena_destroy(&cfg->arena);
+
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+const char* brz_cfg_intern_n(ParsedConfig* cfg, const char* s, size_t n)
 {
-    if(!op) return;
-    free(op->op);
-    free(op->a0);
-    free(op->a1);
-    free(op->a2);
-    memset(op, 0, sizeof(*op));
+    if(!cfg || !s) return NULL;
+    return brz_strtab_intern(&cfg->strings, &cfg->arena, s, n);
 }
 
-static void stmt_free(StmtDef* st);
+const char* brz_cfg_intern(ParsedConfig* cfg, const char* s)
+{
+    return s ? brz_cfg_intern_n(cfg, s, strlen(s)) : NULL;
+}
+
+/* ---------- name -> tag ---------- */
+
+uint16_t brz_dsl_tag_for_resource(const char* name)
+{
+    if(!name) return 0;
+    if(brz_streq(name,"fish")) return BRZ_TAG_COAST;
+    if(brz_streq(name,"grain")) return BRZ_TAG_FIELD;
+    if(brz_streq(name,"wood")) return BRZ_TAG_FOREST;
+    if(brz_streq(name,"clay")) return BRZ_TAG_CLAYPIT;
+    if(brz_streq(name,"copper")) return BRZ_TAG_MINE_CU;
+    if(brz_streq(name,"tin")) return BRZ_TAG_MINE_SN;
+    if(brz_streq(name,"charcoal")) return BRZ_TAG_FOREST;
+    if(brz_streq(name,"fire")) return BRZ_TAG_FIRE;
+    return 0;
+}
+
+uint16_t brz_dsl_tag_for_place(const char* name)
+{
+    if(!name) return BRZ_TAG_FOREST;
+    if(brz_streq(name,"coast")) return BRZ_TAG_COAST;
+    if(brz_streq(name,"field")) return BRZ_TAG_FIELD;
+    if(brz_streq(name,"forest")) return BRZ_TAG_FOREST;
+    if(brz_streq(name,"claypit")) return BRZ_TAG_CLAYPIT;
+    if(brz_streq(name,"mine_copper")) return BRZ_TAG_MINE_CU;
+    if(brz_streq(name,"mine_tin")) return BRZ_TAG_MINE_SN;
+    return BRZ_TAG_FOREST;
+}
+
+/* ---------- link pass ---------- */
+
+static BrzOpCode op_code_for(const char* name)
+{
+    if(!name) return BRZ_OP_NONE;
+    if(brz_streq(name,"gather")) return BRZ_OP_GATHER;
+    if(brz_streq(name,"craft")) return BRZ_OP_CRAFT;
+    if(brz_streq(name,"trade")) return BRZ_OP_TRADE;
+    if(brz_streq(name,"rest")) return BRZ_OP_REST;
+    if(brz_streq(name,"move_to") || brz_streq(name,"roam") || brz_streq(name,"wander")) return BRZ_OP_MOVE;
+    return BRZ_OP_NONE;
+}
+
+static void link_op(OpDef* op, const ParsedConfig* cfg)
+{
+    const char* a0 = op->a0 ? op->a0 : "";
+    const char* a1 = op->a1 ? op->a1 : "";
+    op->code = op_code_for(op->op);
+    op->rid0 = kind_table_find(&cfg->resource_kinds, a0);
+    op->iid0 = kind_table_find(&cfg->item_kinds, a0);
+    op->rid1 = kind_table_find(&cfg->resource_kinds, a1);
+    op->iid1 = kind_table_find(&cfg->item_kinds, a1);
+    switch(op->code)
+    {
+        case BRZ_OP_GATHER: op->tag = brz_dsl_tag_for_resource(a0); break;
+        case BRZ_OP_MOVE:   op->tag = brz_dsl_tag_for_place(a0); break;
+        default:            op->tag = 0; break;
+    }
+}
+
+/* print a link warning and keep it in cfg->warnings, so a config loaded
+   from an image reports the same. Returns false on OOM. */
+static bool link_warn(ParsedConfig* cfg, const char* fmt, ...)
+{
+    va_list ap, aq;
+    va_start(ap, fmt);
+    va_copy(aq, ap);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    char* msg = n >= 0 ? (char*)brz_arena_alloc(&cfg->arena, (size_t)n + 1) : NULL;
+    if(msg) vsnprintf(msg, (size_t)n + 1, fmt, aq);
+    va_end(aq);
+    if(!msg) return false;
+    fprintf(stderr, "%s\n", msg);
+    const char* w = msg;
+    return brz_vec_push(&cfg->warnings, &w);
+}
 
-static void stmt_vec_free(BrzVec* v)
+/* the compiled code is moved into the config arena; a program from an
+   earlier link is simply left there */
+static bool link_expr(ParsedConfig* cfg, BrzExpr* prog, const char* src, int line)
 {
-    if(!v) return;
-    for(size_t i=0;i<v->len;i++)
+    char err[160];
+    BrzExpr e;
+    if(!brz_expr_compile(&e, src, err, sizeof(err))) return false;
+    if(err[0] && !link_warn(cfg, "Warning:%d: when '%s': %s", line, src ? src : "", err))
+    {
+        brz_expr_free(&e);
+        return false;
+    }
+
+    bool ok = true;
+    prog->code = NULL;
+    prog->len = e.len;
+    if(e.len > 0)
     {
-        StmtDef* s = (StmtDef*)brz_vec_at(v, i);
-        stmt_free(s);
+        size_t bytes = (size_t)e.len * sizeof(BrzExprIns);
+        prog->code = (BrzExprIns*)brz_arena_alloc(&cfg->arena, bytes);
+        if(prog->code) memcpy(prog->code, e.code, bytes);
+        else { prog->len = 0; ok = false; }
     }
-    brz_vec_destroy(v);
+    brz_expr_free(&e);
+    return ok;
 }
 
-static void stmt_free(StmtDef* st)
+static bool link_stmts(BrzVec* stmts, ParsedConfig* cfg)
 {
-    if(!st) return;
-    switch(st->kind)
+    for(size_t i=0;i<stmts->len;i++)
     {
-        case ST_OP:
-            op_free(&st->as.op);
-            break;
-        case ST_CHANCE:
-            stmt_vec_free(&st->as.chance.body);
-            break;
-        case ST_WHEN:
-            free(st->as.when_stmt.when_expr);
-            stmt_vec_free(&st->as.when_stmt.body);
-            break;
-        default:
-            break;
+        StmtDef* st = (StmtDef*)brz_vec_at(stmts, i);
+        switch(st->kind)
+        {
+            case ST_OP:
+                link_op(&st->as.op, cfg);
+                break;
+            case ST_CHANCE:
+                if(!link_stmts(&st->as.chance.body, cfg)) return false;
+                break;
+            case ST_WHEN:
+                if(!link_expr(cfg, &st->as.when_stmt.prog, st->as.when_stmt.when_expr, st->line)) return false;
+                if(!link_stmts(&st->as.when_stmt.body, cfg)) return false;
+                break;
+            default:
+                break;
+        }
     }
-    memset(st, 0, sizeof(*st));
+    return true;
 }
 
-static void task_free(TaskDef* t)
+/* group of a BOX rule: its first bounded side */
+static int thr_group_of(const BrzExprBox* b, double* bound, uint8_t* open)
 {
-    if(!t) return;
-    free(t->name);
-    for(size_t i=0;i<t->stmts.len;i++)
+    for(int v=0; v<BRZ_EXPR_VAR_COUNT; v++)
     {
-        StmtDef* s = (StmtDef*)brz_vec_at(&t->stmts, i);
-        stmt_free(s);
+        if(b->lo[v] != -HUGE_VAL){ *bound = b->lo[v]; *open = b->lo_open[v]; return 2*v; }
+        if(b->hi[v] != HUGE_VAL){ *bound = b->hi[v]; *open = b->hi_open[v]; return 2*v + 1; }
     }
-    brz_vec_destroy(&t->stmts);
-    memset(t, 0, sizeof(*t));
+    return -1;
 }
 
-static void rule_free(RuleDef* r)
+/* inclusive first at equal bounds, then rule order */
+static int thr_tie(const BrzRuleThreshold* x, const BrzRuleThreshold* y)
 {
-    if(!r) return;
-    free(r->name);
-    free(r->when_expr);
-    free(r->do_task);
-    memset(r, 0, sizeof(*r));
+    if(x->open != y->open) return (int)x->open - (int)y->open;
+    return (x->rule > y->rule) - (x->rule < y->rule);
 }
 
-static void voc_free(VocationDef* v)
+static int thr_cmp_lower(const void* a, const void* b)
 {
-    if(!v) return;
-    free(v->name);
+    const BrzRuleThreshold* x = (const BrzRuleThreshold*)a;
+    const BrzRuleThreshold* y = (const BrzRuleThreshold*)b;
+    if(x->bound != y->bound) return x->bound < y->bound ? -1 : 1;
+    return thr_tie(x, y);
+}
 
-    for(size_t i=0;i<v->tasks.len;i++)
+static int thr_cmp_upper(const void* a, const void* b)
+{
+    const BrzRuleThreshold* x = (const BrzRuleThreshold*)a;
+    const BrzRuleThreshold* y = (const BrzRuleThreshold*)b;
+    if(x->bound != y->bound) return x->bound > y->bound ? -1 : 1;
+    return thr_tie(x, y);
+}
+
+static bool link_thresholds(ParsedConfig* cfg, VocationDef* v)
+{
+    brz_vec_init_arena(&v->thresholds, sizeof(BrzRuleThreshold), &cfg->arena);
+    if(v->rules.len && !brz_vec_reserve(&v->thresholds, v->rules.len)) return false;
+    for(int g=0; g<BRZ_RULE_THR_GROUPS; g++)
     {
-        TaskDef* t = (TaskDef*)brz_vec_at(&v->tasks, i);
-        task_free(t);
+        size_t first = v->thresholds.len;
+        v->thr_group[g] = (uint32_t)first;
+        for(size_t i=0;i<v->rules.len;i++)
+        {
+            const RuleDef* r = (const RuleDef*)brz_vec_cat(&v->rules, i);
+            if(r->match != BRZ_EXPR_SHAPE_BOX) continue;
+            BrzRuleThreshold t;
+            memset(&t, 0, sizeof(t));
+            if(thr_group_of(&r->guard, &t.bound, &t.open) != g) continue;
+            t.rule = (uint32_t)i;
+            if(!brz_vec_push(&v->thresholds, &t)) return false;
+        }
+        size_t n = v->thresholds.len - first;
+        if(n > 1)
+            qsort((BrzRuleThreshold*)v->thresholds.data + first, n, sizeof(BrzRuleThreshold),
+                  (g & 1) ? thr_cmp_upper : thr_cmp_lower);
     }
-    brz_vec_destroy(&v->tasks);
+    v->thr_group[BRZ_RULE_THR_GROUPS] = (uint32_t)v->thresholds.len;
+    return true;
+}
 
+/* The rules pick_rule has to run, and Vose's method over the
+   always-matching ones. Scaled weights n*w/W
+   below 1 ("small") are topped up by one at or above 1 ("large"), which
+   becomes the alias of that column. */
+static bool link_always(ParsedConfig* cfg, VocationDef* v)
+{
+    brz_vec_init_arena(&v->run_rules, sizeof(uint32_t), &cfg->arena);
+    brz_vec_init_arena(&v->always, sizeof(BrzRuleAlias), &cfg->arena);
+    v->always_w = 0.0;
     for(size_t i=0;i<v->rules.len;i++)
     {
-        RuleDef* r = (RuleDef*)brz_vec_at(&v->rules, i);
-        rule_free(r);
+        const RuleDef* r = (const RuleDef*)brz_vec_cat(&v->rules, i);
+        if(r->match == BRZ_EXPR_SHAPE_GUARDED || r->match == BRZ_EXPR_SHAPE_OPAQUE)
+        {
+            uint32_t ri = (uint32_t)i;
+            if(!brz_vec_push(&v->run_rules, &ri)) return false;
+        }
+        if(r->match != BRZ_EXPR_SHAPE_ALWAYS) continue;
+        BrzRuleAlias c;
+        memset(&c, 0, sizeof(c));
+        c.rule = c.alias = (uint32_t)i;
+        c.prob = (double)brz_rule_weight(r);
+        if(!brz_vec_push(&v->always, &c)) return false;
+        v->always_w += c.prob;
     }
-    brz_vec_destroy(&v->rules);
+    const size_t n = v->always.len;
+    if(n == 0) return true;
+
+    BrzRuleAlias* t = (BrzRuleAlias*)v->always.data;
+    /* the columns waiting for a partner: small ones from the front, large from the back */
+    uint32_t* work = (uint32_t*)malloc(n * sizeof(uint32_t));
+    if(!work) return false;
+    size_t small_n = 0, large_at = n;
+    for(size_t i=0;i<n;i++)
+    {
+        t[i].prob = t[i].prob * (double)n / v->always_w;
+        if(t[i].prob < 1.0) work[small_n++] = (uint32_t)i;
+        else work[--large_at] = (uint32_t)i;
+    }
+    while(small_n > 0 && large_at < n)
+    {
+        BrzRuleAlias* s = &t[work[--small_n]];
+        uint32_t l = work[large_at];
+        s->alias = t[l].rule;
+        t[l].prob -= 1.0 - s->prob;
+        if(t[l].prob < 1.0)
+        {
+            large_at++;
+            work[small_n++] = l;
+        }
+    }
+    /* what is left is 1 up to rounding */
+    for(size_t i=0;i<small_n;i++) t[work[i]].prob = 1.0;
+    for(size_t i=large_at;i<n;i++) t[work[i]].prob = 1.0;
+    free(work);
+    return true;
+}
 
-    memset(v, 0, sizeof(*v));
+bool brz_cfg_add_recipe(ParsedConfig* cfg, const RecipeDef* r, const RecipeInput* in, size_t in_n)
+{
+    if(!cfg || !r || cfg->recipe_in.len + in_n > UINT32_MAX) return false;
+    RecipeDef d = *r;
+    d.in_first = (uint32_t)cfg->recipe_in.len;
+    d.in_n = (uint32_t)in_n;
+    if(!brz_vec_reserve(&cfg->recipe_in, cfg->recipe_in.len + in_n)) return false;
+    for(size_t i=0;i<in_n;i++)
+        if(!brz_vec_push(&cfg->recipe_in, &in[i])) return false;
+    return brz_vec_push(&cfg->recipes, &d);
 }
 
-static void param_free(ParamDef* p)
+/* the recipes craft_with_recipes used to hardcode, for the kinds present */
+static bool add_builtin_recipes(ParsedConfig* cfg)
 {
-    if(!p) return;
-    free(p->key);
-    free(p->svalue);
-    memset(p, 0, sizeof(*p));
+    const BrzKnownKinds* k = &cfg->known;
+    RecipeDef r;
+    RecipeInput in[3];
+    memset(&r, 0, sizeof(r));
+    memset(in, 0, sizeof(in));
+    in[0].ratio = in[1].ratio = in[2].ratio = 1.0;
+
+    if(k->i_bronze >= 0 && k->r_copper >= 0 && k->r_tin >= 0 && k->r_charcoal >= 0)
+    {
+        r.item = brz_cfg_intern(cfg, "bronze");
+        in[0].name = brz_cfg_intern(cfg, "copper");
+        in[1].name = brz_cfg_intern(cfg, "tin");
+        in[2].name = brz_cfg_intern(cfg, "charcoal");
+        if(!r.item || !in[0].name || !in[1].name || !in[2].name || !brz_cfg_add_recipe(cfg, &r, in, 3)) return false;
+    }
+    if(k->i_charcoal >= 0 && k->r_wood >= 0 && k->r_charcoal >= 0)
+    {
+        /* the item is burnt into the charcoal resource */
+        r.item = r.makes = brz_cfg_intern(cfg, "charcoal");
+        in[0].name = brz_cfg_intern(cfg, "wood");
+        if(!r.item || !in[0].name || !brz_cfg_add_recipe(cfg, &r, in, 1)) return false;
+        r.makes = NULL;
+    }
+    if(k->i_pottery >= 0 && k->r_clay >= 0)
+    {
+        r.item = brz_cfg_intern(cfg, "pottery");
+        in[0].name = brz_cfg_intern(cfg, "clay");
+        in[0].ratio = 2.0;
+        if(!r.item || !in[0].name || !brz_cfg_add_recipe(cfg, &r, in, 1)) return false;
+    }
+    return true;
 }
 
-void brz_cfg_init(ParsedConfig* cfg)
+/* kind id of name, as a resource if there is one, else as an item */
+static int32_t link_kind(const ParsedConfig* cfg, const char* name, uint8_t* is_item)
 {
-    if(!cfg) return;
-    memset(cfg, 0, sizeof(*cfg));
-    cfg->seed = 0xC0FFEEu;
-    cfg->years = 60;
-    cfg->agent_count = 0;
-    cfg->settlement_count = 0;
-    kind_table_init(&cfg->resource_kinds);
-    kind_table_init(&cfg->item_kinds);
-    brz_vec_init(&cfg->params, sizeof(ParamDef));
-    brz_vec_init(&cfg->vocations, sizeof(VocationDef));
+    int id = kind_table_find(&cfg->resource_kinds, name);
+    *is_item = 0;
+    if(id < 0)
+    {
+        id = kind_table_find(&cfg->item_kinds, name);
+        *is_item = (id >= 0);
+    }
+    return id;
 }
 
-void brz_cfg_free(ParsedConfig* cfg)
+/* Resolve every recipe and index them by item id. Recipes naming an
+   unknown kind, with a ratio that is not positive, listing an input twice
+   (crafting would take it once per entry) or for an item that already has
+   one are left out with a warning. */
+static bool link_recipes(ParsedConfig* cfg)
 {
-    if(!cfg) return;
+    if(!cfg->has_recipes && cfg->recipes.len == 0 && !add_builtin_recipes(cfg)) return false;
+
+    const size_t item_n = kind_table_count(&cfg->item_kinds);
+    brz_vec_init_arena(&cfg->recipe_of, sizeof(int32_t), &cfg->arena);
+    if(item_n && !brz_vec_reserve(&cfg->recipe_of, item_n)) return false;
+    const int32_t none = -1;
+    for(size_t i=0;i<item_n;i++) brz_vec_push(&cfg->recipe_of, &none);
+    int32_t* of = (int32_t*)cfg->recipe_of.data;
 
-    for(size_t i=0;i<cfg->params.len;i++)
+    for(size_t ri=0; ri<cfg->recipes.len; ri++)
     {
-        ParamDef* p = (ParamDef*)brz_vec_at(&cfg->params, i);
-        param_free(p);
+        RecipeDef* r = (RecipeDef*)brz_vec_at(&cfg->recipes, ri);
+        const char* unknown = NULL; /* first name that is not a kind */
+        const char* nonpos = NULL;  /* first input with ratio <= 0 */
+        const char* twice = NULL;   /* first input listed more than once */
+        int iid = kind_table_find(&cfg->item_kinds, r->item);
+        if(iid < 0) unknown = r->item;
+        r->out = iid;
+        r->out_is_item = 1;
+        if(r->makes && (r->out = link_kind(cfg, r->makes, &r->out_is_item)) < 0 && !unknown) unknown = r->makes;
+        for(uint32_t k=0; k<r->in_n; k++)
+        {
+            RecipeInput* in = (RecipeInput*)brz_vec_at(&cfg->recipe_in, r->in_first + k);
+            in->id = link_kind(cfg, in->name, &in->is_item);
+            if(in->id < 0 && !unknown) unknown = in->name;
+            if(!(in->ratio > 0) && !nonpos) nonpos = in->name;
+            for(uint32_t j=0; j<k && in->id >= 0 && !twice; j++)
+            {
+                const RecipeInput* prev = (const RecipeInput*)brz_vec_cat(&cfg->recipe_in, r->in_first + j);
+                if(prev->id == in->id && prev->is_item == in->is_item) twice = in->name;
+            }
+        }
+        bool ok = true;
+        if(unknown)
+            ok = link_warn(cfg, "Warning:%d: recipe '%s': unknown kind '%s'", r->line, r->item, unknown);
+        else if(nonpos)
+            ok = link_warn(cfg, "Warning:%d: recipe '%s': ratio of '%s' must be positive", r->line, r->item, nonpos);
+        else if(twice)
+            ok = link_warn(cfg, "Warning:%d: recipe '%s': input '%s' is listed twice", r->line, r->item, twice);
+        else if(of[iid] >= 0)
+            ok = link_warn(cfg, "Warning:%d: recipe '%s': item already has a recipe", r->line, r->item);
+        else
+            of[iid] = (int32_t)ri;
+        if(!ok) return false;
     }
-    brz_vec_destroy(&cfg->params);
+    return true;
+}
 
-    for(size_t i=0;i<cfg->vocations.len;i++)
+bool brz_cfg_link(ParsedConfig* cfg)
+{
+    if(!cfg) return false;
+
+    BrzKnownKinds* k = &cfg->known;
+    k->r_grain    = kind_table_find(&cfg->resource_kinds, "grain");
+    k->r_fish     = kind_table_find(&cfg->resource_kinds, "fish");
+    k->r_wood     = kind_table_find(&cfg->resource_kinds, "wood");
+    k->r_clay     = kind_table_find(&cfg->resource_kinds, "clay");
+    k->r_copper   = kind_table_find(&cfg->resource_kinds, "copper");
+    k->r_tin      = kind_table_find(&cfg->resource_kinds, "tin");
+    k->r_charcoal = kind_table_find(&cfg->resource_kinds, "charcoal");
+    k->i_bronze   = kind_table_find(&cfg->item_kinds, "bronze");
+    k->i_charcoal = kind_table_find(&cfg->item_kinds, "charcoal");
+    k->i_pottery  = kind_table_find(&cfg->item_kinds, "pottery");
+    if(!link_recipes(cfg)) return false;
+    for(size_t vi=0; vi<cfg->vocations.len; vi++)
     {
-        VocationDef* v = (VocationDef*)brz_vec_at(&cfg->vocations, i);
-        voc_free(v);
+        VocationDef* v = (VocationDef*)brz_vec_at(&cfg->vocations, vi);
+        for(size_t ti=0; ti<v->tasks.len; ti++)
+        {
+            TaskDef* t = (TaskDef*)brz_vec_at(&v->tasks, ti);
+            if(!link_stmts(&t->stmts, cfg)) return false;
+        }
+        for(size_t ri=0; ri<v->rules.len; ri++)
+        {
+            RuleDef* r = (RuleDef*)brz_vec_at(&v->rules, ri);
+            if(!link_expr(cfg, &r->when_prog, r->when_expr, r->line)) return false;
+            r->task = brz_voc_find_task(v, r->do_task);
+            r->match = (uint8_t)brz_expr_shape(&r->when_prog, &r->guard);
+        }
+        if(!link_thresholds(cfg, v)) return false;
+        if(!link_always(cfg, v)) return false;
     }
-    brz_vec_destroy(&cfg->vocations);
-
-    kind_table_destroy(&cfg->resource_kinds);
-    kind_table_destroy(&cfg->item_kinds);
-
-    memset(cfg, 0, sizeof(*cfg));
+    return true;
 }
 
 TaskDef* brz_voc_find_task(VocationDef* voc, const char* name)
@@ -244,3 +621,143 @@ TaskDef* brz_voc_find_task(VocationDef* voc, const char* name)
     }
     return NULL;
 }
+
+size_t brz_cfg_rule_mask_words(const ParsedConfig* cfg)
+{
+    size_t most = 0;
+    for(size_t i=0;cfg && i<cfg->vocations.len;i++)
+    {
+        const VocationDef* v = (const VocationDef*)brz_vec_cat(&cfg->vocations, i);
+        if(v->rules.len > most) most = v->rules.len;
+    }
+    return most ? (most + 63) / 64 : 1;
+}
+
+/* ---------- params ----------
+   cfg->param_index maps a key to its first entry in cfg->params (open
+   addressing, linear probing, load <= 1/2). Lookups take the key as two
+   parts so callers can ask for "<resource>_renew" without building it. */
+
+static uint32_t param_hash(const char* a, const char* b)
+{
+    uint32_t h = 2166136261u;
+    for(; *a; a++){ h ^= (unsigned char)*a; h *= 16777619u; }
+    for(; *b; b++){ h ^= (unsigned char)*b; h *= 16777619u; }
+    return h;
+}
+
+static bool param_key_is(const char* key, const char* a, const char* b)
+{
+    size_t n = strlen(a);
+    return strncmp(key, a, n) == 0 && strcmp(key + n, b) == 0;
+}
+
+/* entry index of key a+b, or -1; *slot gets the probe position where it
+   is or would go */
+static long param_find(const uint32_t* index, size_t cap, const BrzVec* params,
+                       const char* a, const char* b, size_t* slot)
+{
+    size_t mask = cap - 1;
+    size_t i = param_hash(a, b) & mask;
+    for(; index[i]; i = (i + 1) & mask)
+    {
+        const ParamDef* p = (const ParamDef*)brz_vec_cat(params, index[i] - 1);
+        if(param_key_is(p->key, a, b)) break;
+    }
+    if(slot) *slot = i;
+    return index[i] ? (long)index[i] - 1 : -1;
+}
+
+/* index entry id of cfg->params; later entries with a known key stay unindexed */
+static void param_index_add(uint32_t* index, size_t cap, const BrzVec* params, size_t id)
+{
+    const ParamDef* p = (const ParamDef*)brz_vec_cat(params, id);
+    if(!p->key) return;
+    size_t slot;
+    if(param_find(index, cap, params, p->key, "", &slot) < 0) index[slot] = (uint32_t)id + 1;
+}
+
+static bool param_index_reserve(ParsedConfig* cfg, size_t n)
+{
+    if(n * 2 <= cfg->param_index_cap) return true;
+    size_t cap = cfg->param_index_cap ? cfg->param_index_cap : 32;
+    while(cap < n * 2) cap *= 2;
+    uint32_t* index = (uint32_t*)calloc(cap, sizeof(uint32_t));
+    if(!index) return false;
+    for(size_t i=0;i<cfg->params.len;i++) param_index_add(index, cap, &cfg->params, i);
+    free(cfg->param_index);
+    cfg->param_index = index;
+    cfg->param_index_cap = cap;
+    return true;
+}
+
+bool brz_cfg_reindex_params(ParsedConfig* cfg)
+{
+    if(!cfg) return false;
+    free(cfg->param_index);
+    cfg->param_index = NULL;
+    cfg->param_index_cap = 0;
+    return param_index_reserve(cfg, cfg->params.len);
+}
+
+bool brz_cfg_add_param(ParsedConfig* cfg, const ParamDef* p)
+{
+    if(!cfg || !p || cfg->params.len >= UINT32_MAX - 1) return false;
+    if(!param_index_reserve(cfg, cfg->params.len + 1)) return false;
+    if(!brz_vec_push(&cfg->params, p)) return false;
+    param_index_add(cfg->param_index, cfg->param_index_cap, &cfg->params, cfg->params.len - 1);
+    return true;
+}
+
+const ParamDef* brz_cfg_param_cat(const ParsedConfig* cfg, const char* a, const char* b)
+{
+    if(!cfg || !a || cfg->param_index_cap == 0) return NULL;
+    long id = param_find(cfg->param_index, cfg->param_index_cap, &cfg->params, a, b ? b : "", NULL);
+    return id < 0 ? NULL : (const ParamDef*)brz_vec_cat(&cfg->params, (size_t)id);
+}
+
+const ParamDef* brz_cfg_param(const ParsedConfig* cfg, const char* key)
+{
+    return brz_cfg_param_cat(cfg, key, "");
+}
+
+double brz_cfg_get_num(const ParsedConfig* cfg, const char* key, double defv)
+{
+    const ParamDef* p = brz_cfg_param(cfg, key);
+    return (p && !p->has_svalue) ? p->value : defv;
+}
+
+int brz_cfg_get_int(const ParsedConfig* cfg, const char* key, int defv)
+{
+    const ParamDef* p = brz_cfg_param(cfg, key);
+    if(!p || p->has_svalue) return defv;
+    double v = floor(p->value + 0.5); /* nearest, halves up */
+    if(!(v > (double)INT_MIN)) return INT_MIN; /* also NaN */
+    if(v > (double)INT_MAX) return INT_MAX;
+    return (int)v;
+}
+
+const char* brz_cfg_get_str(const ParsedConfig* cfg, const char* key, const char* defv)
+{
+    const ParamDef* p = brz_cfg_param(cfg, key);
+    return (p && p->has_svalue && p->svalue) ? p->svalue : defv;
+}
+
+bool brz_cfg_set_num(ParsedConfig* cfg, const char* key, double value)
+{
+    if(!cfg || !key) return false;
+    ParamDef* found = (ParamDef*)brz_cfg_param(cfg, key);
+    if(found)
+    {
+        found->svalue = NULL;
+        found->has_svalue = false;
+        found->value = value;
+        return true;
+    }
+    ParamDef p;
+    memset(&p, 0, sizeof(p));
+    p.key = brz_cfg_intern(cfg, key);
+    p.value = value;
+    if(!p.key) return false;
+    return brz_cfg_add_param(cfg, &p);
+}
@@ -5,20 +5,56 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "brz_arena.h"
 #include "brz_vec.h"
 #include "brz_kinds.h"
+#include "brz_expr.h"
 
 /* BRONZESIM DSL structures.
-   Designed to parse very large .bronze files without fixed MAX limits. */
+   Designed to parse very large .bronze files without fixed MAX limits.
+   Every string in these structures is interned in the owning config
+   (brz_cfg_intern) and released with it; equal strings share one copy.
+   The definition vectors and compiled 'when' programs are allocated in the
+   config arena as well, so brz_cfg_free is O(chunks) and a ParsedConfig
+   must not be moved once initialized. */
+
+/* Tile tags. The DSL names them in 'move_to <place>' and implicitly through
+   resource affinities (fish -> coast, copper -> mine_copper, ...). */
+enum {
+    BRZ_TAG_COAST   = 1u<<0,
+    BRZ_TAG_FIELD   = 1u<<1,
+    BRZ_TAG_FOREST  = 1u<<2,
+    BRZ_TAG_CLAYPIT = 1u<<3,
+    BRZ_TAG_MINE_CU = 1u<<4,
+    BRZ_TAG_MINE_SN = 1u<<5,
+    BRZ_TAG_FIRE    = 1u<<6,
+    BRZ_TAG_COUNT   = 7      /* number of tag bits in use */
+};
+
+/* Engine verbs, resolved from OpDef.op by brz_cfg_link */
+typedef enum {
+    BRZ_OP_NONE = 0, /* unknown verb (e.g. 'do' inside a task): no effect */
+    BRZ_OP_GATHER,
+    BRZ_OP_CRAFT,
+    BRZ_OP_TRADE,
+    BRZ_OP_REST,
+    BRZ_OP_MOVE      /* move_to / roam / wander */
+} BrzOpCode;
 
 typedef struct {
-    char* op;       /* e.g. "move_to", "gather", "craft", "rest", "roam", "trade" */
-    char* a0;       /* first word arg */
-    char* a1;       /* second word arg */
-    char* a2;       /* third word arg */
+    const char* op; /* e.g. "move_to", "gather", "craft", "rest", "roam", "trade" */
+    const char* a0; /* first word arg */
+    const char* a1; /* second word arg */
+    const char* a2; /* third word arg */
     double n0;      /* first numeric arg */
     bool has_n0;
     int line;
+
+    /* resolved by brz_cfg_link */
+    BrzOpCode code;
+    int rid0, iid0; /* a0 as resource / item id (-1 if not a kind) */
+    int rid1, iid1; /* a1 as resource / item id */
+    uint16_t tag;   /* gather: tag of tiles holding rid0 (0 = any); move: destination */
 } OpDef;
 
 typedef enum {
@@ -35,35 +71,112 @@ struct StmtDef {
     union {
         OpDef op;
         struct { double chance_pct; BrzVec body; } chance;    /* percent 0..100 */
-        struct { char* when_expr; BrzVec body; } when_stmt;   /* expr string */
+        struct { const char* when_expr; BrzVec body; BrzExpr prog; } when_stmt; /* expr string + compiled form */
     } as;
 };
 
 typedef struct {
-    char* name;
+    const char* name;
     BrzVec stmts; /* StmtDef */
 } TaskDef;
 
 typedef struct {
-    char* name;
-    char* when_expr; /* string expression (simple boolean expr) */
-    char* do_task;   /* task name */
+    const char* name;
+    const char* when_expr; /* string expression (simple boolean expr) */
+    const char* do_task;   /* task name */
     int weight;
+    int line;
+    BrzExpr when_prog; /* compiled when_expr (filled by brz_cfg_link) */
+    TaskDef* task;     /* do_task resolved in the owning vocation, or NULL (brz_cfg_link) */
+    uint8_t match;     /* BrzExprShape of when_prog (brz_cfg_link; 0 = run it) */
+    BrzExprBox guard;  /* its box */
 } RuleDef;
 
+/* Rules whose 'when' is a plain threshold box (BRZ_EXPR_SHAPE_BOX) are
+   indexed by one of their bounds, so that picking a rule can skip the
+   ones an agent's values rule out with a binary search. Group 2*v holds
+   lower bounds on variable v sorted ascending, group 2*v+1 upper bounds
+   sorted descending; at equal bounds the inclusive one comes first. The
+   entries matching a value are then always a prefix of their group. */
+enum { BRZ_RULE_THR_GROUPS = 2 * BRZ_EXPR_VAR_COUNT };
+
+typedef struct {
+    double bound;
+    uint32_t rule; /* index into VocationDef.rules */
+    uint8_t open;  /* bound excluded */
+} BrzRuleThreshold;
+
+/* Rules that always match (BRZ_EXPR_SHAPE_ALWAYS) get a Walker/Vose
+   alias table, so that when no other rule matches one of them is drawn
+   in O(1): column i is taken with probability prob, else its alias. */
 typedef struct {
-    char* name;
+    double prob;
+    uint32_t rule;  /* index into VocationDef.rules */
+    uint32_t alias; /* index into VocationDef.rules */
+} BrzRuleAlias;
+
+typedef struct {
+    const char* name;
     BrzVec tasks; /* TaskDef */
     BrzVec rules; /* RuleDef */
+    BrzVec thresholds; /* BrzRuleThreshold, built by brz_cfg_link */
+    uint32_t thr_group[BRZ_RULE_THR_GROUPS + 1]; /* group g: thresholds[thr_group[g] .. thr_group[g+1]) */
+    BrzVec run_rules; /* uint32_t indices of the rules whose program has to run (brz_cfg_link) */
+    BrzVec always;   /* BrzRuleAlias, one column per always-matching rule (brz_cfg_link) */
+    double always_w; /* their total weight */
 } VocationDef;
 
+/* selection weight of a rule; weights below 1 count as 1 */
+static inline int brz_rule_weight(const RuleDef* r){ return (r->weight > 0) ? r->weight : 1; }
+
+/* Rule index drawn from v's alias table by one uniform 32-bit value u
+   (the high bits pick the column, the rest decide column or alias).
+   v->always must be non-empty. */
+static inline uint32_t brz_voc_sample_always(const VocationDef* v, uint32_t u)
+{
+    const BrzRuleAlias* t = (const BrzRuleAlias*)v->always.data;
+    uint64_t x = (uint64_t)u * (uint64_t)v->always.len;
+    const BrzRuleAlias* col = &t[x >> 32];
+    double frac = (double)(uint32_t)x * (1.0 / 4294967296.0);
+    return (frac < col->prob) ? col->rule : col->alias;
+}
+
 typedef struct {
-    char* key;
+    const char* key;
     double value;    /* numeric value when has_svalue==false */
     bool  has_svalue;
-    char* svalue;    /* string value when has_svalue==true */
+    const char* svalue; /* string value when has_svalue==true */
 } ParamDef;
 
+/* recipes { <item> { <kind> <ratio> ... [makes <kind>] } }: crafting n
+   units of <item> uses ratio*n of every input and yields n of the output
+   (the item itself unless 'makes' names another kind). Kind names are
+   looked up as resources first, then items. */
+typedef struct {
+    const char* name;
+    double ratio;    /* units used per unit crafted, > 0 */
+    int32_t id;      /* resolved by brz_cfg_link (-1 if unknown) */
+    uint8_t is_item;
+} RecipeInput;
+
+typedef struct {
+    const char* item;  /* what 'craft' names */
+    const char* makes; /* output kind, NULL for item */
+    uint32_t in_first; /* inputs: cfg->recipe_in[in_first .. in_first+in_n) */
+    uint32_t in_n;
+    int line;
+
+    /* resolved by brz_cfg_link */
+    int32_t out;
+    uint8_t out_is_item;
+} RecipeDef;
+
+/* Kind ids the engine refers to by name (-1 when the config lacks them) */
+typedef struct {
+    int r_grain, r_fish, r_wood, r_clay, r_copper, r_tin, r_charcoal;
+    int i_bronze, i_charcoal, i_pottery;
+} BrzKnownKinds;
+
 typedef struct {
     /* common knobs */
     uint32_t seed;
@@ -76,17 +189,101 @@ typedef struct {
     KindTable item_kinds;
 
     /* resource params or other numeric params */
-    BrzVec params; /* ParamDef */
+    BrzVec params; /* ParamDef, added through brz_cfg_add_param */
+    uint32_t* param_index;  /* [param_index_cap] key hash -> entry+1, 0 = empty */
+    size_t param_index_cap; /* power of two, or 0 */
 
     /* vocations { vocation X { ... } } */
     BrzVec vocations; /* VocationDef */
+
+    /* recipes { ... }, added through brz_cfg_add_recipe. Without a
+       recipes block brz_cfg_link adds the built-in bronze, charcoal and
+       pottery recipes for the kinds the config has. */
+    BrzVec recipes;   /* RecipeDef */
+    BrzVec recipe_in; /* RecipeInput, each recipe's inputs in one run */
+    bool has_recipes; /* a recipes block was parsed */
+
+    /* filled by brz_cfg_link */
+    BrzKnownKinds known;
+    BrzVec recipe_of; /* int32_t per item id: its recipe in recipes, or -1 */
+    BrzVec warnings;  /* const char*, link diagnostics as printed to stderr */
+
+    /* storage of the strings, vectors and programs above (not the kind tables) */
+    BrzArena arena;
+    BrzStrTab strings;
 } ParsedConfig;
 
 /* lifecycle */
 void brz_cfg_init(ParsedConfig* cfg);
 void brz_cfg_free(ParsedConfig* cfg);
 
+/* s[0..n) interned in cfg; valid until brz_cfg_free. NULL on OOM */
+const char* brz_cfg_intern_n(ParsedConfig* cfg, const char* s, size_t n);
+const char* brz_cfg_intern(ParsedConfig* cfg, const char* s);
+
+/* Resolve pass run once after parsing (brz_parse_file calls it): compiles
+   every 'when' expression and resolves op verbs, kind ids and tags.
+   Malformed expressions are reported on stderr as warnings.
+   Returns false on OOM. */
+bool brz_cfg_link(ParsedConfig* cfg);
+
+/* DSL name -> tile tag. Resource affinity returns 0 when the resource is
+   not bound to a tile type; place names default to forest. */
+uint16_t brz_dsl_tag_for_resource(const char* name);
+uint16_t brz_dsl_tag_for_place(const char* name);
+
+/* Copy voc into cfg's arena and append it to cfg->vocations. The copy
+   holds the rules, then the tasks, then each task's statements with
+   nested bodies right behind their parent list, so a vocation is one
+   contiguous run of memory in declaration order. voc is left untouched
+   and may live in any arena or on the heap. Returns false on OOM. */
+bool brz_cfg_add_vocation(ParsedConfig* cfg, const VocationDef* voc);
+
 /* helpers */
 TaskDef* brz_voc_find_task(VocationDef* voc, const char* name);
 
+/* 64-bit words in a mask with one bit per rule of the largest vocation (at least 1) */
+size_t brz_cfg_rule_mask_words(const ParsedConfig* cfg);
+
+/* Append a recipe whose inputs are in[0..in_n) (names interned in cfg);
+   r->in_first and r->in_n are set from them. Returns false on OOM. */
+bool brz_cfg_add_recipe(ParsedConfig* cfg, const RecipeDef* r, const RecipeInput* in, size_t in_n);
+
+/* the recipe crafting item iid, or NULL (items without one are made from
+   nothing); only resolved recipes are indexed */
+static inline const RecipeDef* brz_cfg_recipe(const ParsedConfig* cfg, int iid)
+{
+    if(iid < 0 || (size_t)iid >= cfg->recipe_of.len) return NULL;
+    int32_t r = ((const int32_t*)cfg->recipe_of.data)[iid];
+    return (r < 0) ? NULL : (const RecipeDef*)cfg->recipes.data + r;
+}
+static inline const RecipeInput* brz_cfg_recipe_inputs(const ParsedConfig* cfg, const RecipeDef* r)
+{
+    return (const RecipeInput*)cfg->recipe_in.data + r->in_first;
+}
+
+/* ---------- params ----------
+   Keys are looked up through a hash index; when a key appears more than
+   once the first entry wins. */
+
+/* append p (key interned in cfg) and index it. Returns false on OOM. */
+bool brz_cfg_add_param(ParsedConfig* cfg, const ParamDef* p);
+/* rebuild the index after filling cfg->params directly. Returns false on OOM. */
+bool brz_cfg_reindex_params(ParsedConfig* cfg);
+
+/* entry for key, or for the key a followed by b (no need to build
+   "<name>_renew"); NULL when missing */
+const ParamDef* brz_cfg_param(const ParsedConfig* cfg, const char* key);
+const ParamDef* brz_cfg_param_cat(const ParsedConfig* cfg, const char* a, const char* b);
+
+/* Typed getters return defv when the key is missing or has the other
+   type. Integers are rounded to nearest (halves up) and clamped. */
+double      brz_cfg_get_num(const ParsedConfig* cfg, const char* key, double defv);
+int         brz_cfg_get_int(const ParsedConfig* cfg, const char* key, int defv);
+const char* brz_cfg_get_str(const ParsedConfig* cfg, const char* key, const char* defv);
+
+/* Set numeric param key (e.g. from a command-line override), replacing the
+   first existing entry or appending a new one. Returns false on OOM. */
+bool brz_cfg_set_num(ParsedConfig* cfg, const char* key, double value);
+
 #endif /* BRZ_DSL_H */
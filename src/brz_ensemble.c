@@ -0,0 +1,165 @@
+#include "brz_ensemble.h"
+#include "brz_kinds.h"
+#include "brz_pool.h"
+#include "brz_sim.h"
+#include "brz_util.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    BrzEnsembleStats* st;
+    const ParsedConfig* cfg;
+    int days;
+    int threads; /* step mode of each run, see run_one */
+} Ensemble;
+
+typedef struct {
+    const Ensemble* e;
+    double* row;  /* this run's [day_n][metric_n] block */
+    int next;     /* next reported day to fill */
+} RunCtx;
+
+static bool record_day(void* ctx, BrzSim* sim)
+{
+    RunCtx* r = (RunCtx*)ctx;
+    const BrzEnsembleStats* st = r->e->st;
+    if(r->next >= st->day_n || st->days[r->next] != sim->day) return true;
+    brz_sim_sync(sim);
+
+    const BrzAgentStore* a = &sim->agents;
+    double* v = r->row + (size_t)r->next * (size_t)st->metric_n;
+    memset(v, 0, (size_t)st->metric_n * sizeof(double));
+    double* tot_res = v + 2;
+    double* tot_item = tot_res + a->res_n;
+    if(a->n > 0){
+        v[0] = brz_agents_total_hunger(a) / a->n;
+        v[1] = brz_agents_total_fatigue(a) / a->n;
+    }
+    for(size_t i=0;i<a->res_n;i++) tot_res[i] = brz_agents_total_res(a, i);
+    for(size_t i=0;i<a->item_n;i++) tot_item[i] = brz_agents_total_item(a, i);
+    r->next++;
+    return true;
+}
+
+static void run_one(void* ctx, int k)
+{
+    const Ensemble* e = (const Ensemble*)ctx;
+    BrzEnsembleStats* st = e->st;
+    RunCtx r;
+    r.e = e;
+    r.row = st->values + (size_t)k * (size_t)st->day_n * (size_t)st->metric_n;
+    r.next = 0;
+
+    BrzSim sim;
+    if(brz_sim_init_seed(&sim, e->cfg, st->seed_lo + (uint32_t)k) != 0) return;
+    /* one thread per run: jobs already keep the cores busy, and the
+       deferred step gives the same result on any thread count */
+    if(brz_sim_run_days(&sim, e->days, e->threads, record_day, &r) == 0 && r.next == st->day_n)
+        st->ok[k] = 1;
+    brz_sim_free(&sim);
+}
+
+bool brz_ensemble_collect(BrzEnsembleStats* st, const ParsedConfig* cfg,
+                          uint32_t seed_lo, uint32_t seed_hi, int jobs)
+{
+    memset(st, 0, sizeof(*st));
+    if(!cfg || seed_hi < seed_lo || seed_hi - seed_lo >= (uint32_t)INT32_MAX) return false;
+    st->seed_lo = seed_lo;
+    st->seed_hi = seed_hi;
+    st->run_n = (int)(seed_hi - seed_lo) + 1;
+
+    Ensemble e;
+    e.st = st;
+    e.cfg = cfg;
+    e.days = brz_cfg_get_int(cfg, "sim_days", 365);
+    e.threads = brz_cfg_get_int(cfg, "sim_threads", 0) > 0 ? 1 : 0;
+    int report_every = brz_cfg_get_int(cfg, "report_every", 30);
+
+    /* the days brz_run would report */
+    st->days = (int*)malloc((size_t)(e.days > 0 ? e.days : 1) * sizeof(int));
+    if(!st->days) return false;
+    for(int day=1; day<=e.days; day++)
+        if(day==1 || (report_every>0 && day%report_every==0) || day==e.days) st->days[st->day_n++] = day;
+
+    size_t res_n = kind_table_count(&cfg->resource_kinds);
+    size_t item_n = kind_table_count(&cfg->item_kinds);
+    st->metric_n = 2 + (int)res_n + (int)item_n;
+    st->metric_names = (const char**)malloc((size_t)st->metric_n * sizeof(char*));
+    st->ok = (uint8_t*)calloc((size_t)st->run_n, 1);
+    st->values = (double*)calloc((size_t)st->run_n * (size_t)(st->day_n > 0 ? st->day_n : 1) * (size_t)st->metric_n,
+                                 sizeof(double));
+    if(!st->metric_names || !st->ok || !st->values) return false;
+    st->metric_names[0] = "avg_hunger";
+    st->metric_names[1] = "avg_fatigue";
+    for(size_t i=0;i<res_n;i++) st->metric_names[2+i] = kind_table_name(&cfg->resource_kinds, (int)i);
+    for(size_t i=0;i<item_n;i++) st->metric_names[2+res_n+i] = kind_table_name(&cfg->item_kinds, (int)i);
+
+    BrzPool* pool = brz_pool_create(jobs);
+    if(!pool) return false;
+    brz_pool_run(pool, st->run_n, run_one, &e);
+    brz_pool_destroy(pool);
+
+    for(int k=0;k<st->run_n;k++) if(!st->ok[k]) st->failed_n++;
+    return st->failed_n < st->run_n;
+}
+
+void brz_ensemble_free(BrzEnsembleStats* st)
+{
+    if(!st) return;
+    free(st->ok);
+    free(st->days);
+    free((void*)st->metric_names);
+    free(st->values);
+    memset(st, 0, sizeof(*st));
+}
+
+bool brz_ensemble_write_table(const BrzEnsembleStats* st, FILE* f)
+{
+    fprintf(f, "Ensemble: runs=%d seeds=%u..%u failed=%d\n",
+            st->run_n, st->seed_lo, st->seed_hi, st->failed_n);
+    fprintf(f, "%6s  %-16s %14s %14s %14s %14s\n", "day", "metric", "mean", "sd", "min", "max");
+    const size_t stride = (size_t)st->day_n * (size_t)st->metric_n;
+    for(int d=0; d<st->day_n; d++){
+        for(int m=0; m<st->metric_n; m++){
+            /* mean and variance by Welford, in seed order */
+            int n = 0;
+            double mean = 0, m2 = 0, lo = 0, hi = 0;
+            for(int k=0;k<st->run_n;k++){
+                if(!st->ok[k]) continue;
+                double x = st->values[(size_t)k*stride + (size_t)d*(size_t)st->metric_n + (size_t)m];
+                if(n == 0){ lo = hi = x; }
+                if(x < lo) lo = x;
+                if(x > hi) hi = x;
+                n++;
+                double dx = x - mean;
+                mean += dx / n;
+                m2 += dx * (x - mean);
+            }
+            double sd = n > 1 ? sqrt(m2 / (n - 1)) : 0.0;
+            const char* nm = st->metric_names[m] ? st->metric_names[m] : "";
+            fprintf(f, "%6d  %-16s %14.4f %14.4f %14.4f %14.4f\n", st->days[d], nm, mean, sd, lo, hi);
+        }
+    }
+    return !ferror(f);
+}
+
+int brz_run_ensemble(const ParsedConfig* cfg, uint32_t seed_lo, uint32_t seed_hi, int jobs)
+{
+    if(brz_cfg_get_int(cfg, "snapshot_every", 0) > 0 || brz_cfg_get_int(cfg, "map_every", 0) > 0 ||
+       brz_cfg_get_int(cfg, "sim_checkpoint_every", 0) > 0)
+        fprintf(stderr, "Warning: snapshots, maps and checkpoints are not written in ensemble mode\n");
+
+    BrzEnsembleStats st;
+    bool ok = brz_ensemble_collect(&st, cfg, seed_lo, seed_hi, jobs);
+    if(!ok){
+        fprintf(stderr, st.run_n > 0 && st.failed_n == st.run_n ? "Error: every ensemble run failed\n"
+                                                                 : "Error: OOM setting up the ensemble\n");
+        brz_ensemble_free(&st);
+        return 1;
+    }
+    if(st.failed_n > 0) fprintf(stderr, "Warning: %d of %d ensemble runs failed\n", st.failed_n, st.run_n);
+    ok = brz_ensemble_write_table(&st, stdout);
+    brz_ensemble_free(&st);
+    return ok ? 0 : 1;
+}
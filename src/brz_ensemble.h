@@ -0,0 +1,54 @@
+#ifndef BRZ_ENSEMBLE_H
+#define BRZ_ENSEMBLE_H
+
+#include "brz_dsl.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * brz_ensemble.h/.c - many seeds of one config in one process
+ *
+ * The config is parsed once and shared read-only by every run. Runs are
+ * independent BrzSim instances handed out to a worker pool; run k uses
+ * seed seed_lo + k and produces exactly what a single run with
+ * sim { seed } set to that value would. Per-day statistics are recorded
+ * on the days a single run reports (day 1, every report_every, the last
+ * day) and aggregated in seed order, so the table does not depend on the
+ * number of jobs.
+ *
+ * Usage:
+ *   BrzEnsembleStats st;
+ *   brz_ensemble_collect(&st, cfg, 1, 500, 8);
+ *   brz_ensemble_write_table(&st, stdout);
+ *   brz_ensemble_free(&st);
+ */
+
+typedef struct BrzEnsembleStats {
+    uint32_t seed_lo, seed_hi; /* inclusive */
+    int run_n;
+    int failed_n;   /* runs that could not be built or stepped */
+    uint8_t* ok;    /* [run_n] 1 when the run completed */
+
+    int day_n;
+    int* days;      /* [day_n] reported days */
+
+    int metric_n;   /* avg_hunger, avg_fatigue, agent-held resources, items */
+    const char** metric_names; /* [metric_n], resource/item names owned by cfg */
+
+    double* values; /* [run_n][day_n][metric_n] */
+} BrzEnsembleStats;
+
+/* Run seeds seed_lo..seed_hi on jobs threads. Returns false on OOM or when
+   no run completed; st must be released with brz_ensemble_free either way. */
+bool brz_ensemble_collect(BrzEnsembleStats* st, const ParsedConfig* cfg,
+                          uint32_t seed_lo, uint32_t seed_hi, int jobs);
+void brz_ensemble_free(BrzEnsembleStats* st);
+
+/* one row per (day, metric): mean, sample sd, min, max over completed runs */
+bool brz_ensemble_write_table(const BrzEnsembleStats* st, FILE* f);
+
+/* collect + print the table to stdout; returns a process exit code */
+int  brz_run_ensemble(const ParsedConfig* cfg, uint32_t seed_lo, uint32_t seed_hi, int jobs);
+
+#endif /* BRZ_ENSEMBLE_H */
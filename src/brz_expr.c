@@ -0,0 +1,316 @@
+#include "brz_expr.h"
+#include "brz_vec.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- character cursor (same rules as the former runtime evaluator) ---- */
+
+static void ex_skip(const char** s){ while(**s && isspace((unsigned char)**s)) (*s)++; }
+static int ex_peek_word(const char* s, const char* w){
+    ex_skip(&s);
+    size_t n=strlen(w);
+    return strncmp(s,w,n)==0 && (s[n]==0 || isspace((unsigned char)s[n]) || s[n]==')' || s[n]=='(');
+}
+static int ex_consume_word(const char** s, const char* w){
+    ex_skip(s);
+    size_t n=strlen(w);
+    if(strncmp(*s,w,n)==0){ *s += n; return 1; }
+    return 0;
+}
+static int ex_read_ident(const char** s, char* out, int out_n){
+    ex_skip(s);
+    int i=0;
+    if(!(isalpha((unsigned char)**s) || **s=='_')) return 0;
+    while(**s && (isalnum((unsigned char)**s) || **s=='_' || **s=='.')){
+        if(i<out_n-1) out[i++] = **s;
+        (*s)++;
+    }
+    out[i]=0;
+    return 1;
+}
+static int ex_read_num(const char** s, double* out){
+    ex_skip(s);
+    char* end=NULL;
+    double v = strtod(*s,&end);
+    if(end==*s) return 0;
+    *out=v; *s=end; return 1;
+}
+static int ex_read_op(const char** s, BrzExprOp* op){
+    ex_skip(s);
+    const char* p = *s;
+    if(p[0]=='>' && p[1]=='='){ *op = BRZ_XOP_GE; *s += 2; return 1; }
+    if(p[0]=='<' && p[1]=='='){ *op = BRZ_XOP_LE; *s += 2; return 1; }
+    if(p[0]=='=' && p[1]=='='){ *op = BRZ_XOP_EQ; *s += 2; return 1; }
+    if(p[0]=='!' && p[1]=='='){ *op = BRZ_XOP_NE; *s += 2; return 1; }
+    if(p[0]=='>'){ *op = BRZ_XOP_GT; (*s)++; return 1; }
+    if(p[0]=='<'){ *op = BRZ_XOP_LT; (*s)++; return 1; }
+    return 0;
+}
+
+/* ---- compiler ---- */
+
+typedef struct {
+    const char* s;
+    BrzVec code;      /* BrzExprIns */
+    BrzVec chain_end; /* int: index one past the last ins of each and-chain */
+    char* err;
+    size_t err_n;
+} ExCompiler;
+
+static void ex_error(ExCompiler* c, const char* msg, const char* at)
+{
+    if(!c->err || c->err_n == 0 || c->err[0]) return;
+    ex_skip(&at);
+    if(*at){
+        size_t n = 0;
+        while(at[n] && !isspace((unsigned char)at[n])) n++;
+        snprintf(c->err, c->err_n, "%s near '%.*s'", msg, (int)n, at);
+    }else{
+        snprintf(c->err, c->err_n, "%s at end of expression", msg);
+    }
+}
+
+static bool ex_emit(ExCompiler* c, BrzExprOp op, int var, double rhs, int thresh)
+{
+    BrzExprIns in;
+    memset(&in, 0, sizeof(in));
+    in.op = (uint8_t)op;
+    in.var = (uint8_t)var;
+    in.rhs = rhs;
+    in.thresh = thresh;
+    return brz_vec_push(&c->code, &in);
+}
+
+static int ex_var_slot(const char* name)
+{
+    if(strcmp(name,"hunger")==0) return BRZ_EXPR_VAR_HUNGER;
+    if(strcmp(name,"fatigue")==0) return BRZ_EXPR_VAR_FATIGUE;
+    return -1;
+}
+
+static int ex_fold(BrzExprOp op, double lhs, double rhs)
+{
+    switch(op){
+        case BRZ_XOP_LT: return lhs <  rhs;
+        case BRZ_XOP_LE: return lhs <= rhs;
+        case BRZ_XOP_GT: return lhs >  rhs;
+        case BRZ_XOP_GE: return lhs >= rhs;
+        case BRZ_XOP_EQ: return lhs == rhs;
+        case BRZ_XOP_NE: return lhs != rhs;
+        default:         return 0;
+    }
+}
+
+/* chance(p) | ident [op number] -> exactly one instruction */
+static bool ex_cond(ExCompiler* c)
+{
+    const char** s = &c->s;
+    ex_skip(s);
+    if(ex_consume_word(s,"chance")){
+        ex_skip(s);
+        if(**s=='('){ (*s)++; }
+        double p=0;
+        if(!ex_read_num(s,&p)){
+            ex_error(c, "expected probability after 'chance'", *s);
+            return ex_emit(c, BRZ_XOP_FALSE, 0, 0.0, 0);
+        }
+        ex_skip(s);
+        if(**s==')') (*s)++;
+        if(p < 0) p = 0;
+        if(p > 1) p = 1;
+        return ex_emit(c, BRZ_XOP_CHANCE, 0, 0.0, (int)(p*10000.0));
+    }
+
+    char ident[128];
+    if(!ex_read_ident(s,ident,sizeof(ident))){
+        ex_error(c, "expected condition", *s);
+        return ex_emit(c, BRZ_XOP_FALSE, 0, 0.0, 0);
+    }
+    int slot = ex_var_slot(ident);
+
+    BrzExprOp op;
+    if(!ex_read_op(s,&op)){
+        /* truthy test */
+        if(slot < 0) return ex_emit(c, BRZ_XOP_FALSE, 0, 0.0, 0);
+        return ex_emit(c, BRZ_XOP_TRUTHY, slot, 0.0, 0);
+    }
+    double rhs=0;
+    if(!ex_read_num(s,&rhs)){
+        ex_error(c, "expected number after comparison", *s);
+        return ex_emit(c, BRZ_XOP_FALSE, 0, 0.0, 0);
+    }
+    if(slot < 0) return ex_emit(c, ex_fold(op, 0.0, rhs) ? BRZ_XOP_TRUE : BRZ_XOP_FALSE, 0, 0.0, 0);
+    return ex_emit(c, op, slot, rhs, 0);
+}
+
+static bool ex_atom(ExCompiler* c)
+{
+    const char** s = &c->s;
+    ex_skip(s);
+    if(**s=='('){
+        (*s)++;
+        if(!ex_cond(c)) return false;
+        ex_skip(s);
+        if(**s==')') (*s)++;
+        return true;
+    }
+    return ex_cond(c);
+}
+
+static bool ex_and(ExCompiler* c)
+{
+    if(!ex_atom(c)) return false;
+    while(ex_peek_word(c->s,"and")){
+        ex_consume_word(&c->s,"and");
+        if(!ex_atom(c)) return false;
+    }
+    int end = (int)c->code.len;
+    return brz_vec_push(&c->chain_end, &end);
+}
+
+static bool ex_or(ExCompiler* c)
+{
+    if(!ex_and(c)) return false;
+    while(ex_peek_word(c->s,"or")){
+        ex_consume_word(&c->s,"or");
+        if(!ex_and(c)) return false;
+    }
+    return true;
+}
+
+/* Wire jumps. Within a chain, true falls through to the next atom and false
+   rejects; the last atom accepts on true and falls back to the next chain. */
+static void ex_link(ExCompiler* c)
+{
+    BrzExprIns* code = (BrzExprIns*)c->code.data;
+    const int* ends = (const int*)c->chain_end.data;
+    size_t nchains = c->chain_end.len;
+    int start = 0;
+    for(size_t ci=0; ci<nchains; ci++){
+        int end = ends[ci];
+        for(int i=start; i<end; i++){
+            if(i+1 < end){
+                code[i].on_true  = i+1;
+                code[i].on_false = BRZ_EXPR_REJECT;
+            }else{
+                code[i].on_true  = BRZ_EXPR_ACCEPT;
+                code[i].on_false = (ci+1 < nchains) ? end : BRZ_EXPR_REJECT;
+            }
+        }
+        start = end;
+    }
+}
+
+bool brz_expr_compile(BrzExpr* out, const char* src, char* err, size_t err_n)
+{
+    if(err && err_n) err[0] = 0;
+    if(!out) return false;
+    out->code = NULL;
+    out->len = 0;
+
+    const char* s = src ? src : "";
+    ex_skip(&s);
+    if(!*s) return true; /* empty: always true */
+
+    ExCompiler c;
+    c.s = s;
+    c.err = err;
+    c.err_n = err_n;
+    brz_vec_init(&c.code, sizeof(BrzExprIns));
+    brz_vec_init(&c.chain_end, sizeof(int));
+
+    if(!ex_or(&c)){
+        brz_vec_destroy(&c.code);
+        brz_vec_destroy(&c.chain_end);
+        return false;
+    }
+    ex_skip(&c.s);
+    if(*c.s) ex_error(&c, "unexpected trailing text", c.s);
+
+    ex_link(&c);
+    brz_vec_destroy(&c.chain_end);
+
+    out->code = (BrzExprIns*)c.code.data;
+    out->len = (int)c.code.len;
+    return true;
+}
+
+/* ---------- shape ---------- */
+
+static void box_lower(BrzExprBox* b, int v, double x, bool open)
+{
+    if(x > b->lo[v] || (x == b->lo[v] && open)){ b->lo[v] = x; b->lo_open[v] = open; }
+}
+
+static void box_upper(BrzExprBox* b, int v, double x, bool open)
+{
+    if(x < b->hi[v] || (x == b->hi[v] && open)){ b->hi[v] = x; b->hi_open[v] = open; }
+}
+
+static bool box_empty(const BrzExprBox* b)
+{
+    for(int v=0; v<BRZ_EXPR_VAR_COUNT; v++){
+        if(b->lo[v] > b->hi[v]) return true;
+        if(b->lo[v] == b->hi[v] && (b->lo_open[v] || b->hi_open[v])) return true;
+    }
+    return false;
+}
+
+static bool box_unbounded(const BrzExprBox* b)
+{
+    for(int v=0; v<BRZ_EXPR_VAR_COUNT; v++)
+        if(b->lo[v] != -HUGE_VAL || b->hi[v] != HUGE_VAL) return false;
+    return true;
+}
+
+BrzExprShape brz_expr_shape(const BrzExpr* e, BrzExprBox* box)
+{
+    for(int v=0; v<BRZ_EXPR_VAR_COUNT; v++){
+        box->lo[v] = -HUGE_VAL; box->hi[v] = HUGE_VAL;
+        box->lo_open[v] = box->hi_open[v] = 0;
+    }
+    if(e->len == 0) return BRZ_EXPR_SHAPE_ALWAYS;
+
+    /* a plain chain: every atom rejects on false and falls through on true */
+    for(int pc=0; pc<e->len; pc++){
+        const BrzExprIns* in = &e->code[pc];
+        int next = (pc + 1 < e->len) ? pc + 1 : BRZ_EXPR_ACCEPT;
+        if(in->on_true != next || in->on_false != BRZ_EXPR_REJECT) return BRZ_EXPR_SHAPE_OPAQUE;
+    }
+
+    for(int pc=0; pc<e->len; pc++){
+        const BrzExprIns* in = &e->code[pc];
+        int v = in->var;
+        switch((BrzExprOp)in->op){
+            case BRZ_XOP_TRUE: break;
+            case BRZ_XOP_FALSE:
+                return BRZ_EXPR_SHAPE_NEVER;
+            case BRZ_XOP_GT: box_lower(box, v, in->rhs, true); break;
+            case BRZ_XOP_GE: box_lower(box, v, in->rhs, false); break;
+            case BRZ_XOP_LT: box_upper(box, v, in->rhs, true); break;
+            case BRZ_XOP_LE: box_upper(box, v, in->rhs, false); break;
+            case BRZ_XOP_EQ: box_lower(box, v, in->rhs, false); box_upper(box, v, in->rhs, false); break;
+            case BRZ_XOP_TRUTHY:
+            case BRZ_XOP_NE:
+            case BRZ_XOP_CHANCE:
+            default:
+                /* the atoms so far still have to hold, and are tested
+                   before anything draws */
+                if(box_empty(box)) return BRZ_EXPR_SHAPE_NEVER;
+                return box_unbounded(box) ? BRZ_EXPR_SHAPE_OPAQUE : BRZ_EXPR_SHAPE_GUARDED;
+        }
+        if(box_empty(box)) return BRZ_EXPR_SHAPE_NEVER;
+    }
+    return box_unbounded(box) ? BRZ_EXPR_SHAPE_ALWAYS : BRZ_EXPR_SHAPE_BOX;
+}
+
+void brz_expr_free(BrzExpr* e)
+{
+    if(!e) return;
+    free(e->code);
+    e->code = NULL;
+    e->len = 0;
+}
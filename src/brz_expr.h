@@ -0,0 +1,137 @@
+#ifndef BRZ_EXPR_H
+#define BRZ_EXPR_H
+
+/*
+ * brz_expr.h/.c - compiled DSL 'when' expressions
+ *
+ * A `when` string is compiled once (at config load) into a flat branch
+ * program. Each instruction tests one atom and jumps to the next pc on
+ * true/false, or terminates with ACCEPT/REJECT.
+ *
+ * Semantics are those of the original string evaluator:
+ *   expr := and_chain { 'or' and_chain }
+ *   and_chain := atom { 'and' atom }
+ *   atom := [ '(' ] cond [ ')' ]
+ *   cond := 'chance' [ '(' ] number [ ')' ] | ident [ cmp number ]
+ * including its short-circuit quirk: a false atom that is followed by
+ * 'and' rejects the whole expression (the remaining text is never read).
+ * Unknown identifiers read as 0 and are folded to constants.
+ *
+ * Usage:
+ *   BrzExpr e;
+ *   char err[128];
+ *   brz_expr_compile(&e, "hunger > 0.5 and chance(0.3)", err, sizeof(err));
+ *   double vars[BRZ_EXPR_VAR_COUNT] = { hunger, fatigue };
+ *   int ok = brz_expr_eval(&e, vars, &rng);
+ *   brz_expr_free(&e);
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "brz_util.h"
+
+/* variable slots, indexes into the vars[] array passed to brz_expr_eval */
+typedef enum {
+    BRZ_EXPR_VAR_HUNGER = 0,
+    BRZ_EXPR_VAR_FATIGUE,
+    BRZ_EXPR_VAR_COUNT
+} BrzExprVar;
+
+typedef enum {
+    BRZ_XOP_FALSE = 0,  /* constant (unknown variable, malformed atom) */
+    BRZ_XOP_TRUE,
+    BRZ_XOP_TRUTHY,     /* var != 0 */
+    BRZ_XOP_LT,
+    BRZ_XOP_LE,
+    BRZ_XOP_GT,
+    BRZ_XOP_GE,
+    BRZ_XOP_EQ,
+    BRZ_XOP_NE,
+    BRZ_XOP_CHANCE      /* rng roll in [0,10000) < thresh */
+} BrzExprOp;
+
+/* terminal jump targets */
+enum { BRZ_EXPR_ACCEPT = -1, BRZ_EXPR_REJECT = -2 };
+
+typedef struct {
+    double  rhs;
+    int32_t on_true;
+    int32_t on_false;
+    int32_t thresh;
+    uint8_t op;   /* BrzExprOp */
+    uint8_t var;  /* BrzExprVar */
+} BrzExprIns;
+
+typedef struct {
+    BrzExprIns* code; /* [len], owned (by the config arena once linked) */
+    int len;          /* 0 = empty expression (always true) */
+} BrzExpr;
+
+/* Set of variable values accepted by a conjunction of comparisons: var v
+   passes when it lies between lo[v] and hi[v], the bound itself included
+   unless lo_open[v] / hi_open[v]. Unbounded sides are -/+HUGE_VAL. */
+typedef struct {
+    double  lo[BRZ_EXPR_VAR_COUNT];
+    double  hi[BRZ_EXPR_VAR_COUNT];
+    uint8_t lo_open[BRZ_EXPR_VAR_COUNT];
+    uint8_t hi_open[BRZ_EXPR_VAR_COUNT];
+} BrzExprBox;
+
+/* What a program reduces to, see brz_expr_shape */
+typedef enum {
+    BRZ_EXPR_SHAPE_OPAQUE = 0, /* only running it tells; box is unbounded */
+    BRZ_EXPR_SHAPE_GUARDED,    /* false outside box without touching the rng;
+                                  inside, the program decides */
+    BRZ_EXPR_SHAPE_BOX,        /* true exactly inside box; never draws */
+    BRZ_EXPR_SHAPE_ALWAYS,     /* true; never draws */
+    BRZ_EXPR_SHAPE_NEVER       /* false; never draws */
+} BrzExprShape;
+
+/* Compile src into out. Always produces a program matching the runtime
+   semantics; if src is malformed a description of the first problem is
+   written to err (err[0]==0 when clean). Returns false only on OOM. */
+bool brz_expr_compile(BrzExpr* out, const char* src, char* err, size_t err_n);
+void brz_expr_free(BrzExpr* e);
+
+/* Classify e and fill box. Recognizes plain 'and' chains: the comparisons
+   ahead of the first chance() form the box. */
+BrzExprShape brz_expr_shape(const BrzExpr* e, BrzExprBox* box);
+
+static inline bool brz_expr_box_holds(const BrzExprBox* b, const double* vars)
+{
+    for(int v=0; v<BRZ_EXPR_VAR_COUNT; v++){
+        double x = vars[v];
+        if(b->lo_open[v] ? !(x > b->lo[v]) : !(x >= b->lo[v])) return false;
+        if(b->hi_open[v] ? !(x < b->hi[v]) : !(x <= b->hi[v])) return false;
+    }
+    return true;
+}
+
+static inline int brz_expr_eval(const BrzExpr* e, const double* vars, BrzRng* rng)
+{
+    if(e->len == 0) return 1;
+    int pc = 0;
+    for(;;){
+        const BrzExprIns* in = &e->code[pc];
+        int v;
+        switch((BrzExprOp)in->op){
+            case BRZ_XOP_TRUE:   v = 1; break;
+            case BRZ_XOP_TRUTHY: v = vars[in->var] != 0.0; break;
+            case BRZ_XOP_LT:     v = vars[in->var] <  in->rhs; break;
+            case BRZ_XOP_LE:     v = vars[in->var] <= in->rhs; break;
+            case BRZ_XOP_GT:     v = vars[in->var] >  in->rhs; break;
+            case BRZ_XOP_GE:     v = vars[in->var] >= in->rhs; break;
+            case BRZ_XOP_EQ:     v = vars[in->var] == in->rhs; break;
+            case BRZ_XOP_NE:     v = vars[in->var] != in->rhs; break;
+            case BRZ_XOP_CHANCE: v = (int)(brz_rng_u32(rng)%10000u) < in->thresh; break;
+            case BRZ_XOP_FALSE:
+            default:             v = 0; break;
+        }
+        pc = v ? in->on_true : in->on_false;
+        if(pc < 0) return pc == BRZ_EXPR_ACCEPT;
+    }
+}
+
+#endif /* BRZ_EXPR_H */
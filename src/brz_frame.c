@@ -0,0 +1,78 @@
+#include "brz_frame.h"
+#include "brz_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void frame_free(BrzFrame* f)
+{
+    free(f->agent_pos);
+    free(f->agent_voc);
+    free(f->tags);
+    memset(f, 0, sizeof(*f));
+}
+
+int brz_frames_init(BrzFrameChannel* ch, const BrzSim* sim)
+{
+    memset(ch, 0, sizeof(*ch));
+    const size_t an = (size_t)(sim->agents.n > 0 ? sim->agents.n : 1);
+    const size_t tn = (size_t)sim->world.w * (size_t)sim->world.h;
+    for(int k=0;k<3;k++){
+        BrzFrame* f = &ch->frame[k];
+        f->day = -1;
+        f->w = sim->world.w;
+        f->h = sim->world.h;
+        f->agent_pos = (BrzPos*)calloc(an, sizeof(BrzPos));
+        f->agent_voc = (uint32_t*)calloc(an, sizeof(uint32_t));
+        f->tags = (uint16_t*)calloc(tn ? tn : 1, sizeof(uint16_t));
+        if(!f->agent_pos || !f->agent_voc || !f->tags){
+            brz_frames_free(ch);
+            return 1;
+        }
+    }
+    ch->back = 0;
+    ch->middle = 1;
+    ch->front = 2;
+    return 0;
+}
+
+void brz_frames_free(BrzFrameChannel* ch)
+{
+    if(!ch) return;
+    for(int k=0;k<3;k++) frame_free(&ch->frame[k]);
+    memset(ch, 0, sizeof(*ch));
+}
+
+BrzFrame* brz_frames_back(BrzFrameChannel* ch)
+{
+    return &ch->frame[ch->back];
+}
+
+void brz_frames_publish(BrzFrameChannel* ch)
+{
+    /* release: the viewer that takes this frame sees everything written to it */
+    unsigned prev = __atomic_exchange_n(&ch->middle, (unsigned)ch->back | BRZ_FRAME_FRESH, __ATOMIC_ACQ_REL);
+    ch->back = (int)(prev & ~BRZ_FRAME_FRESH);
+}
+
+const BrzFrame* brz_frames_latest(BrzFrameChannel* ch)
+{
+    if(__atomic_load_n(&ch->middle, __ATOMIC_ACQUIRE) & BRZ_FRAME_FRESH){
+        unsigned prev = __atomic_exchange_n(&ch->middle, (unsigned)ch->front, __ATOMIC_ACQ_REL);
+        ch->front = (int)(prev & ~BRZ_FRAME_FRESH);
+    }
+    return &ch->frame[ch->front];
+}
+
+void brz_frame_capture(BrzFrame* f, const BrzSim* sim)
+{
+    const BrzAgentStore* a = &sim->agents;
+    f->day = sim->day;
+    f->agent_n = a->n;
+    memcpy(f->agent_pos, a->pos, (size_t)a->n * sizeof(BrzPos));
+    memcpy(f->agent_voc, a->voc, (size_t)a->n * sizeof(uint32_t));
+    if(!f->has_tags || f->tags_gen != sim->world.tags_gen){
+        memcpy(f->tags, sim->world.tags, (size_t)f->w * (size_t)f->h * sizeof(uint16_t));
+        f->tags_gen = sim->world.tags_gen;
+        f->has_tags = true;
+    }
+}
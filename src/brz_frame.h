@@ -0,0 +1,69 @@
+#ifndef BRZ_FRAME_H
+#define BRZ_FRAME_H
+
+/*
+ * brz_frame.h/.c - latest-frame channel from a sim thread to a viewer
+ *
+ * A frame is what a viewer draws of one day: agent positions and vocation
+ * ids, and the tile tags. The channel triple-buffers frames. The sim
+ * captures into the back frame and publishes it; the viewer takes the most
+ * recently published one. Neither side ever waits for the other: the sim
+ * always has a frame of its own to write, a viewer that is slower than
+ * the sim skips the days in between, and a faster one keeps drawing the
+ * same frame. Publishing and taking are each a single atomic exchange.
+ *
+ * Usage:
+ *   BrzFrameChannel ch;
+ *   brz_frames_init(&ch, &sim);
+ *   sim thread:  brz_frame_capture(brz_frames_back(&ch), &sim);
+ *                brz_frames_publish(&ch);
+ *   viewer:      const BrzFrame* f = brz_frames_latest(&ch);
+ *   brz_frames_free(&ch);                    (once both sides are done)
+ */
+
+#include "brz_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct BrzSim;
+
+typedef struct BrzFrame {
+    int day;            /* -1 until the first capture */
+    int agent_n;
+    BrzPos* agent_pos;  /* [agent_n] */
+    uint32_t* agent_voc; /* [agent_n] index into the config's vocations */
+    int w, h;
+    uint16_t* tags;     /* [w*h] */
+    uint32_t tags_gen;  /* world tags_gen the tags were copied at */
+    bool has_tags;
+} BrzFrame;
+
+typedef struct BrzFrameChannel {
+    BrzFrame frame[3];
+    int back;           /* sim side: the frame being captured */
+    int front;          /* viewer side: the frame being drawn */
+    unsigned middle;    /* the other frame, | BRZ_FRAME_FRESH once published
+                           and not yet taken; only touched atomically */
+} BrzFrameChannel;
+
+#define BRZ_FRAME_FRESH 4u
+
+/* Size the frames for sim's agents and map; returns 0 on success, 1 on OOM
+   (ch freed). */
+int  brz_frames_init(BrzFrameChannel* ch, const struct BrzSim* sim);
+void brz_frames_free(BrzFrameChannel* ch);
+
+/* sim side: the frame to capture into, and handing it over */
+BrzFrame* brz_frames_back(BrzFrameChannel* ch);
+void      brz_frames_publish(BrzFrameChannel* ch);
+
+/* viewer side: the newest published frame (day -1 before any). It stays
+   valid and unchanged until the next call. */
+const BrzFrame* brz_frames_latest(BrzFrameChannel* ch);
+
+/* Copy sim's current day into f; sleeping agents must be synced
+   (brz_sim_sync). Tags are only copied when they changed since f last
+   held them. */
+void brz_frame_capture(BrzFrame* f, const struct BrzSim* sim);
+
+#endif /* BRZ_FRAME_H */
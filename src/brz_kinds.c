@@ -1,4 +1,5 @@
 #include "brz_kinds.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -12,10 +13,50 @@ static char* brz_strdup(const char* s)
     return p;
 }
 
+/* FNV-1a */
+static size_t kind_hash(const char* s)
+{
+    uint32_t h = 2166136261u;
+    for(; *s; s++){ h ^= (unsigned char)*s; h *= 16777619u; }
+    return (size_t)h;
+}
+
+static const char* kind_at(const KindTable* kt, size_t id)
+{
+    char* const* sp = (char* const*)brz_vec_cat(&kt->names, id);
+    return (sp && *sp) ? *sp : "";
+}
+
+static void index_insert(int* index, size_t cap, const char* name, int id)
+{
+    size_t mask = cap - 1;
+    size_t i = kind_hash(name) & mask;
+    while(index[i]) i = (i + 1) & mask;
+    index[i] = id + 1;
+}
+
+/* keep the load factor <= 1/2 */
+static bool index_reserve(KindTable* kt, size_t n)
+{
+    if(n * 2 <= kt->index_cap) return true;
+    size_t cap = kt->index_cap ? kt->index_cap : 16;
+    while(cap < n * 2) cap *= 2;
+    int* index = (int*)calloc(cap, sizeof(int));
+    if(!index) return false;
+    for(size_t id=0; id<brz_vec_len(&kt->names); id++)
+        index_insert(index, cap, kind_at(kt, id), (int)id);
+    free(kt->index);
+    kt->index = index;
+    kt->index_cap = cap;
+    return true;
+}
+
 void kind_table_init(KindTable* kt)
 {
     if(!kt) return;
     brz_vec_init(&kt->names, sizeof(char*));
+    kt->index = NULL;
+    kt->index_cap = 0;
 }
 
 void kind_table_destroy(KindTable* kt)
@@ -27,15 +68,19 @@ void kind_table_destroy(KindTable* kt)
         if(sp && *sp) free(*sp);
     }
     brz_vec_destroy(&kt->names);
+    free(kt->index);
+    kt->index = NULL;
+    kt->index_cap = 0;
 }
 
 int kind_table_find(const KindTable* kt, const char* name)
 {
-    if(!kt || !name) return -1;
-    for(size_t i=0;i<brz_vec_len(&kt->names);i++)
+    if(!kt || !name || kt->index_cap == 0) return -1;
+    size_t mask = kt->index_cap - 1;
+    for(size_t i = kind_hash(name) & mask; kt->index[i]; i = (i + 1) & mask)
     {
-        char* const* sp = (char* const*)brz_vec_cat(&kt->names, i);
-        if(sp && *sp && strcmp(*sp, name)==0) return (int)i;
+        int id = kt->index[i] - 1;
+        if(strcmp(kind_at(kt, (size_t)id), name)==0) return id;
     }
     return -1;
 }
@@ -46,6 +91,7 @@ int kind_table_add(KindTable* kt, const char* name)
     int existing = kind_table_find(kt, name);
     if(existing >= 0) return existing;
 
+    if(!index_reserve(kt, brz_vec_len(&kt->names) + 1)) return -1;
     char* dup = brz_strdup(name);
     if(!dup) return -1;
     if(!brz_vec_push(&kt->names, &dup))
@@ -53,7 +99,9 @@ int kind_table_add(KindTable* kt, const char* name)
         free(dup);
         return -1;
     }
-    return (int)(brz_vec_len(&kt->names) - 1);
+    int id = (int)(brz_vec_len(&kt->names) - 1);
+    index_insert(kt->index, kt->index_cap, dup, id);
+    return id;
 }
 
 const char* kind_table_name(const KindTable* kt, int id)
@@ -11,11 +11,14 @@
  *
  * Resources and items are defined by the DSL file, not hard-coded enums.
  * A KindTable is an ordered list of unique names. The numeric id is the
- * index in that list.
+ * index in that list. Lookups go through an open-addressing hash index
+ * (linear probing) kept alongside the list.
  */
 
 typedef struct {
-    BrzVec names; /* elem = char* (owned) */
+    BrzVec names;     /* elem = char* (owned) */
+    int* index;       /* [index_cap] id+1 per slot, 0 = empty */
+    size_t index_cap; /* power of two, or 0 before the first add */
 } KindTable;
 
 void kind_table_init(KindTable* kt);
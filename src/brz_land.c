@@ -14,7 +14,19 @@
     globals, and results are stored as uint8_t heights.
 */
 
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L /* fileno, mmap, getpid */
+#endif
 #include "brz_land.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /* --- internal helpers (ported nearly 1:1) --- */
 
@@ -62,37 +74,44 @@ static void land_topo_set(BrzLand* land, int buffer, int lx, int ly, int value)
 
 static void land_swap_buffers(BrzLand* land) {
     /* Copy buffer 0 to buffer 1 (as per original). */
-    for (int i = 0; i < (BRZ_LAND_DIM * BRZ_LAND_DIM); i++) {
-        land->topo[(BRZ_LAND_DIM * BRZ_LAND_DIM) + i] = land->topo[i];
-    }
+    memcpy(land->topo + BRZ_LAND_DIM * BRZ_LAND_DIM, land->topo, BRZ_LAND_DIM * BRZ_LAND_DIM);
 }
 
 static void land_pack_flat(BrzLand* land) {
-    for (int i = 0; i < (BRZ_LAND_DIM * BRZ_LAND_DIM); i++) {
-        land->topo[i] = 128;
+    memset(land->topo, 128, BRZ_LAND_DIM * BRZ_LAND_DIM);
+}
+
+/* One 3x3 box-blur pass src -> dst with toroidal wrap. The 3x3 sum is split
+   into a vertical sum of three row pointers (col[]) followed by a horizontal
+   sum of three neighbouring columns. Sums are exact integers and the mean of
+   bytes stays in [0,255], so this matches the per-pixel loop of land.c bit
+   for bit while both inner loops vectorize. */
+static void land_blur_pass(const uint8_t* src, uint8_t* dst) {
+    uint16_t col[BRZ_LAND_DIM + 2];
+    for (int py = 0; py < BRZ_LAND_DIM; py++) {
+        const uint8_t* up = src + ((py - 1) & (BRZ_LAND_DIM - 1)) * BRZ_LAND_DIM;
+        const uint8_t* mid = src + py * BRZ_LAND_DIM;
+        const uint8_t* dn = src + ((py + 1) & (BRZ_LAND_DIM - 1)) * BRZ_LAND_DIM;
+        uint8_t* out = dst + py * BRZ_LAND_DIM;
+
+        for (int px = 0; px < BRZ_LAND_DIM; px++) {
+            col[px + 1] = (uint16_t)(up[px] + mid[px] + dn[px]);
+        }
+        col[0] = col[BRZ_LAND_DIM];
+        col[BRZ_LAND_DIM + 1] = col[1];
+
+        for (int px = 0; px < BRZ_LAND_DIM; px++) {
+            out[px] = (uint8_t)((col[px] + col[px + 1] + col[px + 2]) / 9);
+        }
     }
 }
 
 static void land_round(BrzLand* land) {
-    int local_tile_dimension = 1 << 9; /* 512 */
-    int span_minor = 0;
-    while (span_minor < 6) {
-        int py = 0;
-        while (py < local_tile_dimension) {
-            int px = 0;
-            while (px < local_tile_dimension) {
-                int sum = 0;
-                for (int ty = -1; ty < 2; ty++) {
-                    for (int tx = -1; tx < 2; tx++) {
-                        sum += land_topo_get(land, (span_minor & 1), px + tx, py + ty);
-                    }
-                }
-                land_topo_set(land, (span_minor & 1) ^ 1, px, py, sum / 9);
-                px += 1;
-            }
-            py += 1;
-        }
-        span_minor += 1;
+    /* 6 passes ping-ponging between the buffers; the last lands in buffer 0 */
+    for (int span_minor = 0; span_minor < 6; span_minor++) {
+        int from = span_minor & 1;
+        land_blur_pass(land->topo + from * BRZ_LAND_DIM * BRZ_LAND_DIM,
+                       land->topo + (from ^ 1) * BRZ_LAND_DIM * BRZ_LAND_DIM);
     }
 }
 
@@ -136,6 +155,135 @@ static void land_patch(BrzLand* land, int refine) {
     }
 }
 
+/* --- heightmap cache --- */
+
+/* A cache file is this header followed by buffer 0 (DIM*DIM bytes). It is
+   written to a private temp name and renamed into place, so concurrent
+   processes sharing a cache directory only ever see complete files. */
+typedef struct {
+    char     magic[8];
+    uint32_t version;     /* BRZ_LAND_GEN_VERSION */
+    uint32_t dim;
+    int32_t  seed[2];     /* r1, r2 as passed to brz_land_seed */
+    int32_t  genetics[2]; /* PRNG state after generation */
+    uint32_t checksum;    /* FNV-1a of the heights */
+    uint32_t reserved;
+} LandCacheHeader;
+
+static const char k_land_magic[8] = { 'B','R','Z','L','A','N','D',0 };
+
+/* cache directory: set by brz_land_set_cache_dir or, on first use, from
+   BRZ_LAND_CACHE; builds run on several threads, so g_cache_mu guards it */
+static pthread_mutex_t g_cache_mu = PTHREAD_MUTEX_INITIALIZER;
+static char g_cache_dir[1024];
+static bool g_cache_dir_set = false;
+
+static uint32_t land_checksum(const uint8_t* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* with g_cache_mu held */
+static void land_set_cache_dir_locked(const char* dir) {
+    g_cache_dir_set = true;
+    g_cache_dir[0] = 0;
+    if (dir && strlen(dir) < sizeof(g_cache_dir)) {
+        strcpy(g_cache_dir, dir);
+    }
+}
+
+static bool land_cache_path(char* out, size_t out_n, int r1, int r2) {
+    int n = 0;
+    pthread_mutex_lock(&g_cache_mu);
+    if (!g_cache_dir_set) {
+        land_set_cache_dir_locked(getenv("BRZ_LAND_CACHE"));
+    }
+    if (g_cache_dir[0]) {
+        n = snprintf(out, out_n, "%s/land_v%u_%d_%d.brzland", g_cache_dir, BRZ_LAND_GEN_VERSION, r1, r2);
+    }
+    pthread_mutex_unlock(&g_cache_mu);
+    return n > 0 && (size_t)n < out_n;
+}
+
+static bool land_cache_accept(BrzLand* land, const uint8_t* data, size_t size, int r1, int r2) {
+    LandCacheHeader hd;
+    if (size != sizeof(hd) + (size_t)BRZ_LAND_DIM * BRZ_LAND_DIM) return false;
+    memcpy(&hd, data, sizeof(hd));
+    const uint8_t* heights = data + sizeof(hd);
+    if (memcmp(hd.magic, k_land_magic, sizeof(k_land_magic)) != 0 ||
+        hd.version != BRZ_LAND_GEN_VERSION || hd.dim != (uint32_t)BRZ_LAND_DIM ||
+        hd.seed[0] != r1 || hd.seed[1] != r2 ||
+        hd.checksum != land_checksum(heights, (size_t)BRZ_LAND_DIM * BRZ_LAND_DIM)) {
+        return false;
+    }
+    land->genetics[0] = hd.genetics[0];
+    land->genetics[1] = hd.genetics[1];
+    memcpy(land->topo, heights, BRZ_LAND_DIM * BRZ_LAND_DIM);
+    land_swap_buffers(land);
+    return true;
+}
+
+static bool land_cache_load(BrzLand* land, const char* path, int r1, int r2) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    bool ok = false;
+#if !defined(_WIN32)
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && st.st_size > 0) {
+        void* m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (m != MAP_FAILED) {
+            ok = land_cache_accept(land, (const uint8_t*)m, (size_t)st.st_size, r1, r2);
+            munmap(m, (size_t)st.st_size);
+            fclose(f);
+            return ok;
+        }
+    }
+#endif
+    size_t want = sizeof(LandCacheHeader) + (size_t)BRZ_LAND_DIM * BRZ_LAND_DIM;
+    uint8_t* buf = (uint8_t*)malloc(want + 1);
+    if (buf) {
+        size_t got = fread(buf, 1, want + 1, f);
+        ok = land_cache_accept(land, buf, got, r1, r2);
+        free(buf);
+    }
+    fclose(f);
+    return ok;
+}
+
+static void land_cache_store(const BrzLand* land, const char* path, int r1, int r2) {
+    char tmp[1100];
+#if !defined(_WIN32)
+    long pid = (long)getpid();
+#else
+    long pid = 0;
+#endif
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp%ld", path, pid);
+    if (n <= 0 || (size_t)n >= sizeof(tmp)) return;
+
+    LandCacheHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, k_land_magic, sizeof(k_land_magic));
+    hd.version = BRZ_LAND_GEN_VERSION;
+    hd.dim = (uint32_t)BRZ_LAND_DIM;
+    hd.seed[0] = r1;
+    hd.seed[1] = r2;
+    hd.genetics[0] = land->genetics[0];
+    hd.genetics[1] = land->genetics[1];
+    hd.checksum = land_checksum(land->topo, (size_t)BRZ_LAND_DIM * BRZ_LAND_DIM);
+
+    /* the cache is an optimisation: any failure just leaves no file behind */
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return;
+    bool ok = fwrite(&hd, sizeof(hd), 1, f) == 1 &&
+              fwrite(land->topo, 1, BRZ_LAND_DIM * BRZ_LAND_DIM, f) == (size_t)BRZ_LAND_DIM * BRZ_LAND_DIM;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) remove(tmp);
+}
+
 /* --- public API --- */
 
 void brz_land_seed(BrzLand* land, int r1, int r2) {
@@ -168,3 +316,93 @@ uint8_t brz_land_height_at(const BrzLand* land, int x, int y) {
     if (!land) return 0;
     return land->topo[land_wrap_index(x, y)];
 }
+
+void brz_land_set_cache_dir(const char* dir) {
+    pthread_mutex_lock(&g_cache_mu);
+    land_set_cache_dir_locked(dir);
+    pthread_mutex_unlock(&g_cache_mu);
+}
+
+bool brz_land_build(BrzLand* land, int r1, int r2) {
+    if (!land) return false;
+    char path[1024];
+    bool cached = land_cache_path(path, sizeof(path), r1, r2);
+    if (cached && land_cache_load(land, path, r1, r2)) return true;
+
+    brz_land_seed(land, r1, r2);
+    brz_land_generate(land);
+    if (cached) land_cache_store(land, path, r1, r2);
+    return false;
+}
+
+/* --- shared maps --- */
+
+typedef struct LandEntry {
+    BrzLand land; /* first, so a BrzLand* is its entry */
+    int seed[2];
+    int refs;
+    bool building; /* brz_land_build is still filling land */
+    struct LandEntry* next;
+} LandEntry;
+
+/* live maps, plus at most one idle (refs == 0) entry, guarded by g_land_mu;
+   g_land_built is signalled whenever an entry stops building */
+static pthread_mutex_t g_land_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_land_built = PTHREAD_COND_INITIALIZER;
+static LandEntry* g_lands = NULL;
+
+const BrzLand* brz_land_acquire(int r1, int r2) {
+    pthread_mutex_lock(&g_land_mu);
+    LandEntry* e = g_lands;
+    while (e && !(e->seed[0] == r1 && e->seed[1] == r2)) e = e->next;
+    if (e) {
+        /* a second caller for the same seed waits for the first to finish
+           instead of generating the map twice */
+        e->refs++;
+        while (e->building) pthread_cond_wait(&g_land_built, &g_land_mu);
+        pthread_mutex_unlock(&g_land_mu);
+        return &e->land;
+    }
+
+    /* publish a placeholder, then build outside the lock so that other
+       seeds (--ensemble workers) are not held up */
+    e = (LandEntry*)malloc(sizeof(LandEntry));
+    if (e) {
+        e->seed[0] = r1;
+        e->seed[1] = r2;
+        e->refs = 1;
+        e->building = true;
+        e->next = g_lands;
+        g_lands = e;
+    }
+    pthread_mutex_unlock(&g_land_mu);
+    if (!e) return NULL;
+
+    brz_land_build(&e->land, r1, r2);
+
+    pthread_mutex_lock(&g_land_mu);
+    e->building = false;
+    pthread_cond_broadcast(&g_land_built);
+    pthread_mutex_unlock(&g_land_mu);
+    return &e->land;
+}
+
+void brz_land_release(const BrzLand* land) {
+    if (!land) return;
+    pthread_mutex_lock(&g_land_mu);
+    LandEntry* dropped = (LandEntry*)land;
+    if (--dropped->refs == 0) {
+        /* keep dropped as the idle entry; free any older idle one */
+        LandEntry** pp = &g_lands;
+        while (*pp) {
+            LandEntry* e = *pp;
+            if (e != dropped && e->refs == 0) {
+                *pp = e->next;
+                free(e);
+            } else {
+                pp = &e->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_land_mu);
+}
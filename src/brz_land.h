@@ -14,12 +14,22 @@
     Notes:
       - The generator is intentionally tiny and deterministic.
       - Heights wrap toroidally (x,y modulo 512) like the original.
+      - The map depends only on the seed pair, so brz_land_build can keep
+        generated maps in an on-disk cache (land_vV_R1_R2.brzland files).
+        Bump BRZ_LAND_GEN_VERSION whenever the generator output changes.
+      - Worlds share maps through brz_land_acquire/brz_land_release: one
+        heap-allocated, reference-counted map per seed pair, read-only once
+        built, so it never has to live on a (thread) stack.
 */
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 enum { BRZ_LAND_DIM = 512 };
 
+#define BRZ_LAND_GEN_VERSION 1u
+
 typedef struct {
     int genetics[2];
     /* Double-buffer like the original (2 * 512 * 512). Only buffer 0 is public. */
@@ -32,7 +42,31 @@ void   brz_land_seed(BrzLand* land, int r1, int r2);
 /* Generate the full 512x512 heightmap into land->topo (buffer 0). */
 void   brz_land_generate(BrzLand* land);
 
+/* Directory of the heightmap cache; NULL or "" disables it. Until this is
+   called the directory comes from the BRZ_LAND_CACHE environment variable. */
+void   brz_land_set_cache_dir(const char* dir);
+
+/* Seed and generate, going through the cache when one is configured: a hit
+   maps the cached file instead of generating, a miss generates and stores.
+   The result is identical either way. Returns true on a cache hit. */
+bool   brz_land_build(BrzLand* land, int r1, int r2);
+
 /* Sample height with wrapping; returns [0,255]. */
 uint8_t brz_land_height_at(const BrzLand* land, int x, int y);
 
+/* Row y (wrapped) of the heightmap, BRZ_LAND_DIM heights indexed by x in
+   [0, BRZ_LAND_DIM). Lets samplers hoist the row lookup out of the x loop. */
+static inline const uint8_t* brz_land_row(const BrzLand* land, int y) {
+    return land->topo + (size_t)((y + BRZ_LAND_DIM) & (BRZ_LAND_DIM - 1)) * BRZ_LAND_DIM;
+}
+
+/* Shared map for (r1, r2), built with brz_land_build on first use. Further
+   acquires of the same seeds return the same object until the last holder
+   releases it; the most recently dropped map is kept around so that a
+   reload with the same seed reuses it. Thread-safe: maps for different
+   seeds are built concurrently, a caller for a seed that is still being
+   built waits for it. NULL on OOM. */
+const BrzLand* brz_land_acquire(int r1, int r2);
+void           brz_land_release(const BrzLand* land);
+
 #endif /* BRZ_LAND_H */
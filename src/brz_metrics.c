@@ -0,0 +1,408 @@
+#include "brz_metrics.h"
+#include "brz_kinds.h"
+#include "brz_util.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char k_magic[8] = { 'B','R','Z','M','E','T','R',0 };
+static const char* const k_table_name[BRZ_METRICS_TABLES] = { "days", "settlements" };
+/* leading i32 columns: day, agents / day, settlement, population */
+static const int k_int_cols[BRZ_METRICS_TABLES] = { 2, 3 };
+
+static size_t table_rows(const BrzMetrics* m, int t)
+{
+    return t == BRZ_METRICS_DAYS ? (size_t)m->block_days : (size_t)m->block_days * (size_t)m->sett_n;
+}
+
+static size_t col_bytes(int t, int c)
+{
+    return c < k_int_cols[t] ? 4 : 8;
+}
+
+static void col_name(const ParsedConfig* cfg, int t, int c, char* out, size_t n)
+{
+    const size_t res_n = kind_table_count(&cfg->resource_kinds);
+    static const char* const fixed[BRZ_METRICS_TABLES][4] = {
+        { "day", "agents", "avg_hunger", "avg_fatigue" },
+        { "day", "settlement", "population", NULL }
+    };
+    const int fixed_n = t == BRZ_METRICS_DAYS ? 4 : 3;
+    if(c < fixed_n){ snprintf(out, n, "%s", fixed[t][c]); return; }
+    size_t k = (size_t)(c - fixed_n);
+    const char* prefix;
+    const char* nm;
+    if(t == BRZ_METRICS_DAYS && k < res_n){ prefix = "world_"; nm = kind_table_name(&cfg->resource_kinds, (int)k); }
+    else{
+        if(t == BRZ_METRICS_DAYS) k -= res_n;
+        if(k < res_n){ prefix = t == BRZ_METRICS_DAYS ? "agent_res_" : "res_"; nm = kind_table_name(&cfg->resource_kinds, (int)k); }
+        else{ prefix = t == BRZ_METRICS_DAYS ? "agent_item_" : "item_"; nm = kind_table_name(&cfg->item_kinds, (int)(k - res_n)); }
+    }
+    snprintf(out, n, "%s%s", prefix, nm ? nm : "");
+}
+
+/* ---------------- writer ---------------- */
+
+static void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static void put_f64(uint8_t* p, double d)
+{
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    for(int b=0;b<8;b++) p[b] = (uint8_t)(v >> (8*b));
+}
+
+static void write_u32(BrzMetrics* m, uint32_t v)
+{
+    uint8_t b[4];
+    put_u32(b, v);
+    if(fwrite(b, 1, 4, m->f) != 4) m->ok = false;
+}
+
+static void write_str(BrzMetrics* m, const char* s)
+{
+    size_t n = strlen(s);
+    if(n > 0xFFFFu) n = 0xFFFFu;
+    uint8_t b[2] = { (uint8_t)n, (uint8_t)(n >> 8) };
+    if(fwrite(b, 1, 2, m->f) != 2 || fwrite(s, 1, n, m->f) != n) m->ok = false;
+}
+
+static void metrics_release(BrzMetrics* m)
+{
+    if(m->f) fclose(m->f);
+    for(int t=0;t<BRZ_METRICS_TABLES;t++) free(m->col[t]);
+    free(m->buf);
+    memset(m, 0, sizeof(*m));
+}
+
+bool brz_metrics_open(BrzMetrics* m, const char* path, const ParsedConfig* cfg,
+                      const BrzSettlement* setts, int sett_n, int block_rows)
+{
+    memset(m, 0, sizeof(*m));
+    m->res_n = kind_table_count(&cfg->resource_kinds);
+    m->item_n = kind_table_count(&cfg->item_kinds);
+    m->sett_n = sett_n > 0 ? sett_n : 0;
+    m->col_n[BRZ_METRICS_DAYS] = 4 + (int)(2*m->res_n + m->item_n);
+    m->col_n[BRZ_METRICS_SETTLEMENTS] = 3 + (int)(m->res_n + m->item_n);
+    if(block_rows <= 0) block_rows = BRZ_METRICS_BLOCK_ROWS;
+    m->block_days = m->sett_n > 0 ? block_rows / m->sett_n : block_rows;
+    if(m->block_days < 1) m->block_days = 1;
+
+    size_t block_bytes = 0;
+    for(int t=0;t<BRZ_METRICS_TABLES;t++){
+        const size_t rows = table_rows(m, t);
+        m->col[t] = (double*)calloc((size_t)m->col_n[t] * rows + 1, sizeof(double));
+        block_bytes += 4;
+        for(int c=0;c<m->col_n[t];c++) block_bytes += rows * col_bytes(t, c);
+    }
+    m->buf = (uint8_t*)malloc(block_bytes);
+    if(!m->col[0] || !m->col[1] || !m->buf){
+        fprintf(stderr, "Error: OOM for metrics buffers\n");
+        metrics_release(m);
+        return false;
+    }
+    m->f = fopen(path, "wb");
+    if(!m->f){
+        fprintf(stderr, "Error: cannot create %s\n", path);
+        metrics_release(m);
+        return false;
+    }
+    m->ok = true;
+
+    if(fwrite(k_magic, 1, sizeof(k_magic), m->f) != sizeof(k_magic)) m->ok = false;
+    write_u32(m, BRZ_METRICS_VERSION);
+    write_u32(m, 0u); /* flags */
+    write_u32(m, (uint32_t)m->sett_n);
+    for(int s=0;s<m->sett_n;s++) write_str(m, setts[s].name);
+    write_u32(m, BRZ_METRICS_TABLES);
+    for(int t=0;t<BRZ_METRICS_TABLES;t++){
+        write_str(m, k_table_name[t]);
+        write_u32(m, (uint32_t)m->col_n[t]);
+        for(int c=0;c<m->col_n[t];c++){
+            char nm[160];
+            col_name(cfg, t, c, nm, sizeof(nm));
+            uint8_t type = col_bytes(t, c) == 4 ? 'i' : 'd';
+            if(fputc(type, m->f) == EOF) m->ok = false;
+            write_str(m, nm);
+        }
+    }
+    if(!m->ok){
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        metrics_release(m);
+        return false;
+    }
+    return true;
+}
+
+/* encode the buffered days as one block and write it */
+static void metrics_flush(BrzMetrics* m)
+{
+    if(m->days == 0) return;
+    uint8_t* p = m->buf;
+    for(int t=0;t<BRZ_METRICS_TABLES;t++){
+        const size_t cap = table_rows(m, t);
+        const size_t rows = t == BRZ_METRICS_DAYS ? (size_t)m->days : (size_t)m->days * (size_t)m->sett_n;
+        put_u32(p, (uint32_t)rows);
+        p += 4;
+        for(int c=0;c<m->col_n[t];c++){
+            const double* v = m->col[t] + (size_t)c * cap;
+            if(c < k_int_cols[t]){
+                for(size_t r=0;r<rows;r++, p+=4) put_u32(p, (uint32_t)(int32_t)v[r]);
+            }else{
+                for(size_t r=0;r<rows;r++, p+=8) put_f64(p, v[r]);
+            }
+        }
+    }
+    const size_t n = (size_t)(p - m->buf);
+    if(m->ok && fwrite(m->buf, 1, n, m->f) != n) m->ok = false;
+    m->days = 0;
+}
+
+void brz_metrics_record(BrzMetrics* m, int day, const BrzWorld* world,
+                        const BrzSettlement* setts, const BrzAgentStore* agents)
+{
+    if(!m->f) return;
+    const size_t res_n = m->res_n, item_n = m->item_n;
+
+    /* days: one column every block_days values */
+    const size_t dcap = table_rows(m, BRZ_METRICS_DAYS);
+    double* v = m->col[BRZ_METRICS_DAYS] + (size_t)m->days;
+    v[0] = day;
+    v[dcap] = agents->n;
+    v[2*dcap] = agents->n > 0 ? brz_agents_total_hunger(agents) / agents->n : 0.0;
+    v[3*dcap] = agents->n > 0 ? brz_agents_total_fatigue(agents) / agents->n : 0.0;
+    v += 4*dcap;
+    for(size_t r=0;r<res_n;r++, v+=dcap) *v = brz_world_res_total(world, (int)r);
+    for(size_t r=0;r<res_n;r++, v+=dcap) *v = brz_agents_total_res(agents, r);
+    for(size_t i=0;i<item_n;i++, v+=dcap) *v = brz_agents_total_item(agents, i);
+
+    /* settlements: rows day-major, settlement-minor */
+    const size_t scap = table_rows(m, BRZ_METRICS_SETTLEMENTS);
+    double* base = m->col[BRZ_METRICS_SETTLEMENTS] + (size_t)m->days * (size_t)m->sett_n;
+    for(int s=0;s<m->sett_n;s++){
+        double* w = base + s;
+        w[0] = day;
+        w[scap] = s;
+        w[2*scap] = setts[s].population;
+        w += 3*scap;
+        for(size_t r=0;r<res_n;r++, w+=scap) *w = setts[s].res_inv[r];
+        for(size_t i=0;i<item_n;i++, w+=scap) *w = setts[s].item_inv[i];
+    }
+
+    if(++m->days == m->block_days) metrics_flush(m);
+}
+
+bool brz_metrics_close(BrzMetrics* m)
+{
+    if(!m->f){ metrics_release(m); return false; }
+    metrics_flush(m);
+    bool ok = m->ok;
+    if(fclose(m->f) != 0) ok = false;
+    m->f = NULL;
+    metrics_release(m);
+    return ok;
+}
+
+/* ---------------- reader ---------------- */
+
+typedef struct {
+    const uint8_t* p;
+    size_t left;
+    bool ok;
+} MetIn;
+
+static const uint8_t* met_take(MetIn* in, size_t n)
+{
+    if(!in->ok || in->left < n){ in->ok = false; return NULL; }
+    const uint8_t* p = in->p;
+    in->p += n;
+    in->left -= n;
+    return p;
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static double get_f64(const uint8_t* p)
+{
+    uint64_t v = 0;
+    for(int b=0;b<8;b++) v |= (uint64_t)p[b] << (8*b);
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+static uint32_t met_u32(MetIn* in)
+{
+    const uint8_t* p = met_take(in, 4);
+    return p ? get_u32(p) : 0;
+}
+
+static char* met_str(MetIn* in)
+{
+    const uint8_t* lp = met_take(in, 2);
+    if(!lp) return NULL;
+    size_t len = (size_t)lp[0] | ((size_t)lp[1] << 8);
+    const uint8_t* sp = met_take(in, len);
+    if(!sp) return NULL;
+    char* s = (char*)malloc(len + 1);
+    if(!s){ in->ok = false; return NULL; }
+    memcpy(s, sp, len);
+    s[len] = 0;
+    return s;
+}
+
+static size_t row_bytes(const BrzMetricsTable* t)
+{
+    size_t n = 0;
+    for(int c=0;c<t->col_n;c++) n += t->col_type[c] == 'i' ? 4 : 8;
+    return n;
+}
+
+/* walk the blocks; with fill, decode them into the tables */
+static bool met_blocks(BrzMetricsFile* mf, MetIn in, bool fill)
+{
+    size_t at[BRZ_METRICS_TABLES] = { 0 };
+    while(in.ok && in.left > 0){
+        for(int t=0;t<BRZ_METRICS_TABLES && in.ok;t++){
+            BrzMetricsTable* tb = &mf->table[t];
+            const size_t rows = met_u32(&in);
+            const size_t rb = row_bytes(tb);
+            if(!in.ok || (rb && rows > in.left / rb)) return false;
+            if(!fill){
+                in.p += rows * rb;
+                in.left -= rows * rb;
+                tb->rows += rows;
+                continue;
+            }
+            for(int c=0;c<tb->col_n;c++){
+                double* v = tb->col + (size_t)c * tb->rows + at[t];
+                if(tb->col_type[c] == 'i'){
+                    const uint8_t* p = met_take(&in, rows * 4);
+                    for(size_t r=0;r<rows;r++) v[r] = (int32_t)get_u32(p + 4*r);
+                }else{
+                    const uint8_t* p = met_take(&in, rows * 8);
+                    for(size_t r=0;r<rows;r++) v[r] = get_f64(p + 8*r);
+                }
+            }
+            at[t] += rows;
+        }
+    }
+    return in.ok;
+}
+
+static bool met_fail(BrzMetricsFile* mf, char* data, char* err, size_t err_n, const char* msg)
+{
+    if(err && err_n) snprintf(err, err_n, "%s", msg);
+    free(data);
+    brz_metrics_file_free(mf);
+    return false;
+}
+
+bool brz_metrics_read(BrzMetricsFile* mf, const char* path, char* err, size_t err_n)
+{
+    memset(mf, 0, sizeof(*mf));
+    if(err && err_n) err[0] = 0;
+
+    size_t size = 0;
+    char* data = brz_read_entire_file(path, &size);
+    if(!data) return met_fail(mf, NULL, err, err_n, "cannot read file");
+
+    MetIn in;
+    in.p = (const uint8_t*)data;
+    in.left = size;
+    in.ok = true;
+
+    const uint8_t* magic = met_take(&in, sizeof(k_magic));
+    if(!magic || memcmp(magic, k_magic, sizeof(k_magic)) != 0)
+        return met_fail(mf, data, err, err_n, "not a bronzesim metrics file");
+    uint32_t version = met_u32(&in);
+    uint32_t flags = met_u32(&in);
+    if(in.ok && (version != BRZ_METRICS_VERSION || flags != 0u))
+        return met_fail(mf, data, err, err_n, "unsupported metrics version");
+
+    uint32_t sett_n = met_u32(&in);
+    if(!in.ok || sett_n > in.left / 2)
+        return met_fail(mf, data, err, err_n, "truncated or corrupt metrics file");
+    mf->sett_name = (char**)calloc(sett_n ? sett_n : 1, sizeof(char*));
+    if(!mf->sett_name) return met_fail(mf, data, err, err_n, "out of memory");
+    mf->sett_n = (int)sett_n;
+    for(uint32_t s=0;s<sett_n && in.ok;s++) mf->sett_name[s] = met_str(&in);
+
+    if(met_u32(&in) != BRZ_METRICS_TABLES && in.ok)
+        return met_fail(mf, data, err, err_n, "unsupported metrics tables");
+    for(int t=0;t<BRZ_METRICS_TABLES && in.ok;t++){
+        BrzMetricsTable* tb = &mf->table[t];
+        tb->name = met_str(&in);
+        uint32_t col_n = met_u32(&in);
+        if(!in.ok || col_n > in.left / 3){ in.ok = false; break; }
+        tb->col_name = (char**)calloc(col_n ? col_n : 1, sizeof(char*));
+        tb->col_type = (uint8_t*)calloc(col_n ? col_n : 1, 1);
+        if(!tb->col_name || !tb->col_type) return met_fail(mf, data, err, err_n, "out of memory");
+        tb->col_n = (int)col_n;
+        for(uint32_t c=0;c<col_n && in.ok;c++){
+            const uint8_t* type = met_take(&in, 1);
+            if(type && *type != 'i' && *type != 'd') in.ok = false;
+            if(type) tb->col_type[c] = *type;
+            tb->col_name[c] = met_str(&in);
+        }
+    }
+    if(!in.ok || !met_blocks(mf, in, false))
+        return met_fail(mf, data, err, err_n, "truncated or corrupt metrics file");
+
+    for(int t=0;t<BRZ_METRICS_TABLES;t++){
+        BrzMetricsTable* tb = &mf->table[t];
+        tb->col = (double*)malloc(((size_t)tb->col_n * tb->rows + 1) * sizeof(double));
+        if(!tb->col) return met_fail(mf, data, err, err_n, "out of memory");
+    }
+    met_blocks(mf, in, true);
+    free(data);
+    return true;
+}
+
+static void free_strs(char** s, int n)
+{
+    if(!s) return;
+    for(int i=0;i<n;i++) free(s[i]);
+    free(s);
+}
+
+void brz_metrics_file_free(BrzMetricsFile* mf)
+{
+    if(!mf) return;
+    free_strs(mf->sett_name, mf->sett_n);
+    for(int t=0;t<BRZ_METRICS_TABLES;t++){
+        BrzMetricsTable* tb = &mf->table[t];
+        free(tb->name);
+        free_strs(tb->col_name, tb->col_n);
+        free(tb->col_type);
+        free(tb->col);
+    }
+    memset(mf, 0, sizeof(*mf));
+}
+
+const double* brz_metrics_column(const BrzMetricsTable* t, const char* name)
+{
+    for(int c=0;c<t->col_n;c++)
+        if(t->col_name[c] && brz_streq(t->col_name[c], name)) return t->col + (size_t)c * t->rows;
+    return NULL;
+}
+
+bool brz_metrics_write_csv(const BrzMetricsTable* t, FILE* f)
+{
+    for(int c=0;c<t->col_n;c++) fprintf(f, "%s%s", c ? "," : "", t->col_name[c] ? t->col_name[c] : "");
+    fputc('\n', f);
+    for(size_t r=0;r<t->rows;r++){
+        for(int c=0;c<t->col_n;c++){
+            const double v = t->col[(size_t)c * t->rows + r];
+            if(t->col_type[c] == 'i') fprintf(f, "%s%d", c ? "," : "", (int)v);
+            else fprintf(f, "%s%.17g", c ? "," : "", v);
+        }
+        fputc('\n', f);
+    }
+    return !ferror(f);
+}
@@ -0,0 +1,96 @@
+#ifndef BRZ_METRICS_H
+#define BRZ_METRICS_H
+
+#include "brz_dsl.h"
+#include "brz_world.h"
+#include "brz_settlement.h"
+#include "brz_agent.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * brz_metrics.h/.c - columnar per-day time series
+ *
+ * sim { metrics columnar } appends one row per day to a "days" table and
+ * one row per day and settlement to a "settlements" table, read from the
+ * running totals (no rescans, no text formatting). Rows are buffered by
+ * column and written in blocks of about block_rows settlement rows, so a
+ * notebook can load each column with one read per block.
+ *
+ * File layout (all integers and doubles little-endian):
+ *   header   "BRZMETR\0", u32 version, u32 flags,
+ *            u32 sett_n, sett_n settlement names (u16 length + bytes),
+ *            u32 table_n, then per table: name, u32 col_n and per column
+ *            u8 type ('i' = i32, 'd' = f64) and name
+ *   blocks   until the end of the file; per table in header order:
+ *            u32 rows, then each column's rows values in turn
+ *
+ *   days         day, agents, avg_hunger, avg_fatigue, world_<res>...,
+ *                agent_res_<res>..., agent_item_<item>...
+ *   settlements  day, settlement, population, res_<res>..., item_<item>...
+ *
+ * Usage:
+ *   BrzMetrics m;
+ *   brz_metrics_open(&m, "metrics.brzm", cfg, setts, sett_n, 0);
+ *   brz_metrics_record(&m, day, world, setts, agents);   (every day)
+ *   brz_metrics_close(&m);
+ */
+
+#define BRZ_METRICS_FILE "metrics.brzm"
+#define BRZ_METRICS_VERSION 1u
+#define BRZ_METRICS_BLOCK_ROWS 65536
+
+enum { BRZ_METRICS_DAYS = 0, BRZ_METRICS_SETTLEMENTS, BRZ_METRICS_TABLES };
+
+typedef struct BrzMetrics {
+    FILE* f;
+    bool ok;            /* every write so far succeeded */
+    size_t res_n, item_n;
+    int sett_n;
+    int col_n[BRZ_METRICS_TABLES];
+    int block_days;     /* days per block */
+    int days;           /* days buffered */
+    double* col[BRZ_METRICS_TABLES]; /* [col_n][rows per block], column-major */
+    uint8_t* buf;       /* one encoded block */
+} BrzMetrics;
+
+/* Create path and write the header. block_rows <= 0 means
+   BRZ_METRICS_BLOCK_ROWS. Returns false (printed) when the file cannot be
+   created or on OOM; m is then closed already. */
+bool brz_metrics_open(BrzMetrics* m, const char* path, const ParsedConfig* cfg,
+                      const BrzSettlement* setts, int sett_n, int block_rows);
+/* buffer the rows of day; agents must be synced (brz_sim_sync) */
+void brz_metrics_record(BrzMetrics* m, int day, const BrzWorld* world,
+                        const BrzSettlement* setts, const BrzAgentStore* agents);
+/* write the last block and close; false if any write failed */
+bool brz_metrics_close(BrzMetrics* m);
+
+/* ---------------- reader ---------------- */
+
+typedef struct {
+    char* name;
+    int col_n;
+    char** col_name;  /* [col_n] */
+    uint8_t* col_type; /* [col_n] 'i' or 'd' */
+    size_t rows;
+    double* col;      /* [col_n][rows]; i32 columns widened */
+} BrzMetricsTable;
+
+typedef struct {
+    int sett_n;
+    char** sett_name; /* [sett_n] */
+    BrzMetricsTable table[BRZ_METRICS_TABLES];
+} BrzMetricsFile;
+
+/* Read a metrics file; on failure err holds the reason */
+bool brz_metrics_read(BrzMetricsFile* mf, const char* path, char* err, size_t err_n);
+void brz_metrics_file_free(BrzMetricsFile* mf);
+
+/* column of t called name, or NULL */
+const double* brz_metrics_column(const BrzMetricsTable* t, const char* name);
+/* t as CSV with a header line */
+bool brz_metrics_write_csv(const BrzMetricsTable* t, FILE* f);
+
+#endif /* BRZ_METRICS_H */
@@ -1,4 +1,5 @@
 #include "brz_parser.h"
+#include "brz_cfgimage.h"
 #include "brz_util.h"
 #include "brz_vec.h"
 
@@ -7,7 +8,10 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* ---------- lexer ---------- */
+/* ---------- lexer ----------
+   Tokens are (offset, length) slices of the source buffer; nothing is
+   copied until the parser keeps a string, which it interns into the
+   config arena. */
 
 typedef enum {
     TK_EOF=0,
@@ -19,7 +23,8 @@ typedef enum {
 
 typedef struct {
     TokKind kind;
-    char* text; /* for WORD/NUM */
+    uint32_t off; /* text of WORD/NUM: src[off, off+len) */
+    uint32_t len;
     int line;
     int col;
 } Token;
@@ -46,20 +51,19 @@ static int getc_advance(Lexer* lx)
     else { lx->col++; }
     return c;
 }
-static char* dup_span(const char* s, size_t n)
+/* advance over n characters known not to be newlines */
+static void advance_inline(Lexer* lx, size_t n)
 {
-    char* out = (char*)malloc(n+1);
-    if(!out) return NULL;
-    memcpy(out, s, n);
-    out[n]=0;
-    return out;
+    lx->pos += n;
+    lx->col += (int)n;
 }
 
-static bool push_tok(Lexer* lx, TokKind k, char* text, int line, int col)
+static bool push_tok(Lexer* lx, TokKind k, size_t start, int line, int col)
 {
     Token t;
     t.kind = k;
-    t.text = text;
+    t.off  = (uint32_t)start;
+    t.len  = (uint32_t)(lx->pos - start);
     t.line = line;
     t.col  = col;
     return brz_vec_push(&lx->toks, &t);
@@ -71,7 +75,8 @@ static void skip_ws_and_comments(Lexer* lx)
     {
         int c = peekc(lx);
         /* whitespace */
-        if(c==' '||c=='\t'||c=='\r'||c=='\n'){ getc_advance(lx); continue; }
+        if(c==' '||c=='\t'||c=='\r'){ advance_inline(lx, 1); continue; }
+        if(c=='\n'){ getc_advance(lx); continue; }
 
         /* # line comment */
         if(c=='#'){
@@ -102,11 +107,22 @@ static void skip_ws_and_comments(Lexer* lx)
     }
 }
 
+static bool is_ident_char(int c)
+{
+    return isalnum((unsigned char)c) || c=='_';
+}
+
 static bool lex_all(Lexer* lx)
 {
     lx->line = 1;
     lx->col = 1;
     brz_vec_init(&lx->toks, sizeof(Token));
+    if(lx->len > UINT32_MAX){
+        fprintf(stderr, "LexError: source larger than 4 GiB\n");
+        return false;
+    }
+    /* about one token per 6 bytes of typical source; saves regrowth */
+    if(!brz_vec_reserve(&lx->toks, lx->len / 6 + 16)) return false;
 
     while(1)
     {
@@ -114,58 +130,45 @@ static bool lex_all(Lexer* lx)
         int c = peekc(lx);
         int line = lx->line;
         int col  = lx->col;
+        size_t start = lx->pos;
 
         if(c==0){
-            if(!push_tok(lx, TK_EOF, NULL, line, col)) return false;
+            if(!push_tok(lx, TK_EOF, start, line, col)) return false;
             return true;
         }
 
-        if(c=='{'){ getc_advance(lx); if(!push_tok(lx,TK_LBRACE,NULL,line,col)) return false; continue; }
-        if(c=='}'){ getc_advance(lx); if(!push_tok(lx,TK_RBRACE,NULL,line,col)) return false; continue; }
+        if(c=='{'){ advance_inline(lx, 1); if(!push_tok(lx,TK_LBRACE,start,line,col)) return false; continue; }
+        if(c=='}'){ advance_inline(lx, 1); if(!push_tok(lx,TK_RBRACE,start,line,col)) return false; continue; }
 
-        if(c==';' || c==':' || c==','){ getc_advance(lx); continue; }
+        if(c==';' || c==':' || c==','){ advance_inline(lx, 1); continue; }
 
 
         /* operators / punctuation used in conditions: > < >= <= == != ( ) */
         if(c=='>'||c=='<'||c=='='||c=='!'||c=='('||c==')')
         {
-            size_t start = lx->pos;
-            getc_advance(lx);
-            if((c=='>'||c=='<'||c=='='||c=='!') && peekc(lx)=='=') getc_advance(lx);
-            char* s = dup_span(lx->src + start, lx->pos - start);
-            if(!s) return false;
-            if(!push_tok(lx, TK_WORD, s, line, col)) return false;
+            advance_inline(lx, 1);
+            if((c=='>'||c=='<'||c=='='||c=='!') && peekc(lx)=='=') advance_inline(lx, 1);
+            if(!push_tok(lx, TK_WORD, start, line, col)) return false;
             continue;
         }
 
         /* number: int or float (e.g., 12, 0.08, 10.0, 0.0005) */
         if(isdigit((unsigned char)c))
         {
-            size_t start = lx->pos;
-            while(isdigit((unsigned char)peekc(lx))) getc_advance(lx);
+            while(isdigit((unsigned char)peekc(lx))) advance_inline(lx, 1);
             if(peekc(lx)=='.'){
-                getc_advance(lx);
-                while(isdigit((unsigned char)peekc(lx))) getc_advance(lx);
+                advance_inline(lx, 1);
+                while(isdigit((unsigned char)peekc(lx))) advance_inline(lx, 1);
             }
-            char* s = dup_span(lx->src + start, lx->pos - start);
-            if(!s) return false;
-            if(!push_tok(lx, TK_NUM, s, line, col)) return false;
+            if(!push_tok(lx, TK_NUM, start, line, col)) return false;
             continue;
         }
 
         /* word / identifier */
         if(isalpha((unsigned char)c) || c=='_')
         {
-            size_t start = lx->pos;
-            while(1)
-            {
-                int p = peekc(lx);
-                if(isalnum((unsigned char)p) || p=='_' ) { getc_advance(lx); continue; }
-                break;
-            }
-            char* s = dup_span(lx->src + start, lx->pos - start);
-            if(!s) return false;
-            if(!push_tok(lx, TK_WORD, s, line, col)) return false;
+            while(is_ident_char(peekc(lx))) advance_inline(lx, 1);
+            if(!push_tok(lx, TK_WORD, start, line, col)) return false;
             continue;
         }
 
@@ -176,19 +179,20 @@ static bool lex_all(Lexer* lx)
 
 static void free_lexer(Lexer* lx)
 {
-    for(size_t i=0;i<lx->toks.len;i++){
-        Token* t = (Token*)brz_vec_at(&lx->toks, i);
-        free(t->text);
-    }
     brz_vec_destroy(&lx->toks);
 }
 
 /* ---------- parser ---------- */
 
 typedef struct {
+    const char* src;
     Token* toks;
     size_t count;
     size_t pos;
+    ParsedConfig* cfg; /* interns every string the parser keeps */
+    char* scratch;     /* joined expressions and prefixed keys */
+    size_t scratch_cap;
+    BrzArena build;    /* vocation being parsed; packed into cfg when complete */
 } Parser;
 
 static Token* cur(Parser* p)
@@ -196,6 +200,41 @@ static Token* cur(Parser* p)
     if(p->pos >= p->count) return NULL;
     return &p->toks[p->pos];
 }
+static const char* tok_text(const Parser* p, const Token* t)
+{
+    return p->src + t->off;
+}
+static bool tok_is(const Parser* p, const Token* t, const char* w)
+{
+    size_t n = strlen(w);
+    return t->kind==TK_WORD && t->len==n && memcmp(tok_text(p, t), w, n)==0;
+}
+static const char* tok_intern(Parser* p, const Token* t)
+{
+    const char* s = brz_cfg_intern_n(p->cfg, tok_text(p, t), t->len);
+    if(!s) fprintf(stderr, "Error: OOM interning '%.*s'\n", (int)t->len, tok_text(p, t));
+    return s;
+}
+static double tok_num(const Parser* p, const Token* t)
+{
+    /* copy out: the slice is not NUL-terminated */
+    char buf[64];
+    size_t n = t->len < sizeof(buf)-1 ? t->len : sizeof(buf)-1;
+    memcpy(buf, tok_text(p, t), n);
+    buf[n] = 0;
+    return strtod(buf, NULL);
+}
+static bool scratch_reserve(Parser* p, size_t n)
+{
+    if(n <= p->scratch_cap) return true;
+    size_t cap = p->scratch_cap ? p->scratch_cap : 128;
+    while(cap < n) cap *= 2;
+    char* nb = (char*)realloc(p->scratch, cap);
+    if(!nb) return false;
+    p->scratch = nb;
+    p->scratch_cap = cap;
+    return true;
+}
 static bool accept(Parser* p, TokKind k)
 {
     Token* t = cur(p);
@@ -212,43 +251,45 @@ static bool expect(Parser* p, TokKind k, const char* what)
 static bool expect_word(Parser* p, const char** out)
 {
     Token* t = cur(p);
-    if(t && t->kind==TK_WORD){ *out = t->text; p->pos++; return true; }
+    if(t && t->kind==TK_WORD){
+        *out = tok_intern(p, t);
+        if(!*out) return false;
+        p->pos++;
+        return true;
+    }
     fprintf(stderr, "SyntaxError:%d:%d: Expected identifier\n", t?t->line:0, t?t->col:0);
     return false;
 }
 static bool accept_word(Parser* p, const char* w)
 {
     Token* t = cur(p);
-    if(t && t->kind==TK_WORD && brz_streq(t->text, w)){ p->pos++; return true; }
+    if(t && tok_is(p, t, w)){ p->pos++; return true; }
     return false;
 }
 static bool expect_num(Parser* p, double* out)
 {
     Token* t = cur(p);
-    if(t && t->kind==TK_NUM){ *out = strtod(t->text, NULL); p->pos++; return true; }
+    if(t && t->kind==TK_NUM){ *out = tok_num(p, t); p->pos++; return true; }
     fprintf(stderr, "SyntaxError:%d:%d: Expected number\n", t?t->line:0, t?t->col:0);
     return false;
 }
 
-/* join token texts from [start_pos, end_pos) into a single malloc'd string */
-static char* join_tokens(Token* toks, size_t start, size_t end)
+/* join token texts from [start_pos, end_pos) into a single interned string */
+static const char* join_tokens(Parser* p, size_t start, size_t end)
 {
     size_t bytes=1;
+    for(size_t i=start;i<end;i++) bytes += p->toks[i].len + 1;
+    if(!scratch_reserve(p, bytes)) return NULL;
+    size_t len = 0;
     for(size_t i=start;i<end;i++){
-        const char* s = toks[i].text ? toks[i].text : "";
-        bytes += strlen(s) + 1;
-    }
-    char* out = (char*)malloc(bytes);
-    if(!out) return NULL;
-    out[0]=0;
-    for(size_t i=start;i<end;i++){
-        const char* s = toks[i].text ? toks[i].text : "";
-        if(*s){
-            strcat(out, s);
-            if(i+1<end) strcat(out, " ");
+        const Token* t = &p->toks[i];
+        if(t->len){
+            memcpy(p->scratch + len, tok_text(p, t), t->len);
+            len += t->len;
+            if(i+1<end) p->scratch[len++] = ' ';
         }
     }
-    return out;
+    return brz_cfg_intern_n(p->cfg, p->scratch, len);
 }
 
 /* kinds { resources { a b c } items { x y z } } */
@@ -327,10 +368,9 @@ static bool parse_resources_block(Parser* p, ParsedConfig* cfg)
             double v=0.0;
             if(!expect_num(p, &v)) return false;
             ParamDef pd; memset(&pd,0,sizeof(pd));
-            pd.key = brz_strdup(name);
-            if(!pd.key) return false;
+            pd.key = name;
             pd.value = v;
-            if(!brz_vec_push(&cfg->params, &pd)) return false;
+            if(!brz_cfg_add_param(cfg, &pd)) return false;
         }
         else if(t->kind==TK_WORD)
         {
@@ -384,6 +424,44 @@ static bool parse_items_block(Parser* p, ParsedConfig* cfg)
     return true;
 }
 
+/* recipes { bronze { copper 1 tin 1 charcoal 1 } charcoal { wood 1 makes charcoal } } */
+static bool parse_recipes(Parser* p, ParsedConfig* cfg)
+{
+    if(!expect(p, TK_LBRACE, "'{'")) return false;
+    cfg->has_recipes = true;
+
+    BrzVec in; /* inputs of the recipe being parsed */
+    brz_vec_init_arena(&in, sizeof(RecipeInput), &p->build);
+    bool ok = true;
+    while(ok && !accept(p, TK_RBRACE))
+    {
+        Token* t = cur(p);
+        RecipeDef r;
+        memset(&r, 0, sizeof(r));
+        r.line = t ? t->line : 0;
+        ok = expect_word(p, &r.item) && expect(p, TK_LBRACE, "'{'");
+        brz_vec_clear(&in);
+        while(ok && !accept(p, TK_RBRACE))
+        {
+            const char* name = NULL;
+            ok = expect_word(p, &name);
+            if(ok && brz_streq(name, "makes"))
+            {
+                ok = expect_word(p, &r.makes);
+                continue;
+            }
+            RecipeInput ri;
+            memset(&ri, 0, sizeof(ri));
+            ri.name = name;
+            ri.id = -1;
+            ok = ok && expect_num(p, &ri.ratio) && brz_vec_push(&in, &ri);
+        }
+        ok = ok && brz_cfg_add_recipe(cfg, &r, (const RecipeInput*)in.data, in.len);
+    }
+    brz_arena_destroy(&p->build);
+    return ok;
+}
+
 static bool parse_simple_kv_block(Parser* p, const char* block_name, ParsedConfig* cfg)
 {
     if(!expect(p, TK_LBRACE, "'{'")) return false;
@@ -448,15 +526,15 @@ static bool parse_simple_kv_block(Parser* p, const char* block_name, ParsedConfi
         {
             size_t n1 = strlen(prefix);
             size_t n2 = strlen(key);
-            pd.key = (char*)malloc(n1 + n2 + 1);
+            if(!scratch_reserve(p, n1 + n2)) return false;
+            memcpy(p->scratch, prefix, n1);
+            memcpy(p->scratch + n1, key, n2);
+            pd.key = brz_cfg_intern_n(cfg, p->scratch, n1 + n2);
             if(!pd.key) return false;
-            memcpy(pd.key, prefix, n1);
-            memcpy(pd.key + n1, key, n2 + 1);
         }
         else
         {
-            pd.key = brz_strdup(key);
-            if(!pd.key) return false;
+            pd.key = key;
         }
 
         if(is_num)
@@ -466,11 +544,10 @@ static bool parse_simple_kv_block(Parser* p, const char* block_name, ParsedConfi
         else
         {
             pd.has_svalue = true;
-            pd.svalue = brz_strdup(sval);
-            if(!pd.svalue) return false;
+            pd.svalue = sval;
         }
 
-        if(!brz_vec_push(&cfg->params, &pd)) return false;
+        if(!brz_cfg_add_param(cfg, &pd)) return false;
     }
     return true;
 }
@@ -492,14 +569,13 @@ static bool parse_op_only(Parser* p, OpDef* out_op)
     }
 
     int line = t->line;
-    const char* opw = t->text;
-    p->pos++;
 
     OpDef op;
     memset(&op, 0, sizeof(op));
-    op.op = brz_strdup(opw);
+    op.op = tok_intern(p, t);
     op.line = line;
     if(!op.op) return false;
+    p->pos++;
 
     /* collect up to 3 word args and 1 numeric on the same line;
        stop on brace (block start) or end-of-line. */
@@ -512,15 +588,14 @@ static bool parse_op_only(Parser* p, OpDef* out_op)
 
         if(n->kind==TK_WORD)
         {
-            if(!op.a0) op.a0 = brz_strdup(n->text);
-            else if(!op.a1) op.a1 = brz_strdup(n->text);
-            else if(!op.a2) op.a2 = brz_strdup(n->text);
+            const char** slot = !op.a0 ? &op.a0 : !op.a1 ? &op.a1 : !op.a2 ? &op.a2 : NULL;
+            if(slot && !(*slot = tok_intern(p, n))) return false;
             p->pos++;
             continue;
         }
         if(n->kind==TK_NUM)
         {
-            op.n0 = strtod(n->text, NULL);
+            op.n0 = tok_num(p, n);
             op.has_n0 = true;
             p->pos++;
             continue;
@@ -533,43 +608,30 @@ static bool parse_op_only(Parser* p, OpDef* out_op)
     return true;
 }
 
-static char* collect_expr_until_lbrace(Parser* p)
+static const char* collect_expr_until_lbrace(Parser* p)
 {
     /* Collect WORD/NUM tokens into a single space-joined string until '{' */
-    size_t cap = 128;
     size_t len = 0;
-    char* buf = (char*)malloc(cap);
-    if(!buf) return NULL;
-    buf[0] = 0;
+    if(!scratch_reserve(p, 1)) return NULL;
 
     while(1)
     {
         Token* n = cur(p);
-        if(!n){ free(buf); return NULL; }
+        if(!n) return NULL;
         if(n->kind==TK_LBRACE) break;
 
-        const char* s = (n->text ? n->text : "");
-        size_t sl = strlen(s);
-        /* +1 for optional space, +1 for terminator */
-        size_t need = len + (len?1:0) + sl + 1;
-        if(need > cap)
-        {
-            while(cap < need) cap *= 2;
-            char* nb = (char*)realloc(buf, cap);
-            if(!nb){ free(buf); return NULL; }
-            buf = nb;
-        }
+        /* +1 for optional space */
+        if(!scratch_reserve(p, len + 1 + n->len)) return NULL;
         if(len)
         {
-            buf[len++] = ' ';
+            p->scratch[len++] = ' ';
         }
-        memcpy(buf + len, s, sl);
-        len += sl;
-        buf[len] = 0;
+        memcpy(p->scratch + len, tok_text(p, n), n->len);
+        len += n->len;
 
         p->pos++;
     }
-    return buf;
+    return brz_cfg_intern_n(p->cfg, p->scratch, len);
 }
 
 /* statement := chance NUM { stmt* } | when <expr...> { stmt* } | op_line */
@@ -578,7 +640,7 @@ static bool parse_stmt(Parser* p, StmtDef* out_stmt)
     Token* t = cur(p);
     if(!t){ fprintf(stderr, "SyntaxError: Unexpected EOF\n"); return false; }
 
-    if(t->kind==TK_WORD && t->text && brz_streq(t->text, "chance"))
+    if(tok_is(p, t, "chance"))
     {
         int line = t->line;
         p->pos++;
@@ -592,7 +654,7 @@ static bool parse_stmt(Parser* p, StmtDef* out_stmt)
         st.kind = ST_CHANCE;
         st.line = line;
         st.as.chance.chance_pct = pct;
-        brz_vec_init(&st.as.chance.body, sizeof(StmtDef));
+        brz_vec_init_arena(&st.as.chance.body, sizeof(StmtDef), &p->build);
 
         if(!parse_stmt_list(p, &st.as.chance.body)) return false;
 
@@ -600,22 +662,22 @@ static bool parse_stmt(Parser* p, StmtDef* out_stmt)
         return true;
     }
 
-    if(t->kind==TK_WORD && t->text && brz_streq(t->text, "when"))
+    if(tok_is(p, t, "when"))
     {
         int line = t->line;
         p->pos++;
 
-        char* expr = collect_expr_until_lbrace(p);
+        const char* expr = collect_expr_until_lbrace(p);
         if(!expr){ fprintf(stderr, "Error: OOM collecting when expr\n"); return false; }
 
-        if(!expect(p, TK_LBRACE, "'{'")){ free(expr); return false; }
+        if(!expect(p, TK_LBRACE, "'{'")) return false;
 
         StmtDef st;
         memset(&st, 0, sizeof(st));
         st.kind = ST_WHEN;
         st.line = line;
         st.as.when_stmt.when_expr = expr;
-        brz_vec_init(&st.as.when_stmt.body, sizeof(StmtDef));
+        brz_vec_init_arena(&st.as.when_stmt.body, sizeof(StmtDef), &p->build);
 
         if(!parse_stmt_list(p, &st.as.when_stmt.body)) return false;
 
@@ -664,9 +726,8 @@ static bool parse_task(Parser* p, VocationDef* voc)
 
     TaskDef t;
     memset(&t, 0, sizeof(t));
-    t.name = brz_strdup(name);
-    if(!t.name) return false;
-    brz_vec_init(&t.stmts, sizeof(StmtDef));
+    t.name = name;
+    brz_vec_init_arena(&t.stmts, sizeof(StmtDef), &p->build);
 
     if(!expect(p, TK_LBRACE, "'{'")) return false;
     if(!parse_stmt_list(p, &t.stmts)) return false;
@@ -680,14 +741,15 @@ static bool parse_task(Parser* p, VocationDef* voc)
 
 static bool parse_rule(Parser* p, VocationDef* voc)
 {
+    Token* name_tok = cur(p);
     const char* name=NULL;
     if(!expect_word(p, &name)) return false;
 
     if(!expect(p, TK_LBRACE, "'{'")) return false;
 
     int depth = 0; /* nested braces inside rule */
-    char* when_expr = NULL;
-    char* do_task = NULL;
+    const char* when_expr = NULL;
+    const char* do_task = NULL;
     int weight = 1;
 
     while(1)
@@ -715,7 +777,7 @@ static bool parse_rule(Parser* p, VocationDef* voc)
             break;
         }
 
-        if(t->kind==TK_WORD && brz_streq(t->text, "when"))
+        if(tok_is(p, t, "when"))
         {
             p->pos++; /* consume when */
             size_t start = p->pos;
@@ -725,28 +787,27 @@ static bool parse_rule(Parser* p, VocationDef* voc)
                 Token* u = cur(p);
                 if(!u){ fprintf(stderr, "SyntaxError: Unexpected EOF in when\n"); return false; }
                 if(u->kind==TK_LBRACE || u->kind==TK_RBRACE) break;
-                if(u->kind==TK_WORD && brz_streq(u->text, "do")) break;
+                if(tok_is(p, u, "do")) break;
                 p->pos++;
             }
-            free(when_expr);
-            when_expr = join_tokens(p->toks, start, p->pos);
+            when_expr = join_tokens(p, start, p->pos);
             if(!when_expr) return false;
             continue;
         }
 
-        if(t->kind==TK_WORD && brz_streq(t->text, "do"))
+        if(tok_is(p, t, "do"))
         {
             p->pos++; /* consume do */
             const char* task=NULL;
             if(cur(p) && cur(p)->kind==TK_WORD)
             {
                 if(!expect_word(p, &task)) return false;
-                if(!do_task) { do_task = brz_strdup(task); if(!do_task) return false; }
+                if(!do_task) do_task = task;
             }
             continue;
         }
 
-        if(t->kind==TK_WORD && brz_streq(t->text, "weight"))
+        if(tok_is(p, t, "weight"))
         {
             p->pos++;
             if(cur(p) && cur(p)->kind==TK_NUM)
@@ -763,10 +824,11 @@ static bool parse_rule(Parser* p, VocationDef* voc)
 
     RuleDef r;
     memset(&r, 0, sizeof(r));
-    r.name = brz_strdup(name);
-    r.when_expr = when_expr ? when_expr : brz_strdup("true");
-    r.do_task = do_task ? do_task : brz_strdup("");
+    r.name = name;
+    r.when_expr = when_expr ? when_expr : brz_cfg_intern(p->cfg, "true");
+    r.do_task = do_task ? do_task : brz_cfg_intern(p->cfg, "");
     r.weight = weight;
+    r.line = name_tok->line;
     if(!r.name || !r.when_expr || !r.do_task) return false;
 
     if(!brz_vec_push(&voc->rules, &r)) return false;
@@ -777,16 +839,14 @@ static bool parse_rule(Parser* p, VocationDef* voc)
 /* vocation NAME { ... } */
 static bool parse_vocation(Parser* p, ParsedConfig* cfg)
 {
-    (void)cfg;
     const char* name=NULL;
     if(!expect_word(p, &name)) return false;
 
     VocationDef v;
     memset(&v, 0, sizeof(v));
-    v.name = brz_strdup(name);
-    if(!v.name) return false;
-    brz_vec_init(&v.tasks, sizeof(TaskDef));
-    brz_vec_init(&v.rules, sizeof(RuleDef));
+    v.name = name;
+    brz_vec_init_arena(&v.tasks, sizeof(TaskDef), &p->build);
+    brz_vec_init_arena(&v.rules, sizeof(RuleDef), &p->build);
 
     if(!expect(p, TK_LBRACE, "'{'")) return false;
 
@@ -808,8 +868,9 @@ static bool parse_vocation(Parser* p, ParsedConfig* cfg)
         return false;
     }
 
-    if(!brz_vec_push(&cfg->vocations, &v)) return false;
-    return true;
+    bool ok = brz_cfg_add_vocation(cfg, &v);
+    brz_arena_destroy(&p->build);
+    return ok;
 }
 
 /* vocations { vocation X { ... } ... } */
@@ -829,18 +890,44 @@ static bool parse_vocations(Parser* p, ParsedConfig* cfg)
     return true;
 }
 
-/* ---------- public API ---------- */
-
-bool brz_parse_file(const char* path, ParsedConfig* out_cfg)
+/* program := { top_level_block } EOF */
+static bool parse_program(Parser* p)
 {
-    size_t n=0;
-    char* src = brz_read_entire_file(path, &n);
-    if(!src)
+    ParsedConfig* cfg = p->cfg;
+    while(1)
     {
-        fprintf(stderr, "Error: failed to read '%s'\n", path);
-        return false;
+        Token* t = cur(p);
+        if(!t) break;
+        if(t->kind==TK_EOF) break;
+
+        const char* top=NULL;
+        if(!expect_word(p, &top)) return false;
+
+        bool ok;
+        if(brz_streq(top, "kinds")) ok = parse_kinds(p, cfg);
+        else if(brz_streq(top, "world")) ok = parse_simple_kv_block(p, "world", cfg);
+        else if(brz_streq(top, "sim")) ok = parse_simple_kv_block(p, "sim", cfg);
+        else if(brz_streq(top, "agents")) ok = parse_simple_kv_block(p, "agents", cfg);
+        else if(brz_streq(top, "settlements")) ok = parse_simple_kv_block(p, "settlements", cfg);
+        else if(brz_streq(top, "resources")) ok = parse_resources_block(p, cfg);
+        else if(brz_streq(top, "items")) ok = parse_items_block(p, cfg);
+        else if(brz_streq(top, "recipes")) ok = parse_recipes(p, cfg);
+        else if(brz_streq(top, "vocations")) ok = parse_vocations(p, cfg);
+        else
+        {
+            fprintf(stderr, "SyntaxError:%d:%d: Unknown top-level section '%s'\n", t->line, t->col, top);
+            return false;
+        }
+        if(!ok) return false;
     }
+    return true;
+}
+
+/* ---------- public API ---------- */
 
+/* lex, parse and link src[0..n) read from path */
+static bool parse_source(const char* path, const char* src, size_t n, ParsedConfig* out_cfg)
+{
     Lexer lx;
     memset(&lx, 0, sizeof(lx));
     lx.src = src;
@@ -849,67 +936,84 @@ bool brz_parse_file(const char* path, ParsedConfig* out_cfg)
 
     if(!lex_all(&lx))
     {
-        free(src);
         free_lexer(&lx);
         return false;
     }
 
     Parser p;
+    memset(&p, 0, sizeof(p));
+    p.src = src;
     p.toks = (Token*)lx.toks.data;
     p.count = lx.toks.len;
     p.pos = 0;
+    p.cfg = out_cfg;
+    brz_arena_init(&p.build);
 
-    while(1)
+    bool ok = parse_program(&p);
+
+    brz_arena_destroy(&p.build);
+    free(p.scratch);
+    free_lexer(&lx);
+    if(!ok) return false;
+
+    if(!brz_cfg_link(out_cfg))
     {
-        Token* t = cur(&p);
-        if(!t) break;
-        if(t->kind==TK_EOF) break;
+        fprintf(stderr, "Error: OOM linking '%s'\n", path);
+        return false;
+    }
+    return true;
+}
 
-        const char* top=NULL;
-        if(!expect_word(&p, &top)){ free(src); free_lexer(&lx); return false; }
+bool brz_parse_image_path(const char* path, char* out, size_t out_n)
+{
+    int n = snprintf(out, out_n, "%sc", path ? path : "");
+    return path && n > 0 && (size_t)n < out_n;
+}
 
-        if(brz_streq(top, "kinds"))
-        {
-            if(!parse_kinds(&p, out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else if(brz_streq(top, "world"))
-        {
-            if(!parse_simple_kv_block(&p, "world", out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else if(brz_streq(top, "sim"))
-        {
-            if(!parse_simple_kv_block(&p, "sim", out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else if(brz_streq(top, "agents"))
-        {
-            if(!parse_simple_kv_block(&p, "agents", out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else if(brz_streq(top, "settlements"))
-        {
-            if(!parse_simple_kv_block(&p, "settlements", out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else if(brz_streq(top, "resources"))
-        {
-            if(!parse_resources_block(&p, out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else if(brz_streq(top, "items"))
-        {
-            if(!parse_items_block(&p, out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else if(brz_streq(top, "vocations"))
-        {
-            if(!parse_vocations(&p, out_cfg)){ free(src); free_lexer(&lx); return false; }
-        }
-        else
-        {
-            fprintf(stderr, "SyntaxError:%d:%d: Unknown top-level section '%s'\n", t->line, t->col, top);
-            free(src);
-            free_lexer(&lx);
-            return false;
-        }
+bool brz_parse_file(const char* path, ParsedConfig* out_cfg)
+{
+    size_t n=0;
+    char* src = brz_read_entire_file(path, &n);
+    if(!src)
+    {
+        fprintf(stderr, "Error: failed to read '%s'\n", path);
+        return false;
+    }
+
+    /* a missing or stale image just means parsing the source */
+    char img[1024];
+    if(brz_parse_image_path(path, img, sizeof(img)) &&
+       brz_cfg_image_load(out_cfg, img, brz_cfg_source_hash(src, n), n, NULL, 0))
+    {
+        free(src);
+        return true;
     }
 
+    bool ok = parse_source(path, src, n, out_cfg);
     free(src);
-    free_lexer(&lx);
-    return true;
+    return ok;
+}
+
+bool brz_compile_file(const char* path, const char* out_path)
+{
+    size_t n=0;
+    char* src = brz_read_entire_file(path, &n);
+    if(!src)
+    {
+        fprintf(stderr, "Error: failed to read '%s'\n", path);
+        return false;
+    }
+
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    bool ok = parse_source(path, src, n, &cfg);
+    if(ok)
+    {
+        char err[128];
+        ok = brz_cfg_image_write(&cfg, brz_cfg_source_hash(src, n), n, out_path, err, sizeof(err));
+        if(!ok) fprintf(stderr, "Error: %s: %s\n", out_path, err);
+    }
+    brz_cfg_free(&cfg);
+    free(src);
+    return ok;
 }
@@ -5,7 +5,16 @@
 #include "brz_dsl.h"
 
 /* Parse a .bronze file into ParsedConfig (must be init'd with brz_cfg_init()).
+   When a precompiled image of the same source sits next to it (see
+   brz_parse_image_path) the config is loaded from that instead.
    Returns false on error (message printed to stderr). */
 bool brz_parse_file(const char* path, ParsedConfig* out_cfg);
 
+/* Parse path and write its config image (.bronzec, see brz_cfgimage.h)
+   to out_path. Returns false on error (message printed to stderr). */
+bool brz_compile_file(const char* path, const char* out_path);
+
+/* the image brz_parse_file looks for: "file.bronze" -> "file.bronzec" */
+bool brz_parse_image_path(const char* path, char* out, size_t out_n);
+
 #endif /* BRZ_PARSER_H */
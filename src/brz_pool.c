@@ -0,0 +1,117 @@
+#include "brz_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct BrzPool {
+    pthread_t* workers;
+    int worker_n;
+
+    pthread_mutex_t mu;
+    pthread_cond_t  wake;   /* new job or shutdown */
+    pthread_cond_t  idle;   /* last task of a job finished */
+
+    /* current job, guarded by mu */
+    BrzPoolFn fn;
+    void* ctx;
+    int task_n;
+    int next;       /* next task index to hand out */
+    int done;       /* tasks finished */
+    unsigned gen;   /* bumped per job so sleeping workers notice */
+    int quit;
+};
+
+/* pull tasks until the job is drained; called with mu held, returns with mu held */
+static void pool_drain(BrzPool* p)
+{
+    while(p->next < p->task_n){
+        int t = p->next++;
+        BrzPoolFn fn = p->fn;
+        void* ctx = p->ctx;
+        pthread_mutex_unlock(&p->mu);
+        fn(ctx, t);
+        pthread_mutex_lock(&p->mu);
+        if(++p->done == p->task_n) pthread_cond_broadcast(&p->idle);
+    }
+}
+
+static void* pool_worker(void* arg)
+{
+    BrzPool* p = (BrzPool*)arg;
+    unsigned seen = 0;
+    pthread_mutex_lock(&p->mu);
+    for(;;){
+        while(!p->quit && p->gen == seen) pthread_cond_wait(&p->wake, &p->mu);
+        if(p->quit) break;
+        seen = p->gen;
+        pool_drain(p);
+    }
+    pthread_mutex_unlock(&p->mu);
+    return NULL;
+}
+
+BrzPool* brz_pool_create(int threads)
+{
+    BrzPool* p = (BrzPool*)calloc(1, sizeof(BrzPool));
+    if(!p) return NULL;
+    pthread_mutex_init(&p->mu, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->idle, NULL);
+
+    int want = (threads > 1) ? threads - 1 : 0;
+    if(want > 0){
+        p->workers = (pthread_t*)calloc((size_t)want, sizeof(pthread_t));
+        if(!p->workers){ brz_pool_destroy(p); return NULL; }
+        for(int i=0;i<want;i++){
+            if(pthread_create(&p->workers[i], NULL, pool_worker, p) != 0){
+                brz_pool_destroy(p);
+                return NULL;
+            }
+            p->worker_n++;
+        }
+    }
+    return p;
+}
+
+void brz_pool_destroy(BrzPool* p)
+{
+    if(!p) return;
+    pthread_mutex_lock(&p->mu);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->mu);
+    for(int i=0;i<p->worker_n;i++) pthread_join(p->workers[i], NULL);
+    free(p->workers);
+    pthread_cond_destroy(&p->idle);
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->mu);
+    free(p);
+}
+
+int brz_pool_threads(const BrzPool* p)
+{
+    return p ? p->worker_n + 1 : 1;
+}
+
+void brz_pool_run(BrzPool* p, int task_n, BrzPoolFn fn, void* ctx)
+{
+    if(task_n <= 0 || !fn) return;
+    if(!p || p->worker_n == 0){
+        for(int t=0;t<task_n;t++) fn(ctx, t);
+        return;
+    }
+    pthread_mutex_lock(&p->mu);
+    p->fn = fn;
+    p->ctx = ctx;
+    p->task_n = task_n;
+    p->next = 0;
+    p->done = 0;
+    p->gen++;
+    pthread_cond_broadcast(&p->wake);
+
+    pool_drain(p);
+    while(p->done < p->task_n) pthread_cond_wait(&p->idle, &p->mu);
+    p->fn = NULL;
+    p->ctx = NULL;
+    pthread_mutex_unlock(&p->mu);
+}
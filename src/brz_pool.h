@@ -0,0 +1,29 @@
+#ifndef BRZ_POOL_H
+#define BRZ_POOL_H
+
+/*
+ * brz_pool.h/.c - fixed-size worker pool for data-parallel loops
+ *
+ * brz_pool_run hands out task indexes [0, task_n) to the workers and the
+ * calling thread, and returns once every task has finished. Tasks must
+ * not depend on which thread runs them or in which order they complete.
+ *
+ * Usage:
+ *   BrzPool* pool = brz_pool_create(8);     (8 threads including the caller)
+ *   brz_pool_run(pool, chunk_n, step_chunk, &ctx);
+ *   brz_pool_destroy(pool);
+ */
+
+typedef struct BrzPool BrzPool;
+
+typedef void (*BrzPoolFn)(void* ctx, int task);
+
+/* threads <= 1 creates a pool that runs everything on the caller.
+   Returns NULL on OOM or thread creation failure. */
+BrzPool* brz_pool_create(int threads);
+void     brz_pool_destroy(BrzPool* pool);
+
+int  brz_pool_threads(const BrzPool* pool);
+void brz_pool_run(BrzPool* pool, int task_n, BrzPoolFn fn, void* ctx);
+
+#endif /* BRZ_POOL_H */
@@ -0,0 +1,205 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+#endif
+#include "brz_profile.h"
+#include <string.h>
+
+static const char* const k_phase_names[BRZ_PROF_PHASE_COUNT] = {
+    "regen", "step", "rule", "op_gather", "op_craft", "op_trade", "op_rest", "op_move",
+    "path", "trade", "commit", "snapshot", "map"
+};
+
+static const char* const k_counter_names[BRZ_PROF_COUNTER_COUNT] = {
+    "find_calls", "tiles_scanned", "expr_evals", "trades"
+};
+
+const char* brz_profile_phase_name(BrzProfPhase p)
+{
+    return ((unsigned)p < BRZ_PROF_PHASE_COUNT) ? k_phase_names[p] : "?";
+}
+
+const char* brz_profile_counter_name(BrzProfCounter c)
+{
+    return ((unsigned)c < BRZ_PROF_COUNTER_COUNT) ? k_counter_names[c] : "?";
+}
+
+#ifdef BRZ_PROFILE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* One slot per recording thread. A slot is written only by its owner;
+   readers take the list lock and load the fields with relaxed atomics, so
+   a total read while the writer thread works is merely a little stale.
+   A thread's slot is folded into 'g_retired' when the thread exits. */
+typedef struct ProfSlot {
+    BrzProfile p;
+    struct ProfSlot* next;
+} ProfSlot;
+
+int brz_prof_on = 0;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;
+static ProfSlot* g_slots;     /* live threads, guarded by g_mu */
+static BrzProfile g_retired;  /* exited threads, guarded by g_mu */
+static __thread ProfSlot* t_slot;
+
+static FILE* g_csv;
+static BrzProfile g_last;     /* totals at the previous CSV row */
+static uint64_t g_begin_ns;
+
+static uint64_t ld(const uint64_t* v){ return __atomic_load_n(v, __ATOMIC_RELAXED); }
+static void add(uint64_t* v, uint64_t d){ __atomic_store_n(v, *v + d, __ATOMIC_RELAXED); }
+
+static void profile_sum(BrzProfile* dst, const BrzProfile* src)
+{
+    for(int i=0;i<BRZ_PROF_PHASE_COUNT;i++){
+        dst->ns[i] += ld(&src->ns[i]);
+        dst->calls[i] += ld(&src->calls[i]);
+    }
+    for(int i=0;i<BRZ_PROF_COUNTER_COUNT;i++) dst->count[i] += ld(&src->count[i]);
+}
+
+static void slot_release(void* arg)
+{
+    ProfSlot* s = (ProfSlot*)arg;
+    pthread_mutex_lock(&g_mu);
+    for(ProfSlot** pp = &g_slots; *pp; pp = &(*pp)->next){
+        if(*pp == s){ *pp = s->next; break; }
+    }
+    profile_sum(&g_retired, &s->p);
+    pthread_mutex_unlock(&g_mu);
+    free(s);
+}
+
+static void key_create(void)
+{
+    pthread_key_create(&g_key, slot_release);
+}
+
+/* the calling thread's slot, created on first use; NULL on OOM */
+static ProfSlot* slot_get(void)
+{
+    if(t_slot) return t_slot;
+    pthread_once(&g_once, key_create);
+    ProfSlot* s = (ProfSlot*)calloc(1, sizeof(ProfSlot));
+    if(!s) return NULL;
+    pthread_mutex_lock(&g_mu);
+    s->next = g_slots;
+    g_slots = s;
+    pthread_mutex_unlock(&g_mu);
+    pthread_setspecific(g_key, s);
+    t_slot = s;
+    return s;
+}
+
+uint64_t brz_prof_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void brz_prof_add_time(BrzProfPhase p, uint64_t t0)
+{
+    uint64_t t1 = brz_prof_now();
+    ProfSlot* s = slot_get();
+    if(!s) return;
+    add(&s->p.ns[p], t1 - t0);
+    add(&s->p.calls[p], 1);
+}
+
+void brz_prof_add_count(BrzProfCounter c, uint64_t n)
+{
+    ProfSlot* s = slot_get();
+    if(s) add(&s->p.count[c], n);
+}
+
+bool brz_profile_available(void)
+{
+    return true;
+}
+
+bool brz_profile_begin(const char* csv_path)
+{
+    if(g_csv){ fclose(g_csv); g_csv = NULL; }
+    if(csv_path){
+        g_csv = fopen(csv_path, "w");
+        if(!g_csv) return false;
+        fprintf(g_csv, "day");
+        for(int i=0;i<BRZ_PROF_PHASE_COUNT;i++) fprintf(g_csv, ",%s_ms", k_phase_names[i]);
+        for(int i=0;i<BRZ_PROF_COUNTER_COUNT;i++) fprintf(g_csv, ",%s", k_counter_names[i]);
+        fprintf(g_csv, "\n");
+    }
+    pthread_mutex_lock(&g_mu);
+    for(ProfSlot* s = g_slots; s; s = s->next) memset(&s->p, 0, sizeof(s->p));
+    memset(&g_retired, 0, sizeof(g_retired));
+    pthread_mutex_unlock(&g_mu);
+    memset(&g_last, 0, sizeof(g_last));
+    g_begin_ns = brz_prof_now();
+    brz_prof_on = 1;
+    return true;
+}
+
+void brz_profile_totals(BrzProfile* out)
+{
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&g_mu);
+    profile_sum(out, &g_retired);
+    for(ProfSlot* s = g_slots; s; s = s->next) profile_sum(out, &s->p);
+    pthread_mutex_unlock(&g_mu);
+}
+
+void brz_profile_day(int day)
+{
+    if(!brz_prof_on || !g_csv) return;
+    BrzProfile now;
+    brz_profile_totals(&now);
+    fprintf(g_csv, "%d", day);
+    for(int i=0;i<BRZ_PROF_PHASE_COUNT;i++)
+        fprintf(g_csv, ",%.3f", (double)(now.ns[i] - g_last.ns[i]) / 1e6);
+    for(int i=0;i<BRZ_PROF_COUNTER_COUNT;i++)
+        fprintf(g_csv, ",%llu", (unsigned long long)(now.count[i] - g_last.count[i]));
+    fprintf(g_csv, "\n");
+    g_last = now;
+}
+
+void brz_profile_end(FILE* table)
+{
+    if(!brz_prof_on) return;
+    double wall_ms = (double)(brz_prof_now() - g_begin_ns) / 1e6;
+    brz_prof_on = 0;
+    if(g_csv){
+        if(fclose(g_csv) != 0) fprintf(stderr, "Warning: cannot write profile CSV\n");
+        g_csv = NULL;
+    }
+    if(!table) return;
+
+    BrzProfile p;
+    brz_profile_totals(&p);
+    fprintf(table, "Profile (inclusive times, wall %.1f ms)\n", wall_ms);
+    fprintf(table, "  %-10s %12s %12s %10s %7s\n", "phase", "calls", "total_ms", "mean_us", "wall%");
+    for(int i=0;i<BRZ_PROF_PHASE_COUNT;i++){
+        if(!p.calls[i]) continue;
+        double ms = (double)p.ns[i] / 1e6;
+        fprintf(table, "  %-10s %12llu %12.3f %10.3f %7.1f\n", k_phase_names[i],
+                (unsigned long long)p.calls[i], ms, ms * 1e3 / (double)p.calls[i],
+                wall_ms > 0 ? 100.0 * ms / wall_ms : 0.0);
+    }
+    fprintf(table, "  %-14s %16s\n", "counter", "value");
+    for(int i=0;i<BRZ_PROF_COUNTER_COUNT;i++)
+        fprintf(table, "  %-14s %16llu\n", k_counter_names[i], (unsigned long long)p.count[i]);
+}
+
+#else /* !BRZ_PROFILE */
+
+bool brz_profile_available(void){ return false; }
+bool brz_profile_begin(const char* csv_path){ (void)csv_path; return false; }
+void brz_profile_day(int day){ (void)day; }
+void brz_profile_totals(BrzProfile* out){ memset(out, 0, sizeof(*out)); }
+void brz_profile_end(FILE* table){ (void)table; }
+
+#endif /* BRZ_PROFILE */
@@ -0,0 +1,101 @@
+#ifndef BRZ_PROFILE_H
+#define BRZ_PROFILE_H
+
+/*
+ * brz_profile.h/.c - per-phase timers and counters (--profile)
+ *
+ * Built with BRZ_PROFILE (make PROFILE=1), the BRZ_PROF_* macros below
+ * time phases with the monotonic clock and bump event counters. Without
+ * it they expand to nothing and the functions are stubs, so the default
+ * build carries no instrumentation at all.
+ *
+ * Every thread that records anything gets its own BrzProfile slot, so the
+ * parallel day step, ensemble members and the output writer never share
+ * a counter. Totals are the sum over all slots, including those of
+ * threads that have already exited. Phases nest (an agent step contains
+ * its rule pick and ops, an op contains its pathfinding), so times are
+ * inclusive and do not add up to the run time.
+ *
+ * Usage:
+ *   if(brz_profile_begin("profile.csv")){
+ *       ... run, calling brz_profile_day(day) after each day ...
+ *       brz_profile_end(stderr);   (per-phase table)
+ *   }
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+    BRZ_PROF_REGEN = 0,  /* brz_world_step_regen */
+    BRZ_PROF_STEP,       /* one agent's whole day */
+    BRZ_PROF_RULE,       /* pick_rule */
+    BRZ_PROF_OP_GATHER,  /* exec_op, by opcode (same order as BrzOpCode) */
+    BRZ_PROF_OP_CRAFT,
+    BRZ_PROF_OP_TRADE,
+    BRZ_PROF_OP_REST,
+    BRZ_PROF_OP_MOVE,
+    BRZ_PROF_PATH,       /* brz_world_find_nearest_tag */
+    BRZ_PROF_TRADE,      /* settlement side of a trade */
+    BRZ_PROF_COMMIT,     /* applying the parallel step's intent logs */
+    BRZ_PROF_SNAPSHOT,   /* capture on the sim thread + serialization */
+    BRZ_PROF_MAP,        /* ascii map render + write */
+    BRZ_PROF_PHASE_COUNT
+} BrzProfPhase;
+
+typedef enum {
+    BRZ_PROF_FIND_CALLS = 0, /* brz_world_find_nearest_tag calls */
+    BRZ_PROF_TILES_SCANNED,  /* tiles covered by those searches */
+    BRZ_PROF_EXPR_EVALS,     /* 'when' programs evaluated, plus box guards checked for indexed rules */
+    BRZ_PROF_TRADES,         /* trades settled */
+    BRZ_PROF_COUNTER_COUNT
+} BrzProfCounter;
+
+typedef struct BrzProfile {
+    uint64_t ns[BRZ_PROF_PHASE_COUNT];    /* inclusive time per phase */
+    uint64_t calls[BRZ_PROF_PHASE_COUNT]; /* timed intervals per phase */
+    uint64_t count[BRZ_PROF_COUNTER_COUNT];
+} BrzProfile;
+
+const char* brz_profile_phase_name(BrzProfPhase p);
+const char* brz_profile_counter_name(BrzProfCounter c);
+
+/* true when this build has instrumentation compiled in */
+bool brz_profile_available(void);
+
+/* Reset all slots and start recording. csv_path (NULL for none) receives a
+   header and one row per brz_profile_day call. False when the build has
+   no instrumentation or the file cannot be created. Call while no other
+   thread is recording. */
+bool brz_profile_begin(const char* csv_path);
+/* append the activity since the previous row (or begin) as row 'day' */
+void brz_profile_day(int day);
+/* sum over every slot so far */
+void brz_profile_totals(BrzProfile* out);
+/* stop recording, close the CSV and print the per-phase table to table
+   (NULL to skip). Call after the recording threads are joined. */
+void brz_profile_end(FILE* table);
+
+#ifdef BRZ_PROFILE
+
+extern int brz_prof_on;
+
+uint64_t brz_prof_now(void);
+void     brz_prof_add_time(BrzProfPhase p, uint64_t t0);
+void     brz_prof_add_count(BrzProfCounter c, uint64_t n);
+
+/* BRZ_PROF_T0(t) opens interval t; BRZ_PROF_T1(phase, t) charges it */
+#define BRZ_PROF_T0(t)        uint64_t t = brz_prof_on ? brz_prof_now() : 0
+#define BRZ_PROF_T1(phase, t) do{ if(brz_prof_on) brz_prof_add_time((phase), (t)); }while(0)
+#define BRZ_PROF_COUNT(c, n)  do{ if(brz_prof_on) brz_prof_add_count((c), (uint64_t)(n)); }while(0)
+
+#else
+
+#define BRZ_PROF_T0(t)        ((void)0)
+#define BRZ_PROF_T1(phase, t) ((void)0)
+#define BRZ_PROF_COUNT(c, n)  ((void)0)
+
+#endif /* BRZ_PROFILE */
+
+#endif /* BRZ_PROFILE_H */
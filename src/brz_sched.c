@@ -0,0 +1,200 @@
+#include "brz_sched.h"
+#include "brz_sim.h"
+#include "brz_agent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHED_SLOTS (BRZ_SCHED_HORIZON + 1)
+
+bool brz_sched_mode_from_cfg(const ParsedConfig* cfg, int* mode)
+{
+    const char* m = brz_cfg_get_str(cfg, "sim_schedule", "skip");
+    if(brz_streq(m, "skip")) *mode = BRZ_SCHED_SKIP;
+    else if(brz_streq(m, "full")) *mode = BRZ_SCHED_FULL;
+    else if(brz_streq(m, "validate")) *mode = BRZ_SCHED_VALIDATE;
+    else{
+        fprintf(stderr, "Error: unknown sim schedule '%s' (full, skip or validate)\n", m);
+        return false;
+    }
+    return true;
+}
+
+int brz_sched_init(BrzSched* s, int mode, const BrzSim* sim)
+{
+    memset(s, 0, sizeof(*s));
+    for(int k=0;k<SCHED_SLOTS;k++) brz_vec_init(&s->slot[k], sizeof(uint32_t));
+    const int n = sim->agents.n;
+    const size_t voc_n = sim->cfg->vocations.len;
+    s->mode = mode;
+    s->n = n;
+    s->synced   = (int32_t*)calloc((size_t)(n > 0 ? n : 1), sizeof(int32_t));
+    s->wake     = (int32_t*)calloc((size_t)(n > 0 ? n : 1), sizeof(int32_t));
+    s->awake    = (uint32_t*)malloc((size_t)(n > 0 ? n : 1) * sizeof(uint32_t));
+    s->spare    = (uint32_t*)malloc((size_t)(n > 0 ? n : 1) * sizeof(uint32_t));
+    s->may_idle = (uint8_t*)calloc(voc_n ? voc_n : 1, 1);
+    if(!s->synced || !s->wake || !s->awake || !s->spare || !s->may_idle){
+        fprintf(stderr, "Scheduler init failed\n");
+        brz_sched_free(s);
+        return 1;
+    }
+    for(int i=0;i<n;i++) s->awake[i] = (uint32_t)i;
+    s->awake_n = n;
+    const VocationDef* vocs = (const VocationDef*)sim->cfg->vocations.data;
+    for(size_t v=0; v<voc_n; v++) s->may_idle[v] = (uint8_t)brz_voc_may_idle(&vocs[v]);
+    s->ready = true;
+    return 0;
+}
+
+void brz_sched_free(BrzSched* s)
+{
+    if(!s) return;
+    for(int k=0;k<SCHED_SLOTS;k++) brz_vec_destroy(&s->slot[k]);
+    free(s->synced);
+    free(s->wake);
+    free(s->awake);
+    free(s->spare);
+    free(s->may_idle);
+    memset(s, 0, sizeof(*s));
+}
+
+/* replay sleeper i's skipped days up to `day` */
+static void sched_catch_up(BrzSched* s, BrzSim* sim, uint32_t i, int day)
+{
+    if(s->synced[i] >= day) return;
+    brz_agent_skip_days(&sim->agents, (int)i, sim->cfg, &sim->world, sim->setts, sim->sett_n,
+                        day - s->synced[i]);
+    s->synced[i] = day;
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+void brz_sched_begin_day(BrzSched* s, BrzSim* sim, int day)
+{
+    BrzVec* slot = &s->slot[day % SCHED_SLOTS];
+    if(slot->len == 0) return;
+    uint32_t* ids = (uint32_t*)slot->data;
+    const int m = (int)slot->len;
+    for(int k=0;k<m;k++){
+        sched_catch_up(s, sim, ids[k], day - 1);
+        s->wake[ids[k]] = 0;
+    }
+    qsort(ids, (size_t)m, sizeof(uint32_t), cmp_u32);
+
+    /* merge the woken into the awake list */
+    int a = 0, b = 0, o = 0;
+    while(a < s->awake_n || b < m){
+        if(b == m || (a < s->awake_n && s->awake[a] < ids[b])) s->spare[o++] = s->awake[a++];
+        else s->spare[o++] = ids[b++];
+    }
+    uint32_t* t = s->awake; s->awake = s->spare; s->spare = t;
+    s->awake_n = o;
+    s->asleep -= m;
+    brz_vec_clear(slot);
+}
+
+/* Step sleeper i through `day` in full on the side and compare with the
+   quiet day the skip applies; the store ends up with the skipped state. */
+static bool validate_sleeper(BrzSim* sim, uint32_t i, int day, double* row, BrzIntentLog* log)
+{
+    BrzAgentStore* ag = &sim->agents;
+    const int id = (int)i;
+    double* res = brz_agents_res(ag, id);
+    double* item = brz_agents_item(ag, id);
+    const BrzPos pos = ag->pos[i], target = ag->target[i];
+    const uint8_t has_target = ag->has_target[i];
+    const double hunger = ag->hunger[i], fatigue = ag->fatigue[i];
+    memcpy(row, res, ag->res_n * sizeof(double));
+    memcpy(row + ag->res_n, item, ag->item_n * sizeof(double));
+
+    BrzRng rng;
+    brz_rng_stream(&rng, sim->seed, i, (uint32_t)day);
+    const uint32_t rng_state = rng.state;
+    brz_intent_log_clear(log);
+    brz_agent_step_deferred(ag, id, sim->cfg, &sim->world, sim->setts, sim->sett_n, &rng, log);
+    const BrzPos f_pos = ag->pos[i], f_target = ag->target[i];
+    const uint8_t f_has_target = ag->has_target[i];
+    const double f_hunger = ag->hunger[i], f_fatigue = ag->fatigue[i];
+    bool same = rng.state == rng_state && log->intents.len == 0 && !log->oom &&
+                memcmp(row, res, ag->res_n * sizeof(double)) == 0 &&
+                memcmp(row + ag->res_n, item, ag->item_n * sizeof(double)) == 0;
+
+    ag->pos[i] = pos;
+    ag->target[i] = target;
+    ag->has_target[i] = has_target;
+    ag->hunger[i] = hunger;
+    ag->fatigue[i] = fatigue;
+    memcpy(res, row, ag->res_n * sizeof(double));
+    memcpy(item, row + ag->res_n, ag->item_n * sizeof(double));
+    same = same && brz_agent_skip_days(ag, id, sim->cfg, &sim->world, sim->setts, sim->sett_n, 1) == 1;
+
+    return same && ag->pos[i].x == f_pos.x && ag->pos[i].y == f_pos.y &&
+           ag->target[i].x == f_target.x && ag->target[i].y == f_target.y &&
+           ag->has_target[i] == f_has_target &&
+           ag->hunger[i] == f_hunger && ag->fatigue[i] == f_fatigue;
+}
+
+static bool validate_sleepers(BrzSched* s, BrzSim* sim, int day)
+{
+    const BrzAgentStore* ag = &sim->agents;
+    double* row = (double*)malloc((ag->res_n + ag->item_n + 1) * sizeof(double));
+    if(!row){ fprintf(stderr, "Error: OOM validating the schedule (day %d)\n", day); return false; }
+    BrzIntentLog log;
+    brz_intent_log_init(&log);
+    bool ok = true;
+    for(int k=0; k<SCHED_SLOTS && ok; k++){
+        const uint32_t* ids = (const uint32_t*)s->slot[k].data;
+        for(size_t j=0; j<s->slot[k].len; j++){
+            sched_catch_up(s, sim, ids[j], day - 1);
+            if(!validate_sleeper(sim, ids[j], day, row, &log)){
+                fprintf(stderr, "Error: schedule validation failed: agent %u acted on day %d while asleep\n",
+                        (unsigned)ids[j], day);
+                ok = false;
+                break;
+            }
+            s->synced[ids[j]] = day;
+        }
+    }
+    brz_intent_log_destroy(&log);
+    free(row);
+    return ok;
+}
+
+bool brz_sched_end_day(BrzSched* s, BrzSim* sim, int day)
+{
+    if(s->mode == BRZ_SCHED_FULL) return true;
+    if(s->mode == BRZ_SCHED_VALIDATE && s->asleep > 0 && !validate_sleepers(s, sim, day)) return false;
+
+    const BrzAgentStore* ag = &sim->agents;
+    int keep = 0;
+    for(int k=0;k<s->awake_n;k++){
+        uint32_t i = s->awake[k];
+        if(s->may_idle[ag->voc[i]]){
+            int q = brz_agent_quiet_days(ag, (int)i, sim->cfg, &sim->world, sim->setts, sim->sett_n,
+                                         BRZ_SCHED_HORIZON - 1);
+            int wake = day + q + 1;
+            if(q > 0 && brz_vec_push(&s->slot[wake % SCHED_SLOTS], &i)){
+                s->synced[i] = day;
+                s->wake[i] = wake;
+                s->asleep++;
+                continue;
+            }
+        }
+        s->awake[keep++] = i;
+    }
+    s->awake_n = keep;
+    return true;
+}
+
+void brz_sched_sync(BrzSched* s, BrzSim* sim, int day)
+{
+    if(s->asleep == 0) return;
+    for(int k=0;k<SCHED_SLOTS;k++){
+        const uint32_t* ids = (const uint32_t*)s->slot[k].data;
+        for(size_t j=0;j<s->slot[k].len;j++) sched_catch_up(s, sim, ids[j], day);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef BRZ_SCHED_H
+#define BRZ_SCHED_H
+
+/*
+ * brz_sched.h/.c - event-driven agent scheduling
+ *
+ * An agent whose next days are quiet (brz_agent_quiet_days: no rule can
+ * match, no eating, no delivery) needs no decision on them. After its
+ * step the scheduler puts it to sleep on a timing wheel, keyed by the day
+ * of its next decision, and the day loop only steps the awake agents.
+ * A sleeper's stored state stays at the day it fell asleep; waking it, or
+ * brz_sim_sync, replays the skipped days in one go. Quiet days touch
+ * nothing shared and draw nothing, so skipping gives exactly the run that
+ * stepping every agent gives, serial or parallel.
+ *
+ * sim { schedule full|skip|validate } picks the mode (default skip).
+ * validate skips as well, but still steps every sleeper in full each day
+ * and stops the run if that step did anything the skip did not.
+ */
+
+#include "brz_dsl.h"
+#include "brz_vec.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct BrzSim;
+
+typedef enum {
+    BRZ_SCHED_FULL = 0, /* step every agent every day */
+    BRZ_SCHED_SKIP,     /* sleep through quiet days */
+    BRZ_SCHED_VALIDATE  /* skip, and check every skipped day against a full step */
+} BrzSchedMode;
+
+/* longest sleep in days; the wheel has one slot more, so that the slots of
+   all pending wake days are distinct */
+#define BRZ_SCHED_HORIZON 64
+
+typedef struct BrzSched {
+    bool ready;         /* set up for the sim's agents (brz_sched_init) */
+    int mode;           /* BrzSchedMode */
+    int n;              /* agents */
+    int32_t* synced;    /* [n] day a sleeper's stored state is at */
+    int32_t* wake;      /* [n] day a sleeper steps again; 0 while awake */
+    BrzVec slot[BRZ_SCHED_HORIZON + 1]; /* uint32_t sleepers, by wake day % slot count */
+    uint32_t* awake;    /* [n] agents stepping today, ascending */
+    int awake_n;
+    uint32_t* spare;    /* [n] scratch for merging woken agents in */
+    uint8_t* may_idle;  /* [vocations] brz_voc_may_idle */
+    int asleep;
+} BrzSched;
+
+/* sim { schedule } of cfg; false (printed) for an unknown mode */
+bool brz_sched_mode_from_cfg(const ParsedConfig* cfg, int* mode);
+
+/* Every agent of sim starts awake. Returns 0 on success, 1 on OOM
+   (printed; sched freed). */
+int  brz_sched_init(BrzSched* sched, int mode, const struct BrzSim* sim);
+void brz_sched_free(BrzSched* sched);
+
+/* Start `day`: sleepers due wake up with their state brought to day-1.
+   awake[0..awake_n) are then the agents to step, in id order. */
+void brz_sched_begin_day(BrzSched* sched, struct BrzSim* sim, int day);
+/* After the day's step and trade clearing: awake agents with quiet days
+   ahead go to sleep. In validate mode the sleepers are stepped first.
+   Returns false if validation failed (printed). */
+bool brz_sched_end_day(BrzSched* sched, struct BrzSim* sim, int day);
+/* bring every sleeper's stored state up to `day`; they stay asleep */
+void brz_sched_sync(BrzSched* sched, struct BrzSim* sim, int day);
+
+#endif /* BRZ_SCHED_H */
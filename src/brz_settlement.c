@@ -9,10 +9,16 @@ int brz_settlements_alloc(BrzSettlement** out, int n, size_t res_n, size_t item_
     *out = (BrzSettlement*)calloc((size_t)n, sizeof(BrzSettlement));
     if(!*out) return 1;
     for(int i=0;i<n;i++){
-        snprintf((*out)[i].name, sizeof((*out)[i].name), "Settlement%d", i+1);
-        (*out)[i].res_inv = (double*)calloc(res_n, sizeof(double));
-        (*out)[i].item_inv = (double*)calloc(item_n, sizeof(double));
-        if(!(*out)[i].res_inv || !(*out)[i].item_inv) return 1;
+        BrzSettlement* s = &(*out)[i];
+        snprintf(s->name, sizeof(s->name), "Settlement%d", i+1);
+        s->res_n = res_n;
+        s->item_n = item_n;
+        brz_vec_init(&s->orders, sizeof(BrzTradeOrder));
+        s->res_inv = (double*)calloc(res_n, sizeof(double));
+        s->item_inv = (double*)calloc(item_n, sizeof(double));
+        s->res_price = (double*)calloc(res_n ? res_n : 1, sizeof(double));
+        s->item_price = (double*)calloc(item_n ? item_n : 1, sizeof(double));
+        if(!s->res_inv || !s->item_inv || !s->res_price || !s->item_price) return 1;
     }
     return 0;
 }
@@ -39,8 +45,12 @@ void brz_settlements_place(BrzSettlement* s, int n, int w, int h, unsigned seed)
 }
 
 void brz_settlements_begin_day(BrzSettlement* s, int n){
-    (void)s; (void)n;
-    /* placeholder for future daily accounting */
+    for(int i=0;i<n;i++){
+        for(size_t r=0;r<s[i].res_n;r++) s[i].res_price[r] = brz_settlement_price_res(&s[i], (int)r);
+        for(size_t k=0;k<s[i].item_n;k++) s[i].item_price[k] = brz_settlement_price_item(&s[i], (int)k);
+        brz_vec_clear(&s[i].orders);
+        s[i].orders_oom = false;
+    }
 }
 
 void brz_settlements_free(BrzSettlement* s, int n){
@@ -48,10 +58,19 @@ void brz_settlements_free(BrzSettlement* s, int n){
     for(int i=0;i<n;i++){
         free(s[i].res_inv);
         free(s[i].item_inv);
+        free(s[i].res_price);
+        free(s[i].item_price);
+        brz_vec_destroy(&s[i].orders);
     }
     free(s);
 }
 
+bool brz_settlement_queue_trade(BrzSettlement* s, const BrzTradeOrder* o){
+    if(brz_vec_push(&s->orders, o)) return true;
+    s->orders_oom = true;
+    return false;
+}
+
 int brz_find_nearest_settlement(const BrzSettlement* s, int n, BrzPos p){
     int best=-1;
     int bestd=1<<30;
@@ -3,21 +3,45 @@
 #define BRZ_SETTLEMENT_H
 
 #include "brz_types.h"
+#include "brz_vec.h"
+#include <stdbool.h>
 #include <stddef.h>
 
+/* A trade waiting for its settlement's clearing at the end of the agent
+   phase. The agent has already handed over the goods; want_amt is priced
+   at the day's prices. */
+typedef struct {
+    uint32_t agent;        /* index in the agent store */
+    uint8_t give_is_item;  /* give is an item id */
+    int32_t give;
+    int32_t want_r, want_i;
+    double give_amt;
+    double want_amt;
+} BrzTradeOrder;
+
 typedef struct BrzSettlement {
     char name[64];
     BrzPos pos;
     int population;
     double* res_inv;   /* [res_n] */
     double* item_inv;  /* [item_n] */
+    size_t res_n, item_n;
+    double* res_price;  /* [res_n], set by brz_settlements_begin_day */
+    double* item_price; /* [item_n] */
+    BrzVec orders;      /* BrzTradeOrder, in agent order */
+    bool orders_oom;    /* an order could not be queued */
 } BrzSettlement;
 
 int  brz_settlements_alloc(BrzSettlement** out, int n, size_t res_n, size_t item_n);
 void brz_settlements_place(BrzSettlement* s, int n, int w, int h, unsigned seed);
+/* Price every kind from the morning stock. Trades during the day use these
+   prices, so an agent's deal no longer depends on who traded before it. */
 void brz_settlements_begin_day(BrzSettlement* s, int n);
 void brz_settlements_free(BrzSettlement* s, int n);
 
+/* queue a trade for s; false (and s->orders_oom set) when out of memory */
+bool brz_settlement_queue_trade(BrzSettlement* s, const BrzTradeOrder* o);
+
 int   brz_find_nearest_settlement(const BrzSettlement* s, int n, BrzPos p);
 double brz_settlement_price_res(const BrzSettlement* s, int rid);
 double brz_settlement_price_item(const BrzSettlement* s, int iid);
@@ -5,195 +5,140 @@
 #include "brz_world.h"
 #include "brz_settlement.h"
 #include "brz_agent.h"
+#include "brz_pool.h"
+#include "brz_snapshot.h"
+#include "brz_metrics.h"
+#include "brz_writer.h"
+#include "brz_checkpoint.h"
+#include "brz_profile.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
-/* ---------------- config helpers ---------------- */
+/* ---------------- output ----------------
+   Snapshots and maps are captured on the sim thread and handed to the
+   writer, which serializes them in the background. */
 
-static const ParamDef* cfg_find_param(const ParsedConfig* cfg, const char* key)
-{
-    for(size_t i=0;i<cfg->params.len;i++)
-    {
-        const ParamDef* p = (const ParamDef*)brz_vec_cat(&cfg->params, i);
-        if(p->key && brz_streq(p->key, key)) return p;
-    }
-    return NULL;
-}
+typedef struct {
+    BrzSnapshot snap;
+    bool binary;
+} SnapshotJob;
 
-static int cfg_get_int(const ParsedConfig* cfg, const char* key, int defv)
+static bool snapshot_job_write(void* payload, FILE* f)
 {
-    const ParamDef* p = cfg_find_param(cfg, key);
-    if(!p) return defv;
-    if(p->has_svalue) return defv;
-    return (int)(p->value);
+    SnapshotJob* j = (SnapshotJob*)payload;
+    BRZ_PROF_T0(t0);
+    bool ok = j->binary ? brz_snapshot_write_bin(&j->snap, f) : brz_snapshot_write_json(&j->snap, f);
+    BRZ_PROF_T1(BRZ_PROF_SNAPSHOT, t0);
+    return ok;
 }
 
-static const char* cfg_get_str(const ParsedConfig* cfg, const char* key, const char* defv)
+static void snapshot_job_release(void* payload)
 {
-    const ParamDef* p = cfg_find_param(cfg, key);
-    if(!p) return defv;
-    if(!p->has_svalue) return defv;
-    return p->svalue ? p->svalue : defv;
+    SnapshotJob* j = (SnapshotJob*)payload;
+    brz_snapshot_free(&j->snap);
+    free(j);
 }
 
-/* ---------------- snapshot json ---------------- */
-
-static void write_snapshot_json(const ParsedConfig* cfg,
-                                const BrzWorld* world,
-                                const BrzSettlement* setts, int sett_n,
-                                const BrzAgent* agents, int agent_n,
-                                int day, const char* filename)
+static void write_snapshot(BrzWriter* out, const ParsedConfig* cfg,
+                           const BrzWorld* world,
+                           const BrzSettlement* setts, int sett_n,
+                           const BrzAgentStore* agents,
+                           int day, bool binary)
 {
-    FILE* f = fopen(filename, "wb");
-    if(!f){ fprintf(stderr, "Warning: cannot write %s\n", filename); return; }
-
-    const size_t res_n = kind_table_count(&cfg->resource_kinds);
-    const size_t item_n = kind_table_count(&cfg->item_kinds);
-
-    /* world totals */
-    double* world_tot = (double*)calloc(res_n, sizeof(double));
-    if(world_tot){
-        for(int y=0;y<world->h;y++){
-            for(int x=0;x<world->w;x++){
-                const double* r = &world->res[(size_t)(y*world->w+x)*res_n];
-                for(size_t i=0;i<res_n;i++) world_tot[i] += r[i];
-            }
-        }
-    }
-
-    fprintf(f, "{\n");
-    fprintf(f, "  \"day\": %d,\n", day);
-    fprintf(f, "  \"world\": { \"w\": %d, \"h\": %d },\n", world->w, world->h);
-
-    fprintf(f, "  \"resource_kinds\": [");
-    for(size_t i=0;i<res_n;i++){
-        const char* nm = kind_table_name(&cfg->resource_kinds, (int)i);
-        fprintf(f, "%s\"%s\"", (i? ", ":" "), nm?nm:"");
-    }
-    fprintf(f, " ],\n");
-
-    fprintf(f, "  \"item_kinds\": [");
-    for(size_t i=0;i<item_n;i++){
-        const char* nm = kind_table_name(&cfg->item_kinds, (int)i);
-        fprintf(f, "%s\"%s\"", (i? ", ":" "), nm?nm:"");
-    }
-    fprintf(f, " ],\n");
-
-    fprintf(f, "  \"world_resources_total\": [");
-    for(size_t i=0;i<res_n;i++){
-        double v = world_tot ? world_tot[i] : 0.0;
-        fprintf(f, "%s%.3f", (i? ", ":" "), v);
-    }
-    fprintf(f, " ],\n");
-
-    /* settlements */
-    fprintf(f, "  \"settlements\": [\n");
-    for(int si=0; si<sett_n; si++){
-        fprintf(f, "    { \"name\": \"%s\", \"x\": %d, \"y\": %d, \"population\": %d,\n",
-                setts[si].name, setts[si].pos.x, setts[si].pos.y, setts[si].population);
-        fprintf(f, "      \"resources\": [");
-        for(size_t i=0;i<res_n;i++) fprintf(f, "%s%.3f", (i? ", ":" "), setts[si].res_inv[i]);
-        fprintf(f, " ],\n");
-        fprintf(f, "      \"items\": [");
-        for(size_t i=0;i<item_n;i++) fprintf(f, "%s%.3f", (i? ", ":" "), setts[si].item_inv[i]);
-        fprintf(f, " ] }%s\n", (si==sett_n-1? "":","));
+    char fn[128];
+    snprintf(fn, sizeof(fn), binary ? "snapshot_day%05d.bsnap" : "snapshot_day%05d.json", day);
+
+    BRZ_PROF_T0(t0);
+    SnapshotJob* j = (SnapshotJob*)calloc(1, sizeof(SnapshotJob));
+    if(!j || !brz_snapshot_capture(&j->snap, cfg, world, setts, sett_n, agents, day)){
+        fprintf(stderr, "Warning: OOM capturing %s\n", fn);
+        if(j) snapshot_job_release(j);
+        return;
     }
-    fprintf(f, "  ],\n");
-
-    /* agents */
-    fprintf(f, "  \"agents\": [\n");
-    for(int ai=0; ai<agent_n; ai++){
-        const BrzAgent* a = &agents[ai];
-        fprintf(f, "    { \"id\": %u, \"vocation\": \"%s\", \"x\": %d, \"y\": %d, \"home\": %d, \"hunger\": %.3f, \"fatigue\": %.3f,\n",
-                (unsigned)a->id,
-                (a->voc && a->voc->name)?a->voc->name:"",
-                a->pos.x, a->pos.y,
-                a->home_settlement,
-                a->hunger, a->fatigue);
-        fprintf(f, "      \"resources\": [");
-        for(size_t i=0;i<res_n;i++) fprintf(f, "%s%.3f", (i? ", ":" "), a->res_inv[i]);
-        fprintf(f, " ],\n");
-        fprintf(f, "      \"items\": [");
-        for(size_t i=0;i<item_n;i++) fprintf(f, "%s%.3f", (i? ", ":" "), a->item_inv[i]);
-        fprintf(f, " ] }%s\n", (ai==agent_n-1? "":","));
-    }
-    fprintf(f, "  ]\n");
-    fprintf(f, "}\n");
+    BRZ_PROF_T1(BRZ_PROF_SNAPSHOT, t0);
+    j->binary = binary;
+    if(!brz_writer_submit(out, fn, snapshot_job_write, snapshot_job_release, j))
+        fprintf(stderr, "Warning: OOM queueing %s\n", fn);
+}
 
-    free(world_tot);
-    fclose(f);
+static bool map_job_write(void* payload, FILE* f)
+{
+    const char* text = (const char*)payload;
+    size_t n = strlen(text);
+    BRZ_PROF_T0(t0);
+    bool ok = fwrite(text, 1, n, f) == n;
+    BRZ_PROF_T1(BRZ_PROF_MAP, t0);
+    return ok;
 }
 
 /* ---------------- ascii map ---------------- */
 
-static void dump_ascii_map(const ParsedConfig* cfg,
+static void dump_ascii_map(BrzWriter* out,
                            const BrzWorld* world,
                            const BrzSettlement* setts, int sett_n,
-                           const BrzAgent* agents, int agent_n,
-                           int day, const char* filename, int w, int h)
+                           const BrzAgentStore* agents,
+                           int day, int w, int h)
 {
-    (void)cfg;
-    FILE* f = fopen(filename, "wb");
-    if(!f){ fprintf(stderr, "Warning: cannot write %s\n", filename); return; }
-
-    fprintf(f, "Day %d\n", day);
-
-    /* build map buffer */
-    char* buf = (char*)malloc((size_t)(w*h));
-    if(!buf){ fclose(f); return; }
+    char fn[128];
+    snprintf(fn, sizeof(fn), "map_day%05d.txt", day);
+
+    /* "Day N" line, then h rows of w glyphs */
+    size_t row = (size_t)w + 1;
+    char head[32];
+    int head_n = snprintf(head, sizeof(head), "Day %d\n", day);
+    char* text = (char*)malloc((size_t)head_n + row*(size_t)h + 1);
+    if(!text){ fprintf(stderr, "Warning: OOM rendering %s\n", fn); return; }
+    BRZ_PROF_T0(t0);
+    memcpy(text, head, (size_t)head_n);
+    char* buf = text + head_n;
 
     for(int y=0;y<h;y++){
         for(int x=0;x<w;x++){
-            buf[y*w+x] = brz_world_tile_glyph(world, x, y);
+            buf[y*row+x] = brz_world_tile_glyph(world, x, y);
         }
+        buf[y*row+w] = '\n';
     }
+    buf[row*(size_t)h] = 0;
 
     /* settlements */
     for(int si=0; si<sett_n; si++){
         int x=setts[si].pos.x, y=setts[si].pos.y;
-        if(x>=0&&y>=0&&x<w&&y<h) buf[y*w+x] = 'S';
+        if(x>=0&&y>=0&&x<w&&y<h) buf[y*row+x] = 'S';
     }
 
     /* agents */
-    for(int ai=0; ai<agent_n; ai++){
-        int x=agents[ai].pos.x, y=agents[ai].pos.y;
+    for(int ai=0; ai<agents->n; ai++){
+        int x=agents->pos[ai].x, y=agents->pos[ai].y;
         if(x<0||y<0||x>=w||y>=h) continue;
         char c='a';
-        if(agents[ai].voc && agents[ai].voc->name && agents[ai].voc->name[0])
-            c = agents[ai].voc->name[0];
-        buf[y*w+x] = c;
+        const VocationDef* voc = brz_agents_voc(agents, ai);
+        if(voc->name && voc->name[0])
+            c = voc->name[0];
+        buf[y*row+x] = c;
     }
+    BRZ_PROF_T1(BRZ_PROF_MAP, t0);
 
-    for(int y=0;y<h;y++){
-        for(int x=0;x<w;x++) fputc(buf[y*w+x], f);
-        fputc('\n', f);
-    }
-    free(buf);
-    fclose(f);
+    if(!brz_writer_submit(out, fn, map_job_write, free, text))
+        fprintf(stderr, "Warning: OOM queueing %s\n", fn);
 }
 
 /* ---------------- reporting ---------------- */
 
 static void print_day_summary(int day, const ParsedConfig* cfg,
                               const BrzSettlement* setts, int sett_n,
-                              const BrzAgent* agents, int agent_n)
+                              const BrzAgentStore* agents)
 {
+    const int agent_n = agents->n;
     const size_t res_n = kind_table_count(&cfg->resource_kinds);
     const size_t item_n = kind_table_count(&cfg->item_kinds);
 
-    double* tot_res = (double*)calloc(res_n, sizeof(double));
-    double* tot_item = (double*)calloc(item_n, sizeof(double));
     double avg_h=0, avg_f=0;
-
-    for(int ai=0; ai<agent_n; ai++){
-        avg_h += agents[ai].hunger;
-        avg_f += agents[ai].fatigue;
-        for(size_t i=0;i<res_n;i++) tot_res[i] += agents[ai].res_inv[i];
-        for(size_t i=0;i<item_n;i++) tot_item[i] += agents[ai].item_inv[i];
+    if(agent_n>0){
+        avg_h = brz_agents_total_hunger(agents) / agent_n;
+        avg_f = brz_agents_total_fatigue(agents) / agent_n;
     }
-    if(agent_n>0){ avg_h/=agent_n; avg_f/=agent_n; }
 
     printf("Day %d | agents=%d settlements=%d | avg_hunger=%.3f avg_fatigue=%.3f\n",
            day, agent_n, sett_n, avg_h, avg_f);
@@ -203,7 +148,7 @@ static void print_day_summary(int day, const ParsedConfig* cfg,
     for(size_t i=0;i<res_n;i++){
         const char* nm = kind_table_name(&cfg->resource_kinds, (int)i);
         if(!nm) nm="";
-        if(i<6) printf(" %s=%.1f", nm, tot_res[i]);
+        if(i<6) printf(" %s=%.1f", nm, brz_agents_total_res(agents, i));
     }
     if(res_n>6) printf(" ...");
     printf("\n");
@@ -212,111 +157,362 @@ static void print_day_summary(int day, const ParsedConfig* cfg,
     for(size_t i=0;i<item_n;i++){
         const char* nm = kind_table_name(&cfg->item_kinds, (int)i);
         if(!nm) nm="";
-        if(i<6) printf(" %s=%.1f", nm, tot_item[i]);
+        if(i<6) printf(" %s=%.1f", nm, brz_agents_total_item(agents, i));
     }
     if(item_n>6) printf(" ...");
     printf("\n");
 
     /* settlement food stores snapshot */
     if(sett_n>0){
-        int grain = kind_table_find(&cfg->resource_kinds, "grain");
-        int fish  = kind_table_find(&cfg->resource_kinds, "fish");
+        int grain = cfg->known.r_grain;
+        int fish  = cfg->known.r_fish;
         for(int si=0; si<sett_n && si<3; si++){
             double g = (grain>=0)? setts[si].res_inv[grain] : 0;
             double fi= (fish>=0)? setts[si].res_inv[fish] : 0;
             printf("  %s at (%d,%d): grain=%.1f fish=%.1f\n", setts[si].name, setts[si].pos.x, setts[si].pos.y, g, fi);
         }
     }
+}
 
-    free(tot_res);
-    free(tot_item);
+/* ---------------- parallel day step ----------------
+   Agents are stepped in fixed-size chunks, each with its own intent log
+   and a per-agent rng stream seeded from (seed, agent id, day). Chunks
+   only read shared state; the logs are then committed in chunk order,
+   which is agent-id order. The result depends on the seed alone, never on
+   the thread count. */
+
+#define BRZ_STEP_CHUNK 512
+
+typedef struct {
+    const ParsedConfig* cfg;
+    BrzWorld* world;
+    BrzSettlement* setts;
+    int sett_n;
+    BrzAgentStore* agents;
+    uint32_t seed;
+    uint32_t day;
+    const uint32_t* ids; /* agents stepping today, ascending */
+    int id_n;
+    BrzIntentLog* logs; /* [chunk_n] */
+} DayStep;
+
+static void day_step_chunk(void* ctx, int chunk)
+{
+    DayStep* d = (DayStep*)ctx;
+    BrzIntentLog* log = &d->logs[chunk];
+    int lo = chunk * BRZ_STEP_CHUNK;
+    int hi = lo + BRZ_STEP_CHUNK;
+    if(hi > d->id_n) hi = d->id_n;
+    brz_intent_log_clear(log);
+    for(int k=lo;k<hi;k++){
+        const uint32_t i = d->ids[k];
+        BrzRng rng;
+        brz_rng_stream(&rng, d->seed, i, d->day);
+        brz_agent_step_deferred(d->agents, (int)i, d->cfg, d->world, d->setts, d->sett_n, &rng, log);
+    }
 }
 
-/* ---------------- main runner ---------------- */
+/* returns false if an intent log ran out of memory */
+static bool day_step_parallel(BrzPool* pool, DayStep* d, int day)
+{
+    int chunk_n = (d->id_n + BRZ_STEP_CHUNK - 1) / BRZ_STEP_CHUNK;
+    d->day = (uint32_t)day;
+    brz_pool_run(pool, chunk_n, day_step_chunk, d);
+    BRZ_PROF_T0(t0);
+    for(int c=0;c<chunk_n;c++){
+        if(d->logs[c].oom) return false;
+        brz_intents_commit(&d->logs[c], d->agents, d->cfg, d->world, d->setts);
+    }
+    BRZ_PROF_T1(BRZ_PROF_COMMIT, t0);
+    return true;
+}
 
-int brz_run(const ParsedConfig* cfg)
+/* ---------------- run state ---------------- */
+
+int brz_sim_init(BrzSim* sim, const ParsedConfig* cfg)
 {
-    if(!cfg) return 1;
+    return brz_sim_init_seed(sim, cfg, cfg->seed);
+}
+
+int brz_sim_init_seed(BrzSim* sim, const ParsedConfig* cfg, uint32_t seed)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->cfg = cfg;
+    sim->seed = brz_sim_seed(seed);
 
     const size_t res_n  = kind_table_count(&cfg->resource_kinds);
     const size_t item_n = kind_table_count(&cfg->item_kinds);
-
-    int days          = cfg_get_int(cfg, "sim_days", 365);
-    int report_every  = cfg_get_int(cfg, "report_every", 30);
-    int snapshot_every= cfg_get_int(cfg, "snapshot_every", 0);
-    int map_every     = cfg_get_int(cfg, "map_every", 0);
-
-    int map_w = cfg_get_int(cfg, "sim_map_w", 80);
-    int map_h = cfg_get_int(cfg, "sim_map_h", 40);
-    (void)cfg_get_str(cfg, "output_dir", "");
+    int map_w = brz_cfg_get_int(cfg, "sim_map_w", 80);
+    int map_h = brz_cfg_get_int(cfg, "sim_map_h", 40);
 
     int agent_n = (cfg->agent_count > 0) ? cfg->agent_count : (int)cfg->vocations.len;
     if(agent_n <= 0){ fprintf(stderr, "No agents (agents.count or vocations)\n"); return 1; }
     if(cfg->vocations.len == 0){ fprintf(stderr, "No vocations\n"); return 1; }
 
-    int sett_n = (cfg->settlement_count > 0) ? cfg->settlement_count : 1;
+    sim->sett_n = (cfg->settlement_count > 0) ? cfg->settlement_count : 1;
 
-    BrzWorld world;
-    if(brz_world_init(&world, cfg, map_w, map_h, res_n) != 0){
+    const char* world_mode = brz_cfg_get_str(cfg, "sim_world", "flat");
+    if(!brz_streq(world_mode, "flat") && !brz_streq(world_mode, "chunked")){
+        fprintf(stderr, "Error: unknown sim world '%s' (flat or chunked)\n", world_mode);
+        return 1;
+    }
+    const char* caps_mode = brz_cfg_get_str(cfg, "sim_caps", "table");
+    if(!brz_streq(caps_mode, "table") && !brz_streq(caps_mode, "plane")){
+        fprintf(stderr, "Error: unknown sim caps '%s' (table or plane)\n", caps_mode);
+        return 1;
+    }
+    if(brz_world_init_seed(&sim->world, cfg, sim->seed, map_w, map_h, res_n) != 0){
         fprintf(stderr, "World init failed\n");
+        brz_sim_free(sim);
         return 1;
     }
 
-    BrzSettlement* setts = NULL;
-    if(brz_settlements_alloc(&setts, sett_n, res_n, item_n) != 0){
+    if(brz_settlements_alloc(&sim->setts, sim->sett_n, res_n, item_n) != 0){
         fprintf(stderr, "Settlement alloc failed\n");
-        brz_world_free(&world);
+        brz_sim_free(sim);
+        return 1;
+    }
+    brz_settlements_place(sim->setts, sim->sett_n, map_w, map_h, sim->seed);
+    brz_world_stamp_fields_around_settlements(&sim->world, sim->setts, sim->sett_n, 8);
+    if(brz_world_index_settlements(&sim->world, sim->setts, sim->sett_n) != 0 ||
+       brz_world_flow_prepare_cfg(&sim->world, cfg) != 0){
+        fprintf(stderr, "World index failed\n");
+        brz_sim_free(sim);
         return 1;
     }
-    brz_settlements_place(setts, sett_n, map_w, map_h, cfg->seed ? cfg->seed : 0xC0FFEEu);
-    brz_world_stamp_fields_around_settlements(&world, setts, sett_n, 8);
 
-    BrzAgent* agents = NULL;
-    if(brz_agents_alloc_and_spawn(&agents, agent_n, cfg, setts, sett_n, res_n, item_n,
-                                  cfg->seed ? cfg->seed : 0xC0FFEEu) != 0){
+    if(brz_agents_alloc_and_spawn(&sim->agents, agent_n, cfg, sim->setts, sim->sett_n, res_n, item_n,
+                                  sim->seed) != 0){
         fprintf(stderr, "Agent alloc failed\n");
-        brz_settlements_free(setts, sett_n);
-        brz_world_free(&world);
+        brz_sim_free(sim);
         return 1;
     }
 
     /* simple population count */
-    for(int si=0; si<sett_n; si++) setts[si].population = 0;
+    for(int si=0; si<sim->sett_n; si++) sim->setts[si].population = 0;
     for(int ai=0; ai<agent_n; ai++){
-        int h = agents[ai].home_settlement;
-        if(h>=0 && h<sett_n) setts[h].population++;
+        int h = sim->agents.home[ai];
+        if(h>=0 && h<sim->sett_n) sim->setts[h].population++;
     }
 
-    BrzRng rng;
-    brz_rng_seed(&rng, cfg->seed ? cfg->seed : 0xC0FFEEu);
+    brz_rng_seed(&sim->rng, sim->seed);
+    sim->day = 0;
+    return 0;
+}
 
-    for(int day=1; day<=days; day++)
-    {
-        brz_world_step_regen(&world, res_n);
-        brz_settlements_begin_day(setts, sett_n);
+void brz_sim_free(BrzSim* sim)
+{
+    if(!sim) return;
+    brz_sched_free(&sim->sched);
+    brz_agents_free(&sim->agents);
+    if(sim->setts) brz_settlements_free(sim->setts, sim->sett_n);
+    brz_world_free(&sim->world);
+    memset(sim, 0, sizeof(*sim));
+}
 
-        for(int i=0;i<agent_n;i++)
-            brz_agent_step(&agents[i], cfg, &world, setts, sett_n, &rng);
+void brz_sim_sync(BrzSim* sim)
+{
+    if(sim->sched.ready) brz_sched_sync(&sim->sched, sim, sim->day);
+}
 
-        if(day==1 || (report_every>0 && day%report_every==0) || day==days)
-            print_day_summary(day, cfg, setts, sett_n, agents, agent_n);
+int brz_sim_run_days(BrzSim* sim, int days, int threads, BrzDayFn on_day, void* ctx)
+{
+    const ParsedConfig* cfg = sim->cfg;
+    const size_t res_n = kind_table_count(&cfg->resource_kinds);
+    const int agent_n = sim->agents.n;
+    const int sett_n = sim->sett_n;
 
-        if(snapshot_every > 0 && (day % snapshot_every)==0){
-            char fn[128];
-            snprintf(fn, sizeof(fn), "snapshot_day%05d.json", day);
-            write_snapshot_json(cfg, &world, setts, sett_n, agents, agent_n, day, fn);
+    BrzSched* sched = &sim->sched;
+    if(!sched->ready){
+        int mode;
+        if(!brz_sched_mode_from_cfg(cfg, &mode) || brz_sched_init(sched, mode, sim) != 0) return 1;
+    }
+
+    BrzPool* pool = NULL;
+    DayStep ds;
+    memset(&ds, 0, sizeof(ds));
+    int chunk_n = (agent_n + BRZ_STEP_CHUNK - 1) / BRZ_STEP_CHUNK;
+    if(threads > 0){
+        pool = brz_pool_create(threads);
+        ds.logs = (BrzIntentLog*)calloc((size_t)(chunk_n > 0 ? chunk_n : 1), sizeof(BrzIntentLog));
+        if(!pool || !ds.logs){
+            fprintf(stderr, "Thread pool init failed\n");
+            brz_pool_destroy(pool);
+            free(ds.logs);
+            return 1;
         }
+        for(int c=0;c<chunk_n;c++) brz_intent_log_init(&ds.logs[c]);
+        ds.cfg = cfg;
+        ds.world = &sim->world;
+        ds.setts = sim->setts;
+        ds.sett_n = sett_n;
+        ds.agents = &sim->agents;
+        ds.seed = sim->seed;
+    }
 
-        if(map_every > 0 && (day % map_every)==0){
-            char fn[128];
-            snprintf(fn, sizeof(fn), "map_day%05d.txt", day);
-            dump_ascii_map(cfg, &world, setts, sett_n, agents, agent_n, day, fn, map_w, map_h);
+    int rc = 0;
+    for(int day=sim->day+1; day<=days; day++)
+    {
+        BRZ_PROF_T0(t0);
+        brz_world_step_regen(&sim->world, res_n);
+        BRZ_PROF_T1(BRZ_PROF_REGEN, t0);
+        brz_settlements_begin_day(sim->setts, sett_n);
+        brz_world_flow_refresh(&sim->world); /* on failure lookups keep searching */
+        brz_sched_begin_day(sched, sim, day);
+
+        if(pool){
+            ds.ids = sched->awake;
+            ds.id_n = sched->awake_n;
+            if(!day_step_parallel(pool, &ds, day)){
+                fprintf(stderr, "Error: OOM in parallel step (day %d)\n", day);
+                rc = 1;
+                break;
+            }
+        }else{
+            for(int k=0;k<sched->awake_n;k++)
+                brz_agent_step(&sim->agents, (int)sched->awake[k], cfg, &sim->world, sim->setts, sett_n, &sim->rng);
+        }
+        if(!brz_trades_clear(&sim->agents, sim->setts, sett_n)){
+            fprintf(stderr, "Error: OOM in trade queue (day %d)\n", day);
+            rc = 1;
+            break;
+        }
+        if(sim->world.oom){
+            fprintf(stderr, "Error: OOM materializing world chunk (day %d)\n", day);
+            rc = 1;
+            break;
+        }
+        if(!brz_sched_end_day(sched, sim, day)){
+            rc = 1;
+            break;
         }
+        sim->day = day;
+
+        if(on_day && !on_day(ctx, sim)) break;
     }
 
-    brz_agents_free(agents, agent_n);
-    brz_settlements_free(setts, sett_n);
-    brz_world_free(&world);
+    if(pool){
+        for(int c=0;c<chunk_n;c++) brz_intent_log_destroy(&ds.logs[c]);
+        free(ds.logs);
+        brz_pool_destroy(pool);
+    }
+    brz_sim_sync(sim);
+    return rc;
+}
 
-    return 0;
+/* ---------------- main runner ---------------- */
+
+typedef struct {
+    int days;
+    int report_every;
+    int snapshot_every;
+    int map_every;
+    int checkpoint_every;
+    bool snapshot_bin;
+    bool metrics_on;   /* sim { metrics columnar } */
+    BrzMetrics metrics;
+    BrzWriter* out;
+} RunOutput;
+
+static bool run_output_day(void* ctx, BrzSim* sim)
+{
+    RunOutput* o = (RunOutput*)ctx;
+    int day = sim->day;
+
+    bool report = day==1 || (o->report_every>0 && day%o->report_every==0) || day==o->days;
+    if(report || o->metrics_on ||
+       (o->snapshot_every > 0 && (day % o->snapshot_every)==0) ||
+       (o->map_every > 0 && (day % o->map_every)==0) ||
+       (o->checkpoint_every > 0 && (day % o->checkpoint_every)==0))
+        brz_sim_sync(sim);
+
+    if(report)
+        print_day_summary(day, sim->cfg, sim->setts, sim->sett_n, &sim->agents);
+    if(o->metrics_on)
+        brz_metrics_record(&o->metrics, day, &sim->world, sim->setts, &sim->agents);
+
+    if(o->snapshot_every > 0 && (day % o->snapshot_every)==0){
+        write_snapshot(o->out, sim->cfg, &sim->world, sim->setts, sim->sett_n, &sim->agents, day, o->snapshot_bin);
+    }
+
+    if(o->map_every > 0 && (day % o->map_every)==0){
+        dump_ascii_map(o->out, &sim->world, sim->setts, sim->sett_n, &sim->agents, day, sim->world.w, sim->world.h);
+    }
+
+    if(o->checkpoint_every > 0 && (day % o->checkpoint_every)==0){
+        char fn[128];
+        snprintf(fn, sizeof(fn), "checkpoint_day%05d.brzck", day);
+        if(!brz_sim_checkpoint_save(sim, fn))
+            fprintf(stderr, "Warning: cannot write %s\n", fn);
+    }
+    brz_profile_day(day);
+    return true;
+}
+
+int brz_run(const ParsedConfig* cfg)
+{
+    return brz_run_from(cfg, NULL);
+}
+
+int brz_run_from(const ParsedConfig* cfg, const char* resume_path)
+{
+    if(!cfg) return 1;
+
+    RunOutput o;
+    o.days            = brz_cfg_get_int(cfg, "sim_days", 365);
+    o.report_every    = brz_cfg_get_int(cfg, "report_every", 30);
+    o.snapshot_every  = brz_cfg_get_int(cfg, "snapshot_every", 0);
+    o.map_every       = brz_cfg_get_int(cfg, "map_every", 0);
+    o.checkpoint_every= brz_cfg_get_int(cfg, "sim_checkpoint_every", 0);
+
+    int threads = brz_cfg_get_int(cfg, "sim_threads", 0); /* 0 = legacy serial step */
+    o.snapshot_bin = brz_streq(brz_cfg_get_str(cfg, "sim_snapshot_format", "json"), "binary");
+    int output_queue = brz_cfg_get_int(cfg, "sim_output_queue", 2); /* 0 = write on the sim thread */
+    (void)brz_cfg_get_str(cfg, "output_dir", "");
+    const char* metrics = brz_cfg_get_str(cfg, "sim_metrics", "off");
+    if(!brz_streq(metrics, "off") && !brz_streq(metrics, "columnar")){
+        fprintf(stderr, "Error: unknown sim metrics '%s' (off or columnar)\n", metrics);
+        return 1;
+    }
+    o.metrics_on = brz_streq(metrics, "columnar");
+
+    BrzSim sim;
+    if(resume_path){
+        char err[160];
+        if(!brz_sim_checkpoint_load(&sim, cfg, resume_path, err, sizeof(err))){
+            fprintf(stderr, "Error: cannot resume from %s: %s\n", resume_path, err);
+            return 1;
+        }
+        printf("Resumed from %s at day %d\n", resume_path, sim.day);
+    }else if(brz_sim_init(&sim, cfg) != 0){
+        return 1;
+    }
+    if(o.checkpoint_every > 0 && sim.world.chunks){
+        fprintf(stderr, "Error: checkpoints need sim { world flat }\n");
+        brz_sim_free(&sim);
+        return 1;
+    }
+
+    /* no thread unless there is something to write */
+    o.out = brz_writer_create((o.snapshot_every > 0 || o.map_every > 0) ? output_queue : 0);
+    if(!o.out){
+        fprintf(stderr, "Output writer init failed\n");
+        brz_sim_free(&sim);
+        return 1;
+    }
+    if(o.metrics_on &&
+       !brz_metrics_open(&o.metrics, BRZ_METRICS_FILE, cfg, sim.setts, sim.sett_n,
+                         brz_cfg_get_int(cfg, "sim_metrics_block", 0))){
+        brz_writer_destroy(o.out);
+        brz_sim_free(&sim);
+        return 1;
+    }
+
+    int rc = brz_sim_run_days(&sim, o.days, threads, run_output_day, &o);
+
+    if(o.metrics_on && !brz_metrics_close(&o.metrics))
+        fprintf(stderr, "Warning: cannot write %s\n", BRZ_METRICS_FILE);
+    brz_writer_destroy(o.out); /* finishes queued files */
+    brz_sim_free(&sim);
+    return rc;
 }
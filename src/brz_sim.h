@@ -2,10 +2,59 @@
 #define BRZ_SIM_H
 
 #include "brz_dsl.h"
+#include "brz_world.h"
+#include "brz_settlement.h"
+#include "brz_agent.h"
+#include "brz_sched.h"
+#include "brz_util.h"
+
+/* Run state: everything a day step reads or writes besides the config.
+   day is the last completed day (0 before the first step). The config is
+   only read, so any number of runs may share one ParsedConfig, each on its
+   own thread. */
+typedef struct BrzSim {
+    const ParsedConfig* cfg;
+    uint32_t seed; /* run seed; replaces cfg->seed for this run */
+    BrzWorld world;
+    BrzSettlement* setts;
+    int sett_n;
+    BrzAgentStore agents;
+    BrzRng rng;  /* serial step rng */
+    int day;
+    BrzSched sched; /* sleeping agents (sim { schedule }); set up by the first run */
+} BrzSim;
+
+/* effective run seed for a configured seed (0 selects the fixed default) */
+static inline uint32_t brz_sim_seed(uint32_t seed){ return seed ? seed : 0xC0FFEEu; }
+
+/* Build day 0 from cfg: world, settlements, spawned agents and rng.
+   Returns 0 on success; on failure the error is printed and sim freed. */
+int  brz_sim_init(BrzSim* sim, const ParsedConfig* cfg);
+/* same, for run seed instead of cfg->seed; brz_sim_init_seed(s, cfg, N)
+   builds exactly what a config with seed N would */
+int  brz_sim_init_seed(BrzSim* sim, const ParsedConfig* cfg, uint32_t seed);
+void brz_sim_free(BrzSim* sim);
+
+/* Called after every completed day; returning false ends the run early.
+   Agents asleep in the scheduler are not up to date in sim->agents at this
+   point: call brz_sim_sync before reading them. */
+typedef bool (*BrzDayFn)(void* ctx, BrzSim* sim);
+
+/* bring sleeping agents' stored state up to sim->day (brz_sched.h) */
+void brz_sim_sync(BrzSim* sim);
+
+/* Step sim through day `days`, starting after sim->day. threads follows
+   sim { threads }: 0 is the legacy serial step, N > 0 the deferred step on
+   N threads (same result for every N). on_day may be NULL. sim->agents is
+   up to date when it returns.
+   Returns 0 on success, 1 on error (printed). */
+int  brz_sim_run_days(BrzSim* sim, int days, int threads, BrzDayFn on_day, void* ctx);
 
 /* Simulation runner.
    Executes vocations/rules/tasks over a number of cycles and prints
    interactions and key values over time. */
 int brz_run(const ParsedConfig* cfg);
+/* Same, but continue from a checkpoint file when resume_path is set */
+int brz_run_from(const ParsedConfig* cfg, const char* resume_path);
 
 #endif /* BRZ_SIM_H */
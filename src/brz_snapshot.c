@@ -0,0 +1,498 @@
+#include "brz_snapshot.h"
+#include "brz_kinds.h"
+#include "brz_util.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char k_magic[8] = { 'B','R','Z','S','N','A','P',0 };
+
+/* ---------------- capture ---------------- */
+
+static char** copy_kind_names(const KindTable* t, size_t n)
+{
+    char** out = (char**)calloc(n ? n : 1, sizeof(char*));
+    if(!out) return NULL;
+    for(size_t i=0;i<n;i++){
+        const char* nm = kind_table_name(t, (int)i);
+        out[i] = brz_strdup(nm ? nm : "");
+        if(!out[i]) return out; /* caller sees the NULL */
+    }
+    return out;
+}
+
+static bool names_ok(char** names, size_t n)
+{
+    if(!names) return false;
+    for(size_t i=0;i<n;i++) if(!names[i]) return false;
+    return true;
+}
+
+static void free_names(char** names, size_t n)
+{
+    if(!names) return;
+    for(size_t i=0;i<n;i++) free(names[i]);
+    free(names);
+}
+
+/* calloc that never returns NULL for a zero-sized request */
+static void* snap_alloc(size_t n, size_t sz)
+{
+    return calloc(n ? n : 1, sz);
+}
+
+static bool snap_alloc_arrays(BrzSnapshot* s)
+{
+    const size_t sn = (size_t)s->sett_n, an = (size_t)s->agent_n;
+    s->world_tot    = (double*)snap_alloc(s->res_n, sizeof(double));
+    s->sett_name    = (char(*)[64])snap_alloc(sn, 64);
+    s->sett_x       = (int32_t*)snap_alloc(sn, sizeof(int32_t));
+    s->sett_y       = (int32_t*)snap_alloc(sn, sizeof(int32_t));
+    s->sett_pop     = (int32_t*)snap_alloc(sn, sizeof(int32_t));
+    s->sett_res     = (double*)snap_alloc(sn*s->res_n, sizeof(double));
+    s->sett_item    = (double*)snap_alloc(sn*s->item_n, sizeof(double));
+    s->agent_voc    = (uint32_t*)snap_alloc(an, sizeof(uint32_t));
+    s->agent_x      = (int32_t*)snap_alloc(an, sizeof(int32_t));
+    s->agent_y      = (int32_t*)snap_alloc(an, sizeof(int32_t));
+    s->agent_home   = (int32_t*)snap_alloc(an, sizeof(int32_t));
+    s->agent_hunger = (double*)snap_alloc(an, sizeof(double));
+    s->agent_fatigue= (double*)snap_alloc(an, sizeof(double));
+    s->agent_res    = (double*)snap_alloc(an*s->res_n, sizeof(double));
+    s->agent_item   = (double*)snap_alloc(an*s->item_n, sizeof(double));
+    return s->world_tot && s->sett_name && s->sett_x && s->sett_y && s->sett_pop &&
+           s->sett_res && s->sett_item && s->agent_voc && s->agent_x && s->agent_y &&
+           s->agent_home && s->agent_hunger && s->agent_fatigue && s->agent_res && s->agent_item;
+}
+
+bool brz_snapshot_capture(BrzSnapshot* snap, const ParsedConfig* cfg, const BrzWorld* world,
+                          const BrzSettlement* setts, int sett_n,
+                          const BrzAgentStore* agents, int day)
+{
+    memset(snap, 0, sizeof(*snap));
+    snap->day = day;
+    snap->world_w = world->w;
+    snap->world_h = world->h;
+    snap->res_n = kind_table_count(&cfg->resource_kinds);
+    snap->item_n = kind_table_count(&cfg->item_kinds);
+    snap->voc_n = (int)cfg->vocations.len;
+    snap->sett_n = sett_n;
+    snap->agent_n = agents->n;
+
+    snap->res_names = copy_kind_names(&cfg->resource_kinds, snap->res_n);
+    snap->item_names = copy_kind_names(&cfg->item_kinds, snap->item_n);
+    snap->voc_names = (char**)snap_alloc((size_t)snap->voc_n, sizeof(char*));
+    if(snap->voc_names){
+        for(int v=0; v<snap->voc_n; v++){
+            const VocationDef* voc = (const VocationDef*)brz_vec_cat(&cfg->vocations, (size_t)v);
+            snap->voc_names[v] = brz_strdup(voc->name ? voc->name : "");
+            if(!snap->voc_names[v]) break;
+        }
+    }
+    if(!names_ok(snap->res_names, snap->res_n) || !names_ok(snap->item_names, snap->item_n) ||
+       !names_ok(snap->voc_names, (size_t)snap->voc_n) || !snap_alloc_arrays(snap))
+        return false;
+
+    for(size_t i=0;i<snap->res_n;i++) snap->world_tot[i] = brz_world_res_total(world, (int)i);
+
+    for(int si=0; si<sett_n; si++){
+        memcpy(snap->sett_name[si], setts[si].name, 64);
+        snap->sett_name[si][63] = 0;
+        snap->sett_x[si] = setts[si].pos.x;
+        snap->sett_y[si] = setts[si].pos.y;
+        snap->sett_pop[si] = setts[si].population;
+        if(snap->res_n) memcpy(&snap->sett_res[(size_t)si*snap->res_n], setts[si].res_inv, snap->res_n*sizeof(double));
+        if(snap->item_n) memcpy(&snap->sett_item[(size_t)si*snap->item_n], setts[si].item_inv, snap->item_n*sizeof(double));
+    }
+
+    const size_t an = (size_t)agents->n;
+    for(size_t i=0;i<an;i++){
+        snap->agent_x[i] = agents->pos[i].x;
+        snap->agent_y[i] = agents->pos[i].y;
+    }
+    memcpy(snap->agent_voc, agents->voc, an*sizeof(uint32_t));
+    memcpy(snap->agent_home, agents->home, an*sizeof(int32_t));
+    memcpy(snap->agent_hunger, agents->hunger, an*sizeof(double));
+    memcpy(snap->agent_fatigue, agents->fatigue, an*sizeof(double));
+    memcpy(snap->agent_res, agents->res, an*snap->res_n*sizeof(double));
+    memcpy(snap->agent_item, agents->item, an*snap->item_n*sizeof(double));
+    return true;
+}
+
+void brz_snapshot_free(BrzSnapshot* snap)
+{
+    if(!snap) return;
+    free_names(snap->res_names, snap->res_n);
+    free_names(snap->item_names, snap->item_n);
+    free_names(snap->voc_names, (size_t)snap->voc_n);
+    free(snap->world_tot);
+    free(snap->sett_name);
+    free(snap->sett_x);
+    free(snap->sett_y);
+    free(snap->sett_pop);
+    free(snap->sett_res);
+    free(snap->sett_item);
+    free(snap->agent_voc);
+    free(snap->agent_x);
+    free(snap->agent_y);
+    free(snap->agent_home);
+    free(snap->agent_hunger);
+    free(snap->agent_fatigue);
+    free(snap->agent_res);
+    free(snap->agent_item);
+    memset(snap, 0, sizeof(*snap));
+}
+
+/* ---------------- json ---------------- */
+
+static void json_list(FILE* f, const double* v, size_t n)
+{
+    for(size_t i=0;i<n;i++) fprintf(f, "%s%.3f", (i? ", ":" "), v[i]);
+}
+
+bool brz_snapshot_write_json(const BrzSnapshot* s, FILE* f)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"day\": %d,\n", s->day);
+    fprintf(f, "  \"world\": { \"w\": %d, \"h\": %d },\n", s->world_w, s->world_h);
+
+    fprintf(f, "  \"resource_kinds\": [");
+    for(size_t i=0;i<s->res_n;i++) fprintf(f, "%s\"%s\"", (i? ", ":" "), s->res_names[i]);
+    fprintf(f, " ],\n");
+
+    fprintf(f, "  \"item_kinds\": [");
+    for(size_t i=0;i<s->item_n;i++) fprintf(f, "%s\"%s\"", (i? ", ":" "), s->item_names[i]);
+    fprintf(f, " ],\n");
+
+    fprintf(f, "  \"world_resources_total\": [");
+    json_list(f, s->world_tot, s->res_n);
+    fprintf(f, " ],\n");
+
+    fprintf(f, "  \"settlements\": [\n");
+    for(int si=0; si<s->sett_n; si++){
+        fprintf(f, "    { \"name\": \"%s\", \"x\": %d, \"y\": %d, \"population\": %d,\n",
+                s->sett_name[si], (int)s->sett_x[si], (int)s->sett_y[si], (int)s->sett_pop[si]);
+        fprintf(f, "      \"resources\": [");
+        json_list(f, &s->sett_res[(size_t)si*s->res_n], s->res_n);
+        fprintf(f, " ],\n");
+        fprintf(f, "      \"items\": [");
+        json_list(f, &s->sett_item[(size_t)si*s->item_n], s->item_n);
+        fprintf(f, " ] }%s\n", (si==s->sett_n-1? "":","));
+    }
+    fprintf(f, "  ],\n");
+
+    fprintf(f, "  \"agents\": [\n");
+    for(int ai=0; ai<s->agent_n; ai++){
+        uint32_t v = s->agent_voc[ai];
+        fprintf(f, "    { \"id\": %u, \"vocation\": \"%s\", \"x\": %d, \"y\": %d, \"home\": %d, \"hunger\": %.3f, \"fatigue\": %.3f,\n",
+                (unsigned)ai,
+                (v < (uint32_t)s->voc_n) ? s->voc_names[v] : "",
+                (int)s->agent_x[ai], (int)s->agent_y[ai],
+                (int)s->agent_home[ai],
+                s->agent_hunger[ai], s->agent_fatigue[ai]);
+        fprintf(f, "      \"resources\": [");
+        json_list(f, &s->agent_res[(size_t)ai*s->res_n], s->res_n);
+        fprintf(f, " ],\n");
+        fprintf(f, "      \"items\": [");
+        json_list(f, &s->agent_item[(size_t)ai*s->item_n], s->item_n);
+        fprintf(f, " ] }%s\n", (ai==s->agent_n-1? "":","));
+    }
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+    return !ferror(f);
+}
+
+/* ---------------- binary writer ---------------- */
+
+#define BIN_BUF_SIZE (1u << 20)
+
+typedef struct {
+    FILE* f;
+    uint8_t* buf;
+    size_t len;
+    bool ok;
+} BinOut;
+
+static void bin_flush(BinOut* o)
+{
+    if(o->ok && o->len && fwrite(o->buf, 1, o->len, o->f) != o->len) o->ok = false;
+    o->len = 0;
+}
+
+static uint8_t* bin_reserve(BinOut* o, size_t n)
+{
+    if(o->len + n > BIN_BUF_SIZE) bin_flush(o);
+    uint8_t* p = o->buf + o->len;
+    o->len += n;
+    return p;
+}
+
+static void bin_u16(BinOut* o, uint16_t v)
+{
+    uint8_t* p = bin_reserve(o, 2);
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+
+static void bin_u32(BinOut* o, uint32_t v)
+{
+    uint8_t* p = bin_reserve(o, 4);
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static void bin_f64(BinOut* o, double d)
+{
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    uint8_t* p = bin_reserve(o, 8);
+    for(int b=0;b<8;b++) p[b] = (uint8_t)(v >> (8*b));
+}
+
+static void bin_bytes(BinOut* o, const void* src, size_t n)
+{
+    const uint8_t* s = (const uint8_t*)src;
+    while(n){
+        size_t room = BIN_BUF_SIZE - o->len;
+        if(!room){ bin_flush(o); room = BIN_BUF_SIZE; }
+        size_t k = n < room ? n : room;
+        memcpy(o->buf + o->len, s, k);
+        o->len += k; s += k; n -= k;
+    }
+}
+
+static void bin_str(BinOut* o, const char* s)
+{
+    size_t n = strlen(s);
+    if(n > 0xFFFFu) n = 0xFFFFu;
+    bin_u16(o, (uint16_t)n);
+    bin_bytes(o, s, n);
+}
+
+static void bin_i32s(BinOut* o, const int32_t* v, size_t n)
+{
+    for(size_t i=0;i<n;i++) bin_u32(o, (uint32_t)v[i]);
+}
+
+static void bin_u32s(BinOut* o, const uint32_t* v, size_t n)
+{
+    for(size_t i=0;i<n;i++) bin_u32(o, v[i]);
+}
+
+static void bin_f64s(BinOut* o, const double* v, size_t n)
+{
+    for(size_t i=0;i<n;i++) bin_f64(o, v[i]);
+}
+
+bool brz_snapshot_write_bin(const BrzSnapshot* s, FILE* f)
+{
+    BinOut o;
+    o.f = f;
+    o.len = 0;
+    o.ok = true;
+    o.buf = (uint8_t*)malloc(BIN_BUF_SIZE);
+    if(!o.buf) return false;
+
+    bin_bytes(&o, k_magic, sizeof(k_magic));
+    bin_u32(&o, BRZ_SNAPSHOT_VERSION);
+    bin_u32(&o, 0u); /* flags */
+    bin_u32(&o, (uint32_t)s->day);
+    bin_u32(&o, (uint32_t)s->world_w);
+    bin_u32(&o, (uint32_t)s->world_h);
+    bin_u32(&o, (uint32_t)s->res_n);
+    bin_u32(&o, (uint32_t)s->item_n);
+    bin_u32(&o, (uint32_t)s->voc_n);
+    bin_u32(&o, (uint32_t)s->sett_n);
+    bin_u32(&o, (uint32_t)s->agent_n);
+    bin_u32(&o, BRZ_SNAPSHOT_CHUNK_ROWS);
+
+    for(size_t i=0;i<s->res_n;i++) bin_str(&o, s->res_names[i]);
+    for(size_t i=0;i<s->item_n;i++) bin_str(&o, s->item_names[i]);
+    for(int i=0;i<s->voc_n;i++) bin_str(&o, s->voc_names[i]);
+
+    bin_f64s(&o, s->world_tot, s->res_n);
+
+    const size_t sn = (size_t)s->sett_n;
+    bin_bytes(&o, s->sett_name, sn*64);
+    bin_i32s(&o, s->sett_x, sn);
+    bin_i32s(&o, s->sett_y, sn);
+    bin_i32s(&o, s->sett_pop, sn);
+    bin_f64s(&o, s->sett_res, sn*s->res_n);
+    bin_f64s(&o, s->sett_item, sn*s->item_n);
+
+    for(size_t at=0; at<(size_t)s->agent_n; at+=BRZ_SNAPSHOT_CHUNK_ROWS){
+        size_t rows = (size_t)s->agent_n - at;
+        if(rows > BRZ_SNAPSHOT_CHUNK_ROWS) rows = BRZ_SNAPSHOT_CHUNK_ROWS;
+        bin_u32s(&o, &s->agent_voc[at], rows);
+        bin_i32s(&o, &s->agent_x[at], rows);
+        bin_i32s(&o, &s->agent_y[at], rows);
+        bin_i32s(&o, &s->agent_home[at], rows);
+        bin_f64s(&o, &s->agent_hunger[at], rows);
+        bin_f64s(&o, &s->agent_fatigue[at], rows);
+        bin_f64s(&o, &s->agent_res[at*s->res_n], rows*s->res_n);
+        bin_f64s(&o, &s->agent_item[at*s->item_n], rows*s->item_n);
+    }
+
+    bin_flush(&o);
+    free(o.buf);
+    return o.ok;
+}
+
+/* ---------------- binary reader ---------------- */
+
+typedef struct {
+    const uint8_t* p;
+    size_t left;
+    bool ok;
+} BinIn;
+
+static const uint8_t* bin_take(BinIn* in, size_t n)
+{
+    if(!in->ok || in->left < n){ in->ok = false; return NULL; }
+    const uint8_t* p = in->p;
+    in->p += n;
+    in->left -= n;
+    return p;
+}
+
+static uint32_t bin_get_u32(BinIn* in)
+{
+    const uint8_t* p = bin_take(in, 4);
+    if(!p) return 0;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static double bin_get_f64(BinIn* in)
+{
+    const uint8_t* p = bin_take(in, 8);
+    if(!p) return 0.0;
+    uint64_t v = 0;
+    for(int b=0;b<8;b++) v |= (uint64_t)p[b] << (8*b);
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+static char** bin_get_names(BinIn* in, size_t n)
+{
+    char** out = (char**)snap_alloc(n, sizeof(char*));
+    if(!out){ in->ok = false; return NULL; }
+    for(size_t i=0;i<n && in->ok;i++){
+        const uint8_t* lp = bin_take(in, 2);
+        if(!lp) break;
+        size_t len = (size_t)lp[0] | ((size_t)lp[1] << 8);
+        const uint8_t* sp = bin_take(in, len);
+        if(!sp) break;
+        out[i] = (char*)malloc(len + 1);
+        if(!out[i]){ in->ok = false; break; }
+        memcpy(out[i], sp, len);
+        out[i][len] = 0;
+    }
+    return out;
+}
+
+static void bin_get_i32s(BinIn* in, int32_t* v, size_t n)
+{
+    for(size_t i=0;i<n;i++) v[i] = (int32_t)bin_get_u32(in);
+}
+
+static void bin_get_u32s(BinIn* in, uint32_t* v, size_t n)
+{
+    for(size_t i=0;i<n;i++) v[i] = bin_get_u32(in);
+}
+
+static void bin_get_f64s(BinIn* in, double* v, size_t n)
+{
+    for(size_t i=0;i<n;i++) v[i] = bin_get_f64(in);
+}
+
+static bool read_fail(BrzSnapshot* snap, char* err, size_t err_n, const char* msg)
+{
+    if(err && err_n) snprintf(err, err_n, "%s", msg);
+    brz_snapshot_free(snap);
+    return false;
+}
+
+bool brz_snapshot_read(BrzSnapshot* snap, const char* path, char* err, size_t err_n)
+{
+    memset(snap, 0, sizeof(*snap));
+    if(err && err_n) err[0] = 0;
+
+    size_t size = 0;
+    char* data = brz_read_entire_file(path, &size);
+    if(!data) return read_fail(snap, err, err_n, "cannot read file");
+
+    BinIn in;
+    in.p = (const uint8_t*)data;
+    in.left = size;
+    in.ok = true;
+
+    const uint8_t* magic = bin_take(&in, sizeof(k_magic));
+    if(!magic || memcmp(magic, k_magic, sizeof(k_magic)) != 0){
+        free(data);
+        return read_fail(snap, err, err_n, "not a bronzesim snapshot");
+    }
+    uint32_t version = bin_get_u32(&in);
+    uint32_t flags = bin_get_u32(&in);
+    if(in.ok && (version != BRZ_SNAPSHOT_VERSION || flags != 0u)){
+        free(data);
+        return read_fail(snap, err, err_n, "unsupported snapshot version");
+    }
+    snap->day = (int)bin_get_u32(&in);
+    snap->world_w = (int)bin_get_u32(&in);
+    snap->world_h = (int)bin_get_u32(&in);
+    uint32_t res_n = bin_get_u32(&in), item_n = bin_get_u32(&in), voc_n = bin_get_u32(&in);
+    uint32_t sett_n = bin_get_u32(&in), agent_n = bin_get_u32(&in);
+    uint32_t chunk_rows = bin_get_u32(&in);
+
+    /* every count has to be backed by file bytes before anything is allocated */
+    uint64_t need = ((uint64_t)res_n + (uint64_t)item_n + (uint64_t)voc_n) * 2u + (uint64_t)res_n * 8u
+                  + (uint64_t)sett_n * (64u + 12u + 8u * ((uint64_t)res_n + item_n))
+                  + (uint64_t)agent_n * (16u + 16u + 8u * ((uint64_t)res_n + item_n));
+    if(!in.ok || chunk_rows == 0u || need > (uint64_t)in.left ||
+       voc_n > (uint32_t)INT_MAX || sett_n > (uint32_t)INT_MAX || agent_n > (uint32_t)INT_MAX){
+        free(data);
+        return read_fail(snap, err, err_n, "truncated or corrupt snapshot");
+    }
+    snap->res_n = res_n;
+    snap->item_n = item_n;
+    snap->sett_n = (int)sett_n;
+    snap->agent_n = (int)agent_n;
+
+    snap->voc_n = (int)voc_n;
+    snap->res_names = bin_get_names(&in, res_n);
+    snap->item_names = bin_get_names(&in, item_n);
+    snap->voc_names = bin_get_names(&in, voc_n);
+    if(!in.ok || !snap_alloc_arrays(snap)){
+        free(data);
+        return read_fail(snap, err, err_n, in.ok ? "out of memory" : "truncated or corrupt snapshot");
+    }
+
+    bin_get_f64s(&in, snap->world_tot, res_n);
+
+    const uint8_t* names = bin_take(&in, (size_t)sett_n*64);
+    if(names){
+        memcpy(snap->sett_name, names, (size_t)sett_n*64);
+        for(uint32_t i=0;i<sett_n;i++) snap->sett_name[i][63] = 0;
+    }
+    bin_get_i32s(&in, snap->sett_x, sett_n);
+    bin_get_i32s(&in, snap->sett_y, sett_n);
+    bin_get_i32s(&in, snap->sett_pop, sett_n);
+    bin_get_f64s(&in, snap->sett_res, (size_t)sett_n*res_n);
+    bin_get_f64s(&in, snap->sett_item, (size_t)sett_n*item_n);
+
+    for(size_t at=0; at<agent_n && in.ok; at+=chunk_rows){
+        size_t rows = agent_n - at;
+        if(rows > chunk_rows) rows = chunk_rows;
+        bin_get_u32s(&in, &snap->agent_voc[at], rows);
+        bin_get_i32s(&in, &snap->agent_x[at], rows);
+        bin_get_i32s(&in, &snap->agent_y[at], rows);
+        bin_get_i32s(&in, &snap->agent_home[at], rows);
+        bin_get_f64s(&in, &snap->agent_hunger[at], rows);
+        bin_get_f64s(&in, &snap->agent_fatigue[at], rows);
+        bin_get_f64s(&in, &snap->agent_res[at*res_n], rows*res_n);
+        bin_get_f64s(&in, &snap->agent_item[at*item_n], rows*item_n);
+    }
+
+    bool ok = in.ok && in.left == 0;
+    free(data);
+    if(!ok) return read_fail(snap, err, err_n, "truncated or corrupt snapshot");
+    return true;
+}
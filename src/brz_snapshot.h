@@ -0,0 +1,78 @@
+#ifndef BRZ_SNAPSHOT_H
+#define BRZ_SNAPSHOT_H
+
+#include "brz_dsl.h"
+#include "brz_world.h"
+#include "brz_settlement.h"
+#include "brz_agent.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Snapshot: a self-contained copy of the sim state of one day.
+ *
+ * It owns every array, so it stays valid once the sim moves on. It is
+ * written either as the legacy JSON document or in the binary format below,
+ * and can be read back from the binary file.
+ *
+ * Binary layout (all integers and doubles little-endian):
+ *   header   "BRZSNAP\0", u32 version, u32 flags, i32 day, i32 world_w,
+ *            i32 world_h, u32 res_n, item_n, voc_n, sett_n, agent_n,
+ *            u32 chunk_rows
+ *   names    res_n + item_n + voc_n strings, each u16 length + bytes
+ *   world    f64 world_tot[res_n]
+ *   setts    u8 name[sett_n][64], i32 x[], i32 y[], i32 population[],
+ *            f64 res[sett_n*res_n], f64 item[sett_n*item_n]
+ *   agents   ceil(agent_n/chunk_rows) chunks of rows = min(chunk_rows, left):
+ *            u32 voc[rows], i32 x[], i32 y[], i32 home[], f64 hunger[],
+ *            f64 fatigue[], f64 res[rows*res_n], f64 item[rows*item_n]
+ */
+
+#define BRZ_SNAPSHOT_VERSION 1u
+#define BRZ_SNAPSHOT_CHUNK_ROWS 65536u
+
+typedef struct BrzSnapshot {
+    int day;
+    int world_w, world_h;
+    size_t res_n, item_n;
+    int voc_n, sett_n, agent_n;
+
+    char** res_names;   /* [res_n] */
+    char** item_names;  /* [item_n] */
+    char** voc_names;   /* [voc_n] */
+
+    double* world_tot;  /* [res_n] */
+
+    char    (*sett_name)[64];
+    int32_t* sett_x;
+    int32_t* sett_y;
+    int32_t* sett_pop;
+    double*  sett_res;  /* [sett_n*res_n] */
+    double*  sett_item; /* [sett_n*item_n] */
+
+    uint32_t* agent_voc; /* index into voc_names */
+    int32_t*  agent_x;
+    int32_t*  agent_y;
+    int32_t*  agent_home;
+    double*   agent_hunger;
+    double*   agent_fatigue;
+    double*   agent_res;  /* [agent_n*res_n] */
+    double*   agent_item; /* [agent_n*item_n] */
+} BrzSnapshot;
+
+/* Copy the state of day into snap (zeroed first). Returns false on OOM;
+   snap must be released with brz_snapshot_free either way. */
+bool brz_snapshot_capture(BrzSnapshot* snap, const ParsedConfig* cfg, const BrzWorld* world,
+                          const BrzSettlement* setts, int sett_n,
+                          const BrzAgentStore* agents, int day);
+void brz_snapshot_free(BrzSnapshot* snap);
+
+bool brz_snapshot_write_json(const BrzSnapshot* snap, FILE* f);
+bool brz_snapshot_write_bin(const BrzSnapshot* snap, FILE* f);
+
+/* Read a binary snapshot; on failure err holds the reason */
+bool brz_snapshot_read(BrzSnapshot* snap, const char* path, char* err, size_t err_n);
+
+#endif /* BRZ_SNAPSHOT_H */
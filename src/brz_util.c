@@ -40,6 +40,33 @@ char* brz_read_entire_file(const char* path, size_t* out_size)
     return buf;
 }
 
+uint64_t brz_hash64(const void* data, size_t n)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ (uint64_t)n;
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h ^= w;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    if(i < n)
+    {
+        uint64_t w = 0;
+        memcpy(&w, p + i, n - i);
+        h ^= w;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    h ^= h >> 29;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 32;
+    return h;
+}
+
 /* xorshift32 */
 void brz_rng_seed(BrzRng* r, uint32_t seed)
 {
@@ -57,6 +84,26 @@ uint32_t brz_rng_u32(BrzRng* r)
     return x;
 }
 
+/* murmur3 finalizer */
+static uint32_t rng_mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+void brz_rng_stream(BrzRng* r, uint32_t seed, uint32_t stream, uint32_t counter)
+{
+    if(!r) return;
+    uint32_t h = rng_mix32(seed ^ 0x9E3779B9u);
+    h = rng_mix32(h ^ stream);
+    h = rng_mix32(h + counter * 0x9E3779B9u);
+    brz_rng_seed(r, h);
+}
+
 int brz_rng_range(BrzRng* r, int lo, int hi)
 {
     if(hi < lo) { int t=lo; lo=hi; hi=t; }
@@ -9,6 +9,10 @@ bool   brz_streq(const char* a, const char* b);
 char*  brz_strdup(const char* s);
 char*  brz_read_entire_file(const char* path, size_t* out_size);
 
+/* fast non-cryptographic 64-bit hash (8 bytes per step), for file
+   identity and checksums; native byte order */
+uint64_t brz_hash64(const void* data, size_t n);
+
 /* simple xorshift rng (deterministic) */
 typedef struct {
     uint32_t state;
@@ -18,4 +22,26 @@ void     brz_rng_seed(BrzRng* r, uint32_t seed);
 uint32_t brz_rng_u32(BrzRng* r);
 int      brz_rng_range(BrzRng* r, int lo, int hi); /* inclusive */
 
+/* Seed r with an independent stream for (seed, stream, counter), e.g.
+   (run seed, agent id, day). The state is a hash of the triple, so any
+   stream can be reproduced without stepping the others. */
+void     brz_rng_stream(BrzRng* r, uint32_t seed, uint32_t stream, uint32_t counter);
+
+/* Running total kept up by adding deltas. The rounding error of every
+   addition is carried along (Knuth's two-sum, branch-free), so the total
+   stays within rounding of the sum a fresh recount gives. */
+typedef struct {
+    double s; /* sum */
+    double c; /* accumulated rounding error */
+} BrzSum;
+
+static inline void brz_sum_add(BrzSum* a, double v)
+{
+    double t = a->s + v;
+    double vp = t - a->s;
+    a->c += (a->s - (t - vp)) + (v - vp);
+    a->s = t;
+}
+static inline double brz_sum_value(const BrzSum* a){ return a->s + a->c; }
+
 #endif /* BRZ_UTIL_H */
@@ -1,4 +1,5 @@
 #include "brz_vec.h"
+#include "brz_arena.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,8 +12,19 @@ static bool brz_vec_grow_to(BrzVec* v, size_t new_cap)
     size_t bytes = new_cap * v->elem_size;
     if(new_cap != 0 && bytes / new_cap != v->elem_size) return false;
 
-    void* p = realloc(v->data, bytes);
-    if(!p) return false;
+    void* p;
+    if(v->arena)
+    {
+        /* the old block stays in the arena until it is destroyed */
+        p = brz_arena_alloc(v->arena, bytes);
+        if(!p) return false;
+        if(v->len) memcpy(p, v->data, v->len * v->elem_size);
+    }
+    else
+    {
+        p = realloc(v->data, bytes);
+        if(!p) return false;
+    }
 
     v->data = p;
     v->cap = new_cap;
@@ -26,16 +38,25 @@ void brz_vec_init(BrzVec* v, size_t elem_size)
     v->len = 0;
     v->cap = 0;
     v->elem_size = elem_size;
+    v->arena = NULL;
+}
+
+void brz_vec_init_arena(BrzVec* v, size_t elem_size, struct BrzArena* arena)
+{
+    if(!v) return;
+    brz_vec_init(v, elem_size);
+    v->arena = arena;
 }
 
 void brz_vec_destroy(BrzVec* v)
 {
     if(!v) return;
-    free(v->data);
+    if(!v->arena) free(v->data);
     v->data = NULL;
     v->len = 0;
     v->cap = 0;
     v->elem_size = 0;
+    v->arena = NULL;
 }
 
 void brz_vec_clear(BrzVec* v)
@@ -93,3 +114,21 @@ const void* brz_vec_cat(const BrzVec* v, size_t idx)
     if(!v || idx >= v->len) return NULL;
     return (const unsigned char*)v->data + (idx * v->elem_size);
 }
+
+bool brz_vec_copy_arena(BrzVec* dst, const BrzVec* src, struct BrzArena* arena)
+{
+    if(!dst || !src || !arena) return false;
+    const BrzVec s = *src; /* dst may be src */
+    brz_vec_init_arena(dst, s.elem_size, arena);
+    if(s.len == 0) return true;
+
+    size_t bytes = s.len * s.elem_size;
+    if(bytes / s.len != s.elem_size) return false;
+    void* p = brz_arena_alloc(arena, bytes);
+    if(!p) return false;
+    memcpy(p, s.data, bytes);
+    dst->data = p;
+    dst->len = s.len;
+    dst->cap = s.len;
+    return true;
+}
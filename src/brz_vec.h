@@ -8,6 +8,9 @@
  *  - "Drop-in": tiny C99 implementation, no dependencies beyond stdlib/string
  *  - Generic: stores elements by value (copies bytes) in a contiguous buffer
  *  - Predictable: doubling growth, returns bool for OOM handling
+ *  - Optionally arena-backed: storage then comes from a BrzArena and is
+ *    released with it; growing leaves the old block in the arena and
+ *    brz_vec_destroy frees nothing
  *
  * Usage:
  *   BrzVec v;
@@ -17,6 +20,10 @@
  *   MyType* p = (MyType*)brz_vec_at(&v, i);
  *   brz_vec_destroy(&v);
  *
+ * Arena-backed:
+ *   brz_vec_init_arena(&v, sizeof(MyType), &arena);
+ *   brz_vec_copy_arena(&dst, &v, &arena);  exact-size copy, cap == len
+ *
  * Typed helper macro:
  *   BRZ_VEC_DECL(MyType, MyTypeVec)
  *   MyTypeVec mv; MyTypeVec_init(&mv); ...
@@ -29,14 +36,18 @@
 extern "C" {
 #endif
 
+struct BrzArena;
+
 typedef struct BrzVec {
     void*  data;
     size_t len;
     size_t cap;
     size_t elem_size;
+    struct BrzArena* arena; /* storage owner, NULL = heap */
 } BrzVec;
 
 void  brz_vec_init(BrzVec* v, size_t elem_size);
+void  brz_vec_init_arena(BrzVec* v, size_t elem_size, struct BrzArena* arena);
 void  brz_vec_destroy(BrzVec* v);
 void  brz_vec_clear(BrzVec* v);
 
@@ -46,6 +57,11 @@ bool  brz_vec_pop(BrzVec* v, void* out_elem); /* optional out */
 void* brz_vec_at(BrzVec* v, size_t idx);
 const void* brz_vec_cat(const BrzVec* v, size_t idx);
 
+/* dst = copy of src's elements in one block of exactly src->len from arena.
+   dst is initialized here and may be src itself (src's old storage is then
+   left to its owner). Returns false on OOM. */
+bool  brz_vec_copy_arena(BrzVec* dst, const BrzVec* src, struct BrzArena* arena);
+
 static inline size_t brz_vec_len(const BrzVec* v) { return v ? v->len : 0; }
 
 #ifdef __cplusplus
@@ -4,136 +4,238 @@
 #include "brz_util.h"
 #include "brz_settlement.h"
 #include "brz_land.h"
+#include "brz_profile.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-static double* tile_ptr(BrzWorld* w, int x, int y, size_t res_n){
-    return &w->res[(size_t)(y*w->w + x) * res_n];
-}
-static double* tile_cap_ptr(BrzWorld* w, int x, int y, size_t res_n){
-    return &w->cap[(size_t)(y*w->w + x) * res_n];
-}
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define BRZ_REGEN_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || (defined(__ARM_NEON) && defined(BRZ_RES_FLOAT))
+#define BRZ_REGEN_NEON 1
+#include <arm_neon.h>
+#endif
 
-static uint16_t tag_for_resource_name(const char* nm){
-    if(!nm) return 0;
-    if(brz_streq(nm,"fish")) return BRZ_TAG_COAST;
-    if(brz_streq(nm,"grain")) return BRZ_TAG_FIELD;
-    if(brz_streq(nm,"wood")) return BRZ_TAG_FOREST;
-    if(brz_streq(nm,"clay")) return BRZ_TAG_CLAYPIT;
-    if(brz_streq(nm,"copper")) return BRZ_TAG_MINE_CU;
-    if(brz_streq(nm,"tin")) return BRZ_TAG_MINE_SN;
-    if(brz_streq(nm,"fire")) return BRZ_TAG_FIRE;
-    if(brz_streq(nm,"charcoal")) return BRZ_TAG_FOREST;
-    return 0;
+/* resources are stored plane-major: element (rid, tile) */
+static size_t res_at(const BrzWorld* w, size_t tile, size_t rid){
+    return rid * (size_t)w->w * (size_t)w->h + tile;
 }
 
-int brz_world_init(BrzWorld* world, const ParsedConfig* cfg, int w, int h, size_t res_n)
+/* the caps BRZ_CAP_CLASSES stand for */
+static const double k_cap_class[BRZ_CAP_CLASSES] = { 10.0, 100.0, 200.0 };
+
+/* cap_key holds a tile's tags in one byte */
+typedef char brz_cap_key_fits[(BRZ_TAG_COUNT <= 8) ? 1 : -1];
+
+static int world_alloc(BrzWorld* world, int w, int h, size_t res_n, int chunked, int keyed)
 {
     memset(world, 0, sizeof(*world));
     world->w = w; world->h = h;
+    world->res_n = res_n;
     world->tags  = (uint16_t*)calloc((size_t)w*h, sizeof(uint16_t));
     world->height= (uint8_t*)calloc((size_t)w*h, sizeof(uint8_t));
-    world->res   = (double*)calloc((size_t)w*h*res_n, sizeof(double));
-    world->cap   = (double*)calloc((size_t)w*h*res_n, sizeof(double));
     world->regen = (double*)calloc(res_n, sizeof(double));
-    if(!world->tags || !world->height || !world->res || !world->cap || !world->regen) return 1;
+    world->res_tot = (BrzSum*)calloc(res_n ? res_n : 1, sizeof(BrzSum));
+    world->cap_tags = (uint16_t*)calloc(res_n ? 2*res_n : 1, sizeof(uint16_t));
+    if(!world->tags || !world->height || !world->regen || !world->res_tot || !world->cap_tags) return 1;
+    if(keyed){
+        world->cap_key = (uint8_t*)calloc((w > 0 && h > 0) ? (size_t)w*h : 1, sizeof(uint8_t));
+        world->cap_tab = (brz_res_t*)calloc(res_n ? res_n*BRZ_CAP_KEYS : 1, sizeof(brz_res_t));
+        if(!world->cap_key || !world->cap_tab) return 1;
+    }
+
+    if(chunked){
+        world->chunk_w = (w + BRZ_CHUNK_DIM - 1) >> BRZ_CHUNK_SHIFT;
+        world->chunk_h = (h + BRZ_CHUNK_DIM - 1) >> BRZ_CHUNK_SHIFT;
+        size_t cn = (size_t)world->chunk_w * (size_t)world->chunk_h;
+        world->chunks = (BrzChunk**)calloc(cn ? cn : 1, sizeof(BrzChunk*));
+        world->idle = (BrzIdleClass*)calloc(res_n ? res_n*BRZ_CAP_CLASSES : 1, sizeof(BrzIdleClass));
+        return (!world->chunks || !world->idle) ? 1 : 0;
+    }
+
+    world->res   = (brz_res_t*)calloc((size_t)w*h*res_n, sizeof(brz_res_t));
+    if(!keyed) world->cap = (brz_res_t*)calloc((size_t)w*h*res_n, sizeof(brz_res_t));
+    world->dirty = (uint32_t*)malloc((size_t)w*h*sizeof(uint32_t));
+    world->dirty_mark = (uint8_t*)malloc((size_t)w*h);
+    if(!world->res || (!keyed && !world->cap) || !world->dirty || !world->dirty_mark) return 1;
+
+    /* every tile starts half full, so all of them are dirty */
+    for(size_t i=0;i<(size_t)w*h;i++){ world->dirty[i] = (uint32_t)i; world->dirty_mark[i] = 1; }
+    world->dirty_n = (size_t)w*h;
+    return 0;
+}
+
+int brz_world_alloc(BrzWorld* world, int w, int h, size_t res_n)
+{
+    return world_alloc(world, w, h, res_n, 0, 0);
+}
+
+void brz_world_apply_config(BrzWorld* world, const ParsedConfig* cfg, size_t res_n)
+{
+    world->regen_dense = brz_streq(brz_cfg_get_str(cfg, "sim_regen", ""), "dense");
+
+    /* regen: read <resname>_renew params if present, else 0.01 */
+    for(size_t rid=0; rid<res_n; rid++){
+        const char* rn = kind_table_name(&cfg->resource_kinds, (int)rid);
+        const ParamDef* p = brz_cfg_param_cat(cfg, rn, "_renew");
+        world->regen[rid] = (p && !p->has_svalue) ? p->value : 0.01;
+    }
+}
+
+int brz_world_init(BrzWorld* world, const ParsedConfig* cfg, int w, int h, size_t res_n)
+{
+    return brz_world_init_seed(world, cfg, cfg->seed, w, h, res_n);
+}
+
+/* Tags a tile is generated with. These are intentionally simple heuristics;
+   the DSL-driven sim can evolve more sophisticated interpretations later. */
+static uint16_t terrain_tags(int x, int y, uint8_t height, uint8_t sea, uint32_t s)
+{
+    uint16_t t = 0;
+    if(height < sea){
+        /* Below waterline -> water tile. */
+        t |= BRZ_TAG_COAST;
+    } else {
+        /* Above waterline -> land tile; choose a coarse biome tag. */
+        uint8_t dh = (uint8_t)(height - sea);
+        if(dh < 40) t |= BRZ_TAG_FIELD;      /* lowlands */
+        else if(dh < 140) t |= BRZ_TAG_FOREST; /* midlands */
+        /* highlands: leave as default '^' */
+    }
+
+    /* scatter clay pits */
+    if(!(t & BRZ_TAG_COAST)){
+        if(((x*73856093u) ^ (y*19349663u) ^ s) % 97u == 0u) t |= BRZ_TAG_CLAYPIT;
+        /* scatter mines */
+        if(((x*83492791u) ^ (y*2654435761u) ^ s) % 173u == 0u) t |= BRZ_TAG_MINE_CU;
+        if(((x*2654435761u) ^ (y*83492791u) ^ s) % 199u == 0u) t |= BRZ_TAG_MINE_SN;
+    }
+    return t;
+}
+
+/* cap class of resource rid on a tile generated with tags t */
+static int cap_class(const BrzWorld* world, uint16_t t, size_t rid)
+{
+    if(t & world->cap_tags[2*rid+1]) return 2;
+    if(t & world->cap_tags[2*rid]) return 1;
+    return 0;
+}
+
+/* one regen update of v towards cap; the same arithmetic as regen_tile */
+static brz_res_t regen_value(brz_res_t v, brz_res_t cap, double rate)
+{
+    brz_res_t next = v + cap * (brz_res_t)rate;
+    if(next > cap) next = cap;
+    if(next < 0) next = 0;
+    return next;
+}
+
+static void idle_step(BrzWorld* world, size_t res_n)
+{
+    for(size_t rid=0; rid<res_n; rid++){
+        for(int c=0;c<BRZ_CAP_CLASSES;c++){
+            BrzIdleClass* ic = &world->idle[rid*BRZ_CAP_CLASSES + c];
+            if(!ic->moving) continue;
+            ic->v = regen_value(ic->v, ic->cap, world->regen[rid]);
+            ic->moving = regen_value(ic->v, ic->cap, world->regen[rid]) != ic->v;
+        }
+    }
+}
+
+double brz_world_idle_total(const BrzWorld* world, int rid)
+{
+    const BrzIdleClass* ic = &world->idle[(size_t)rid*BRZ_CAP_CLASSES];
+    double tot = 0.0;
+    for(int c=0;c<BRZ_CAP_CLASSES;c++) tot += (double)ic[c].n * (double)ic[c].v;
+    return tot;
+}
+
+int brz_world_init_seed(BrzWorld* world, const ParsedConfig* cfg, uint32_t seed, int w, int h, size_t res_n)
+{
+    int chunked = brz_streq(brz_cfg_get_str(cfg, "sim_world", "flat"), "chunked");
+    int keyed = !brz_streq(brz_cfg_get_str(cfg, "sim_caps", "table"), "plane");
+    if(world_alloc(world, w, h, res_n, chunked, keyed) != 0) return 1;
 
     /* sea level: default 128, override with param "sea_level" if present */
-    uint8_t sea = 128;
-    for(size_t i=0;i<cfg->params.len;i++){
-        const ParamDef* p = (const ParamDef*)brz_vec_cat(&cfg->params, i);
-        if(p->key && brz_streq(p->key, "sea_level") && !p->has_svalue){
-            int iv = (int)(p->value);
-            if(iv < 0) iv = 0;
-            if(iv > 255) iv = 255;
-            sea = (uint8_t)iv;
-            break;
+    int sea = brz_cfg_get_int(cfg, "sea_level", 128);
+    if(sea < 0) sea = 0;
+    if(sea > 255) sea = 255;
+    world->sea_level = (uint8_t)sea;
+
+    brz_world_apply_config(world, cfg, res_n);
+
+    /* caps: 100 where the resource's tag is, 200 for grain on fields and
+       fish on the coast, 10 elsewhere */
+    for(size_t rid=0; rid<res_n; rid++){
+        const char* rn = kind_table_name(&cfg->resource_kinds, (int)rid);
+        world->cap_tags[2*rid] = brz_dsl_tag_for_resource(rn);
+        if((int)rid == cfg->known.r_grain) world->cap_tags[2*rid+1] |= BRZ_TAG_FIELD;
+        if((int)rid == cfg->known.r_fish) world->cap_tags[2*rid+1] |= BRZ_TAG_COAST;
+        if(keyed){
+            for(int t=0;t<BRZ_CAP_KEYS;t++)
+                world->cap_tab[rid*BRZ_CAP_KEYS + t] = (brz_res_t)k_cap_class[cap_class(world, (uint16_t)t, rid)];
         }
     }
-    world->sea_level = sea;
 
     /* Build a deterministic fractal heightmap (512x512), then sample it to the
        requested world size.
 
-       Seeds: use cfg->seed when provided, else fall back to a fixed constant to
-       preserve determinism.
+       Seeds: use the run seed when provided, else fall back to a fixed constant to
+       preserve determinism. The heightmap comes from the land cache when one
+       is configured (BRZ_LAND_CACHE or --land-cache).
     */
-    BrzLand land;
-    uint32_t s = (cfg->seed ? (uint32_t)cfg->seed : 0xC0FFEEu);
+    uint32_t s = (seed ? seed : 0xC0FFEEu);
+    world->terrain_seed = s;
     int r1 = (int)(s & 0xFFFFu);
     int r2 = (int)((s >> 16) & 0xFFFFu);
-    brz_land_seed(&land, r1, r2);
-    brz_land_generate(&land);
+    world->land = brz_land_acquire(r1, r2);
+    if(!world->land) return 1;
 
-    /* regen: read <resname>_renew params if present, else 0.01 */
-    for(size_t rid=0; rid<res_n; rid++){
-        const char* rn = kind_table_name(&cfg->resource_kinds, (int)rid);
-        char key[128];
-        snprintf(key, sizeof(key), "%s_renew", rn?rn:"");
-        /* cfg params are in cfg->params array; easiest is to use small helper: */
-        double v = 0.01;
-        for(size_t i=0;i<cfg->params.len;i++){
-            const ParamDef* p = (const ParamDef*)brz_vec_cat(&cfg->params, i);
-            if(p->key && brz_streq(p->key, key) && !p->has_svalue){
-                v = p->value;
-                break;
-            }
-        }
-        world->regen[rid] = v;
-    }
+    /* map column of every world column; rows are looked up once per y */
+    int* land_x = (int*)malloc((size_t)w * sizeof(int));
+    if(!land_x) return 1;
+    for(int x=0;x<w;x++) land_x[x] = (int)((int64_t)x * BRZ_LAND_DIM / (w>0?w:1));
 
     /* tags, heights, and initial resources/caps */
     for(int y=0;y<h;y++){
+        const uint8_t* land_row = brz_land_row(world->land, (int)((int64_t)y * BRZ_LAND_DIM / (h>0?h:1)));
         for(int x=0;x<w;x++){
-            uint16_t t = 0;
-
             /* Sample from the 512x512 fractal map. */
-            int sx = (int)((int64_t)x * BRZ_LAND_DIM / (w>0?w:1));
-            int sy = (int)((int64_t)y * BRZ_LAND_DIM / (h>0?h:1));
-            uint8_t height = brz_land_height_at(&land, sx, sy);
+            uint8_t height = land_row[land_x[x]];
             world->height[y*w+x] = height;
 
-            if(height < sea){
-                /* Below waterline -> water tile. */
-                t |= BRZ_TAG_COAST;
-            } else {
-                /* Above waterline -> land tile; choose a coarse biome tag.
-                   These are intentionally simple heuristics; the DSL-driven
-                   sim can evolve more sophisticated interpretations later.
-                */
-                uint8_t dh = (uint8_t)(height - sea);
-                if(dh < 40) t |= BRZ_TAG_FIELD;      /* lowlands */
-                else if(dh < 140) t |= BRZ_TAG_FOREST; /* midlands */
-                /* highlands: leave as default '^' */
-            }
-
-            /* scatter clay pits */
-            if(!(t & BRZ_TAG_COAST)){
-                if(((x*73856093u) ^ (y*19349663u) ^ s) % 97u == 0u) t |= BRZ_TAG_CLAYPIT;
-                /* scatter mines */
-                if(((x*83492791u) ^ (y*2654435761u) ^ s) % 173u == 0u) t |= BRZ_TAG_MINE_CU;
-                if(((x*2654435761u) ^ (y*83492791u) ^ s) % 199u == 0u) t |= BRZ_TAG_MINE_SN;
-            }
-
+            uint16_t t = terrain_tags(x, y, height, world->sea_level, s);
             world->tags[y*w+x] = t;
 
-            double* r = tile_ptr(world,x,y,res_n);
-            double* c = tile_cap_ptr(world,x,y,res_n);
+            size_t tile = (size_t)y*w + x;
+            if(keyed) world->cap_key[tile] = (uint8_t)t;
             for(size_t rid=0; rid<res_n; rid++){
-                const char* rn = kind_table_name(&cfg->resource_kinds, (int)rid);
-                uint16_t need = tag_for_resource_name(rn);
-                double cap = 10.0;
-                if(need && (t & need)) cap = 100.0;
-                if((t & BRZ_TAG_FIELD) && brz_streq(rn,"grain")) cap = 200.0;
-                if((t & BRZ_TAG_COAST) && brz_streq(rn,"fish")) cap = 200.0;
-                c[rid] = cap;
-                r[rid] = cap * 0.5; /* start half full */
+                int c = cap_class(world, t, rid);
+                if(chunked){
+                    world->idle[rid*BRZ_CAP_CLASSES + c].n++;
+                    continue;
+                }
+                double cap = k_cap_class[c];
+                if(!keyed) world->cap[res_at(world,tile,rid)] = (brz_res_t)cap;
+                world->res[res_at(world,tile,rid)] = (brz_res_t)(cap * 0.5); /* start half full */
             }
         }
     }
+    free(land_x);
+    if(chunked){
+        for(size_t rid=0; rid<res_n; rid++){
+            for(int c=0;c<BRZ_CAP_CLASSES;c++){
+                BrzIdleClass* ic = &world->idle[rid*BRZ_CAP_CLASSES + c];
+                ic->cap = (brz_res_t)k_cap_class[c];
+                ic->v = (brz_res_t)(k_cap_class[c] * 0.5);
+                ic->moving = regen_value(ic->v, ic->cap, world->regen[rid]) != ic->v;
+            }
+        }
+    }
+    brz_world_recount(world, res_n);
 
-    return 0;
+    return brz_world_index_tags(world);
 }
 
 void brz_world_free(BrzWorld* world){
@@ -143,24 +245,316 @@ void brz_world_free(BrzWorld* world){
     free(world->res);
     free(world->cap);
     free(world->regen);
+    free(world->res_tot);
+    free(world->cap_tags);
+    free(world->cap_key);
+    free(world->cap_tab);
+    if(world->chunks){
+        for(size_t i=0;i<(size_t)world->chunk_w*(size_t)world->chunk_h;i++){
+            if(world->chunks[i]){ free(world->chunks[i]->res); free(world->chunks[i]); }
+        }
+    }
+    free(world->chunks);
+    free(world->idle);
+    free(world->tag_bits);
+    free(world->dirty);
+    free(world->dirty_mark);
+    free(world->sett_owner);
+    for(int i=0;i<world->flow_n;i++){ free(world->flow[i].near); free(world->flow[i].dist); }
+    brz_land_release(world->land);
     memset(world,0,sizeof(*world));
 }
 
-void brz_world_step_regen(BrzWorld* world, size_t res_n){
-    const int W=world->w, H=world->h;
-    for(int y=0;y<H;y++){
-        for(int x=0;x<W;x++){
-            double* r = tile_ptr(world,x,y,res_n);
-            double* c = tile_cap_ptr(world,x,y,res_n);
+/* regen one tile, whose resources are r[rid*stride] with caps c[rid*cstride];
+   returns 1 unless the next update would be a no-op for every resource (the
+   tile is at its fixed point) */
+static int regen_tile(BrzWorld* world, brz_res_t* r, size_t stride, const brz_res_t* c, size_t cstride, size_t res_n){
+    int moving = 0;
+    for(size_t rid=0; rid<res_n; rid++, r+=stride, c+=cstride){
+        brz_res_t cap = *c;
+        brz_res_t add = cap * (brz_res_t)world->regen[rid];
+        brz_res_t v = *r + add;
+        if(v > cap) v = cap;
+        if(v < 0) v = 0;
+        if(v != *r) brz_sum_add(&world->res_tot[rid], (double)v - (double)*r);
+        *r = v;
+        brz_res_t next = v + add;
+        if(next > cap) next = cap;
+        if(next < 0) next = 0;
+        if(next != v) moving = 1;
+    }
+    return moving;
+}
+
+/* chunk holding tile, and the tile's index inside it */
+static size_t chunk_index(const BrzWorld* world, size_t tile, size_t* local){
+    size_t x = tile % (size_t)world->w, y = tile / (size_t)world->w;
+    *local = ((y & (BRZ_CHUNK_DIM-1)) << BRZ_CHUNK_SHIFT) | (x & (BRZ_CHUNK_DIM-1));
+    return (y >> BRZ_CHUNK_SHIFT) * (size_t)world->chunk_w + (x >> BRZ_CHUNK_SHIFT);
+}
+
+/* Allocate chunk ci with every tile at its idle value, moving those tiles
+   from the idle counts to res_tot. Tiles that are still regenerating join
+   the dirty set. Returns NULL (and sets oom) when out of memory. */
+static BrzChunk* chunk_materialize(BrzWorld* world, size_t ci){
+    const size_t res_n = world->res_n;
+    size_t need = (world->chunk_live + 1) * BRZ_CHUNK_TILES;
+    if(need > world->dirty_cap){
+        size_t cap = world->dirty_cap ? world->dirty_cap * 2 : need;
+        if(cap < need) cap = need;
+        uint32_t* d = (uint32_t*)realloc(world->dirty, cap * sizeof(uint32_t));
+        if(!d){ world->oom = 1; return NULL; }
+        world->dirty = d;
+        world->dirty_cap = cap;
+    }
+    BrzChunk* c = (BrzChunk*)calloc(1, sizeof(BrzChunk));
+    const size_t plane_n = world->cap_tab ? 1 : 2; /* res, and cap unless looked up */
+    brz_res_t* planes = (brz_res_t*)calloc(res_n ? plane_n*res_n*BRZ_CHUNK_TILES : 1, sizeof(brz_res_t));
+    if(!c || !planes){ free(c); free(planes); world->oom = 1; return NULL; }
+    c->res = planes;
+    c->cap = world->cap_tab ? NULL : planes + res_n*BRZ_CHUNK_TILES;
+
+    /* tiles past the map edge keep cap 0 and never enter dirty */
+    const int x0 = (int)(ci % (size_t)world->chunk_w) << BRZ_CHUNK_SHIFT;
+    const int y0 = (int)(ci / (size_t)world->chunk_w) << BRZ_CHUNK_SHIFT;
+    for(int ly=0; ly<BRZ_CHUNK_DIM && y0+ly<world->h; ly++){
+        for(int lx=0; lx<BRZ_CHUNK_DIM && x0+lx<world->w; lx++){
+            const int x = x0+lx, y = y0+ly;
+            const size_t tile = (size_t)y*world->w + x, local = ((size_t)ly << BRZ_CHUNK_SHIFT) | (size_t)lx;
+            uint16_t t = terrain_tags(x, y, world->height[tile], world->sea_level, world->terrain_seed);
+            int moving = 0;
+            for(size_t rid=0; rid<res_n; rid++){
+                BrzIdleClass* ic = &world->idle[rid*BRZ_CAP_CLASSES + cap_class(world, t, rid)];
+                if(c->cap) c->cap[rid*BRZ_CHUNK_TILES + local] = ic->cap;
+                c->res[rid*BRZ_CHUNK_TILES + local] = ic->v;
+                if(ic->v != 0) brz_sum_add(&world->res_tot[rid], (double)ic->v);
+                ic->n--;
+                moving |= ic->moving;
+            }
+            if(moving){
+                c->mark[local] = 1;
+                world->dirty[world->dirty_n++] = (uint32_t)tile;
+            }
+        }
+    }
+    world->chunks[ci] = c;
+    world->chunk_live++;
+    return c;
+}
+
+/* r[i] = clamp(r[i] + c[i]*k, 0, c[i]) over one plane. The vector paths
+   select with the same comparisons as the scalar tail (NaN and -0 included),
+   so every path produces identical bits. */
+static void regen_plane_scalar(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k){
+    for(size_t i=0;i<n;i++){
+        brz_res_t cap = c[i];
+        brz_res_t v = r[i] + cap * k;
+        if(v > cap) v = cap;
+        if(v < 0) v = 0;
+        r[i] = v;
+    }
+}
+
+#if defined(BRZ_REGEN_X86)
+#ifdef BRZ_RES_FLOAT
+static void regen_plane_sse2(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k){
+    const __m128 vk = _mm_set1_ps(k), zero = _mm_setzero_ps();
+    size_t i = 0;
+    for(; i+4<=n; i+=4){
+        __m128 cap = _mm_loadu_ps(c+i);
+        __m128 v = _mm_add_ps(_mm_loadu_ps(r+i), _mm_mul_ps(cap, vk));
+        v = _mm_min_ps(cap, v);   /* v > cap ? cap : v */
+        v = _mm_max_ps(zero, v);  /* v < 0 ? 0 : v */
+        _mm_storeu_ps(r+i, v);
+    }
+    regen_plane_scalar(r+i, c+i, n-i, k);
+}
+__attribute__((target("avx2")))
+static void regen_plane_avx2(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k){
+    const __m256 vk = _mm256_set1_ps(k), zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        __m256 cap = _mm256_loadu_ps(c+i);
+        __m256 v = _mm256_add_ps(_mm256_loadu_ps(r+i), _mm256_mul_ps(cap, vk));
+        v = _mm256_min_ps(cap, v);
+        v = _mm256_max_ps(zero, v);
+        _mm256_storeu_ps(r+i, v);
+    }
+    regen_plane_scalar(r+i, c+i, n-i, k);
+}
+#else
+static void regen_plane_sse2(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k){
+    const __m128d vk = _mm_set1_pd(k), zero = _mm_setzero_pd();
+    size_t i = 0;
+    for(; i+2<=n; i+=2){
+        __m128d cap = _mm_loadu_pd(c+i);
+        __m128d v = _mm_add_pd(_mm_loadu_pd(r+i), _mm_mul_pd(cap, vk));
+        v = _mm_min_pd(cap, v);   /* v > cap ? cap : v */
+        v = _mm_max_pd(zero, v);  /* v < 0 ? 0 : v */
+        _mm_storeu_pd(r+i, v);
+    }
+    regen_plane_scalar(r+i, c+i, n-i, k);
+}
+__attribute__((target("avx2")))
+static void regen_plane_avx2(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k){
+    const __m256d vk = _mm256_set1_pd(k), zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i+4<=n; i+=4){
+        __m256d cap = _mm256_loadu_pd(c+i);
+        __m256d v = _mm256_add_pd(_mm256_loadu_pd(r+i), _mm256_mul_pd(cap, vk));
+        v = _mm256_min_pd(cap, v);
+        v = _mm256_max_pd(zero, v);
+        _mm256_storeu_pd(r+i, v);
+    }
+    regen_plane_scalar(r+i, c+i, n-i, k);
+}
+#endif
+#elif defined(BRZ_REGEN_NEON)
+/* NEON min/max treat NaN and -0 differently from the scalar compares, so
+   select explicitly instead */
+#ifdef BRZ_RES_FLOAT
+static void regen_plane_neon(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k){
+    const float32x4_t vk = vdupq_n_f32(k), zero = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for(; i+4<=n; i+=4){
+        float32x4_t cap = vld1q_f32(c+i);
+        float32x4_t v = vaddq_f32(vld1q_f32(r+i), vmulq_f32(cap, vk));
+        v = vbslq_f32(vcgtq_f32(v, cap), cap, v);
+        v = vbslq_f32(vcltq_f32(v, zero), zero, v);
+        vst1q_f32(r+i, v);
+    }
+    regen_plane_scalar(r+i, c+i, n-i, k);
+}
+#else
+static void regen_plane_neon(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k){
+    const float64x2_t vk = vdupq_n_f64(k), zero = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for(; i+2<=n; i+=2){
+        float64x2_t cap = vld1q_f64(c+i);
+        float64x2_t v = vaddq_f64(vld1q_f64(r+i), vmulq_f64(cap, vk));
+        v = vbslq_f64(vcgtq_f64(v, cap), cap, v);
+        v = vbslq_f64(vcltq_f64(v, zero), zero, v);
+        vst1q_f64(r+i, v);
+    }
+    regen_plane_scalar(r+i, c+i, n-i, k);
+}
+#endif
+#endif
+
+typedef void (*RegenPlaneFn)(brz_res_t* r, const brz_res_t* c, size_t n, brz_res_t k);
+
+/* regen_plane_scalar with the cap of r[i] looked up as tab[key[i]] */
+static void regen_plane_keyed(brz_res_t* r, const uint8_t* key, const brz_res_t* tab, size_t n, brz_res_t k){
+    for(size_t i=0;i<n;i++){
+        brz_res_t cap = tab[key[i]];
+        brz_res_t v = r[i] + cap * k;
+        if(v > cap) v = cap;
+        if(v < 0) v = 0;
+        r[i] = v;
+    }
+}
+
+/* picked per call: __builtin_cpu_supports only reads the cpu model
+   libgcc filled in at startup, and no state is shared between sims */
+static RegenPlaneFn regen_plane_kernel(void){
+#if defined(BRZ_REGEN_X86)
+    return __builtin_cpu_supports("avx2") ? regen_plane_avx2 : regen_plane_sse2;
+#elif defined(BRZ_REGEN_NEON)
+    return regen_plane_neon;
+#else
+    return regen_plane_scalar;
+#endif
+}
+
+static void step_regen_dense(BrzWorld* world, size_t res_n){
+    const size_t n = (size_t)world->w * (size_t)world->h;
+    RegenPlaneFn fn = regen_plane_kernel();
+    if(world->chunks){
+        for(size_t i=0;i<(size_t)world->chunk_w*(size_t)world->chunk_h;i++){
+            BrzChunk* c = world->chunks[i];
+            if(!c) continue;
+            if(c->cap){
+                for(size_t rid=0; rid<res_n; rid++)
+                    fn(&c->res[rid*BRZ_CHUNK_TILES], &c->cap[rid*BRZ_CHUNK_TILES], BRZ_CHUNK_TILES,
+                       (brz_res_t)world->regen[rid]);
+                continue;
+            }
+            /* keyed: row by row, tiles past the map edge stay at 0 */
+            const int x0 = (int)(i % (size_t)world->chunk_w) << BRZ_CHUNK_SHIFT;
+            const int y0 = (int)(i / (size_t)world->chunk_w) << BRZ_CHUNK_SHIFT;
+            const size_t row_n = (size_t)((world->w - x0 < BRZ_CHUNK_DIM) ? world->w - x0 : BRZ_CHUNK_DIM);
             for(size_t rid=0; rid<res_n; rid++){
-                double cap = c[rid];
-                double add = cap * world->regen[rid];
-                r[rid] += add;
-                if(r[rid] > cap) r[rid] = cap;
-                if(r[rid] < 0) r[rid] = 0;
+                for(int ly=0; ly<BRZ_CHUNK_DIM && y0+ly<world->h; ly++)
+                    regen_plane_keyed(&c->res[rid*BRZ_CHUNK_TILES + ((size_t)ly << BRZ_CHUNK_SHIFT)],
+                                      &world->cap_key[(size_t)(y0+ly)*world->w + x0],
+                                      &world->cap_tab[rid*BRZ_CAP_KEYS], row_n, (brz_res_t)world->regen[rid]);
             }
         }
+        idle_step(world, res_n);
+    }else if(world->cap_tab){
+        for(size_t rid=0; rid<res_n; rid++)
+            regen_plane_keyed(&world->res[rid*n], world->cap_key, &world->cap_tab[rid*BRZ_CAP_KEYS], n,
+                              (brz_res_t)world->regen[rid]);
+    }else{
+        for(size_t rid=0; rid<res_n; rid++)
+            fn(&world->res[rid*n], &world->cap[rid*n], n, (brz_res_t)world->regen[rid]);
     }
+    brz_world_recount(world, res_n); /* the sweep has touched every tile anyway */
+}
+
+/* Only tiles in the dirty set can change; everything else is a fixed point
+   of the dense update, so skipping it gives identical results. */
+static void step_regen_sparse(BrzWorld* world, size_t res_n){
+    const size_t n = (size_t)world->w * (size_t)world->h;
+    size_t keep = 0;
+    if(world->chunks){
+        for(size_t i=0;i<world->dirty_n;i++){
+            uint32_t t = world->dirty[i];
+            size_t local;
+            BrzChunk* c = world->chunks[chunk_index(world, t, &local)];
+            int moving = c->cap
+                ? regen_tile(world, &c->res[local], BRZ_CHUNK_TILES, &c->cap[local], BRZ_CHUNK_TILES, res_n)
+                : regen_tile(world, &c->res[local], BRZ_CHUNK_TILES, &world->cap_tab[world->cap_key[t]], BRZ_CAP_KEYS, res_n);
+            if(moving) world->dirty[keep++] = t;
+            else c->mark[local] = 0;
+        }
+        idle_step(world, res_n);
+    }else{
+        for(size_t i=0;i<world->dirty_n;i++){
+            uint32_t t = world->dirty[i];
+            int moving = world->cap
+                ? regen_tile(world, &world->res[t], n, &world->cap[t], n, res_n)
+                : regen_tile(world, &world->res[t], n, &world->cap_tab[world->cap_key[t]], BRZ_CAP_KEYS, res_n);
+            if(moving) world->dirty[keep++] = t;
+            else world->dirty_mark[t] = 0;
+        }
+    }
+    world->dirty_n = keep;
+}
+
+void brz_world_recount(BrzWorld* world, size_t res_n){
+    const size_t n = (size_t)world->w * (size_t)world->h;
+    for(size_t rid=0; rid<res_n; rid++){
+        double tot = 0.0;
+        if(world->chunks){
+            /* tiles past the map edge hold 0 */
+            for(size_t i=0;i<(size_t)world->chunk_w*(size_t)world->chunk_h;i++){
+                if(!world->chunks[i]) continue;
+                const brz_res_t* r = &world->chunks[i]->res[rid*BRZ_CHUNK_TILES];
+                for(size_t t=0;t<BRZ_CHUNK_TILES;t++) tot += r[t];
+            }
+        }else{
+            const brz_res_t* r = &world->res[rid*n];
+            for(size_t t=0;t<n;t++) tot += r[t];
+        }
+        world->res_tot[rid].s = tot;
+        world->res_tot[rid].c = 0.0;
+    }
+}
+
+void brz_world_step_regen(BrzWorld* world, size_t res_n){
+    if(world->regen_dense || (!world->dirty && !world->chunks)) step_regen_dense(world, res_n);
+    else step_regen_sparse(world, res_n);
 }
 
 uint16_t brz_world_tags_at(const BrzWorld* world, BrzPos p){
@@ -176,30 +570,149 @@ uint8_t brz_world_height_at(const BrzWorld* world, BrzPos p){
 
 double brz_world_take(BrzWorld* world, BrzPos p, size_t res_n, int rid, double amt){
     if(p.x<0||p.y<0||p.x>=world->w||p.y>=world->h) return 0;
-    double* r = &world->res[(size_t)(p.y*world->w+p.x)*res_n + (size_t)rid];
+    return brz_world_take_tile(world, (size_t)(p.y*world->w+p.x), res_n, rid, amt);
+}
+
+double brz_world_take_tile(BrzWorld* world, size_t tile, size_t res_n, int rid, double amt){
+    (void)res_n;
+    brz_res_t* r;
+    uint8_t* mark = NULL;
+    if(world->chunks){
+        size_t local, ci = chunk_index(world, tile, &local);
+        BrzChunk* c = world->chunks[ci] ? world->chunks[ci] : chunk_materialize(world, ci);
+        if(!c) return 0;
+        r = &c->res[(size_t)rid*BRZ_CHUNK_TILES + local];
+        mark = &c->mark[local];
+    }else{
+        r = &world->res[res_at(world, tile, (size_t)rid)];
+        if(world->dirty_mark) mark = &world->dirty_mark[tile];
+    }
+    const brz_res_t old = *r;
     if(*r < 0) *r = 0;
-    double t = (*r < amt) ? *r : amt;
-    *r -= t;
+    double t = (*r < amt) ? (double)*r : amt;
+    *r = (brz_res_t)(*r - t);
+    if(*r != old) brz_sum_add(&world->res_tot[rid], (double)*r - (double)old);
+    if(mark && !*mark){
+        *mark = 1;
+        world->dirty[world->dirty_n++] = (uint32_t)tile;
+    }
     return t;
 }
 
 double brz_world_peek(const BrzWorld* world, BrzPos p, size_t res_n, int rid){
     if(p.x<0||p.y<0||p.x>=world->w||p.y>=world->h) return 0;
-    return world->res[(size_t)(p.y*world->w+p.x)*res_n + (size_t)rid];
+    (void)res_n;
+    const size_t tile = (size_t)(p.y*world->w+p.x);
+    if(world->chunks){
+        size_t local;
+        const BrzChunk* c = world->chunks[chunk_index(world, tile, &local)];
+        if(c) return c->res[(size_t)rid*BRZ_CHUNK_TILES + local];
+        uint16_t t = terrain_tags(p.x, p.y, world->height[tile], world->sea_level, world->terrain_seed);
+        return world->idle[(size_t)rid*BRZ_CAP_CLASSES + cap_class(world, t, (size_t)rid)].v;
+    }
+    return world->res[res_at(world, tile, (size_t)rid)];
 }
 
-BrzPos brz_world_find_nearest_tag(const BrzWorld* world, BrzPos from, uint16_t tag, int max_r){
-    /* simple expanding square search */
-    BrzPos best = from;
+/* ---- nearest-tag index ---- */
+
+static uint64_t* tag_row(const BrzWorld* world, int bit, int y){
+    return &world->tag_bits[((size_t)bit * (size_t)world->h + (size_t)y) * (size_t)world->tag_words];
+}
+
+static uint64_t tag_word(const BrzWorld* world, uint16_t mask, int y, int wi){
+    uint64_t v = 0;
+    for(int b=0; b<BRZ_TAG_COUNT; b++)
+        if(mask & (1u<<b)) v |= tag_row(world, b, y)[wi];
+    return v;
+}
+
+static int bit_lowest(uint64_t v){
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while(!(v & 1u)){ v >>= 1; n++; }
+    return n;
+#endif
+}
+
+static int bit_highest(uint64_t v){
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#else
+    int n = 0;
+    while(v >>= 1) n++;
+    return n;
+#endif
+}
+
+/* bits xa..xb (inclusive, same word) of a word */
+static uint64_t span_mask(int xa, int xb){
+    uint64_t hi = (xb % 64 == 63) ? ~(uint64_t)0 : (((uint64_t)1 << (xb % 64 + 1)) - 1);
+    return hi & (~(uint64_t)0 << (xa % 64));
+}
+
+/* leftmost x in [xa,xb] of row y with any tag in mask, or -1 */
+static int row_first_set(const BrzWorld* world, uint16_t mask, int y, int xa, int xb){
+    for(int wi = xa/64; wi <= xb/64; wi++){
+        int lo = (wi == xa/64) ? xa : wi*64;
+        int hi = (wi == xb/64) ? xb : wi*64 + 63;
+        uint64_t v = tag_word(world, mask, y, wi) & span_mask(lo, hi);
+        if(v) return wi*64 + bit_lowest(v);
+    }
+    return -1;
+}
+
+/* rightmost x in [xa,xb] of row y with any tag in mask, or -1 */
+static int row_last_set(const BrzWorld* world, uint16_t mask, int y, int xa, int xb){
+    for(int wi = xb/64; wi >= xa/64; wi--){
+        int lo = (wi == xa/64) ? xa : wi*64;
+        int hi = (wi == xb/64) ? xb : wi*64 + 63;
+        uint64_t v = tag_word(world, mask, y, wi) & span_mask(lo, hi);
+        if(v) return wi*64 + bit_highest(v);
+    }
+    return -1;
+}
+
+int brz_world_index_tags(BrzWorld* world){
+    free(world->tag_bits);
+    world->tag_words = (world->w + 63) / 64;
+    world->tag_bits = (uint64_t*)calloc((size_t)BRZ_TAG_COUNT * (size_t)world->h * (size_t)world->tag_words,
+                                        sizeof(uint64_t));
+    if(!world->tag_bits) return 1;
+    for(int y=0;y<world->h;y++){
+        for(int x=0;x<world->w;x++){
+            uint16_t t = world->tags[y*world->w+x];
+            for(int b=0; b<BRZ_TAG_COUNT; b++)
+                if(t & (1u<<b)) tag_row(world, b, y)[x/64] |= (uint64_t)1 << (x%64);
+        }
+    }
+    return 0;
+}
+
+void brz_world_set_tags(BrzWorld* world, int x, int y, uint16_t tags){
+    if(x<0||y<0||x>=world->w||y>=world->h) return;
+    if(world->tags[y*world->w+x] != tags){
+        world->flow_stale = 1;
+        world->tags_gen++;
+    }
+    world->tags[y*world->w+x] = tags;
+    if(!world->tag_bits) return;
+    for(int b=0; b<BRZ_TAG_COUNT; b++){
+        uint64_t* w = &tag_row(world, b, y)[x/64];
+        uint64_t m = (uint64_t)1 << (x%64);
+        if(tags & (1u<<b)) *w |= m; else *w &= ~m;
+    }
+}
+
+/* reference expanding-square scan, used for tags outside the index */
+static BrzPos find_nearest_tag_scan(const BrzWorld* world, BrzPos from, BrzPos best, uint16_t tag, int max_r){
     int W=world->w,H=world->h;
-    if(from.x<0) from.x=0;
-    if(from.y<0) from.y=0;
-    if(from.x>=W) from.x=W-1;
-    if(from.y>=H) from.y=H-1;
     for(int r=0; r<=max_r; r++){
         int x0 = from.x - r, x1 = from.x + r;
         int y0 = from.y - r, y1 = from.y + r;
         for(int y=y0; y<=y1; y++){
+            BRZ_PROF_COUNT(BRZ_PROF_TILES_SCANNED, (y>=0 && y<H) ? brz_clamp_i(x1,-1,W-1) - brz_clamp_i(x0,0,W) + 1 : 0);
             for(int x=x0; x<=x1; x++){
                 if(x<0||y<0||x>=W||y>=H) continue;
                 if(world->tags[y*W+x] & tag){
@@ -212,20 +725,336 @@ BrzPos brz_world_find_nearest_tag(const BrzWorld* world, BrzPos from, uint16_t t
     return best;
 }
 
+static BrzPos find_nearest_tag(const BrzWorld* world, BrzPos from, uint16_t tag, int max_r){
+    BrzPos best = from;
+    int W=world->w,H=world->h;
+    if(from.x<0) from.x=0;
+    if(from.y<0) from.y=0;
+    if(from.x>=W) from.x=W-1;
+    if(from.y>=H) from.y=H-1;
+    if(!tag || max_r < 0) return best;
+    if(max_r > W && max_r > H) max_r = W > H ? W : H; /* no tile is farther; keeps max_r + 1 in range */
+    if(!world->tag_bits || (tag >> BRZ_TAG_COUNT))
+        return find_nearest_tag_scan(world, from, best, tag, max_r);
+
+    /* 1) smallest Chebyshev ring holding a match: per row, the nearest set
+          bit on either side of from.x; rows visited by increasing |dy| */
+    const int fx = from.x, fy = from.y;
+    int r_best = max_r + 1;
+    for(int dy=0; dy<=max_r && dy<r_best; dy++){
+        for(int side=0; side<2; side++){
+            int y = side ? fy + dy : fy - dy;
+            if(side && dy==0) break;
+            if(y<0 || y>=H) continue;
+            int lim = r_best - 1; /* only a strictly closer tile helps */
+            int xa = fx - lim; if(xa < 0) xa = 0;
+            int xb = fx + lim; if(xb > W-1) xb = W-1;
+            int d = r_best;
+            BRZ_PROF_COUNT(BRZ_PROF_TILES_SCANNED, xb - xa + 1);
+            int xr = row_first_set(world, tag, y, fx, xb);
+            if(xr >= 0 && xr - fx < d) d = xr - fx;
+            if(fx > 0 && xa <= fx - 1){
+                int xl = row_last_set(world, tag, y, xa, fx - 1);
+                if(xl >= 0 && fx - xl < d) d = fx - xl;
+            }
+            if(d < dy) d = dy;
+            if(d < r_best) r_best = d;
+        }
+    }
+    if(r_best > max_r) return best;
+
+    /* 2) on that ring, the first tile in row-major order (the order of the
+          original square scan) */
+    const int r = r_best;
+    for(int y = fy - r; y <= fy + r; y++){
+        if(y<0 || y>=H) continue;
+        if(y == fy - r || y == fy + r){
+            int xa = fx - r; if(xa < 0) xa = 0;
+            int xb = fx + r; if(xb > W-1) xb = W-1;
+            int x = row_first_set(world, tag, y, xa, xb);
+            if(x >= 0){ best.x = x; best.y = y; return best; }
+        }else{
+            if(fx - r >= 0 && (world->tags[y*W + fx - r] & tag)){ best.x = fx - r; best.y = y; return best; }
+            if(fx + r < W  && (world->tags[y*W + fx + r] & tag)){ best.x = fx + r; best.y = y; return best; }
+        }
+    }
+    return best; /* not reached */
+}
+
+static const BrzFlowField* flow_find(const BrzWorld* world, uint16_t tag){
+    if(world->flow_stale) return NULL;
+    for(int i=0;i<world->flow_n;i++)
+        if(world->flow[i].tag == tag) return &world->flow[i];
+    return NULL;
+}
+
+BrzPos brz_world_find_nearest_tag(const BrzWorld* world, BrzPos from, uint16_t tag, int max_r){
+    BRZ_PROF_T0(t0);
+    BrzPos best = from;
+    const BrzFlowField* f = flow_find(world, tag);
+    if(f && from.x>=0 && from.y>=0 && from.x<world->w && from.y<world->h){
+        size_t t = (size_t)from.y * world->w + from.x;
+        if(f->near[t] != BRZ_FLOW_NONE && max_r >= 0 && f->dist[t] <= max_r){
+            if(f->dist[t] < UINT16_MAX - 1){
+                best.x = (int)(f->near[t] % (uint32_t)world->w);
+                best.y = (int)(f->near[t] / (uint32_t)world->w);
+            }else{
+                /* saturated: the field only knows the tile is at least this far */
+                best = find_nearest_tag(world, from, tag, max_r);
+            }
+        }
+        BRZ_PROF_COUNT(BRZ_PROF_TILES_SCANNED, 1);
+    }else{
+        best = find_nearest_tag(world, from, tag, max_r);
+    }
+    BRZ_PROF_COUNT(BRZ_PROF_FIND_CALLS, 1);
+    BRZ_PROF_T1(BRZ_PROF_PATH, t0);
+    return best;
+}
+
+/* Multi-source breadth-first search over the 8-neighbour grid, whose
+   distances are Chebyshev distances. At equal distance the lowest tile
+   index wins, which is the first tile in row-major order, as in the
+   square scan. */
+static int flow_build(BrzWorld* world, BrzFlowField* f){
+    const int W = world->w, H = world->h;
+    const size_t tiles = (size_t)W * (size_t)H;
+    uint32_t* queue = (uint32_t*)malloc((tiles ? tiles : 1) * sizeof(uint32_t));
+    if(!queue) return 1;
+    size_t head = 0, tail = 0;
+    for(size_t t=0;t<tiles;t++){
+        if(world->tags[t] & f->tag){
+            f->near[t] = (uint32_t)t;
+            f->dist[t] = 0;
+            queue[tail++] = (uint32_t)t;
+        }else{
+            f->near[t] = BRZ_FLOW_NONE;
+            f->dist[t] = UINT16_MAX;
+        }
+    }
+    while(head < tail){
+        uint32_t t = queue[head++];
+        int x = (int)(t % (uint32_t)W), y = (int)(t / (uint32_t)W);
+        const uint16_t nd = (uint16_t)(f->dist[t] < UINT16_MAX - 1 ? f->dist[t] + 1 : UINT16_MAX - 1);
+        const uint32_t o = f->near[t];
+        for(int dy=-1; dy<=1; dy++){
+            int ny = y + dy;
+            if(ny < 0 || ny >= H) continue;
+            for(int dx=-1; dx<=1; dx++){
+                int nx = x + dx;
+                if((dx == 0 && dy == 0) || nx < 0 || nx >= W) continue;
+                uint32_t u = (uint32_t)ny * (uint32_t)W + (uint32_t)nx;
+                if(f->near[u] == BRZ_FLOW_NONE){
+                    f->near[u] = o;
+                    f->dist[u] = nd;
+                    queue[tail++] = u;
+                }else if(f->dist[u] == nd && o < f->near[u]){
+                    f->near[u] = o;
+                }
+            }
+        }
+    }
+    free(queue);
+    return 0;
+}
+
+int brz_world_flow_prepare(BrzWorld* world, uint16_t tag){
+    /* a field is two dense planes; chunked worlds search (bounded by max_r) */
+    if(!tag || world->chunks) return 0;
+    for(int i=0;i<world->flow_n;i++) if(world->flow[i].tag == tag) return 0;
+    if(world->flow_n >= BRZ_FLOW_MAX) return 0;
+    const size_t tiles = (size_t)world->w * (size_t)world->h;
+    BrzFlowField* f = &world->flow[world->flow_n];
+    memset(f, 0, sizeof(*f));
+    f->tag = tag;
+    f->near = (uint32_t*)malloc((tiles ? tiles : 1) * sizeof(uint32_t));
+    f->dist = (uint16_t*)malloc((tiles ? tiles : 1) * sizeof(uint16_t));
+    if(!f->near || !f->dist || flow_build(world, f) != 0){
+        free(f->near); free(f->dist);
+        memset(f, 0, sizeof(*f));
+        return 1;
+    }
+    world->flow_n++;
+    return 0;
+}
+
+static int flow_prepare_stmts(BrzWorld* world, const BrzVec* stmts){
+    for(size_t i=0;i<stmts->len;i++){
+        const StmtDef* st = (const StmtDef*)brz_vec_cat(stmts, i);
+        int rc = 0;
+        switch(st->kind){
+            case ST_OP:
+                if(st->as.op.code == BRZ_OP_MOVE || st->as.op.code == BRZ_OP_GATHER)
+                    rc = brz_world_flow_prepare(world, st->as.op.tag);
+                break;
+            case ST_WHEN:   rc = flow_prepare_stmts(world, &st->as.when_stmt.body); break;
+            case ST_CHANCE: rc = flow_prepare_stmts(world, &st->as.chance.body); break;
+            default: break;
+        }
+        if(rc != 0) return rc;
+    }
+    return 0;
+}
+
+int brz_world_flow_prepare_cfg(BrzWorld* world, const ParsedConfig* cfg){
+    for(size_t vi=0; vi<cfg->vocations.len; vi++){
+        const VocationDef* v = (const VocationDef*)brz_vec_cat(&cfg->vocations, vi);
+        for(size_t ti=0; ti<v->tasks.len; ti++){
+            const TaskDef* t = (const TaskDef*)brz_vec_cat(&v->tasks, ti);
+            if(flow_prepare_stmts(world, &t->stmts) != 0) return 1;
+        }
+    }
+    return 0;
+}
+
+int brz_world_flow_refresh(BrzWorld* world){
+    if(!world->flow_stale) return 0;
+    for(int i=0;i<world->flow_n;i++)
+        if(flow_build(world, &world->flow[i]) != 0) return 1; /* stays stale */
+    world->flow_stale = 0;
+    return 0;
+}
+
+/* Multi-source breadth-first search over the 4-neighbour grid; its
+   distances are Manhattan distances. A tile reached at equal distance from
+   several settlements keeps the lowest index, as the linear scan does: all
+   of a tile's updates happen before it is expanded. */
+int brz_world_index_settlements(BrzWorld* world, const struct BrzSettlement* setts, int sett_n){
+    free(world->sett_owner);
+    world->sett_owner = NULL;
+    world->sett_owner_n = 0;
+    const int W = world->w, H = world->h;
+    /* a chunked world does not get a dense owner plane; it scans settlements */
+    if(sett_n <= 0 || W <= 0 || H <= 0 || world->chunks) return 0;
+    for(int i=0;i<sett_n;i++){
+        BrzPos p = setts[i].pos;
+        if(p.x<0||p.y<0||p.x>=W||p.y>=H) return 0; /* linear scan it is */
+    }
+    const size_t tiles = (size_t)W * (size_t)H;
+    int32_t* owner = (int32_t*)malloc(tiles * sizeof(int32_t));
+    int32_t* dist = (int32_t*)malloc(tiles * sizeof(int32_t));
+    uint32_t* queue = (uint32_t*)malloc(tiles * sizeof(uint32_t));
+    if(!owner || !dist || !queue){ free(owner); free(dist); free(queue); return 1; }
+    for(size_t t=0;t<tiles;t++) dist[t] = -1;
+
+    size_t head = 0, tail = 0;
+    for(int i=0;i<sett_n;i++){
+        size_t t = (size_t)setts[i].pos.y * W + setts[i].pos.x;
+        if(dist[t] >= 0) continue; /* an earlier settlement on the same tile */
+        dist[t] = 0;
+        owner[t] = i;
+        queue[tail++] = (uint32_t)t;
+    }
+    while(head < tail){
+        uint32_t t = queue[head++];
+        int x = (int)(t % (uint32_t)W), y = (int)(t / (uint32_t)W);
+        const int nd = dist[t] + 1;
+        const int32_t o = owner[t];
+        uint32_t nb[4];
+        int nn = 0;
+        if(x > 0)     nb[nn++] = t - 1;
+        if(x < W - 1) nb[nn++] = t + 1;
+        if(y > 0)     nb[nn++] = t - (uint32_t)W;
+        if(y < H - 1) nb[nn++] = t + (uint32_t)W;
+        for(int k=0;k<nn;k++){
+            uint32_t u = nb[k];
+            if(dist[u] < 0){
+                dist[u] = nd;
+                owner[u] = o;
+                queue[tail++] = u;
+            }else if(dist[u] == nd && o < owner[u]){
+                owner[u] = o;
+            }
+        }
+    }
+    free(dist);
+    free(queue);
+    world->sett_owner = owner;
+    world->sett_owner_n = sett_n;
+    return 0;
+}
+
+int brz_world_nearest_settlement(const BrzWorld* world, const struct BrzSettlement* setts, int sett_n, BrzPos p){
+    if(world->sett_owner && world->sett_owner_n == sett_n &&
+       p.x >= 0 && p.y >= 0 && p.x < world->w && p.y < world->h)
+        return world->sett_owner[p.y * world->w + p.x];
+    return brz_find_nearest_settlement(setts, sett_n, p);
+}
+
+typedef struct { int x0, x1; } StampSpan;
+
+static int cmp_span(const void* a, const void* b){
+    const StampSpan* p = (const StampSpan*)a;
+    const StampSpan* q = (const StampSpan*)b;
+    return (p->x0 > q->x0) - (p->x0 < q->x0);
+}
+
+static int cmp_by_y(const void* a, const void* b){
+    const BrzPos* p = (const BrzPos*)a;
+    const BrzPos* q = (const BrzPos*)b;
+    if(p->y != q->y) return (p->y > q->y) - (p->y < q->y);
+    return (p->x > q->x) - (p->x < q->x);
+}
+
+/* Row by row: the discs of the settlements within radius of the row are
+   cut into spans, the spans merged, and each covered tile stamped once,
+   however many discs overlap it. */
 void brz_world_stamp_fields_around_settlements(BrzWorld* world, const struct BrzSettlement* setts, int sett_n, int radius){
-    for(int si=0; si<sett_n; si++){
-        BrzPos c = setts[si].pos;
-        for(int dy=-radius; dy<=radius; dy++){
+    if(sett_n <= 0 || radius < 0) return;
+    BrzPos* centers = (BrzPos*)malloc((size_t)sett_n * sizeof(BrzPos));
+    StampSpan* spans = (StampSpan*)malloc((size_t)sett_n * sizeof(StampSpan));
+    int* half = (int*)malloc((size_t)(radius + 1) * sizeof(int));
+    if(!centers || !spans || !half){
+        /* per-disc fallback */
+        free(centers); free(spans); free(half);
+        for(int si=0; si<sett_n; si++){
+            BrzPos c = setts[si].pos;
+            for(int dy=-radius; dy<=radius; dy++)
             for(int dx=-radius; dx<=radius; dx++){
                 int x=c.x+dx, y=c.y+dy;
                 if(x<0||y<0||x>=world->w||y>=world->h) continue;
                 if(dx*dx+dy*dy > radius*radius) continue;
-                /* don't overwrite coast */
-                if(world->tags[y*world->w+x] & BRZ_TAG_COAST) continue;
-                world->tags[y*world->w+x] |= BRZ_TAG_FIELD;
+                uint16_t t = world->tags[y*world->w+x];
+                if(t & BRZ_TAG_COAST) continue; /* don't overwrite coast */
+                brz_world_set_tags(world, x, y, (uint16_t)(t | BRZ_TAG_FIELD));
+            }
+        }
+        return;
+    }
+    for(int si=0; si<sett_n; si++) centers[si] = setts[si].pos;
+    qsort(centers, (size_t)sett_n, sizeof(BrzPos), cmp_by_y);
+    /* half[d]: widest dx with dx*dx + d*d <= radius*radius */
+    for(int d=0, dx=radius; d<=radius; d++){
+        while(dx*dx + d*d > radius*radius) dx--;
+        half[d] = dx;
+    }
+
+    int first = 0; /* first center with y >= row - radius */
+    for(int y=0; y<world->h; y++){
+        while(first < sett_n && centers[first].y < y - radius) first++;
+        int n = 0;
+        for(int i=first; i<sett_n && centers[i].y <= y + radius; i++){
+            int h = half[brz_abs_i(centers[i].y - y)];
+            StampSpan sp = { centers[i].x - h, centers[i].x + h };
+            if(sp.x0 < 0) sp.x0 = 0;
+            if(sp.x1 > world->w - 1) sp.x1 = world->w - 1;
+            if(sp.x0 <= sp.x1) spans[n++] = sp;
+        }
+        if(n == 0) continue;
+        qsort(spans, (size_t)n, sizeof(StampSpan), cmp_span);
+        int x = 0; /* tiles left of x are done */
+        for(int i=0;i<n;i++){
+            if(spans[i].x0 > x) x = spans[i].x0;
+            for(; x<=spans[i].x1; x++){
+                uint16_t t = world->tags[y*world->w+x];
+                if(t & BRZ_TAG_COAST) continue; /* don't overwrite coast */
+                brz_world_set_tags(world, x, y, (uint16_t)(t | BRZ_TAG_FIELD));
             }
         }
     }
+    free(centers);
+    free(spans);
+    free(half);
 }
 
 char brz_world_tile_glyph(const BrzWorld* world, int x, int y){
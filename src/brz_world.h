@@ -4,43 +4,195 @@
 
 #include "brz_types.h"
 #include "brz_dsl.h"
+#include "brz_land.h"
 #include <stddef.h>
 #include <stdint.h>
 
 struct BrzSettlement;
 
-enum {
-    BRZ_TAG_COAST   = 1u<<0,
-    BRZ_TAG_FIELD   = 1u<<1,
-    BRZ_TAG_FOREST  = 1u<<2,
-    BRZ_TAG_CLAYPIT = 1u<<3,
-    BRZ_TAG_MINE_CU = 1u<<4,
-    BRZ_TAG_MINE_SN = 1u<<5,
-    BRZ_TAG_FIRE    = 1u<<6
-};
+/* tile tags (BRZ_TAG_*) are declared in brz_dsl.h next to their DSL names */
+
+/* Resource grid element type. Build with BRZ_RES_FLOAT (make RES_FLOAT=1) to
+   store res/cap as float, halving the grid; results then differ slightly from
+   the default double build. */
+#ifdef BRZ_RES_FLOAT
+typedef float  brz_res_t;
+#else
+typedef double brz_res_t;
+#endif
+
+#define BRZ_FLOW_MAX 16 /* tag masks with a nearest-tag field */
+#define BRZ_FLOW_NONE UINT32_MAX /* no tile carries the tag */
+
+/* chunked worlds (sim { world chunked }) keep res/cap in square chunks */
+#define BRZ_CHUNK_SHIFT 6
+#define BRZ_CHUNK_DIM   (1 << BRZ_CHUNK_SHIFT)
+#define BRZ_CHUNK_TILES (BRZ_CHUNK_DIM * BRZ_CHUNK_DIM)
+
+/* initial caps: every tile starts with one of these per resource */
+#define BRZ_CAP_CLASSES 3
+
+/* cap table rows: one per combination of tag bits (sim { caps table }) */
+#define BRZ_CAP_KEYS (1 << BRZ_TAG_COUNT)
+
+typedef struct {
+    uint16_t  tag;
+    uint32_t* near; /* [w*h] nearest tile index, or BRZ_FLOW_NONE */
+    uint16_t* dist; /* [w*h] Chebyshev distance to it, saturating */
+} BrzFlowField;
+
+typedef struct {
+    brz_res_t* res;   /* [res_n][BRZ_CHUNK_TILES], row-major within the chunk */
+    brz_res_t* cap;   /* [res_n][BRZ_CHUNK_TILES], or NULL with a cap table */
+    uint8_t   mark[BRZ_CHUNK_TILES]; /* 1 if the tile is in the dirty set */
+} BrzChunk;
+
+/* the untouched tiles of one (resource, cap class): they all started at
+   cap/2 and have seen the same regen since */
+typedef struct {
+    brz_res_t cap;
+    brz_res_t v;      /* value of each of them today */
+    size_t    n;      /* tiles not yet materialized */
+    int       moving; /* regen would still change v */
+} BrzIdleClass;
 
 typedef struct {
     int w, h;
+    size_t res_n;
     uint16_t* tags;   /* [w*h] */
+    uint32_t  tags_gen; /* bumped whenever brz_world_set_tags changes a tile */
     uint8_t*  height; /* [w*h] heightmap sample in [0,255] */
     uint8_t   sea_level; /* waterline threshold in [0,255] */
-    double*   res;    /* [w*h*res_n] */
-    double*   cap;    /* [w*h*res_n] */
+    const BrzLand* land; /* shared source heightmap (brz_land_acquire), or NULL */
+    brz_res_t* res;   /* [res_n][h][w], one plane per resource */
+    brz_res_t* cap;   /* [res_n][h][w], or NULL with a cap table */
     double*   regen;  /* [res_n] */
+    BrzSum*   res_tot; /* [res_n] total of each plane, kept up by take and regen */
+
+    /* nearest-tag index: one bitboard per tag bit, rows of tag_words
+       64-bit words, laid out [bit][y][word]. Kept in sync with tags by
+       brz_world_set_tags. */
+    uint64_t* tag_bits;
+    int       tag_words;
+
+    /* sparse regen: tiles that may still change under step_regen. A tile
+       leaves the set once regen is a fixed point for all of its resources
+       and rejoins on brz_world_take. */
+    uint32_t* dirty;       /* [dirty_n] tile indexes */
+    size_t    dirty_n;
+    uint8_t*  dirty_mark;  /* [w*h] 1 if in dirty */
+    int       regen_dense; /* sim { regen dense }: always sweep every tile */
+
+    /* nearest-tag fields (brz_world_flow_prepare), one per destination tag
+       mask: per tile the tile brz_world_find_nearest_tag returns and its
+       Chebyshev distance, so that a lookup is O(1). brz_world_set_tags
+       marks them stale; brz_world_flow_refresh rebuilds them. */
+    BrzFlowField flow[BRZ_FLOW_MAX];
+    int       flow_n;
+    int       flow_stale;
+
+    /* nearest-settlement index (brz_world_index_settlements): per tile the
+       settlement brz_find_nearest_settlement returns there. Settlements
+       do not move once placed. NULL when not built. */
+    int32_t*  sett_owner;  /* [w*h] */
+    int       sett_owner_n; /* settlement count it was built for */
+
+    /* terrain generation inputs, kept so a tile's initial tags and caps
+       can be rebuilt from its height */
+    uint32_t  terrain_seed;
+    uint16_t* cap_tags;    /* [res_n][2] tags giving cap class 1 and 2 */
+
+    /* sim { caps table } (the default): a tile's caps only depend on the
+       tags it was generated with, so instead of cap planes every tile
+       keeps those tags and caps are looked up in cap_tab. With
+       sim { caps plane }, or after brz_world_alloc, both are NULL and cap
+       holds one explicit cap per (resource, tile). */
+    uint8_t*   cap_key;    /* [w*h] generated tags */
+    brz_res_t* cap_tab;    /* [res_n][BRZ_CAP_KEYS] */
+
+    /* chunked storage: res, cap and dirty_mark are NULL and resources live
+       in BRZ_CHUNK_DIM^2 chunks, allocated the first time something is
+       taken from one of their tiles. Tiles of unallocated chunks are still
+       at their initial state, which only depends on their cap class; idle
+       tracks it per class, so regen and the totals cost O(res_n) for all
+       of them together. No flow fields or sett_owner are built: lookups
+       search instead, bounded by their radius. What stays per tile is
+       tags, height, cap_key and tag_bits, about 5 bytes. */
+    BrzChunk** chunks;     /* [chunk_w*chunk_h], NULL entries until touched */
+    int       chunk_w, chunk_h;
+    size_t    chunk_live;  /* chunks allocated */
+    BrzIdleClass* idle;    /* [res_n][BRZ_CAP_CLASSES] */
+    size_t    dirty_cap;   /* capacity of dirty in chunked mode */
+    int       oom;         /* a chunk could not be allocated; set until freed */
 } BrzWorld;
 
+/* resource plane of rid: w*h values in row-major tile order (flat worlds) */
+static inline brz_res_t* brz_world_res_plane(const BrzWorld* world, int rid){
+    return &world->res[(size_t)rid * (size_t)world->w * (size_t)world->h];
+}
+
+/* cap of resource rid on a tile of a flat world, from cap or the cap table */
+static inline brz_res_t brz_world_cap_tile(const BrzWorld* world, size_t tile, int rid){
+    if(world->cap) return world->cap[(size_t)rid * (size_t)world->w * (size_t)world->h + tile];
+    return world->cap_tab[(size_t)rid * BRZ_CAP_KEYS + world->cap_key[tile]];
+}
+
+/* sim { world chunked } selects chunked storage, the default is flat;
+   sim { caps plane } stores caps per tile instead of in a cap table */
 int  brz_world_init(BrzWorld* world, const ParsedConfig* cfg, int w, int h, size_t res_n);
+/* same, with the terrain seed given explicitly instead of cfg->seed (0 = default) */
+int  brz_world_init_seed(BrzWorld* world, const ParsedConfig* cfg, uint32_t seed, int w, int h, size_t res_n);
+/* allocate an empty w x h world with every tile dirty; returns 0 on success */
+int  brz_world_alloc(BrzWorld* world, int w, int h, size_t res_n);
+/* (re)read the config-driven regen settings: <res>_renew rates, sim { regen } */
+void brz_world_apply_config(BrzWorld* world, const ParsedConfig* cfg, size_t res_n);
 void brz_world_free(BrzWorld* world);
 
 void brz_world_step_regen(BrzWorld* world, size_t res_n);
 
+/* Total of resource rid over all tiles in O(1). brz_world_take and regen
+   keep it up to date; after writing res[] directly, call brz_world_recount. */
+double brz_world_idle_total(const BrzWorld* world, int rid);
+static inline double brz_world_res_total(const BrzWorld* world, int rid){
+    double t = brz_sum_value(&world->res_tot[rid]);
+    return world->idle ? t + brz_world_idle_total(world, rid) : t;
+}
+void brz_world_recount(BrzWorld* world, size_t res_n);
+
 uint16_t brz_world_tags_at(const BrzWorld* world, BrzPos p);
 uint8_t  brz_world_height_at(const BrzWorld* world, BrzPos p);
+/* On a chunked world take materializes the tile's chunk; if that fails it
+   takes nothing and sets world->oom. */
 double   brz_world_take(BrzWorld* world, BrzPos p, size_t res_n, int rid, double amt);
+double   brz_world_take_tile(BrzWorld* world, size_t tile, size_t res_n, int rid, double amt);
 double   brz_world_peek(const BrzWorld* world, BrzPos p, size_t res_n, int rid);
 
+/* Nearest tile (Chebyshev distance <= max_r) carrying any bit of tag. Ties
+   go to the first tile in row-major order. Returns from when none. */
 BrzPos brz_world_find_nearest_tag(const BrzWorld* world, BrzPos from, uint16_t tag, int max_r);
 
+/* Keep a nearest-tag field for tag (built now); returns 0 on success, or
+   when BRZ_FLOW_MAX fields exist already or the world is chunked (tag then
+   goes on searching).
+   Fields are built up front because lookups happen from worker threads. */
+int  brz_world_flow_prepare(BrzWorld* world, uint16_t tag);
+/* prepare the destination tags of every move_to and gather op in cfg */
+int  brz_world_flow_prepare_cfg(BrzWorld* world, const ParsedConfig* cfg);
+/* rebuild the fields after tag changes; returns 0 on success */
+int  brz_world_flow_refresh(BrzWorld* world);
+
+/* (Re)build the tag index from tags[]; returns 0 on success */
+int  brz_world_index_tags(BrzWorld* world);
+/* Replace the tags of one tile, keeping the index current */
+void brz_world_set_tags(BrzWorld* world, int x, int y, uint16_t tags);
+
+/* Build the nearest-settlement index; returns 0 on success. Without one
+   (chunked worlds, or settlements off the map) queries fall back to the
+   linear scan. */
+int  brz_world_index_settlements(BrzWorld* world, const struct BrzSettlement* setts, int sett_n);
+/* brz_find_nearest_settlement(setts, sett_n, p), in O(1) when indexed */
+int  brz_world_nearest_settlement(const BrzWorld* world, const struct BrzSettlement* setts, int sett_n, BrzPos p);
+
 void  brz_world_stamp_fields_around_settlements(BrzWorld* world, const struct BrzSettlement* setts, int sett_n, int radius);
 char  brz_world_tile_glyph(const BrzWorld* world, int x, int y);
 
@@ -0,0 +1,158 @@
+#include "brz_writer.h"
+#include "brz_util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char* path;
+    BrzWriteFn write_fn;
+    BrzReleaseFn release;
+    void* payload;
+} WriteJob;
+
+struct BrzWriter {
+    pthread_t thread;
+    int threaded;
+
+    pthread_mutex_t mu;
+    pthread_cond_t  has_job;  /* queue not empty, or shutdown */
+    pthread_cond_t  has_room; /* a slot freed up */
+    pthread_cond_t  drained;  /* queue empty and nothing in flight */
+
+    /* ring of depth jobs, guarded by mu */
+    WriteJob* ring;
+    int depth;
+    int head;
+    int count;
+    int busy;      /* a job has been taken and is being written */
+    int quit;
+    int failures;
+};
+
+static void job_run(WriteJob* j, int* failures)
+{
+    FILE* f = fopen(j->path, "wb");
+    if(!f){
+        fprintf(stderr, "Warning: cannot write %s\n", j->path);
+        (*failures)++;
+    }else{
+        bool ok = j->write_fn(j->payload, f);
+        if(fclose(f) != 0) ok = false;
+        if(!ok){
+            fprintf(stderr, "Warning: failed to write %s\n", j->path);
+            (*failures)++;
+        }
+    }
+    if(j->release) j->release(j->payload);
+    free(j->path);
+}
+
+static void* writer_main(void* arg)
+{
+    BrzWriter* w = (BrzWriter*)arg;
+    pthread_mutex_lock(&w->mu);
+    for(;;){
+        while(!w->quit && w->count == 0) pthread_cond_wait(&w->has_job, &w->mu);
+        if(w->count == 0) break; /* quit with nothing left */
+        WriteJob j = w->ring[w->head];
+        w->head = (w->head + 1) % w->depth;
+        w->count--;
+        w->busy = 1;
+        pthread_cond_signal(&w->has_room);
+        pthread_mutex_unlock(&w->mu);
+
+        int failures = 0;
+        job_run(&j, &failures);
+
+        pthread_mutex_lock(&w->mu);
+        w->failures += failures;
+        w->busy = 0;
+        if(w->count == 0) pthread_cond_broadcast(&w->drained);
+    }
+    pthread_mutex_unlock(&w->mu);
+    return NULL;
+}
+
+BrzWriter* brz_writer_create(int depth)
+{
+    BrzWriter* w = (BrzWriter*)calloc(1, sizeof(BrzWriter));
+    if(!w) return NULL;
+    pthread_mutex_init(&w->mu, NULL);
+    pthread_cond_init(&w->has_job, NULL);
+    pthread_cond_init(&w->has_room, NULL);
+    pthread_cond_init(&w->drained, NULL);
+    if(depth > 0){
+        w->depth = depth;
+        w->ring = (WriteJob*)calloc((size_t)depth, sizeof(WriteJob));
+        if(!w->ring){ brz_writer_destroy(w); return NULL; }
+        if(pthread_create(&w->thread, NULL, writer_main, w) != 0){
+            brz_writer_destroy(w);
+            return NULL;
+        }
+        w->threaded = 1;
+    }
+    return w;
+}
+
+void brz_writer_destroy(BrzWriter* w)
+{
+    if(!w) return;
+    if(w->threaded){
+        pthread_mutex_lock(&w->mu);
+        w->quit = 1;
+        pthread_cond_broadcast(&w->has_job);
+        pthread_mutex_unlock(&w->mu);
+        pthread_join(w->thread, NULL);
+    }
+    free(w->ring);
+    pthread_cond_destroy(&w->drained);
+    pthread_cond_destroy(&w->has_room);
+    pthread_cond_destroy(&w->has_job);
+    pthread_mutex_destroy(&w->mu);
+    free(w);
+}
+
+bool brz_writer_submit(BrzWriter* w, const char* path,
+                       BrzWriteFn write_fn, BrzReleaseFn release, void* payload)
+{
+    WriteJob j;
+    j.path = brz_strdup(path);
+    j.write_fn = write_fn;
+    j.release = release;
+    j.payload = payload;
+    if(!j.path){
+        if(release) release(payload);
+        return false;
+    }
+    if(!w->threaded){
+        job_run(&j, &w->failures);
+        return true;
+    }
+
+    pthread_mutex_lock(&w->mu);
+    while(w->count == w->depth) pthread_cond_wait(&w->has_room, &w->mu);
+    w->ring[(w->head + w->count) % w->depth] = j;
+    w->count++;
+    pthread_cond_signal(&w->has_job);
+    pthread_mutex_unlock(&w->mu);
+    return true;
+}
+
+void brz_writer_flush(BrzWriter* w)
+{
+    if(!w || !w->threaded) return;
+    pthread_mutex_lock(&w->mu);
+    while(w->count > 0 || w->busy) pthread_cond_wait(&w->drained, &w->mu);
+    pthread_mutex_unlock(&w->mu);
+}
+
+int brz_writer_failures(const BrzWriter* w)
+{
+    if(!w) return 0;
+    BrzWriter* m = (BrzWriter*)w;
+    pthread_mutex_lock(&m->mu);
+    int n = m->failures;
+    pthread_mutex_unlock(&m->mu);
+    return n;
+}
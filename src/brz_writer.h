@@ -0,0 +1,46 @@
+#ifndef BRZ_WRITER_H
+#define BRZ_WRITER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * brz_writer.h/.c - background file writer for sim output
+ *
+ * The day loop captures what it wants written (a snapshot, a rendered map)
+ * into a payload it hands over with brz_writer_submit. A writer thread
+ * opens the file, serializes the payload with write_fn, closes it and
+ * releases the payload, while the next days simulate. At most depth jobs
+ * are queued; submit blocks while the queue is full, so a slow disk holds
+ * back the sim instead of piling up captures.
+ *
+ * Usage:
+ *   BrzWriter* w = brz_writer_create(2);
+ *   brz_writer_submit(w, "snapshot_day00030.json", write_json, release, snap);
+ *   brz_writer_destroy(w);                  (writes everything still queued)
+ */
+
+typedef struct BrzWriter BrzWriter;
+
+/* serialize payload into f; false reports a write error */
+typedef bool (*BrzWriteFn)(void* payload, FILE* f);
+typedef void (*BrzReleaseFn)(void* payload);
+
+/* depth <= 0 creates a writer that writes synchronously in submit.
+   Returns NULL on OOM or thread creation failure. */
+BrzWriter* brz_writer_create(int depth);
+void       brz_writer_destroy(BrzWriter* w);
+
+/* Queue path for writing; the writer owns payload from here on (release is
+   called even when the file cannot be written). Returns false on OOM, in
+   which case the payload has already been released. */
+bool brz_writer_submit(BrzWriter* w, const char* path,
+                       BrzWriteFn write_fn, BrzReleaseFn release, void* payload);
+
+/* block until every queued job has been written */
+void brz_writer_flush(BrzWriter* w);
+
+/* number of files that failed to open or write so far */
+int  brz_writer_failures(const BrzWriter* w);
+
+#endif /* BRZ_WRITER_H */
@@ -1,38 +1,255 @@
+#include "brz_ensemble.h"
+#include "brz_land.h"
+#include "brz_metrics.h"
 #include "brz_parser.h"
+#include "brz_profile.h"
 #include "brz_sim.h"
+#include "brz_snapshot.h"
 #include "brz_util.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
 static void usage(const char* exe)
 {
-    printf("Usage: %s [file.bronze]\n", exe);
+    printf("Usage: %s [options] [file.bronze]\n", exe);
+    printf("Options:\n");
+    printf("  --threads N   step agents on N threads (overrides sim { threads }); results do not depend on N\n");
+    printf("  --dump-snapshot FILE  print a binary snapshot (.bsnap) as JSON and exit\n");
+    printf("  --dump-metrics FILE [days|settlements]  print a table of a metrics file as CSV and exit\n");
+    printf("  --checkpoint-every N  save checkpoint_dayNNNNN.brzck every N days\n");
+    printf("  --resume FILE         continue a run from a checkpoint\n");
+    printf("  --land-cache DIR      keep generated heightmaps in DIR (default: $BRZ_LAND_CACHE)\n");
+    printf("  --ensemble seeds=A..B run every seed in A..B and print per-day statistics\n");
+    printf("  --jobs N              run N ensemble members at a time (default 1)\n");
+    printf("  --compile [-o OUT]    write the parsed config as an image (default file.bronzec) and exit;\n");
+    printf("                        file.bronzec next to file.bronze is loaded instead of parsing while the source is unchanged\n");
+    printf("  --profile             print per-phase times and counters at exit and write profile.csv per day\n");
+    printf("                        (needs a build with make PROFILE=1)\n");
     printf("Outputs:\n");
     printf("  snapshot_dayNNNNN.json and map_dayNNNNN.txt are controlled by sim { snapshot_every, map_every }\n");
+    printf("  sim { snapshot_format binary } writes snapshot_dayNNNNN.bsnap instead of JSON\n");
+    printf("  sim { metrics columnar } writes " BRZ_METRICS_FILE " with per-day and per-settlement columns\n");
 }
 
-static int find_param_int(const ParsedConfig* cfg, const char* key, int defv)
+static int dump_snapshot(const char* path)
 {
-    if(!cfg) return defv;
-    size_t n = cfg->params.len;
-    for(size_t i=0;i<n;i++)
+    BrzSnapshot snap;
+    char err[128];
+    if(!brz_snapshot_read(&snap, path, err, sizeof(err)))
     {
-        const ParamDef* p = (const ParamDef*)brz_vec_at((BrzVec*)&cfg->params, i);
-        if(p && p->key && brz_streq(p->key, key) && !p->has_svalue)
-            return (int)floor(p->value + 0.5);
+        fprintf(stderr, "Error: %s: %s\n", path, err);
+        return 1;
+    }
+    bool ok = brz_snapshot_write_json(&snap, stdout);
+    brz_snapshot_free(&snap);
+    return ok ? 0 : 1;
+}
+
+static int dump_metrics(const char* path, const char* table)
+{
+    int t;
+    if(brz_streq(table, "days")) t = BRZ_METRICS_DAYS;
+    else if(brz_streq(table, "settlements")) t = BRZ_METRICS_SETTLEMENTS;
+    else
+    {
+        fprintf(stderr, "Error: unknown metrics table '%s' (days or settlements)\n", table);
+        return 1;
+    }
+    BrzMetricsFile mf;
+    char err[128];
+    if(!brz_metrics_read(&mf, path, err, sizeof(err)))
+    {
+        fprintf(stderr, "Error: %s: %s\n", path, err);
+        return 1;
+    }
+    bool ok = brz_metrics_write_csv(&mf.table[t], stdout);
+    brz_metrics_file_free(&mf);
+    return ok ? 0 : 1;
+}
+
+/* strict positive integer argument for option opt; -1 when invalid */
+static int parse_count(int argc, char** argv, int i, const char* opt)
+{
+    char* end = NULL;
+    int v = (i+1 < argc) ? (int)strtol(argv[i+1], &end, 10) : -1;
+    if(i+1 >= argc || end == argv[i+1] || *end || v < 1)
+    {
+        fprintf(stderr, "Error: %s expects a positive integer\n", opt);
+        return -1;
     }
-    return defv;
+    return v;
+}
+
+/* "seeds=A..B" or "seeds=A" */
+static bool parse_seed_range(const char* s, uint32_t* lo, uint32_t* hi)
+{
+    if(strncmp(s, "seeds=", 6) != 0) return false;
+    s += 6;
+    char* end = NULL;
+    unsigned long a = strtoul(s, &end, 10);
+    if(end == s) return false;
+    unsigned long b = a;
+    if(end[0] == '.' && end[1] == '.')
+    {
+        const char* t = end + 2;
+        b = strtoul(t, &end, 10);
+        if(end == t) return false;
+    }
+    if(*end || b < a || b > 0xFFFFFFFFul) return false;
+    *lo = (uint32_t)a;
+    *hi = (uint32_t)b;
+    return true;
 }
 
 int main(int argc, char** argv)
 {
-    const char* path = (argc >= 2) ? argv[1] : "example.bronze";
-    if(argc >= 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))
+    const char* path = "example.bronze";
+    int threads = -1;
+    int checkpoint_every = -1;
+    const char* resume = NULL;
+    bool ensemble = false;
+    uint32_t seed_lo = 0, seed_hi = 0;
+    int jobs = -1;
+    bool compile = false;
+    const char* compile_out = NULL;
+    bool profile = false;
+    for(int i=1;i<argc;i++)
     {
-        usage(argv[0]);
+        if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if(!strcmp(argv[i], "--threads"))
+        {
+            threads = parse_count(argc, argv, i, "--threads");
+            if(threads < 1) return 1;
+            i++;
+        }
+        else if(!strcmp(argv[i], "--checkpoint-every"))
+        {
+            checkpoint_every = parse_count(argc, argv, i, "--checkpoint-every");
+            if(checkpoint_every < 1) return 1;
+            i++;
+        }
+        else if(!strcmp(argv[i], "--resume"))
+        {
+            if(i+1 >= argc)
+            {
+                fprintf(stderr, "Error: --resume expects a checkpoint file\n");
+                return 1;
+            }
+            resume = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--land-cache"))
+        {
+            if(i+1 >= argc)
+            {
+                fprintf(stderr, "Error: --land-cache expects a directory\n");
+                return 1;
+            }
+            brz_land_set_cache_dir(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--ensemble"))
+        {
+            if(i+1 >= argc || !parse_seed_range(argv[i+1], &seed_lo, &seed_hi))
+            {
+                fprintf(stderr, "Error: --ensemble expects seeds=A..B\n");
+                return 1;
+            }
+            ensemble = true;
+            i++;
+        }
+        else if(!strcmp(argv[i], "--jobs"))
+        {
+            jobs = parse_count(argc, argv, i, "--jobs");
+            if(jobs < 1) return 1;
+            i++;
+        }
+        else if(!strcmp(argv[i], "--compile"))
+        {
+            compile = true;
+        }
+        else if(!strcmp(argv[i], "--profile"))
+        {
+            profile = true;
+        }
+        else if(!strcmp(argv[i], "-o"))
+        {
+            if(i+1 >= argc)
+            {
+                fprintf(stderr, "Error: -o expects a file\n");
+                return 1;
+            }
+            compile_out = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--dump-snapshot"))
+        {
+            if(i+1 >= argc)
+            {
+                fprintf(stderr, "Error: --dump-snapshot expects a file\n");
+                return 1;
+            }
+            return dump_snapshot(argv[i+1]);
+        }
+        else if(!strcmp(argv[i], "--dump-metrics"))
+        {
+            if(i+1 >= argc)
+            {
+                fprintf(stderr, "Error: --dump-metrics expects a file\n");
+                return 1;
+            }
+            return dump_metrics(argv[i+1], i+2 < argc ? argv[i+2] : "days");
+        }
+        else if(argv[i][0] == '-' && argv[i][1] == '-')
+        {
+            fprintf(stderr, "Error: unknown option '%s'\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if(compile_out && !compile)
+    {
+        fprintf(stderr, "Error: -o needs --compile\n");
+        return 1;
+    }
+    if(compile)
+    {
+        char out[1024];
+        if(!compile_out)
+        {
+            if(!brz_parse_image_path(path, out, sizeof(out)))
+            {
+                fprintf(stderr, "Error: path too long\n");
+                return 1;
+            }
+            compile_out = out;
+        }
+        if(!brz_compile_file(path, compile_out)) return 1;
+        printf("Compiled %s -> %s\n", path, compile_out);
         return 0;
     }
+    if(jobs > 0 && !ensemble)
+    {
+        fprintf(stderr, "Error: --jobs needs --ensemble\n");
+        return 1;
+    }
+    if(ensemble && resume)
+    {
+        fprintf(stderr, "Error: --ensemble cannot be combined with --resume\n");
+        return 1;
+    }
+    if(profile && !brz_profile_available())
+    {
+        fprintf(stderr, "Error: --profile needs a build with instrumentation (make PROFILE=1)\n");
+        return 1;
+    }
 
     ParsedConfig cfg;
     brz_cfg_init(&cfg);
@@ -42,12 +259,19 @@ int main(int argc, char** argv)
         brz_cfg_free(&cfg);
         return 1;
     }
+    if((threads > 0 && !brz_cfg_set_num(&cfg, "sim_threads", (double)threads)) ||
+       (checkpoint_every > 0 && !brz_cfg_set_num(&cfg, "sim_checkpoint_every", (double)checkpoint_every)))
+    {
+        fprintf(stderr, "Error: OOM\n");
+        brz_cfg_free(&cfg);
+        return 1;
+    }
 
     /* legacy-style banner (restored) */
-    int days = find_param_int(&cfg, "sim_days", find_param_int(&cfg, "cycles", 60));
-    int snapshot_every = find_param_int(&cfg, "sim_snapshot_every", 0);
-    int map_every = find_param_int(&cfg, "sim_map_every", 0);
-    int cache_max = find_param_int(&cfg, "sim_cache_max", 0);
+    int days = brz_cfg_get_int(&cfg, "sim_days", brz_cfg_get_int(&cfg, "cycles", 60));
+    int snapshot_every = brz_cfg_get_int(&cfg, "sim_snapshot_every", 0);
+    int map_every = brz_cfg_get_int(&cfg, "sim_map_every", 0);
+    int cache_max = brz_cfg_get_int(&cfg, "sim_cache_max", 0);
 
     printf("Config: seed=%u days=%d agents=%d settlements=%d cache_max=%d snapshot_every=%d map_every=%d\n",
            cfg.seed, days, cfg.agent_count, cfg.settlement_count, cache_max, snapshot_every, map_every);
@@ -63,7 +287,16 @@ int main(int argc, char** argv)
                v->rules.len);
     }
 
-    int rc = brz_run(&cfg);
+    /* ensemble members run concurrently, so only the table is kept */
+    if(profile && !brz_profile_begin(ensemble ? NULL : "profile.csv"))
+    {
+        fprintf(stderr, "Error: cannot create profile.csv\n");
+        brz_cfg_free(&cfg);
+        return 1;
+    }
+    int rc = ensemble ? brz_run_ensemble(&cfg, seed_lo, seed_hi, jobs > 0 ? jobs : 1)
+                      : brz_run_from(&cfg, resume);
+    if(profile) brz_profile_end(stderr);
     brz_cfg_free(&cfg);
     return rc;
 }
@@ -0,0 +1,326 @@
+#include "test_common.h"
+#include "../brz_agent.h"
+#include "../brz_parser.h"
+#include "../brz_sim.h"
+#include <math.h>
+
+static bool load_cfg(const char* s, ParsedConfig* cfg)
+{
+    char* path = brz_test_write_temp("brz_agent_", s);
+    if(!path) return false;
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+static void test_store_layout(void)
+{
+    const char* src =
+        "kinds { resources { grain fish wood } items { bronze pottery } }\n"
+        "vocations {\n"
+        "  vocation farmer { task t { rest } rule r { when hunger > 0 do t } }\n"
+        "  vocation fisher { task t { rest } rule r { when hunger > 0 do t } }\n"
+        "}\n";
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(src, &cfg));
+
+    BrzSettlement setts[2];
+    memset(setts, 0, sizeof(setts));
+    setts[0].pos = (BrzPos){ 3, 4 };
+    setts[1].pos = (BrzPos){ 10, 20 };
+
+    BrzAgentStore st;
+    TEST_EQ_INT(brz_agents_alloc_and_spawn(&st, 5, &cfg, setts, 2, 3, 2, 77u), 0);
+    TEST_EQ_INT(st.n, 5);
+    TEST_EQ_SIZE(st.res_n, 3);
+    TEST_EQ_SIZE(st.item_n, 2);
+
+    /* vocations and homes are assigned round robin */
+    TEST_STREQ(brz_agents_voc(&st, 0)->name, "farmer");
+    TEST_STREQ(brz_agents_voc(&st, 1)->name, "fisher");
+    TEST_STREQ(brz_agents_voc(&st, 4)->name, "farmer");
+    TEST_EQ_INT(st.home[3], 1);
+    TEST_EQ_INT(st.pos[3].x, 10);
+    TEST_EQ_INT(st.pos[3].y, 20);
+    TEST_EQ_INT(st.has_target[0], 0);
+
+    /* inventories are rows of one slab, zero initialised */
+    TEST_ASSERT(brz_agents_res(&st, 1) == st.res + 3);
+    TEST_ASSERT(brz_agents_item(&st, 4) == st.item + 8);
+    double sum = 0.0;
+    for(size_t i=0;i<5*3;i++) sum += st.res[i];
+    TEST_ASSERT(sum == 0.0);
+    for(int i=0;i<5;i++)
+    {
+        TEST_ASSERT(st.hunger[i] >= 0.3 && st.hunger[i] <= 0.7);
+        TEST_ASSERT(st.fatigue[i] == 0.2);
+    }
+
+    /* spawning is deterministic for a seed */
+    BrzAgentStore st2;
+    TEST_EQ_INT(brz_agents_alloc_and_spawn(&st2, 5, &cfg, setts, 2, 3, 2, 77u), 0);
+    TEST_EQ_INT(memcmp(st.hunger, st2.hunger, 5*sizeof(double)), 0);
+    brz_agents_free(&st2);
+
+    brz_agents_free(&st);
+    TEST_ASSERT(st.res == NULL && st.pos == NULL);
+    TEST_EQ_INT(st.n, 0);
+    brz_agents_free(&st); /* double free is harmless */
+
+    brz_cfg_free(&cfg);
+}
+
+/* Trades are priced at the morning prices and only settled, in agent
+   order, by brz_trades_clear; the last buyer gets what stock is left. */
+static void test_trade_queue(void)
+{
+    const char* src =
+        "kinds { resources { grain fish } }\n"
+        "vocations {\n"
+        "  vocation trader {\n"
+        "    task sell { trade grain fish }\n"
+        "    rule r { when hunger >= 0 do sell }\n"
+        "  }\n"
+        "}\n";
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(src, &cfg));
+
+    BrzSettlement* setts = NULL;
+    TEST_EQ_INT(brz_settlements_alloc(&setts, 1, 2, 0), 0);
+    setts[0].pos = (BrzPos){ 5, 5 };
+    setts[0].population = 10;
+    setts[0].res_inv[1] = 20.0; /* fish */
+    BrzWorld world;
+    TEST_EQ_INT(brz_world_init_seed(&world, &cfg, 3u, 16, 16, 2), 0);
+    BrzAgentStore st;
+    TEST_EQ_INT(brz_agents_alloc_and_spawn(&st, 3, &cfg, setts, 1, 2, 0, 5u), 0);
+    for(int i=0;i<3;i++){ st.hunger[i] = 0.0; brz_agents_res(&st, i)[0] = 2.0; }
+
+    brz_settlements_begin_day(setts, 1);
+    const double pg = brz_settlement_price_res(&setts[0], 0);
+    const double pw = brz_settlement_price_res(&setts[0], 1);
+    TEST_ASSERT(setts[0].res_price[0] == pg && setts[0].res_price[1] == pw);
+
+    BrzRng rng; brz_rng_seed(&rng, 1u);
+    for(int i=0;i<3;i++) brz_agent_step(&st, i, &cfg, &world, setts, 1, &rng);
+    /* queued, not settled: stock untouched, the goods already handed over */
+    TEST_EQ_SIZE(setts[0].orders.len, 3);
+    TEST_ASSERT(setts[0].res_inv[0] == 0.0 && setts[0].res_inv[1] == 20.0);
+    TEST_ASSERT(brz_agents_res(&st, 2)[0] == 1.0);
+    const BrzTradeOrder* o = (const BrzTradeOrder*)setts[0].orders.data;
+    int bad = 0;
+    for(int k=0;k<3;k++) if((int)o[k].agent != k || o[k].want_amt != pg / pw) bad++;
+    TEST_EQ_INT(bad, 0);
+
+    /* stock for two and a half trades */
+    setts[0].res_inv[1] = 2.5 * pg / pw;
+    TEST_ASSERT(brz_trades_clear(&st, setts, 1));
+    TEST_EQ_SIZE(setts[0].orders.len, 0);
+    TEST_ASSERT(setts[0].res_inv[0] == 3.0);
+    TEST_ASSERT(fabs(setts[0].res_inv[1]) < 1e-12);
+    TEST_ASSERT(brz_agents_res(&st, 0)[1] == pg / pw);
+    TEST_ASSERT(brz_agents_res(&st, 1)[1] == pg / pw);
+    TEST_ASSERT(fabs(brz_agents_res(&st, 2)[1] - 0.5 * pg / pw) < 1e-12);
+
+    brz_agents_free(&st);
+    brz_world_free(&world);
+    brz_settlements_free(setts, 1);
+    brz_cfg_free(&cfg);
+}
+
+/* largest gap between the running totals and a recount */
+static double totals_drift(BrzSim* sim)
+{
+    const BrzAgentStore* st = &sim->agents;
+    double h = 0, f = 0, worst = 0;
+    for(int i=0;i<st->n;i++){ h += st->hunger[i]; f += st->fatigue[i]; }
+    worst = fmax(fabs(brz_agents_total_hunger(st) - h), fabs(brz_agents_total_fatigue(st) - f));
+    for(size_t r=0;r<st->res_n;r++){
+        double t = 0;
+        for(int i=0;i<st->n;i++) t += brz_agents_res(st, i)[r];
+        worst = fmax(worst, fabs(brz_agents_total_res(st, r) - t));
+    }
+    for(size_t k=0;k<st->item_n;k++){
+        double t = 0;
+        for(int i=0;i<st->n;i++) t += brz_agents_item(st, i)[k];
+        worst = fmax(worst, fabs(brz_agents_total_item(st, k) - t));
+    }
+    const size_t tiles = (size_t)sim->world.w * (size_t)sim->world.h;
+    for(size_t r=0;r<st->res_n;r++){
+        const brz_res_t* plane = brz_world_res_plane(&sim->world, (int)r);
+        double t = 0;
+        for(size_t i=0;i<tiles;i++) t += plane[i];
+        worst = fmax(worst, fabs(brz_world_res_total(&sim->world, (int)r) - t));
+    }
+    return worst;
+}
+
+static void test_running_totals(void)
+{
+    const char* src =
+        "sim { seed 4 map_w 40 map_h 24 }\n"
+        "agents { count 700 }\n"
+        "settlements { count 3 }\n"
+        "kinds { resources { grain fish clay } items { pottery } }\n"
+        "vocations {\n"
+        "  vocation farmer {\n"
+        "    task farm {\n"
+        "      move_to field\n"
+        "      gather grain 3\n"
+        "    }\n"
+        "    task sell { trade grain fish }\n"
+        "    rule work { when hunger > 0.4 do farm weight 3 }\n"
+        "    rule market { when hunger >= 0 do sell }\n"
+        "  }\n"
+        "  vocation potter {\n"
+        "    task dig {\n"
+        "      move_to hill\n"
+        "      gather clay 2\n"
+        "    }\n"
+        "    task make { craft pottery 1 }\n"
+        "    rule d { when fatigue < 0.5 do dig }\n"
+        "    rule m { when hunger >= 0 do make }\n"
+        "  }\n"
+        "}\n";
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(src, &cfg));
+
+    BrzSim serial, one, four;
+    TEST_EQ_INT(brz_sim_init(&serial, &cfg), 0);
+    TEST_EQ_INT(brz_sim_init(&one, &cfg), 0);
+    TEST_EQ_INT(brz_sim_init(&four, &cfg), 0);
+    TEST_ASSERT(totals_drift(&serial) == 0.0); /* spawn counts from scratch */
+    TEST_EQ_INT(brz_sim_run_days(&serial, 40, 0, NULL, NULL), 0);
+    TEST_EQ_INT(brz_sim_run_days(&one, 40, 1, NULL, NULL), 0);
+    TEST_EQ_INT(brz_sim_run_days(&four, 40, 4, NULL, NULL), 0);
+    TEST_ASSERT(brz_agents_total_item(&serial.agents, 0) > 0);
+    TEST_ASSERT(totals_drift(&serial) < 1e-6);
+    TEST_ASSERT(totals_drift(&one) < 1e-6);
+
+    /* the parallel tallies are folded in chunk order: no thread-count dependence */
+    const size_t slots = 2 + one.agents.res_n + one.agents.item_n;
+    int differ = 0;
+    for(size_t k=0;k<slots;k++) if(brz_agents_total(&one.agents, k) != brz_agents_total(&four.agents, k)) differ++;
+    TEST_EQ_INT(differ, 0);
+
+    brz_agents_recount(&serial.agents);
+    brz_world_recount(&serial.world, serial.agents.res_n);
+    TEST_ASSERT(totals_drift(&serial) == 0.0);
+
+    brz_sim_free(&serial);
+    brz_sim_free(&one);
+    brz_sim_free(&four);
+    brz_cfg_free(&cfg);
+}
+
+/* Crafting follows cfg->recipes: an item without a recipe is made from
+   nothing, one with a recipe only as far as its inputs last. Runs 40
+   agents for 10 days and returns the wool, cloth and pottery they hold. */
+static bool craft_totals(const char* recipes, double out[3])
+{
+    char src[1024];
+    snprintf(src, sizeof(src),
+        "sim { seed 9 map_w 32 map_h 20 }\n"
+        "agents { count 40 }\n"
+        "settlements { count 1 }\n"
+        "kinds { resources { clay } items { wool cloth pottery } }\n"
+        "%s"
+        "vocations {\n"
+        "  vocation maker {\n"
+        "    task make {\n"
+        "      craft wool 2\n"
+        "      craft cloth 1\n"
+        "      craft pottery 1\n"
+        "    }\n"
+        "    rule m { when hunger >= 0 do make }\n"
+        "  }\n"
+        "}\n", recipes);
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    bool ok = load_cfg(src, &cfg);
+    BrzSim sim;
+    if(ok && brz_sim_init(&sim, &cfg) == 0)
+    {
+        ok = brz_sim_run_days(&sim, 10, 0, NULL, NULL) == 0;
+        for(int i=0;i<3;i++) out[i] = brz_agents_total_item(&sim.agents, (size_t)i);
+        brz_sim_free(&sim);
+    }
+    else ok = false;
+    brz_cfg_free(&cfg);
+    return ok;
+}
+
+static void test_craft_recipes(void)
+{
+    double t[3];
+    /* an empty block drops the built-in recipes: everything from nothing */
+    TEST_ASSERT(craft_totals("recipes { }\n", t));
+    TEST_ASSERT(t[0] == 800.0 && t[1] == 400.0 && t[2] == 400.0);
+
+    /* cloth is paid for in wool; nobody gathers clay */
+    TEST_ASSERT(craft_totals("recipes { cloth { wool 1 } pottery { clay 2 } }\n", t));
+    TEST_ASSERT(t[0] == 400.0 && t[1] == 400.0 && t[2] == 0.0);
+
+    TEST_ASSERT(craft_totals("recipes { cloth { wool 0.5 } }\n", t));
+    TEST_ASSERT(t[0] == 600.0 && t[1] == 400.0 && t[2] == 400.0);
+
+    /* an input listed twice would be taken once per entry and drive wool
+       negative; the recipe is dropped, so cloth is made from nothing */
+    TEST_ASSERT(craft_totals("recipes { cloth { wool 1 wool 1 } }\n", t));
+    TEST_ASSERT(t[0] == 800.0 && t[1] == 400.0 && t[2] == 400.0);
+}
+
+/* pick_rule's match mask is sized for the largest vocation up front, so
+   vocations past a few hundred rules pick like small ones */
+static void test_many_rules(void)
+{
+    const int rules = 300;
+    size_t cap = 4096 + (size_t)rules * 64;
+    char* src = (char*)malloc(cap);
+    TEST_ASSERT(src != NULL);
+    if(!src) return;
+    size_t len = (size_t)snprintf(src, cap,
+        "sim { seed 3 map_w 24 map_h 16 }\n"
+        "agents { count 8 }\n"
+        "settlements { count 1 }\n"
+        "kinds { resources { grain } items { wool } }\n"
+        "vocations {\n"
+        "  vocation big {\n"
+        "    task make {\n"
+        "      craft wool 1\n"
+        "    }\n");
+    for(int i=0;i<rules-1;i++)
+        len += (size_t)snprintf(src + len, cap - len, "    rule r%d { when hunger > %d do make }\n", i, 2 + i);
+    snprintf(src + len, cap - len, "    rule last { when fatigue < 2 do make }\n  }\n}\n");
+
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(src, &cfg));
+    free(src);
+    TEST_EQ_SIZE(brz_cfg_rule_mask_words(&cfg), 5);
+
+    BrzSim serial, par;
+    TEST_EQ_INT(brz_sim_init(&serial, &cfg), 0);
+    TEST_EQ_INT(brz_sim_init(&par, &cfg), 0);
+    TEST_EQ_SIZE(serial.agents.rule_mask_words, 5);
+    TEST_EQ_INT(brz_sim_run_days(&serial, 3, 0, NULL, NULL), 0);
+    TEST_EQ_INT(brz_sim_run_days(&par, 3, 2, NULL, NULL), 0);
+    TEST_ASSERT(brz_agents_total_item(&serial.agents, 0) == 24.0);
+    TEST_ASSERT(brz_agents_total_item(&par.agents, 0) == 24.0);
+    brz_sim_free(&serial);
+    brz_sim_free(&par);
+    brz_cfg_free(&cfg);
+}
+
+void test_agent_run(void)
+{
+    test_store_layout();
+    test_trade_queue();
+    test_running_totals();
+    test_craft_recipes();
+    test_many_rules();
+}
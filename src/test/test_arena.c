@@ -0,0 +1,79 @@
+#include "test_common.h"
+#include "../brz_arena.h"
+
+static void test_arena_alloc(void)
+{
+    BrzArena a;
+    brz_arena_init(&a);
+
+    char* p1 = (char*)brz_arena_alloc(&a, 3);
+    char* p2 = (char*)brz_arena_alloc(&a, 5);
+    TEST_ASSERT(p1 && p2);
+    TEST_ASSERT(((uintptr_t)p1 % 16) == 0);
+    TEST_ASSERT(((uintptr_t)p2 % 16) == 0);
+    TEST_ASSERT(p2 >= p1 + 3);
+
+    /* many small blocks across chunks stay intact */
+    int* blocks[2000];
+    for(int i=0;i<2000;i++){
+        blocks[i] = (int*)brz_arena_alloc(&a, 40);
+        if(blocks[i]) blocks[i][0] = i;
+    }
+    int bad = 0;
+    for(int i=0;i<2000;i++) if(!blocks[i] || blocks[i][0] != i) bad++;
+    TEST_EQ_INT(bad, 0);
+
+    /* an oversized block does not discard the current chunk */
+    char* small = (char*)brz_arena_alloc(&a, 16);
+    char* big = (char*)brz_arena_alloc(&a, 1u << 20);
+    char* next = (char*)brz_arena_alloc(&a, 16);
+    TEST_ASSERT(small && big && next);
+    if(big) memset(big, 0xab, 1u << 20);
+    TEST_ASSERT(next == small + 16);
+
+    char* s = brz_arena_strndup(&a, "bronze age", 6);
+    TEST_STREQ(s, "bronze");
+    brz_arena_destroy(&a);
+    TEST_ASSERT(a.head == NULL);
+}
+
+static void test_strtab_intern(void)
+{
+    BrzArena a;
+    BrzStrTab t;
+    brz_arena_init(&a);
+    brz_strtab_init(&t);
+
+    const char* src = "fish grain fish";
+    const char* f1 = brz_strtab_intern(&t, &a, src, 4);
+    const char* g  = brz_strtab_intern(&t, &a, src + 5, 5);
+    const char* f2 = brz_strtab_intern(&t, &a, src + 11, 4);
+    TEST_STREQ(f1, "fish");
+    TEST_STREQ(g, "grain");
+    TEST_ASSERT(f1 == f2);
+    TEST_ASSERT(f1 != src);
+    TEST_EQ_SIZE(t.n, 2);
+
+    const char* e = brz_strtab_intern(&t, &a, "", 0);
+    TEST_STREQ(e, "");
+
+    /* survives rehashing */
+    char name[32];
+    int oom = 0;
+    for(int i=0;i<1000;i++){
+        int n = snprintf(name, sizeof(name), "k%d", i);
+        if(!brz_strtab_intern(&t, &a, name, (size_t)n)) oom++;
+    }
+    TEST_EQ_INT(oom, 0);
+    TEST_ASSERT(brz_strtab_intern(&t, &a, "fish", 4) == f1);
+    TEST_EQ_SIZE(t.n, 1003);
+
+    brz_strtab_destroy(&t);
+    brz_arena_destroy(&a);
+}
+
+void test_arena_run(void)
+{
+    test_arena_alloc();
+    test_strtab_intern();
+}
@@ -0,0 +1,283 @@
+#include "test_common.h"
+#include "../brz_cfgimage.h"
+#include "../brz_parser.h"
+#include "../brz_util.h"
+
+static const char* k_src =
+    "kinds { resources { grain fish clay } items { pottery } }\n"
+    "world { seed 77 }\n"
+    "sim { days 12 }\n"
+    "resources { grain_renew 0.05 }\n"
+    "recipes { pottery { clay 2 grain 0.5 } }\n"
+    "vocations {\n"
+    "  vocation potter {\n"
+    "    task make {\n"
+    "      move_to claypit\n"
+    "      chance 50 { gather clay 2 }\n"
+    "      when hunger > 0.5 {\n"
+    "        rest\n"
+    "        when fatigue > 0.9 { rest }\n"
+    "      }\n"
+    "      craft pottery\n"
+    "    }\n"
+    "    task eat { gather grain }\n"
+    "    rule r1 { when hunger > 0.8 do eat weight 4 }\n"
+    "    rule r2 { when fatigue < 0.90 and prob 0.25 do make }\n"
+    "    rule r3 { when true do missing }\n"
+    "  }\n"
+    "  vocation fisher { task t { gather fish } rule r { when hunger > 0 do t } }\n"
+    "}\n";
+
+static bool same_str(const char* a, const char* b)
+{
+    return (!a && !b) || (a && b && strcmp(a, b) == 0);
+}
+
+static bool same_expr(const BrzExpr* a, const BrzExpr* b)
+{
+    return a->len == b->len && (a->len == 0 || memcmp(a->code, b->code, (size_t)a->len * sizeof(BrzExprIns)) == 0);
+}
+
+static bool same_stmts(const BrzVec* a, const BrzVec* b)
+{
+    if(a->len != b->len) return false;
+    for(size_t i=0;i<a->len;i++)
+    {
+        const StmtDef* x = (const StmtDef*)brz_vec_cat(a, i);
+        const StmtDef* y = (const StmtDef*)brz_vec_cat(b, i);
+        if(x->kind != y->kind || x->line != y->line) return false;
+        switch(x->kind)
+        {
+            case ST_OP:
+                if(!same_str(x->as.op.op, y->as.op.op) || !same_str(x->as.op.a0, y->as.op.a0) ||
+                   !same_str(x->as.op.a1, y->as.op.a1) || !same_str(x->as.op.a2, y->as.op.a2) ||
+                   x->as.op.n0 != y->as.op.n0 || x->as.op.code != y->as.op.code ||
+                   x->as.op.rid0 != y->as.op.rid0 || x->as.op.iid0 != y->as.op.iid0 ||
+                   x->as.op.tag != y->as.op.tag) return false;
+                break;
+            case ST_CHANCE:
+                if(x->as.chance.chance_pct != y->as.chance.chance_pct ||
+                   !same_stmts(&x->as.chance.body, &y->as.chance.body)) return false;
+                break;
+            case ST_WHEN:
+                if(!same_str(x->as.when_stmt.when_expr, y->as.when_stmt.when_expr) ||
+                   !same_expr(&x->as.when_stmt.prog, &y->as.when_stmt.prog) ||
+                   !same_stmts(&x->as.when_stmt.body, &y->as.when_stmt.body)) return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+static bool same_cfg(const ParsedConfig* a, const ParsedConfig* b)
+{
+    if(a->seed != b->seed || a->years != b->years || a->agent_count != b->agent_count ||
+       a->settlement_count != b->settlement_count) return false;
+    if(memcmp(&a->known, &b->known, sizeof(a->known)) != 0) return false;
+    if(kind_table_count(&a->resource_kinds) != kind_table_count(&b->resource_kinds) ||
+       kind_table_count(&a->item_kinds) != kind_table_count(&b->item_kinds)) return false;
+    for(size_t i=0;i<kind_table_count(&a->resource_kinds);i++)
+        if(!same_str(kind_table_name(&a->resource_kinds, (int)i), kind_table_name(&b->resource_kinds, (int)i))) return false;
+    if(a->params.len != b->params.len || a->warnings.len != b->warnings.len) return false;
+    for(size_t i=0;i<a->params.len;i++)
+    {
+        const ParamDef* x = (const ParamDef*)brz_vec_cat(&a->params, i);
+        const ParamDef* y = (const ParamDef*)brz_vec_cat(&b->params, i);
+        if(!same_str(x->key, y->key) || x->value != y->value || x->has_svalue != y->has_svalue ||
+           !same_str(x->svalue, y->svalue)) return false;
+    }
+    for(size_t i=0;i<a->warnings.len;i++)
+        if(!same_str(*(const char* const*)brz_vec_cat(&a->warnings, i),
+                     *(const char* const*)brz_vec_cat(&b->warnings, i))) return false;
+    if(a->has_recipes != b->has_recipes || a->recipes.len != b->recipes.len ||
+       a->recipe_in.len != b->recipe_in.len || a->recipe_of.len != b->recipe_of.len) return false;
+    for(size_t i=0;i<a->recipes.len;i++)
+    {
+        const RecipeDef* x = (const RecipeDef*)brz_vec_cat(&a->recipes, i);
+        const RecipeDef* y = (const RecipeDef*)brz_vec_cat(&b->recipes, i);
+        if(!same_str(x->item, y->item) || !same_str(x->makes, y->makes) || x->in_first != y->in_first ||
+           x->in_n != y->in_n || x->out != y->out || x->out_is_item != y->out_is_item) return false;
+    }
+    for(size_t i=0;i<a->recipe_in.len;i++)
+    {
+        const RecipeInput* x = (const RecipeInput*)brz_vec_cat(&a->recipe_in, i);
+        const RecipeInput* y = (const RecipeInput*)brz_vec_cat(&b->recipe_in, i);
+        if(!same_str(x->name, y->name) || x->ratio != y->ratio || x->id != y->id || x->is_item != y->is_item) return false;
+    }
+    if(a->recipe_of.len && memcmp(a->recipe_of.data, b->recipe_of.data, a->recipe_of.len*sizeof(int32_t)) != 0) return false;
+    if(a->vocations.len != b->vocations.len) return false;
+    for(size_t vi=0;vi<a->vocations.len;vi++)
+    {
+        const VocationDef* x = (const VocationDef*)brz_vec_cat(&a->vocations, vi);
+        const VocationDef* y = (const VocationDef*)brz_vec_cat(&b->vocations, vi);
+        if(!same_str(x->name, y->name) || x->tasks.len != y->tasks.len || x->rules.len != y->rules.len) return false;
+        for(size_t i=0;i<x->tasks.len;i++)
+        {
+            const TaskDef* s = (const TaskDef*)brz_vec_cat(&x->tasks, i);
+            const TaskDef* t = (const TaskDef*)brz_vec_cat(&y->tasks, i);
+            if(!same_str(s->name, t->name) || !same_stmts(&s->stmts, &t->stmts)) return false;
+        }
+        for(size_t i=0;i<x->rules.len;i++)
+        {
+            const RuleDef* s = (const RuleDef*)brz_vec_cat(&x->rules, i);
+            const RuleDef* t = (const RuleDef*)brz_vec_cat(&y->rules, i);
+            if(!same_str(s->name, t->name) || !same_str(s->when_expr, t->when_expr) ||
+               !same_str(s->do_task, t->do_task) || s->weight != t->weight || s->line != t->line ||
+               !same_expr(&s->when_prog, &t->when_prog)) return false;
+            /* task pointers point into the loaded vocation */
+            if((s->task == NULL) != (t->task == NULL)) return false;
+            if(s->task && (s->task - (const TaskDef*)x->tasks.data) != (t->task - (const TaskDef*)y->tasks.data))
+                return false;
+        }
+    }
+    return true;
+}
+
+static char* image_path_for(const char* src_path)
+{
+    char buf[1024];
+    if(!brz_parse_image_path(src_path, buf, sizeof(buf))) return NULL;
+    return brz_strdup(buf);
+}
+
+static void test_image_round_trip(void)
+{
+    char* src_path = brz_test_write_temp("brz_cfgimg_", k_src);
+    TEST_ASSERT(src_path != NULL);
+    if(!src_path) return;
+    char* img = image_path_for(src_path);
+    TEST_ASSERT(img != NULL);
+
+    ParsedConfig parsed;
+    brz_cfg_init(&parsed);
+    TEST_ASSERT(brz_parse_file(src_path, &parsed));
+    TEST_ASSERT(parsed.warnings.len >= 1);
+
+    TEST_ASSERT(brz_compile_file(src_path, img));
+
+    /* loaded straight from the image */
+    size_t n = 0;
+    char* text = brz_read_entire_file(src_path, &n);
+    uint64_t h = brz_cfg_source_hash(text, n);
+    ParsedConfig loaded;
+    brz_cfg_init(&loaded);
+    char err[128];
+    TEST_ASSERT(brz_cfg_image_load(&loaded, img, h, n, err, sizeof(err)));
+    TEST_ASSERT(same_cfg(&parsed, &loaded));
+
+    /* tables were rebuilt: lookups and interning still work */
+    TEST_EQ_INT(kind_table_find(&loaded.resource_kinds, "clay"), 2);
+    const RecipeDef* rec = brz_cfg_recipe(&loaded, 0);
+    TEST_ASSERT(rec != NULL && rec->in_n == 2);
+    if(rec) TEST_ASSERT(brz_cfg_recipe_inputs(&loaded, rec)[1].ratio == 0.5);
+    const VocationDef* v = (const VocationDef*)brz_vec_cat(&loaded.vocations, 0);
+    TEST_ASSERT(brz_cfg_intern(&loaded, "potter") == v->name);
+    TEST_ASSERT(v->tasks.arena == &loaded.arena);
+    TEST_ASSERT(brz_cfg_set_num(&loaded, "sim_threads", 2));
+    TEST_ASSERT(brz_cfg_set_num(&loaded, "sim_days", 5));
+    const ParamDef* p = (const ParamDef*)brz_vec_cat(&loaded.params, 0);
+    TEST_ASSERT(p != NULL);
+    brz_cfg_free(&loaded);
+
+    /* source edited: the image is refused */
+    brz_cfg_init(&loaded);
+    TEST_ASSERT(!brz_cfg_image_load(&loaded, img, h ^ 1u, n, err, sizeof(err)));
+    TEST_ASSERT(strstr(err, "source") != NULL);
+    TEST_EQ_SIZE(loaded.vocations.len, 0);
+    TEST_EQ_SIZE(kind_table_count(&loaded.resource_kinds), 0);
+    brz_cfg_free(&loaded);
+
+    /* one flipped bit */
+    FILE* f = fopen(img, "r+b");
+    TEST_ASSERT(f != NULL);
+    if(f)
+    {
+        fseek(f, -9, SEEK_END);
+        int c = fgetc(f);
+        fseek(f, -9, SEEK_END);
+        fputc(c ^ 0x40, f);
+        fclose(f);
+    }
+    brz_cfg_init(&loaded);
+    TEST_ASSERT(!brz_cfg_image_load(&loaded, img, h, n, err, sizeof(err)));
+    TEST_ASSERT(strstr(err, "checksum") != NULL);
+    brz_cfg_free(&loaded);
+
+    /* brz_parse_file falls back to the source */
+    brz_cfg_init(&loaded);
+    TEST_ASSERT(brz_parse_file(src_path, &loaded));
+    TEST_ASSERT(same_cfg(&parsed, &loaded));
+    brz_cfg_free(&loaded);
+
+    brz_test_unlink(img);
+    TEST_ASSERT(!brz_cfg_image_load(&loaded, img, h, n, err, sizeof(err)));
+
+    free(text);
+    brz_cfg_free(&parsed);
+    free(img);
+    brz_test_unlink(src_path);
+    free(src_path);
+}
+
+static void test_parse_file_uses_image(void)
+{
+    /* an image keyed to source A but holding config B: parsing A must
+       yield B, which proves the image was taken */
+    const char* a = "vocations { vocation a { task t { rest } rule r { when true do t } } }\n";
+    const char* b = "kinds { resources { tin } }\n"
+                    "vocations { vocation b1 { task t { rest } } vocation b2 { task u { rest } } }\n";
+    char* pa = brz_test_write_temp("brz_cfgimg_a_", a);
+    char* pb = brz_test_write_temp("brz_cfgimg_b_", b);
+    TEST_ASSERT(pa && pb);
+    if(!pa || !pb){ free(pa); free(pb); return; }
+    char* img = image_path_for(pa);
+
+    ParsedConfig cb;
+    brz_cfg_init(&cb);
+    TEST_ASSERT(brz_parse_file(pb, &cb));
+    TEST_ASSERT(brz_cfg_image_write(&cb, brz_cfg_source_hash(a, strlen(a)), strlen(a), img, NULL, 0));
+    brz_cfg_free(&cb);
+
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(brz_parse_file(pa, &cfg));
+    TEST_EQ_SIZE(cfg.vocations.len, 2);
+    TEST_EQ_INT(kind_table_find(&cfg.resource_kinds, "tin"), 0);
+    brz_cfg_free(&cfg);
+
+    brz_test_unlink(img);
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(brz_parse_file(pa, &cfg));
+    TEST_EQ_SIZE(cfg.vocations.len, 1);
+    brz_cfg_free(&cfg);
+
+    free(img);
+    brz_test_unlink(pa);
+    brz_test_unlink(pb);
+    free(pa);
+    free(pb);
+}
+
+static void test_image_rejects_garbage(void)
+{
+    char* path = brz_test_write_temp("brz_cfgimg_bad_", "not an image");
+    TEST_ASSERT(path != NULL);
+    if(!path) return;
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    char err[128];
+    TEST_ASSERT(!brz_cfg_image_load(&cfg, path, 0, 0, err, sizeof(err)));
+    TEST_ASSERT(err[0] != 0);
+    brz_cfg_free(&cfg);
+    brz_test_unlink(path);
+    free(path);
+}
+
+void test_cfgimage_run(void)
+{
+    test_image_round_trip();
+    test_parse_file_uses_image();
+    test_image_rejects_garbage();
+}
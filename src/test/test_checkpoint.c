@@ -0,0 +1,163 @@
+#include "test_common.h"
+#include "../brz_checkpoint.h"
+#include "../brz_kinds.h"
+#include "../brz_parser.h"
+
+static const char* k_src =
+    "sim { seed 9 map_w 40 map_h 24 }\n"
+    "agents { count 60 }\n"
+    "settlements { count 3 }\n"
+    "kinds { resources { grain fish wood } items { pottery } }\n"
+    "resources { grain_renew 0.05 }\n"
+    "vocations {\n"
+    "  vocation farmer {\n"
+    "    task farm { move field gather grain 2 }\n"
+    "    task nap { rest }\n"
+    "    rule tired { when fatigue > 0.6 do nap }\n"
+    "    rule work { when hunger > 0 do farm }\n"
+    "  }\n"
+    "  vocation fisher {\n"
+    "    task fish { move coast gather fish 1 }\n"
+    "    rule work { when hunger > 0 do fish }\n"
+    "  }\n"
+    "}\n";
+
+static bool load_cfg(const char* s, ParsedConfig* cfg)
+{
+    char* path = brz_test_write_temp("brz_ck_", s);
+    if(!path) return false;
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+/* one serial day, as brz_run does it */
+static void step_day(BrzSim* sim)
+{
+    size_t res_n = kind_table_count(&sim->cfg->resource_kinds);
+    brz_world_step_regen(&sim->world, res_n);
+    brz_settlements_begin_day(sim->setts, sim->sett_n);
+    for(int i=0;i<sim->agents.n;i++)
+        brz_agent_step(&sim->agents, i, sim->cfg, &sim->world, sim->setts, sim->sett_n, &sim->rng);
+    brz_trades_clear(&sim->agents, sim->setts, sim->sett_n);
+    sim->day++;
+}
+
+static bool same_state(const BrzSim* a, const BrzSim* b)
+{
+    size_t res_n = a->agents.res_n, item_n = a->agents.item_n;
+    size_t tiles = (size_t)a->world.w * (size_t)a->world.h;
+    size_t an = (size_t)a->agents.n;
+    if(a->day != b->day || a->rng.state != b->rng.state) return false;
+    if(a->world.w != b->world.w || a->world.h != b->world.h || a->agents.n != b->agents.n) return false;
+    if(memcmp(a->world.tags, b->world.tags, tiles*sizeof(uint16_t)) != 0) return false;
+    if(memcmp(a->world.res, b->world.res, tiles*res_n*sizeof(brz_res_t)) != 0) return false;
+    for(size_t r=0;r<res_n;r++)
+        for(size_t t=0;t<tiles;t++)
+            if(brz_world_cap_tile(&a->world, t, (int)r) != brz_world_cap_tile(&b->world, t, (int)r)) return false;
+    if(a->world.dirty_n != b->world.dirty_n) return false;
+    if(memcmp(a->agents.pos, b->agents.pos, an*sizeof(BrzPos)) != 0) return false;
+    if(memcmp(a->agents.voc, b->agents.voc, an*sizeof(uint32_t)) != 0) return false;
+    if(memcmp(a->agents.hunger, b->agents.hunger, an*sizeof(double)) != 0) return false;
+    if(memcmp(a->agents.res, b->agents.res, an*res_n*sizeof(double)) != 0) return false;
+    if(memcmp(a->agents.item, b->agents.item, an*item_n*sizeof(double)) != 0) return false;
+    for(int s=0;s<a->sett_n;s++)
+    {
+        if(a->setts[s].population != b->setts[s].population) return false;
+        if(memcmp(a->setts[s].res_inv, b->setts[s].res_inv, res_n*sizeof(double)) != 0) return false;
+    }
+    return true;
+}
+
+static void test_save_load_resume(void)
+{
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(k_src, &cfg));
+
+    BrzSim a;
+    TEST_EQ_INT(brz_sim_init(&a, &cfg), 0);
+    for(int d=0; d<25; d++) step_day(&a);
+
+    char* path = brz_test_write_temp("brz_ck_file_", "");
+    TEST_ASSERT(path != NULL);
+    TEST_ASSERT(brz_sim_checkpoint_save(&a, path));
+
+    BrzSim b;
+    char err[160];
+    TEST_ASSERT(brz_sim_checkpoint_load(&b, &cfg, path, err, sizeof(err)));
+    TEST_EQ_INT(b.day, 25);
+    TEST_ASSERT(same_state(&a, &b));
+    TEST_ASSERT(b.agents.voc_table == (const VocationDef*)cfg.vocations.data);
+
+    /* resumed run continues exactly like the original */
+    for(int d=0; d<30; d++){ step_day(&a); step_day(&b); }
+    TEST_ASSERT(same_state(&a, &b));
+    brz_sim_free(&b);
+
+    /* a config with other kinds is refused */
+    ParsedConfig other;
+    brz_cfg_init(&other);
+    TEST_ASSERT(load_cfg(
+        "kinds { resources { grain fish clay } items { pottery } }\n"
+        "vocations {\n"
+        "  vocation farmer { task t { rest } rule r { when hunger > 0 do t } }\n"
+        "  vocation fisher { task t { rest } rule r { when hunger > 0 do t } }\n"
+        "}\n", &other));
+    TEST_ASSERT(!brz_sim_checkpoint_load(&b, &other, path, err, sizeof(err)));
+    TEST_ASSERT(strstr(err, "kinds") != NULL);
+    TEST_ASSERT(b.agents.pos == NULL);
+    brz_cfg_free(&other);
+
+    /* agent fields used as indexes are checked: home settlement and
+       position must be in range */
+    {
+        const int32_t home = a.agents.home[5];
+        a.agents.home[5] = a.sett_n;
+        TEST_ASSERT(brz_sim_checkpoint_save(&a, path));
+        TEST_ASSERT(!brz_sim_checkpoint_load(&b, &cfg, path, err, sizeof(err)));
+        TEST_ASSERT(strstr(err, "home") != NULL);
+        a.agents.home[5] = -1;
+        TEST_ASSERT(brz_sim_checkpoint_save(&a, path));
+        TEST_ASSERT(!brz_sim_checkpoint_load(&b, &cfg, path, err, sizeof(err)));
+        a.agents.home[5] = home;
+
+        const BrzPos pos = a.agents.pos[7], target = a.agents.target[7];
+        a.agents.pos[7].x = a.world.w;
+        TEST_ASSERT(brz_sim_checkpoint_save(&a, path));
+        TEST_ASSERT(!brz_sim_checkpoint_load(&b, &cfg, path, err, sizeof(err)));
+        TEST_ASSERT(strstr(err, "position") != NULL);
+        a.agents.pos[7] = pos;
+        a.agents.target[7].y = -3;
+        TEST_ASSERT(brz_sim_checkpoint_save(&a, path));
+        TEST_ASSERT(!brz_sim_checkpoint_load(&b, &cfg, path, err, sizeof(err)));
+        a.agents.target[7] = target;
+
+        TEST_ASSERT(brz_sim_checkpoint_save(&a, path));
+        TEST_ASSERT(brz_sim_checkpoint_load(&b, &cfg, path, err, sizeof(err)));
+        brz_sim_free(&b);
+    }
+
+    /* truncated file */
+    size_t size = 0;
+    char* data = brz_read_entire_file(path, &size);
+    TEST_ASSERT(data != NULL);
+    FILE* f = fopen(path, "wb");
+    TEST_ASSERT(f != NULL);
+    fwrite(data, 1, size / 2, f);
+    fclose(f);
+    TEST_ASSERT(!brz_sim_checkpoint_load(&b, &cfg, path, err, sizeof(err)));
+    TEST_ASSERT(err[0] != 0);
+    free(data);
+
+    brz_test_unlink(path);
+    free(path);
+    brz_sim_free(&a);
+    brz_cfg_free(&cfg);
+}
+
+void test_checkpoint_run(void)
+{
+    test_save_load_resume();
+}
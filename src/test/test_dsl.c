@@ -2,6 +2,8 @@
 #include "test_common.h"
 #include "../brz_dsl.h"
 #include "../brz_util.h"
+#include "../brz_parser.h"
+#include <math.h>
 
 static void test_cfg_init_defaults(void)
 {
@@ -24,24 +26,27 @@ static void test_cfg_init_defaults(void)
 
 static void test_voc_find_task(void)
 {
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+
     VocationDef v;
     memset(&v, 0, sizeof(v));
-    v.name = brz_strdup("testvoc");
-    brz_vec_init(&v.tasks, sizeof(TaskDef));
-    brz_vec_init(&v.rules, sizeof(RuleDef));
+    v.name = brz_cfg_intern(&cfg, "testvoc");
+    brz_vec_init_arena(&v.tasks, sizeof(TaskDef), &cfg.arena);
+    brz_vec_init_arena(&v.rules, sizeof(RuleDef), &cfg.arena);
 
     TEST_ASSERT(brz_voc_find_task(&v, "missing") == NULL);
     TEST_ASSERT(brz_voc_find_task(NULL, "x") == NULL);
     TEST_ASSERT(brz_voc_find_task(&v, NULL) == NULL);
 
     TaskDef t1; memset(&t1, 0, sizeof(t1));
-    t1.name = brz_strdup("alpha");
-    brz_vec_init(&t1.stmts, sizeof(StmtDef));
+    t1.name = brz_cfg_intern(&cfg, "alpha");
+    brz_vec_init_arena(&t1.stmts, sizeof(StmtDef), &cfg.arena);
     TEST_ASSERT(brz_vec_push(&v.tasks, &t1));
 
     TaskDef t2; memset(&t2, 0, sizeof(t2));
-    t2.name = brz_strdup("beta");
-    brz_vec_init(&t2.stmts, sizeof(StmtDef));
+    t2.name = brz_cfg_intern(&cfg, "beta");
+    brz_vec_init_arena(&t2.stmts, sizeof(StmtDef), &cfg.arena);
     TEST_ASSERT(brz_vec_push(&v.tasks, &t2));
 
     TaskDef* f1 = brz_voc_find_task(&v, "alpha");
@@ -54,9 +59,7 @@ static void test_voc_find_task(void)
     TEST_STREQ(f1->name, "alpha");
     TEST_STREQ(f2->name, "beta");
 
-    /* cleanup using cfg_free path to exercise voc_free/task_free */
-    ParsedConfig cfg;
-    brz_cfg_init(&cfg);
+    /* the arena owns everything; cfg_free releases it in one go */
     TEST_ASSERT(brz_vec_push(&cfg.vocations, &v));
     brz_cfg_free(&cfg);
 }
@@ -68,10 +71,10 @@ static void test_cfg_free_clears_state(void)
 
     /* add some params */
     ParamDef p; memset(&p,0,sizeof(p));
-    p.key = brz_strdup("x");
+    p.key = brz_cfg_intern(&cfg, "x");
     p.value = 3.14;
     p.has_svalue = false;
-    TEST_ASSERT(brz_vec_push(&cfg.params, &p));
+    TEST_ASSERT(brz_cfg_add_param(&cfg, &p));
 
     /* add some kinds */
     TEST_EQ_INT(kind_table_add(&cfg.resource_kinds, "fish"), 0);
@@ -79,9 +82,9 @@ static void test_cfg_free_clears_state(void)
 
     /* add vocation with empty blocks */
     VocationDef v; memset(&v,0,sizeof(v));
-    v.name = brz_strdup("v");
-    brz_vec_init(&v.tasks, sizeof(TaskDef));
-    brz_vec_init(&v.rules, sizeof(RuleDef));
+    v.name = brz_cfg_intern(&cfg, "v");
+    brz_vec_init_arena(&v.tasks, sizeof(TaskDef), &cfg.arena);
+    brz_vec_init_arena(&v.rules, sizeof(RuleDef), &cfg.arena);
     TEST_ASSERT(brz_vec_push(&cfg.vocations, &v));
 
     brz_cfg_free(&cfg);
@@ -94,9 +97,327 @@ static void test_cfg_free_clears_state(void)
     TEST_EQ_SIZE(kind_table_count(&cfg.item_kinds), 0);
 }
 
+static void test_cfg_intern(void)
+{
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    const char* a = brz_cfg_intern(&cfg, "grain");
+    const char* b = brz_cfg_intern_n(&cfg, "grain_renew", 5);
+    TEST_ASSERT(a != NULL);
+    TEST_ASSERT(a == b);
+    TEST_STREQ(b, "grain");
+    TEST_ASSERT(brz_cfg_intern(&cfg, "fish") != a);
+    TEST_ASSERT(brz_cfg_intern(&cfg, NULL) == NULL);
+
+    /* set_num keys live in the config too */
+    TEST_ASSERT(brz_cfg_set_num(&cfg, "sim_threads", 4));
+    const ParamDef* p = (const ParamDef*)brz_vec_cat(&cfg.params, 0);
+    TEST_ASSERT(p->key == brz_cfg_intern(&cfg, "sim_threads"));
+    brz_cfg_free(&cfg);
+}
+
+static StmtDef op_stmt(ParsedConfig* cfg, const char* verb)
+{
+    StmtDef st;
+    memset(&st, 0, sizeof(st));
+    st.kind = ST_OP;
+    st.as.op.op = brz_cfg_intern(cfg, verb);
+    return st;
+}
+
+static void test_cfg_add_vocation_packs(void)
+{
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+
+    /* build on the heap, as a caller without an arena would */
+    VocationDef v;
+    memset(&v, 0, sizeof(v));
+    v.name = brz_cfg_intern(&cfg, "smith");
+    brz_vec_init(&v.tasks, sizeof(TaskDef));
+    brz_vec_init(&v.rules, sizeof(RuleDef));
+
+    TaskDef t;
+    memset(&t, 0, sizeof(t));
+    t.name = brz_cfg_intern(&cfg, "work");
+    brz_vec_init(&t.stmts, sizeof(StmtDef));
+    StmtDef w;
+    memset(&w, 0, sizeof(w));
+    w.kind = ST_WHEN;
+    w.as.when_stmt.when_expr = brz_cfg_intern(&cfg, "hunger > 0.5");
+    brz_vec_init(&w.as.when_stmt.body, sizeof(StmtDef));
+    StmtDef g = op_stmt(&cfg, "gather");
+    TEST_ASSERT(brz_vec_push(&w.as.when_stmt.body, &g));
+    TEST_ASSERT(brz_vec_push(&t.stmts, &w));
+    StmtDef r = op_stmt(&cfg, "rest");
+    TEST_ASSERT(brz_vec_push(&t.stmts, &r));
+    TEST_ASSERT(brz_vec_push(&v.tasks, &t));
+
+    TaskDef t2;
+    memset(&t2, 0, sizeof(t2));
+    t2.name = brz_cfg_intern(&cfg, "idle");
+    brz_vec_init(&t2.stmts, sizeof(StmtDef));
+    TEST_ASSERT(brz_vec_push(&t2.stmts, &r));
+    TEST_ASSERT(brz_vec_push(&v.tasks, &t2));
+
+    RuleDef rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.name = brz_cfg_intern(&cfg, "r");
+    rule.when_expr = brz_cfg_intern(&cfg, "fatigue < 1");
+    rule.do_task = brz_cfg_intern(&cfg, "idle");
+    TEST_ASSERT(brz_vec_push(&v.rules, &rule));
+
+    TEST_ASSERT(brz_cfg_add_vocation(&cfg, &v));
+
+    /* the heap original can go right away */
+    brz_vec_destroy(&w.as.when_stmt.body);
+    brz_vec_destroy(&t.stmts);
+    brz_vec_destroy(&t2.stmts);
+    brz_vec_destroy(&v.tasks);
+    brz_vec_destroy(&v.rules);
+
+    TEST_EQ_SIZE(cfg.vocations.len, 1);
+    VocationDef* pv = (VocationDef*)brz_vec_at(&cfg.vocations, 0);
+    TEST_ASSERT(pv->tasks.arena == &cfg.arena);
+    TEST_EQ_SIZE(pv->tasks.cap, 2);
+    TEST_EQ_SIZE(pv->rules.cap, 1);
+    TaskDef* pt = (TaskDef*)brz_vec_at(&pv->tasks, 0);
+    TaskDef* pt2 = (TaskDef*)brz_vec_at(&pv->tasks, 1);
+    StmtDef* pw = (StmtDef*)brz_vec_at(&pt->stmts, 0);
+    TEST_EQ_SIZE(pt->stmts.len, 2);
+    TEST_EQ_SIZE(pw->as.when_stmt.body.len, 1);
+    TEST_STREQ(((StmtDef*)brz_vec_at(&pw->as.when_stmt.body, 0))->as.op.op, "gather");
+
+    /* rules, tasks, then statement lists in declaration order */
+    const char* rules = (const char*)pv->rules.data;
+    const char* tasks = (const char*)pv->tasks.data;
+    const char* s1 = (const char*)pt->stmts.data;
+    const char* body = (const char*)pw->as.when_stmt.body.data;
+    const char* s2 = (const char*)pt2->stmts.data;
+    TEST_ASSERT(rules < tasks && tasks < s1 && s1 < body && body < s2);
+    TEST_ASSERT((size_t)(s2 - rules) < 2 * sizeof(RuleDef) + 3 * sizeof(TaskDef) + 6 * sizeof(StmtDef));
+
+    /* compiled programs land in the arena too */
+    TEST_ASSERT(brz_cfg_link(&cfg));
+    TEST_ASSERT(pw->as.when_stmt.prog.len > 0);
+    RuleDef* pr = (RuleDef*)brz_vec_at(&pv->rules, 0);
+    TEST_ASSERT(pr->task == pt2);
+    TEST_ASSERT(pr->when_prog.len > 0);
+    brz_cfg_free(&cfg);
+}
+
+static bool add_num(ParsedConfig* cfg, const char* key, double v)
+{
+    ParamDef p;
+    memset(&p, 0, sizeof(p));
+    p.key = brz_cfg_intern(cfg, key);
+    p.value = v;
+    return brz_cfg_add_param(cfg, &p);
+}
+
+static void test_param_table(void)
+{
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(brz_cfg_param(&cfg, "x") == NULL);
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "x", 7), 7);
+
+    TEST_ASSERT(add_num(&cfg, "sim_days", 12.5));
+    TEST_ASSERT(add_num(&cfg, "fish_renew", 0.08));
+    TEST_ASSERT(add_num(&cfg, "sim_days", 99));  /* duplicate: the first one wins */
+    ParamDef s;
+    memset(&s, 0, sizeof(s));
+    s.key = brz_cfg_intern(&cfg, "sim_regen");
+    s.has_svalue = true;
+    s.svalue = brz_cfg_intern(&cfg, "dense");
+    TEST_ASSERT(brz_cfg_add_param(&cfg, &s));
+
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "sim_days", 0), 13);
+    TEST_ASSERT(brz_cfg_get_num(&cfg, "sim_days", 0) == 12.5);
+    TEST_ASSERT(brz_cfg_get_num(&cfg, "fish_renew", 0) == 0.08);
+    TEST_ASSERT(brz_cfg_param_cat(&cfg, "fish", "_renew") == brz_cfg_param(&cfg, "fish_renew"));
+    TEST_ASSERT(brz_cfg_param_cat(&cfg, "fis", "h_renew") != NULL);
+    TEST_ASSERT(brz_cfg_param_cat(&cfg, "fish", "_renewx") == NULL);
+    TEST_ASSERT(brz_cfg_param_cat(&cfg, "fish_renew", NULL) != NULL);
+
+    /* the wrong type gives the default */
+    TEST_STREQ(brz_cfg_get_str(&cfg, "sim_regen", "sparse"), "dense");
+    TEST_STREQ(brz_cfg_get_str(&cfg, "sim_days", "none"), "none");
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "sim_regen", -1), -1);
+
+    /* one rounding rule everywhere: nearest, halves up, clamped */
+    TEST_ASSERT(add_num(&cfg, "a", 2.4));
+    TEST_ASSERT(add_num(&cfg, "b", -0.5));
+    TEST_ASSERT(add_num(&cfg, "c", -2.6));
+    TEST_ASSERT(add_num(&cfg, "d", 1e30));
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "a", 0), 2);
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "b", 9), 0);
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "c", 0), -3);
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "d", 0), INT32_MAX);
+
+    /* set_num updates the indexed entry or adds a new one */
+    TEST_ASSERT(brz_cfg_set_num(&cfg, "sim_days", 30));
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "sim_days", 0), 30);
+    TEST_ASSERT(brz_cfg_set_num(&cfg, "sim_regen", 1));
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "sim_regen", 0), 1);
+    size_t before = cfg.params.len;
+    TEST_ASSERT(brz_cfg_set_num(&cfg, "sim_threads", 4));
+    TEST_EQ_SIZE(cfg.params.len, before + 1);
+
+    /* many keys: the index grows and every key stays reachable */
+    char key[32];
+    int missing = 0;
+    for(int i=0;i<300;i++){ snprintf(key, sizeof(key), "k%d", i); if(!add_num(&cfg, key, i)) missing++; }
+    for(int i=0;i<300;i++)
+    {
+        snprintf(key, sizeof(key), "k%d", i);
+        if(brz_cfg_get_int(&cfg, key, -1) != i) missing++;
+    }
+    TEST_EQ_INT(missing, 0);
+
+    /* entries pushed directly are found after a reindex */
+    ParamDef raw;
+    memset(&raw, 0, sizeof(raw));
+    raw.key = brz_cfg_intern(&cfg, "raw");
+    raw.value = 5;
+    TEST_ASSERT(brz_vec_push(&cfg.params, &raw));
+    TEST_ASSERT(brz_cfg_reindex_params(&cfg));
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "raw", 0), 5);
+    TEST_EQ_INT(brz_cfg_get_int(&cfg, "sim_days", 0), 30);
+    brz_cfg_free(&cfg);
+}
+
+static void push_rule(ParsedConfig* cfg, VocationDef* v, const char* when, int weight)
+{
+    RuleDef r;
+    memset(&r, 0, sizeof(r));
+    r.name = brz_cfg_intern(cfg, "r");
+    r.when_expr = brz_cfg_intern(cfg, when);
+    r.do_task = brz_cfg_intern(cfg, "");
+    r.weight = weight;
+    TEST_ASSERT(brz_vec_push(&v->rules, &r));
+}
+
+/* The alias table of the always-matching rules keeps their weights:
+   exactly in the table, and in the frequencies it samples. */
+static void test_always_alias_table(void)
+{
+    static const int weights[] = { 1, 7, 2, 0, 12, 3, 1, 5 };
+    const size_t wn = sizeof(weights) / sizeof(weights[0]);
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    VocationDef v;
+    memset(&v, 0, sizeof(v));
+    v.name = brz_cfg_intern(&cfg, "herder");
+    brz_vec_init(&v.tasks, sizeof(TaskDef));
+    brz_vec_init(&v.rules, sizeof(RuleDef));
+    push_rule(&cfg, &v, "hunger > 0.5", 4);   /* box: not in the table */
+    for(size_t i=0;i<wn;i++) push_rule(&cfg, &v, "", weights[i]);
+    push_rule(&cfg, &v, "hunger", 2);         /* has to run */
+    TEST_ASSERT(brz_cfg_add_vocation(&cfg, &v));
+    brz_vec_destroy(&v.tasks);
+    brz_vec_destroy(&v.rules);
+    TEST_ASSERT(brz_cfg_link(&cfg));
+
+    const VocationDef* pv = (const VocationDef*)brz_vec_cat(&cfg.vocations, 0);
+    TEST_EQ_SIZE(pv->always.len, wn);
+    TEST_EQ_SIZE(pv->run_rules.len, 1);
+    TEST_EQ_INT(*(const uint32_t*)pv->run_rules.data, (int)wn + 1);
+    double total = 0;
+    for(size_t i=0;i<wn;i++) total += weights[i] > 0 ? weights[i] : 1;
+    TEST_ASSERT(pv->always_w == total);
+
+    /* mass of each rule over the columns */
+    double mass[16] = { 0 };
+    const BrzRuleAlias* t = (const BrzRuleAlias*)pv->always.data;
+    int bad = 0;
+    for(size_t c=0;c<wn;c++)
+    {
+        if(t[c].prob < 0.0 || t[c].prob > 1.0) bad++;
+        if(t[c].rule < 1 || t[c].rule > wn || t[c].alias < 1 || t[c].alias > wn){ bad++; continue; }
+        mass[t[c].rule] += t[c].prob / (double)wn;
+        mass[t[c].alias] += (1.0 - t[c].prob) / (double)wn;
+    }
+    TEST_EQ_INT(bad, 0);
+    for(size_t i=0;i<wn;i++)
+    {
+        double want = (weights[i] > 0 ? weights[i] : 1) / total;
+        if(fabs(mass[i + 1] - want) > 1e-12) bad++;
+    }
+    TEST_EQ_INT(bad, 0);
+
+    /* sampled on an even grid of draws, the frequencies match too */
+    const uint32_t steps = 1u << 20;
+    uint32_t hits[16] = { 0 };
+    for(uint32_t k=0;k<steps;k++)
+    {
+        uint32_t ri = brz_voc_sample_always(pv, k << 12);
+        if(ri < 16) hits[ri]++;
+    }
+    for(size_t i=0;i<wn;i++)
+    {
+        double want = (weights[i] > 0 ? weights[i] : 1) / total;
+        if(fabs((double)hits[i + 1] / steps - want) > 1e-4) bad++;
+    }
+    TEST_EQ_INT(hits[0] + hits[wn + 1], 0);
+    TEST_EQ_INT(bad, 0);
+
+    /* a single always rule takes every draw */
+    brz_cfg_free(&cfg);
+    brz_cfg_init(&cfg);
+    memset(&v, 0, sizeof(v));
+    v.name = brz_cfg_intern(&cfg, "potter");
+    brz_vec_init(&v.tasks, sizeof(TaskDef));
+    brz_vec_init(&v.rules, sizeof(RuleDef));
+    push_rule(&cfg, &v, "fatigue < 0.2", 1);
+    push_rule(&cfg, &v, "", 3);
+    TEST_ASSERT(brz_cfg_add_vocation(&cfg, &v));
+    brz_vec_destroy(&v.tasks);
+    brz_vec_destroy(&v.rules);
+    TEST_ASSERT(brz_cfg_link(&cfg));
+    pv = (const VocationDef*)brz_vec_cat(&cfg.vocations, 0);
+    TEST_EQ_SIZE(pv->always.len, 1);
+    TEST_EQ_INT(brz_voc_sample_always(pv, 0u), 1);
+    TEST_EQ_INT(brz_voc_sample_always(pv, 0xFFFFFFFFu), 1);
+    brz_cfg_free(&cfg);
+}
+
+/* always-matching rules per vocation in a shipped config: -1 when the
+   vocations disagree */
+static int shipped_always(const char* path)
+{
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    int n = -2;
+    if(brz_parse_file(path, &cfg))
+    {
+        for(size_t i=0;i<cfg.vocations.len;i++)
+        {
+            const VocationDef* v = (const VocationDef*)brz_vec_cat(&cfg.vocations, i);
+            if(n == -2) n = (int)v->always.len;
+            else if(n != (int)v->always.len) n = -1;
+        }
+    }
+    brz_cfg_free(&cfg);
+    return n;
+}
+
+/* example.bronze has no always-matching rule; example_large.bronze has
+   exactly one per vocation, where the table draw equals the old walk */
+static void test_shipped_always_rules(void)
+{
+    TEST_EQ_INT(shipped_always("../example.bronze"), 0);
+    TEST_EQ_INT(shipped_always("../example_large.bronze"), 1);
+}
+
 void test_dsl_run(void)
 {
     test_cfg_init_defaults();
     test_voc_find_task();
     test_cfg_free_clears_state();
+    test_cfg_intern();
+    test_cfg_add_vocation_packs();
+    test_param_table();
+    test_always_alias_table();
+    test_shipped_always_rules();
 }
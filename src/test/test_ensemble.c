@@ -0,0 +1,93 @@
+#include "test_common.h"
+#include "../brz_ensemble.h"
+#include "../brz_parser.h"
+#include "../brz_sim.h"
+#include <math.h>
+
+static const char* k_src =
+    "sim { days 12 map_w 32 map_h 20 }\n"
+    "agents { count 30 }\n"
+    "settlements { count 2 }\n"
+    "kinds { resources { grain fish } items { pottery } }\n"
+    "resources { report_every 5 }\n"
+    "vocations {\n"
+    "  vocation farmer {\n"
+    "    task farm { move field gather grain 2 }\n"
+    "    task nap { rest }\n"
+    "    rule tired { when fatigue > 0.6 do nap }\n"
+    "    rule work { when hunger > 0 do farm }\n"
+    "  }\n"
+    "}\n";
+
+static bool load_cfg(const char* s, ParsedConfig* cfg)
+{
+    char* path = brz_test_write_temp("brz_ens_", s);
+    if(!path) return false;
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+static bool stop_at_day(void* ctx, BrzSim* sim)
+{
+    return sim->day < *(const int*)ctx;
+}
+
+static void test_members_match_single_runs(void)
+{
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(k_src, &cfg));
+
+    BrzEnsembleStats a, b;
+    TEST_ASSERT(brz_ensemble_collect(&a, &cfg, 5, 9, 1));
+    TEST_ASSERT(brz_ensemble_collect(&b, &cfg, 5, 9, 3));
+    TEST_EQ_INT(a.run_n, 5);
+    TEST_EQ_INT(a.failed_n, 0);
+    TEST_EQ_INT(a.day_n, 4); /* days 1, 5, 10, 12 */
+    TEST_EQ_INT(a.days[2], 10);
+    TEST_EQ_INT(a.metric_n, 5);
+    TEST_STREQ(a.metric_names[3], "fish");
+
+    /* independent of the job count */
+    size_t n = (size_t)a.run_n * (size_t)a.day_n * (size_t)a.metric_n;
+    TEST_ASSERT(memcmp(a.values, b.values, n*sizeof(double)) == 0);
+
+    /* member for seed 7 is the run a config with seed 7 makes, at day 10 */
+    BrzSim sim;
+    TEST_EQ_INT(brz_sim_init_seed(&sim, &cfg, 7), 0);
+    int stop = 10;
+    TEST_EQ_INT(brz_sim_run_days(&sim, 12, 0, stop_at_day, &stop), 0);
+    TEST_EQ_INT(sim.day, 10);
+    double hunger = 0, grain = 0;
+    for(int i=0;i<sim.agents.n;i++){ hunger += sim.agents.hunger[i]; grain += brz_agents_res(&sim.agents, i)[0]; }
+    hunger /= sim.agents.n;
+    const double* row = a.values + ((size_t)2*a.day_n + 2) * (size_t)a.metric_n;
+    TEST_ASSERT(row[0] == brz_agents_total_hunger(&sim.agents) / sim.agents.n);
+    TEST_ASSERT(row[2] == brz_agents_total_res(&sim.agents, 0));
+    /* the running totals agree with a recount up to rounding */
+    TEST_ASSERT(fabs(row[0] - hunger) < 1e-9);
+    TEST_ASSERT(fabs(row[2] - grain) < 1e-6);
+    brz_sim_free(&sim);
+
+    /* table: header lines plus one row per (day, metric) */
+    FILE* f = tmpfile();
+    TEST_ASSERT(f != NULL);
+    TEST_ASSERT(brz_ensemble_write_table(&a, f));
+    rewind(f);
+    char line[256];
+    int lines = 0;
+    while(fgets(line, sizeof(line), f)) lines++;
+    fclose(f);
+    TEST_EQ_INT(lines, 2 + a.day_n * a.metric_n);
+
+    brz_ensemble_free(&a);
+    brz_ensemble_free(&b);
+    brz_cfg_free(&cfg);
+}
+
+void test_ensemble_run(void)
+{
+    test_members_match_single_runs();
+}
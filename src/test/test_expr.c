@@ -0,0 +1,202 @@
+#include "test_common.h"
+#include "../brz_expr.h"
+#include <math.h>
+
+static int eval_hf(const char* src, double hunger, double fatigue)
+{
+    BrzExpr e;
+    char err[128];
+    if(!brz_expr_compile(&e, src, err, sizeof(err))) return -1;
+    double vars[BRZ_EXPR_VAR_COUNT] = { hunger, fatigue };
+    BrzRng rng; brz_rng_seed(&rng, 1u);
+    int v = brz_expr_eval(&e, vars, &rng);
+    brz_expr_free(&e);
+    return v;
+}
+
+static void test_empty_is_true(void)
+{
+    TEST_EQ_INT(eval_hf("", 0.0, 0.0), 1);
+    TEST_EQ_INT(eval_hf("   ", 0.0, 0.0), 1);
+    TEST_EQ_INT(eval_hf(NULL, 0.0, 0.0), 1);
+}
+
+static void test_comparisons(void)
+{
+    TEST_EQ_INT(eval_hf("hunger > 0.5", 0.6, 0.0), 1);
+    TEST_EQ_INT(eval_hf("hunger > 0.5", 0.5, 0.0), 0);
+    TEST_EQ_INT(eval_hf("hunger >= 0.5", 0.5, 0.0), 1);
+    TEST_EQ_INT(eval_hf("fatigue < 0.9", 0.0, 0.89), 1);
+    TEST_EQ_INT(eval_hf("fatigue <= 0.9", 0.0, 0.9), 1);
+    TEST_EQ_INT(eval_hf("fatigue == 0.25", 0.0, 0.25), 1);
+    TEST_EQ_INT(eval_hf("fatigue != 0.25", 0.0, 0.25), 0);
+    TEST_EQ_INT(eval_hf("( hunger > 0.1 )", 0.2, 0.0), 1);
+
+    /* bare identifier is a truthy test */
+    TEST_EQ_INT(eval_hf("hunger", 0.2, 0.0), 1);
+    TEST_EQ_INT(eval_hf("hunger", 0.0, 0.0), 0);
+}
+
+static void test_unknown_vars_fold_to_zero(void)
+{
+    BrzExpr e;
+    char err[128];
+    TEST_ASSERT(brz_expr_compile(&e, "grain < 2", err, sizeof(err)));
+    TEST_EQ_INT(e.len, 1);
+    TEST_EQ_INT(e.code[0].op, BRZ_XOP_TRUE);
+    TEST_EQ_INT(err[0], 0);
+    brz_expr_free(&e);
+
+    TEST_EQ_INT(eval_hf("true", 1.0, 1.0), 0);
+    TEST_EQ_INT(eval_hf("grain > 2", 1.0, 1.0), 0);
+}
+
+static void test_and_or(void)
+{
+    TEST_EQ_INT(eval_hf("hunger > 0.25 and fatigue < 0.90", 0.3, 0.5), 1);
+    TEST_EQ_INT(eval_hf("hunger > 0.25 and fatigue < 0.90", 0.3, 0.95), 0);
+    TEST_EQ_INT(eval_hf("hunger > 0.25 and fatigue < 0.90", 0.1, 0.5), 0);
+
+    TEST_EQ_INT(eval_hf("hunger > 0.9 or fatigue > 0.9", 0.95, 0.0), 1);
+    TEST_EQ_INT(eval_hf("hunger > 0.9 or fatigue > 0.9", 0.0, 0.95), 1);
+    TEST_EQ_INT(eval_hf("hunger > 0.9 or fatigue > 0.9", 0.0, 0.0), 0);
+
+    /* a false atom followed by 'and' rejects the whole expression,
+       even when a later 'or' branch would hold (runtime-compatible) */
+    TEST_EQ_INT(eval_hf("hunger > 0.9 and fatigue > 0.9 or hunger < 0.5", 0.1, 0.0), 0);
+    /* ...but a false last atom falls through to the next branch */
+    TEST_EQ_INT(eval_hf("hunger > 0.05 and fatigue > 0.9 or hunger < 0.5", 0.1, 0.0), 1);
+}
+
+static void test_chance_consumes_rng(void)
+{
+    BrzExpr e;
+    char err[128];
+    TEST_ASSERT(brz_expr_compile(&e, "chance ( 0.3 )", err, sizeof(err)));
+    TEST_EQ_INT(err[0], 0);
+    TEST_EQ_INT(e.len, 1);
+    TEST_EQ_INT(e.code[0].thresh, 3000);
+
+    double vars[BRZ_EXPR_VAR_COUNT] = { 0.0, 0.0 };
+    BrzRng a, b;
+    brz_rng_seed(&a, 77u);
+    brz_rng_seed(&b, 77u);
+    for(int i=0;i<100;i++)
+    {
+        int expect = (int)(brz_rng_u32(&b)%10000u) < 3000;
+        TEST_EQ_INT(brz_expr_eval(&e, vars, &a), expect);
+    }
+    brz_expr_free(&e);
+
+    /* short-circuited chance does not draw */
+    TEST_ASSERT(brz_expr_compile(&e, "hunger > 0.5 and chance 0.5", err, sizeof(err)));
+    brz_rng_seed(&a, 5u);
+    brz_rng_seed(&b, 5u);
+    TEST_EQ_INT(brz_expr_eval(&e, vars, &a), 0);
+    TEST_EQ_INT(brz_rng_u32(&a), brz_rng_u32(&b));
+    brz_expr_free(&e);
+}
+
+static void test_errors_reported(void)
+{
+    BrzExpr e;
+    char err[128];
+
+    TEST_ASSERT(brz_expr_compile(&e, "fatigue < 0.90 and prob 0.25", err, sizeof(err)));
+    TEST_ASSERT(err[0] != 0);
+    TEST_ASSERT(strstr(err, "0.25") != NULL);
+    brz_expr_free(&e);
+
+    TEST_ASSERT(brz_expr_compile(&e, "hunger <", err, sizeof(err)));
+    TEST_ASSERT(err[0] != 0);
+    brz_expr_free(&e);
+
+    TEST_ASSERT(brz_expr_compile(&e, ">= 3", err, sizeof(err)));
+    TEST_ASSERT(err[0] != 0);
+    brz_expr_free(&e);
+
+    TEST_ASSERT(brz_expr_compile(&e, "hunger < 0.5 or fatigue > 0.1", err, sizeof(err)));
+    TEST_EQ_INT(err[0], 0);
+    TEST_EQ_INT(e.len, 2);
+    brz_expr_free(&e);
+}
+
+static BrzExprShape shape_of(const char* src, BrzExprBox* box)
+{
+    BrzExpr e;
+    char err[128];
+    if(!brz_expr_compile(&e, src, err, sizeof(err))) return (BrzExprShape)-1;
+    BrzExprShape s = brz_expr_shape(&e, box);
+    brz_expr_free(&e);
+    return s;
+}
+
+static void test_shape(void)
+{
+    BrzExprBox b;
+    TEST_EQ_INT(shape_of("", &b), BRZ_EXPR_SHAPE_ALWAYS);
+    TEST_EQ_INT(shape_of("grain < 2", &b), BRZ_EXPR_SHAPE_ALWAYS);
+    TEST_EQ_INT(shape_of("grain > 2", &b), BRZ_EXPR_SHAPE_NEVER);
+    TEST_EQ_INT(shape_of("hunger > 0.8 and hunger < 0.2", &b), BRZ_EXPR_SHAPE_NEVER);
+    TEST_EQ_INT(shape_of("chance(0.3)", &b), BRZ_EXPR_SHAPE_OPAQUE);
+    TEST_EQ_INT(shape_of("hunger > 0.5 or fatigue > 0.2", &b), BRZ_EXPR_SHAPE_OPAQUE);
+    TEST_EQ_INT(shape_of("hunger", &b), BRZ_EXPR_SHAPE_OPAQUE);
+
+    TEST_EQ_INT(shape_of("hunger > 0.5 and fatigue <= 0.3", &b), BRZ_EXPR_SHAPE_BOX);
+    TEST_ASSERT(b.lo[BRZ_EXPR_VAR_HUNGER] == 0.5 && b.lo_open[BRZ_EXPR_VAR_HUNGER]);
+    TEST_ASSERT(b.hi[BRZ_EXPR_VAR_HUNGER] == HUGE_VAL);
+    TEST_ASSERT(b.hi[BRZ_EXPR_VAR_FATIGUE] == 0.3 && !b.hi_open[BRZ_EXPR_VAR_FATIGUE]);
+    TEST_ASSERT(b.lo[BRZ_EXPR_VAR_FATIGUE] == -HUGE_VAL);
+
+    /* the tighter of two bounds wins */
+    TEST_EQ_INT(shape_of("hunger >= 0.2 and hunger > 0.4 and hunger < 0.9", &b), BRZ_EXPR_SHAPE_BOX);
+    TEST_ASSERT(b.lo[BRZ_EXPR_VAR_HUNGER] == 0.4 && b.lo_open[BRZ_EXPR_VAR_HUNGER]);
+    TEST_ASSERT(b.hi[BRZ_EXPR_VAR_HUNGER] == 0.9 && b.hi_open[BRZ_EXPR_VAR_HUNGER]);
+
+    /* comparisons ahead of a chance() still guard it */
+    TEST_EQ_INT(shape_of("hunger > 0.5 and chance(0.3)", &b), BRZ_EXPR_SHAPE_GUARDED);
+    TEST_ASSERT(b.lo[BRZ_EXPR_VAR_HUNGER] == 0.5);
+}
+
+/* a BOX program and its box agree everywhere, boundaries included */
+static void test_shape_box_matches_eval(void)
+{
+    static const char* srcs[] = {
+        "hunger > 0.5 and fatigue <= 0.3",
+        "hunger >= 0.25",
+        "fatigue < 0.75 and hunger <= 0.5 and hunger > 0.25",
+        "fatigue == 0.5",
+    };
+    static const double pts[] = { 0.0, 0.25, 0.3, 0.5, 0.75, 1.0 };
+    BrzRng rng; brz_rng_seed(&rng, 9u);
+    int bad = 0;
+    for(size_t s=0; s<sizeof(srcs)/sizeof(srcs[0]); s++)
+    {
+        BrzExpr e;
+        BrzExprBox b;
+        char err[128];
+        TEST_ASSERT(brz_expr_compile(&e, srcs[s], err, sizeof(err)));
+        TEST_EQ_INT(brz_expr_shape(&e, &b), BRZ_EXPR_SHAPE_BOX);
+        for(int i=0;i<400;i++)
+        {
+            double vars[BRZ_EXPR_VAR_COUNT];
+            for(int v=0; v<BRZ_EXPR_VAR_COUNT; v++)
+                vars[v] = (i < 36) ? pts[(v ? i / 6 : i) % 6] : (double)(brz_rng_u32(&rng) % 1001u) / 1000.0;
+            if(brz_expr_box_holds(&b, vars) != (brz_expr_eval(&e, vars, &rng) != 0)) bad++;
+        }
+        brz_expr_free(&e);
+    }
+    TEST_EQ_INT(bad, 0);
+}
+
+void test_expr_run(void)
+{
+    test_empty_is_true();
+    test_comparisons();
+    test_unknown_vars_fold_to_zero();
+    test_and_or();
+    test_chance_consumes_rng();
+    test_errors_reported();
+    test_shape();
+    test_shape_box_matches_eval();
+}
@@ -0,0 +1,131 @@
+#include "test_common.h"
+#include "../brz_frame.h"
+#include "../brz_parser.h"
+#include "../brz_sim.h"
+#include <pthread.h>
+
+static const char* k_src =
+    "sim { seed 3 map_w 30 map_h 20 }\n"
+    "agents { count 40 }\n"
+    "settlements { count 2 }\n"
+    "kinds { resources { grain } }\n"
+    "vocations {\n"
+    "  vocation farmer { task farm { move_to field gather grain 2 } rule r { when hunger > 0.1 do farm } }\n"
+    "  vocation idler { task nap { rest } rule r { when fatigue > 0.5 do nap } }\n"
+    "}\n";
+
+static bool make_sim(ParsedConfig* cfg, BrzSim* sim)
+{
+    char* path = brz_test_write_temp("brz_frame_", k_src);
+    if(!path) return false;
+    brz_cfg_init(cfg);
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok && brz_sim_init(sim, cfg) == 0;
+}
+
+static void test_capture(void)
+{
+    ParsedConfig cfg;
+    BrzSim sim;
+    TEST_ASSERT(make_sim(&cfg, &sim));
+    BrzFrameChannel ch;
+    TEST_EQ_INT(brz_frames_init(&ch, &sim), 0);
+
+    const BrzFrame* f = brz_frames_latest(&ch);
+    TEST_EQ_INT(f->day, -1);
+    TEST_ASSERT(f != brz_frames_back(&ch));
+
+    TEST_EQ_INT(brz_sim_run_days(&sim, 5, 0, NULL, NULL), 0);
+    BrzFrame* b = brz_frames_back(&ch);
+    brz_frame_capture(b, &sim);
+    brz_frames_publish(&ch);
+    TEST_ASSERT(brz_frames_back(&ch) != b);
+    f = brz_frames_latest(&ch);
+    TEST_ASSERT(f == b);
+    TEST_EQ_INT(f->day, 5);
+    TEST_EQ_INT(f->agent_n, 40);
+    TEST_ASSERT(memcmp(f->agent_pos, sim.agents.pos, 40 * sizeof(BrzPos)) == 0);
+    TEST_ASSERT(memcmp(f->agent_voc, sim.agents.voc, 40 * sizeof(uint32_t)) == 0);
+    TEST_ASSERT(memcmp(f->tags, sim.world.tags, 30 * 20 * sizeof(uint16_t)) == 0);
+    TEST_ASSERT(brz_frames_latest(&ch) == f); /* nothing newer */
+
+    /* two publishes before the viewer looks: it gets the second */
+    for(int d=6; d<=7; d++){
+        sim.day = d;
+        brz_frame_capture(brz_frames_back(&ch), &sim);
+        brz_frames_publish(&ch);
+    }
+    f = brz_frames_latest(&ch);
+    TEST_EQ_INT(f->day, 7);
+
+    /* tags are copied only when the world's changed */
+    BrzFrame* t = brz_frames_back(&ch);
+    brz_frame_capture(t, &sim);
+    t->tags[0] = 0xFFFFu;
+    brz_frame_capture(t, &sim);
+    TEST_EQ_INT(t->tags[0], 0xFFFF);
+    brz_world_set_tags(&sim.world, 1, 0, (uint16_t)(sim.world.tags[1] ^ BRZ_TAG_FIRE));
+    brz_frame_capture(t, &sim);
+    TEST_ASSERT(memcmp(t->tags, sim.world.tags, 30 * 20 * sizeof(uint16_t)) == 0);
+
+    brz_frames_free(&ch);
+    brz_sim_free(&sim);
+    brz_cfg_free(&cfg);
+}
+
+/* the writer fills every position of frame k with k; a torn or reused
+   frame would show mixed values */
+typedef struct {
+    BrzFrameChannel* ch;
+    int last;
+} Writer;
+
+static void* writer_main(void* p)
+{
+    Writer* w = (Writer*)p;
+    for(int k=1; k<=w->last; k++){
+        BrzFrame* f = brz_frames_back(w->ch);
+        for(int i=0;i<f->agent_n;i++){ f->agent_pos[i].x = k; f->agent_pos[i].y = -k; }
+        f->day = k;
+        brz_frames_publish(w->ch);
+    }
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    ParsedConfig cfg;
+    BrzSim sim;
+    TEST_ASSERT(make_sim(&cfg, &sim));
+    BrzFrameChannel ch;
+    TEST_EQ_INT(brz_frames_init(&ch, &sim), 0);
+    for(int k=0;k<3;k++) ch.frame[k].agent_n = sim.agents.n;
+
+    Writer w = { &ch, 20000 };
+    pthread_t th;
+    TEST_EQ_INT(pthread_create(&th, NULL, writer_main, &w), 0);
+    int prev = -1, torn = 0, backwards = 0;
+    for(;;){
+        const BrzFrame* f = brz_frames_latest(&ch);
+        if(f->day < prev) backwards++;
+        for(int i=0;i<f->agent_n && f->day > 0;i++)
+            if(f->agent_pos[i].x != f->day || f->agent_pos[i].y != -f->day){ torn++; break; }
+        prev = f->day;
+        if(prev == w.last) break;
+    }
+    pthread_join(th, NULL);
+    TEST_EQ_INT(torn, 0);
+    TEST_EQ_INT(backwards, 0);
+
+    brz_frames_free(&ch);
+    brz_sim_free(&sim);
+    brz_cfg_free(&cfg);
+}
+
+void test_frame_run(void)
+{
+    test_capture();
+    test_threads();
+}
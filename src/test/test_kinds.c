@@ -77,6 +77,41 @@ static void test_many_adds_and_order(void)
     kind_table_destroy(&kt);
 }
 
+static void test_index_growth(void)
+{
+    KindTable kt;
+    kind_table_init(&kt);
+
+    /* enough names to force several rehashes */
+    char buf[32];
+    const int n = 5000;
+    int bad = 0;
+    for(int i=0;i<n;i++)
+    {
+        snprintf(buf, sizeof(buf), "kind_%d", i);
+        if(kind_table_add(&kt, buf) != i) bad++;
+    }
+    TEST_EQ_INT(bad, 0);
+    TEST_EQ_SIZE(kind_table_count(&kt), (size_t)n);
+    TEST_ASSERT(kt.index_cap >= (size_t)n * 2);
+
+    bad = 0;
+    for(int i=0;i<n;i++)
+    {
+        snprintf(buf, sizeof(buf), "kind_%d", i);
+        if(kind_table_find(&kt, buf) != i) bad++;
+        if(kind_table_add(&kt, buf) != i) bad++;
+    }
+    TEST_EQ_INT(bad, 0);
+    TEST_EQ_SIZE(kind_table_count(&kt), (size_t)n);
+    TEST_EQ_INT(kind_table_find(&kt, "kind_5000"), -1);
+    TEST_EQ_INT(kind_table_find(&kt, ""), -1);
+    TEST_STREQ(kind_table_name(&kt, 4999), "kind_4999");
+
+    kind_table_destroy(&kt);
+    TEST_EQ_SIZE(kind_table_count(&kt), 0);
+}
+
 static void test_null_inputs(void)
 {
     KindTable kt;
@@ -97,5 +132,6 @@ void test_kinds_run(void)
     test_add_find_name();
     test_duplicate_returns_existing();
     test_many_adds_and_order();
+    test_index_growth();
     test_null_inputs();
 }
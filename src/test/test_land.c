@@ -1,6 +1,7 @@
 
 #include "test_common.h"
 #include "../brz_land.h"
+#include <pthread.h>
 
 static void test_basic_generation_and_range(void)
 {
@@ -113,6 +114,126 @@ static void test_edge_samples_stable(void)
     TEST_EQ_INT(br, brz_land_height_at(&land, -1, -1));
 }
 
+static uint32_t topo_hash(const BrzLand* land)
+{
+    uint32_t h = 2166136261u;
+    for(int i=0;i<BRZ_LAND_DIM*BRZ_LAND_DIM;i++){ h ^= land->topo[i]; h *= 16777619u; }
+    return h;
+}
+
+static void test_matches_reference_generator(void)
+{
+    /* hashes of buffer 0 from the original per-pixel land.c smoothing */
+    static BrzLand land;
+    brz_land_seed(&land, 1, 2);
+    brz_land_generate(&land);
+    TEST_ASSERT(topo_hash(&land) == 0x60bb3fbfu);
+    brz_land_seed(&land, 65535, 65535);
+    brz_land_generate(&land);
+    TEST_ASSERT(topo_hash(&land) == 0x0bae7f89u);
+}
+
+static void test_cache_round_trip(void)
+{
+    static BrzLand fresh, a, b;
+    const char* tmpdir = getenv("TMPDIR");
+    if(!tmpdir) tmpdir = "/tmp";
+    char path[512];
+    snprintf(path, sizeof(path), "%s/land_v%u_%d_%d.brzland", tmpdir, BRZ_LAND_GEN_VERSION, 4242, 77);
+    brz_test_unlink(path);
+
+    brz_land_seed(&fresh, 4242, 77);
+    brz_land_generate(&fresh);
+
+    brz_land_set_cache_dir(tmpdir);
+    TEST_ASSERT(!brz_land_build(&a, 4242, 77)); /* miss: generates and stores */
+    TEST_ASSERT(brz_land_build(&b, 4242, 77));  /* hit */
+    TEST_ASSERT(memcmp(fresh.topo, a.topo, sizeof(fresh.topo)) == 0);
+    TEST_ASSERT(memcmp(fresh.topo, b.topo, sizeof(fresh.topo)) == 0);
+    TEST_EQ_INT(b.genetics[0], fresh.genetics[0]);
+    TEST_EQ_INT(b.genetics[1], fresh.genetics[1]);
+
+    /* a damaged entry is ignored and regenerated */
+    FILE* f = fopen(path, "r+b");
+    TEST_ASSERT(f != NULL);
+    if(f){ fseek(f, 100, SEEK_SET); fputc(0x5a, f); fseek(f, 1000, SEEK_SET); fputc(0xa5, f); fclose(f); }
+    memset(&b, 0, sizeof(b));
+    TEST_ASSERT(!brz_land_build(&b, 4242, 77));
+    TEST_ASSERT(memcmp(fresh.topo, b.topo, sizeof(fresh.topo)) == 0);
+
+    brz_land_set_cache_dir(NULL);
+    TEST_ASSERT(!brz_land_build(&b, 4242, 77));
+    brz_test_unlink(path);
+}
+
+static void test_shared_maps(void)
+{
+    static BrzLand fresh;
+    brz_land_seed(&fresh, 31, 41);
+    brz_land_generate(&fresh);
+
+    const BrzLand* a = brz_land_acquire(31, 41);
+    const BrzLand* b = brz_land_acquire(31, 41);
+    const BrzLand* c = brz_land_acquire(41, 31);
+    TEST_ASSERT(a != NULL && c != NULL);
+    TEST_ASSERT(a == b);
+    TEST_ASSERT(a != c);
+    TEST_ASSERT(memcmp(a->topo, fresh.topo, BRZ_LAND_DIM*BRZ_LAND_DIM) == 0);
+
+    /* row lookup agrees with the wrapping sampler */
+    TEST_EQ_INT(brz_land_row(a, -1)[5], brz_land_height_at(a, 5, BRZ_LAND_DIM-1));
+    TEST_EQ_INT(brz_land_row(a, 700)[300], brz_land_height_at(a, 300, 700));
+
+    brz_land_release(a);
+    brz_land_release(c);
+    /* still held by b */
+    TEST_ASSERT(brz_land_acquire(31, 41) == b);
+    brz_land_release(b);
+    brz_land_release(b);
+    /* the last dropped map is kept for a reload with the same seed */
+    const BrzLand* d = brz_land_acquire(31, 41);
+    TEST_ASSERT(d == a);
+    brz_land_release(d);
+}
+
+typedef struct {
+    int r1, r2;
+    const BrzLand* got;
+} AcquireJob;
+
+static void* acquire_main(void* arg)
+{
+    AcquireJob* j = (AcquireJob*)arg;
+    j->got = brz_land_acquire(j->r1, j->r2);
+    return NULL;
+}
+
+/* maps are built outside the registry lock: different seeds build side by
+   side while callers for a seed that is still building wait for it */
+static void test_shared_maps_concurrent(void)
+{
+    static BrzLand fresh;
+    brz_land_seed(&fresh, 57, 9);
+    brz_land_generate(&fresh);
+
+    AcquireJob jobs[6] = { {57, 9, NULL}, {9, 57, NULL}, {57, 9, NULL},
+                           {9, 57, NULL}, {57, 9, NULL}, {9, 57, NULL} };
+    pthread_t th[6];
+    int started = 0;
+    for (int i = 0; i < 6; i++) {
+        if (pthread_create(&th[i], NULL, acquire_main, &jobs[i]) != 0) break;
+        started++;
+    }
+    TEST_EQ_INT(started, 6);
+    for (int i = 0; i < started; i++) pthread_join(th[i], NULL);
+
+    TEST_ASSERT(jobs[0].got != NULL && jobs[1].got != NULL);
+    TEST_ASSERT(jobs[0].got != jobs[1].got);
+    for (int i = 2; i < started; i++) TEST_ASSERT(jobs[i].got == jobs[i % 2].got);
+    TEST_ASSERT(memcmp(jobs[0].got->topo, fresh.topo, BRZ_LAND_DIM*BRZ_LAND_DIM) == 0);
+    for (int i = 0; i < started; i++) brz_land_release(jobs[i].got);
+}
+
 void test_land_run(void)
 {
     test_basic_generation_and_range();
@@ -120,4 +241,8 @@ void test_land_run(void)
     test_determinism_same_seed();
     test_different_seed_changes_map();
     test_edge_samples_stable();
+    test_matches_reference_generator();
+    test_cache_round_trip();
+    test_shared_maps();
+    test_shared_maps_concurrent();
 }
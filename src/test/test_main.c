@@ -4,10 +4,24 @@
 /* per-file runners */
 void test_util_run(void);
 void test_vec_run(void);
+void test_arena_run(void);
 void test_kinds_run(void);
 void test_land_run(void);
 void test_parser_run(void);
+void test_cfgimage_run(void);
 void test_dsl_run(void);
+void test_expr_run(void);
+void test_pool_run(void);
+void test_agent_run(void);
+void test_world_run(void);
+void test_snapshot_run(void);
+void test_writer_run(void);
+void test_checkpoint_run(void);
+void test_ensemble_run(void);
+void test_profile_run(void);
+void test_sched_run(void);
+void test_metrics_run(void);
+void test_frame_run(void);
 
 static void banner(const char* name)
 {
@@ -21,10 +35,24 @@ int main(void)
 
     banner("test_util");   test_util_run();
     banner("test_vec");    test_vec_run();
+    banner("test_arena");  test_arena_run();
     banner("test_kinds");  test_kinds_run();
     banner("test_land");   test_land_run();
     banner("test_parser"); test_parser_run();
+    banner("test_cfgimage"); test_cfgimage_run();
     banner("test_dsl");    test_dsl_run();
+    banner("test_expr");   test_expr_run();
+    banner("test_pool");   test_pool_run();
+    banner("test_agent");  test_agent_run();
+    banner("test_world");  test_world_run();
+    banner("test_snapshot"); test_snapshot_run();
+    banner("test_writer"); test_writer_run();
+    banner("test_checkpoint"); test_checkpoint_run();
+    banner("test_ensemble"); test_ensemble_run();
+    banner("test_profile"); test_profile_run();
+    banner("test_sched");  test_sched_run();
+    banner("test_metrics"); test_metrics_run();
+    banner("test_frame");  test_frame_run();
 
     int passed = g_test_ctx.passed - start_pass;
     int failed = g_test_ctx.failed - start_fail;
@@ -0,0 +1,163 @@
+#include "test_common.h"
+#include "../brz_metrics.h"
+#include "../brz_parser.h"
+#include "../brz_sim.h"
+#include <math.h>
+
+static const char* k_src =
+    "sim { seed 11 days 10 map_w 40 map_h 24 }\n"
+    "agents { count 60 }\n"
+    "settlements { count 3 }\n"
+    "kinds { resources { grain fish } items { pot } }\n"
+    "vocations {\n"
+    "  vocation farmer {\n"
+    "    task farm { move_to field gather grain 3 trade grain fish }\n"
+    "    rule work { when hunger > 0.1 do farm }\n"
+    "  }\n"
+    "}\n";
+
+static bool load_cfg(ParsedConfig* cfg)
+{
+    char* path = brz_test_write_temp("brz_metrics_", k_src);
+    if(!path) return false;
+    brz_cfg_init(cfg);
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+static bool record(void* ctx, BrzSim* sim)
+{
+    brz_sim_sync(sim);
+    brz_metrics_record((BrzMetrics*)ctx, sim->day, &sim->world, sim->setts, &sim->agents);
+    return true;
+}
+
+/* run 10 days into path, 2 days (6 settlement rows) per block */
+static bool write_run(const char* path, ParsedConfig* cfg, BrzSim* sim)
+{
+    BrzMetrics m;
+    if(brz_sim_init(sim, cfg) != 0) return false;
+    if(!brz_metrics_open(&m, path, cfg, sim->setts, sim->sett_n, 7)) return false;
+    TEST_EQ_INT(m.block_days, 2);
+    bool ok = brz_sim_run_days(sim, 10, 0, record, &m) == 0;
+    return brz_metrics_close(&m) && ok;
+}
+
+static void test_round_trip(void)
+{
+    ParsedConfig cfg;
+    TEST_ASSERT(load_cfg(&cfg));
+    char* path = brz_test_write_temp("brz_metrics_", "");
+    TEST_ASSERT(path != NULL);
+    BrzSim sim;
+    TEST_ASSERT(write_run(path, &cfg, &sim));
+
+    BrzMetricsFile mf;
+    char err[128];
+    TEST_ASSERT(brz_metrics_read(&mf, path, err, sizeof(err)));
+    TEST_EQ_INT(mf.sett_n, 3);
+    TEST_STREQ(mf.sett_name[2], sim.setts[2].name);
+
+    const BrzMetricsTable* days = &mf.table[BRZ_METRICS_DAYS];
+    const BrzMetricsTable* sets = &mf.table[BRZ_METRICS_SETTLEMENTS];
+    TEST_STREQ(days->name, "days");
+    TEST_EQ_INT((int)days->rows, 10);
+    TEST_EQ_INT((int)sets->rows, 30);
+    TEST_EQ_INT(days->col_n, 4 + 2*2 + 1);
+    TEST_EQ_INT(sets->col_n, 3 + 2 + 1);
+
+    const double* day = brz_metrics_column(days, "day");
+    const double* hunger = brz_metrics_column(days, "avg_hunger");
+    const double* fish = brz_metrics_column(days, "agent_res_fish");
+    const double* world = brz_metrics_column(days, "world_grain");
+    TEST_ASSERT(day && hunger && fish && world && brz_metrics_column(days, "agent_item_pot"));
+    TEST_ASSERT(brz_metrics_column(days, "grain") == NULL);
+    int in_order = 0;
+    for(int d=0; d<10; d++) in_order += day[d] == d + 1;
+    TEST_EQ_INT(in_order, 10);
+
+    /* the last row matches a rescan of the final state */
+    double h = 0, f = 0, w = 0;
+    for(int i=0;i<sim.agents.n;i++){
+        h += sim.agents.hunger[i];
+        f += brz_agents_res(&sim.agents, i)[1];
+    }
+    const brz_res_t* plane = brz_world_res_plane(&sim.world, 0);
+    for(int t=0; t<sim.world.w*sim.world.h; t++) w += plane[t];
+    TEST_ASSERT(fabs(hunger[9] - h / sim.agents.n) < 1e-9);
+    TEST_ASSERT(fabs(fish[9] - f) < 1e-6);
+    TEST_ASSERT(fabs(world[9] - w) < 1e-6);
+
+    const double* sd = brz_metrics_column(sets, "day");
+    const double* si = brz_metrics_column(sets, "settlement");
+    const double* grain = brz_metrics_column(sets, "res_grain");
+    TEST_ASSERT(sd && si && grain && brz_metrics_column(sets, "item_pot"));
+    int match = 0;
+    for(int s=0;s<3;s++)
+        match += sd[27 + s] == 10 && si[27 + s] == s && grain[27 + s] == sim.setts[s].res_inv[0];
+    TEST_EQ_INT(match, 3);
+
+    FILE* csv = tmpfile();
+    TEST_ASSERT(csv != NULL);
+    TEST_ASSERT(brz_metrics_write_csv(sets, csv));
+    char line[256] = { 0 };
+    rewind(csv);
+    TEST_ASSERT(fgets(line, sizeof(line), csv) != NULL);
+    TEST_STREQ(line, "day,settlement,population,res_grain,res_fish,item_pot\n");
+    TEST_ASSERT(fgets(line, sizeof(line), csv) != NULL);
+    TEST_ASSERT(strncmp(line, "1,0,", 4) == 0);
+    fclose(csv);
+
+    brz_metrics_file_free(&mf);
+    brz_sim_free(&sim);
+    brz_test_unlink(path);
+    free(path);
+    brz_cfg_free(&cfg);
+}
+
+static void test_bad_files(void)
+{
+    ParsedConfig cfg;
+    TEST_ASSERT(load_cfg(&cfg));
+    char* path = brz_test_write_temp("brz_metrics_", "");
+    TEST_ASSERT(path != NULL);
+    BrzSim sim;
+    TEST_ASSERT(write_run(path, &cfg, &sim));
+    brz_sim_free(&sim);
+
+    size_t size = 0;
+    char* data = brz_read_entire_file(path, &size);
+    TEST_ASSERT(data != NULL && size > 16);
+
+    BrzMetricsFile mf;
+    char err[128];
+    /* a block cut short */
+    FILE* f = fopen(path, "wb");
+    TEST_ASSERT(f != NULL);
+    fwrite(data, 1, size - 3, f);
+    fclose(f);
+    TEST_ASSERT(!brz_metrics_read(&mf, path, err, sizeof(err)));
+    TEST_STREQ(err, "truncated or corrupt metrics file");
+
+    /* not a metrics file */
+    data[0] = 'X';
+    f = fopen(path, "wb");
+    TEST_ASSERT(f != NULL);
+    fwrite(data, 1, size, f);
+    fclose(f);
+    TEST_ASSERT(!brz_metrics_read(&mf, path, err, sizeof(err)));
+    TEST_STREQ(err, "not a bronzesim metrics file");
+
+    free(data);
+    brz_test_unlink(path);
+    free(path);
+    brz_cfg_free(&cfg);
+}
+
+void test_metrics_run(void)
+{
+    test_round_trip();
+    test_bad_files();
+}
@@ -156,6 +156,161 @@ static void test_parse_task_stmt_variants(void)
     brz_cfg_free(&cfg);
 }
 
+static void test_parse_link_resolves_ops(void)
+{
+    const char* src =
+        "kinds { resources { wood copper fish } items { bronze pottery } }\n"
+        "vocations {\n"
+        "  vocation v {\n"
+        "    task a {\n"
+        "      gather fish 2\n"
+        "      craft bronze 1\n"
+        "      trade copper bronze\n"
+        "      move_to mine_tin\n"
+        "      wander\n"
+        "      chance 50 { rest }\n"
+        "      sing loud\n"
+        "    }\n"
+        "    rule rr { when true do a weight 1 }\n"
+        "    rule r2 { when true do nosuch }\n"
+        "  }\n"
+        "}\n";
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(parse_from_string(src, &cfg));
+
+    TEST_EQ_INT(cfg.known.r_wood, 0);
+    TEST_EQ_INT(cfg.known.r_copper, 1);
+    TEST_EQ_INT(cfg.known.r_fish, 2);
+    TEST_EQ_INT(cfg.known.r_grain, -1);
+    TEST_EQ_INT(cfg.known.i_bronze, 0);
+    TEST_EQ_INT(cfg.known.i_pottery, 1);
+    TEST_EQ_INT(cfg.known.i_charcoal, -1);
+
+    VocationDef* v = (VocationDef*)brz_vec_at(&cfg.vocations, 0);
+    TaskDef* t = brz_voc_find_task(v, "a");
+    TEST_ASSERT(t != NULL);
+    TEST_EQ_SIZE(t->stmts.len, 7);
+
+    const OpDef* op = &((StmtDef*)brz_vec_at(&t->stmts, 0))->as.op;
+    TEST_EQ_INT(op->code, BRZ_OP_GATHER);
+    TEST_EQ_INT(op->rid0, 2);
+    TEST_EQ_INT(op->iid0, -1);
+    TEST_EQ_INT(op->tag, BRZ_TAG_COAST);
+
+    op = &((StmtDef*)brz_vec_at(&t->stmts, 1))->as.op;
+    TEST_EQ_INT(op->code, BRZ_OP_CRAFT);
+    TEST_EQ_INT(op->rid0, -1);
+    TEST_EQ_INT(op->iid0, 0);
+
+    op = &((StmtDef*)brz_vec_at(&t->stmts, 2))->as.op;
+    TEST_EQ_INT(op->code, BRZ_OP_TRADE);
+    TEST_EQ_INT(op->rid0, 1);
+    TEST_EQ_INT(op->iid1, 0);
+    TEST_EQ_INT(op->rid1, -1);
+
+    op = &((StmtDef*)brz_vec_at(&t->stmts, 3))->as.op;
+    TEST_EQ_INT(op->code, BRZ_OP_MOVE);
+    TEST_EQ_INT(op->tag, BRZ_TAG_MINE_SN);
+
+    /* no destination defaults to forest */
+    op = &((StmtDef*)brz_vec_at(&t->stmts, 4))->as.op;
+    TEST_EQ_INT(op->code, BRZ_OP_MOVE);
+    TEST_EQ_INT(op->tag, BRZ_TAG_FOREST);
+
+    /* ops nested in blocks are resolved too */
+    const StmtDef* ch = (const StmtDef*)brz_vec_at(&t->stmts, 5);
+    TEST_EQ_INT(ch->kind, ST_CHANCE);
+    op = &((const StmtDef*)brz_vec_cat(&ch->as.chance.body, 0))->as.op;
+    TEST_EQ_INT(op->code, BRZ_OP_REST);
+
+    /* unknown verbs are kept but do nothing */
+    op = &((StmtDef*)brz_vec_at(&t->stmts, 6))->as.op;
+    TEST_EQ_INT(op->code, BRZ_OP_NONE);
+
+    /* rules point straight at their task */
+    const RuleDef* r = (const RuleDef*)brz_vec_cat(&v->rules, 0);
+    TEST_ASSERT(r->task == t);
+    r = (const RuleDef*)brz_vec_cat(&v->rules, 1);
+    TEST_ASSERT(r->task == NULL);
+
+    brz_cfg_free(&cfg);
+}
+
+static void test_parse_recipes(void)
+{
+    const char* src =
+        "kinds { resources { wood clay charcoal } items { pottery charcoal brick kiln } }\n"
+        "recipes {\n"
+        "  pottery { clay 3 }\n"
+        "  charcoal { wood 2 makes charcoal }\n"
+        "  kiln { brick 4 pottery 0.5 }\n"
+        "  brick { peat 1 }\n"
+        "  pottery { wood 1 }\n"
+        "  kiln { clay 0 }\n"
+        "  brick { clay 1 clay 1 }\n"
+        "}\n";
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(parse_from_string(src, &cfg));
+    TEST_ASSERT(cfg.has_recipes);
+    TEST_EQ_SIZE(cfg.recipes.len, 7);
+    TEST_EQ_SIZE(cfg.warnings.len, 4); /* unknown peat, second pottery, zero ratio, clay twice */
+
+    const RecipeDef* r = brz_cfg_recipe(&cfg, 0);
+    TEST_ASSERT(r != NULL);
+    TEST_STREQ(r->item, "pottery");
+    TEST_EQ_INT(r->out, 0);
+    TEST_EQ_INT(r->out_is_item, 1);
+    TEST_EQ_INT((int)r->in_n, 1);
+    const RecipeInput* in = brz_cfg_recipe_inputs(&cfg, r);
+    TEST_EQ_INT(in[0].id, 1);
+    TEST_EQ_INT(in[0].is_item, 0);
+    TEST_ASSERT(in[0].ratio == 3.0);
+
+    /* makes names a resource first, like inputs do */
+    r = brz_cfg_recipe(&cfg, 1);
+    TEST_ASSERT(r != NULL);
+    TEST_EQ_INT(r->out, 2);
+    TEST_EQ_INT(r->out_is_item, 0);
+
+    /* items can be inputs */
+    r = brz_cfg_recipe(&cfg, 3);
+    TEST_ASSERT(r != NULL);
+    TEST_EQ_INT((int)r->in_n, 2);
+    in = brz_cfg_recipe_inputs(&cfg, r);
+    TEST_EQ_INT(in[0].id, 2);
+    TEST_EQ_INT(in[0].is_item, 1);
+    TEST_EQ_INT(in[1].id, 0);
+    TEST_EQ_INT(in[1].is_item, 1);
+
+    /* dropped recipes leave their item without one */
+    TEST_ASSERT(brz_cfg_recipe(&cfg, 2) == NULL);
+    TEST_ASSERT(brz_cfg_recipe(&cfg, 4) == NULL);
+    TEST_ASSERT(brz_cfg_recipe(&cfg, -1) == NULL);
+    brz_cfg_free(&cfg);
+
+    /* without a recipes block the built-in ones are used */
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(parse_from_string("kinds { resources { copper tin charcoal clay } items { bronze pottery } }\n", &cfg));
+    TEST_ASSERT(!cfg.has_recipes);
+    TEST_EQ_SIZE(cfg.recipes.len, 2);
+    r = brz_cfg_recipe(&cfg, 0);
+    TEST_ASSERT(r != NULL);
+    TEST_EQ_INT((int)r->in_n, 3);
+    r = brz_cfg_recipe(&cfg, 1);
+    TEST_ASSERT(r != NULL);
+    TEST_ASSERT(brz_cfg_recipe_inputs(&cfg, r)[0].ratio == 2.0);
+    brz_cfg_free(&cfg);
+
+    /* an empty block turns them off */
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(parse_from_string("kinds { resources { clay } items { pottery } }\nrecipes { }\n", &cfg));
+    TEST_EQ_SIZE(cfg.recipes.len, 0);
+    TEST_ASSERT(brz_cfg_recipe(&cfg, 0) == NULL);
+    brz_cfg_free(&cfg);
+}
+
 static void test_parse_errors_return_false(void)
 {
     /* unknown top-level */
@@ -180,6 +335,14 @@ static void test_parse_errors_return_false(void)
         TEST_ASSERT(!parse_from_string(src, &cfg));
         brz_cfg_free(&cfg);
     }
+    /* recipe inputs need a ratio */
+    {
+        const char* src = "kinds { resources { clay } items { pottery } }\n"
+                          "recipes { pottery { clay } }\n";
+        ParsedConfig cfg; brz_cfg_init(&cfg);
+        TEST_ASSERT(!parse_from_string(src, &cfg));
+        brz_cfg_free(&cfg);
+    }
     /* rule missing name */
     {
         const char* src = "kinds { resources { fish } items { fish } }\n"
@@ -190,6 +353,125 @@ static void test_parse_errors_return_false(void)
     }
 }
 
+static void test_parse_interns_strings(void)
+{
+    const char* src =
+        "kinds { resources { fish } items { pot } }\n"
+        "sim { regen dense }\n"
+        "vocations {\n"
+        "  vocation a {\n"
+        "    task fish { gather fish 2 }\n"
+        "    rule r { when hunger>0.5 and fatigue < 0.2 do fish }\n"
+        "  }\n"
+        "  vocation b {\n"
+        "    task t { when hunger >0.5 { gather fish } }\n"
+        "    rule r { when hunger > 0.5 do t }\n"
+        "  }\n"
+        "}\n";
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(parse_from_string(src, &cfg));
+    VocationDef* a = (VocationDef*)brz_vec_at(&cfg.vocations, 0);
+    VocationDef* b = (VocationDef*)brz_vec_at(&cfg.vocations, 1);
+    TaskDef* fish = brz_voc_find_task(a, "fish");
+    TaskDef* t = brz_voc_find_task(b, "t");
+    TEST_ASSERT(fish && t);
+    if(fish && t){
+        const StmtDef* g = (const StmtDef*)brz_vec_cat(&fish->stmts, 0);
+        const StmtDef* w = (const StmtDef*)brz_vec_cat(&t->stmts, 0);
+        const StmtDef* g2 = (const StmtDef*)brz_vec_cat(&w->as.when_stmt.body, 0);
+        /* one copy per distinct string */
+        TEST_ASSERT(g->as.op.op == g2->as.op.op);
+        TEST_ASSERT(g->as.op.a0 == fish->name);
+        TEST_ASSERT(g->as.op.n0 == 2.0);
+        /* expressions are joined with single spaces, then interned */
+        const RuleDef* ra = (const RuleDef*)brz_vec_cat(&a->rules, 0);
+        const RuleDef* rb = (const RuleDef*)brz_vec_cat(&b->rules, 0);
+        TEST_STREQ(ra->when_expr, "hunger > 0.5 and fatigue < 0.2");
+        TEST_STREQ(w->as.when_stmt.when_expr, "hunger > 0.5");
+        TEST_ASSERT(rb->when_expr == w->as.when_stmt.when_expr);
+        TEST_ASSERT(ra->name == rb->name);
+        TEST_ASSERT(rb->task == t);
+    }
+    const ParamDef* regen = find_param(&cfg, "sim_regen");
+    TEST_ASSERT(regen && regen->has_svalue);
+    if(regen) TEST_STREQ(regen->svalue, "dense");
+    brz_cfg_free(&cfg);
+}
+
+/* The per-vocation threshold index selects exactly the BOX rules whose
+   program holds: in each group the satisfied thresholds form a prefix. */
+static void test_parse_rule_threshold_index(void)
+{
+    const char* src =
+        "vocations {\n"
+        "  vocation farmer {\n"
+        "    task rest { rest }\n"
+        "    rule a { when hunger > 0.5 do rest }\n"
+        "    rule b { when hunger >= 0.5 and fatigue < 0.8 do rest }\n"
+        "    rule c { when hunger > 0.2 do rest }\n"
+        "    rule d { when fatigue <= 0.3 do rest }\n"
+        "    rule e { when fatigue > 0.6 and fatigue < 0.9 do rest }\n"
+        "    rule f { when true do rest }\n"
+        "    rule g { when hunger > 0.1 and chance(0.5) do rest }\n"
+        "    rule h { when hunger < 0.4 do rest }\n"
+        "  }\n"
+        "}\n";
+
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(parse_from_string(src, &cfg));
+    TEST_EQ_SIZE(cfg.vocations.len, 1);
+    const VocationDef* v = (const VocationDef*)brz_vec_cat(&cfg.vocations, 0);
+    const RuleDef* rules = (const RuleDef*)v->rules.data;
+    TEST_EQ_SIZE(v->rules.len, 8);
+    TEST_EQ_INT(rules[5].match, BRZ_EXPR_SHAPE_NEVER); /* 'true' is an unknown name, so 0 */
+    TEST_EQ_INT(rules[6].match, BRZ_EXPR_SHAPE_GUARDED);
+
+    /* every BOX rule sits in exactly one group */
+    size_t boxes = 0;
+    for(size_t i=0;i<v->rules.len;i++) boxes += rules[i].match == BRZ_EXPR_SHAPE_BOX;
+    TEST_EQ_SIZE(boxes, 6);
+    TEST_EQ_SIZE(v->thresholds.len, boxes);
+    TEST_EQ_INT(v->thr_group[0], 0);
+    TEST_EQ_INT(v->thr_group[BRZ_RULE_THR_GROUPS], (int)boxes);
+
+    /* lower bounds on hunger: a, b and c, ascending with >= ahead of > */
+    const BrzRuleThreshold* t = (const BrzRuleThreshold*)v->thresholds.data;
+    TEST_EQ_INT(v->thr_group[1] - v->thr_group[0], 3);
+    TEST_EQ_INT(t[0].rule, 2);
+    TEST_EQ_INT(t[1].rule, 1);
+    TEST_EQ_INT(t[2].rule, 0);
+
+    int bad = 0;
+    for(int hi=0; hi<=20; hi++)
+    for(int fi=0; fi<=20; fi++)
+    {
+        double vars[BRZ_EXPR_VAR_COUNT] = { hi * 0.05, fi * 0.05 };
+        bool hit[8] = { false };
+        for(int g=0; g<BRZ_RULE_THR_GROUPS; g++)
+        {
+            bool prefix = true;
+            for(uint32_t j=v->thr_group[g]; j<v->thr_group[g+1]; j++)
+            {
+                double x = vars[g / 2];
+                bool ok = (g & 1) ? (t[j].open ? x < t[j].bound : x <= t[j].bound)
+                                  : (t[j].open ? x > t[j].bound : x >= t[j].bound);
+                if(ok && !prefix) bad++;
+                if(!ok) prefix = false;
+                if(ok && brz_expr_box_holds(&rules[t[j].rule].guard, vars)) hit[t[j].rule] = true;
+            }
+        }
+        for(size_t i=0;i<v->rules.len;i++)
+        {
+            if(rules[i].match != BRZ_EXPR_SHAPE_BOX) continue;
+            if(hit[i] != (brz_expr_eval(&rules[i].when_prog, vars, NULL) != 0)) bad++;
+        }
+    }
+    TEST_EQ_INT(bad, 0);
+    brz_cfg_free(&cfg);
+}
+
 void test_parser_run(void)
 {
     test_parse_minimal_success();
@@ -197,5 +479,9 @@ void test_parser_run(void)
     test_parse_items_mapping_form_adds_kind();
     test_parse_world_agents_settlements_defaults();
     test_parse_task_stmt_variants();
+    test_parse_link_resolves_ops();
+    test_parse_interns_strings();
+    test_parse_rule_threshold_index();
+    test_parse_recipes();
     test_parse_errors_return_false();
 }
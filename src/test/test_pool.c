@@ -0,0 +1,78 @@
+#include "test_common.h"
+#include "../brz_pool.h"
+#include "../brz_util.h"
+
+typedef struct {
+    int* hits;
+    long long* sums;
+} PoolCtx;
+
+static void pool_task(void* ctx, int task)
+{
+    PoolCtx* c = (PoolCtx*)ctx;
+    long long s = 0;
+    for(int i=0;i<=task;i++) s += i;
+    c->hits[task]++;
+    c->sums[task] = s;
+}
+
+static void run_pool(int threads, int task_n)
+{
+    BrzPool* pool = brz_pool_create(threads);
+    TEST_ASSERT(pool != NULL);
+    if(!pool) return;
+    TEST_EQ_INT(brz_pool_threads(pool), threads > 1 ? threads : 1);
+
+    int* hits = (int*)calloc((size_t)task_n, sizeof(int));
+    long long* sums = (long long*)calloc((size_t)task_n, sizeof(long long));
+    PoolCtx c = { hits, sums };
+
+    /* several jobs back to back on the same pool */
+    for(int round=0; round<3; round++)
+        brz_pool_run(pool, task_n, pool_task, &c);
+
+    int bad = 0;
+    for(int t=0;t<task_n;t++)
+    {
+        if(hits[t] != 3) bad++;
+        if(sums[t] != (long long)t*(t+1)/2) bad++;
+    }
+    TEST_EQ_INT(bad, 0);
+
+    brz_pool_run(pool, 0, pool_task, &c); /* no-op */
+    free(hits);
+    free(sums);
+    brz_pool_destroy(pool);
+}
+
+static void test_pool_runs_every_task_once(void)
+{
+    run_pool(1, 10);
+    run_pool(2, 1);
+    run_pool(4, 257);
+    run_pool(8, 1000);
+}
+
+static void test_rng_stream_reproducible(void)
+{
+    BrzRng a, b;
+    brz_rng_stream(&a, 1234u, 7u, 3u);
+    brz_rng_stream(&b, 1234u, 7u, 3u);
+    for(int i=0;i<16;i++) TEST_EQ_INT(brz_rng_u32(&a), brz_rng_u32(&b));
+
+    /* neighbouring agents / days get different streams */
+    BrzRng c, d;
+    brz_rng_stream(&a, 1234u, 7u, 3u);
+    brz_rng_stream(&c, 1234u, 8u, 3u);
+    brz_rng_stream(&d, 1234u, 7u, 4u);
+    uint32_t x = brz_rng_u32(&a);
+    TEST_NE_INT(x, brz_rng_u32(&c));
+    TEST_NE_INT(x, brz_rng_u32(&d));
+    TEST_ASSERT(a.state != 0 && c.state != 0 && d.state != 0);
+}
+
+void test_pool_run(void)
+{
+    test_pool_runs_every_task_once();
+    test_rng_stream_reproducible();
+}
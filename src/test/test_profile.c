@@ -0,0 +1,143 @@
+#include "test_common.h"
+#include "../brz_parser.h"
+#include "../brz_profile.h"
+#include "../brz_sim.h"
+
+static const char* k_src =
+    "sim { days 6 map_w 32 map_h 20 }\n"
+    "agents { count 40 }\n"
+    "settlements { count 2 }\n"
+    "kinds { resources { grain fish } }\n"
+    "vocations {\n"
+    "  vocation farmer {\n"
+    "    task farm {\n"
+    "      move_to field\n"
+    "      gather grain 2\n"
+    "    }\n"
+    "    task sell { trade grain fish }\n"
+    "    rule work { when hunger > 0 do farm weight 3 }\n"
+    "    rule market { when hunger >= 0 do sell }\n"
+    "  }\n"
+    "}\n";
+
+static bool load_cfg(const char* s, ParsedConfig* cfg)
+{
+    char* path = brz_test_write_temp("brz_prof_", s);
+    if(!path) return false;
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+static bool profile_day(void* ctx, BrzSim* sim)
+{
+    (void)ctx;
+    brz_profile_day(sim->day);
+    return true;
+}
+
+static int count_lines(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if(!f) return -1;
+    int n = 0, c;
+    while((c = fgetc(f)) != EOF) if(c == '\n') n++;
+    fclose(f);
+    return n;
+}
+
+static void test_names(void)
+{
+    TEST_STREQ(brz_profile_phase_name(BRZ_PROF_REGEN), "regen");
+    TEST_STREQ(brz_profile_phase_name(BRZ_PROF_OP_MOVE), "op_move");
+    TEST_STREQ(brz_profile_phase_name(BRZ_PROF_MAP), "map");
+    TEST_STREQ(brz_profile_phase_name(BRZ_PROF_PHASE_COUNT), "?");
+    TEST_STREQ(brz_profile_counter_name(BRZ_PROF_TILES_SCANNED), "tiles_scanned");
+    TEST_STREQ(brz_profile_counter_name(BRZ_PROF_TRADES), "trades");
+    /* op phases follow the opcode order */
+    TEST_EQ_INT(BRZ_PROF_OP_MOVE - BRZ_PROF_OP_GATHER, BRZ_OP_MOVE - BRZ_OP_GATHER);
+}
+
+static void test_recording(void)
+{
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(k_src, &cfg));
+    char* csv = brz_test_write_temp("brz_prof_csv_", "");
+    TEST_ASSERT(csv != NULL);
+    if(!csv){ brz_cfg_free(&cfg); return; }
+
+    BrzProfile p;
+    if(!brz_profile_available())
+    {
+        /* stubs: nothing starts, nothing is counted */
+        TEST_ASSERT(!brz_profile_begin(csv));
+        BrzSim sim;
+        TEST_EQ_INT(brz_sim_init(&sim, &cfg), 0);
+        TEST_EQ_INT(brz_sim_run_days(&sim, 3, 0, profile_day, NULL), 0);
+        brz_sim_free(&sim);
+        brz_profile_end(NULL);
+        brz_profile_totals(&p);
+        TEST_ASSERT(p.calls[BRZ_PROF_STEP] == 0 && p.count[BRZ_PROF_EXPR_EVALS] == 0);
+        brz_test_unlink(csv);
+        free(csv);
+        brz_cfg_free(&cfg);
+        return;
+    }
+
+    TEST_ASSERT(brz_profile_begin(csv));
+    BrzSim sim;
+    TEST_EQ_INT(brz_sim_init(&sim, &cfg), 0);
+    TEST_EQ_INT(brz_sim_run_days(&sim, 6, 0, profile_day, NULL), 0);
+    brz_sim_free(&sim);
+
+    brz_profile_totals(&p);
+    TEST_ASSERT(p.calls[BRZ_PROF_REGEN] == 6);
+    TEST_ASSERT(p.calls[BRZ_PROF_STEP] == 6 * 40);
+    TEST_ASSERT(p.calls[BRZ_PROF_RULE] == 6 * 40);
+    TEST_ASSERT(p.calls[BRZ_PROF_COMMIT] == 0);
+    TEST_ASSERT(p.count[BRZ_PROF_FIND_CALLS] == p.calls[BRZ_PROF_PATH]);
+    TEST_ASSERT(p.count[BRZ_PROF_FIND_CALLS] > 0);
+    TEST_ASSERT(p.count[BRZ_PROF_TILES_SCANNED] >= p.count[BRZ_PROF_FIND_CALLS]);
+    TEST_ASSERT(p.count[BRZ_PROF_EXPR_EVALS] >= p.calls[BRZ_PROF_RULE]);
+    TEST_ASSERT(p.count[BRZ_PROF_TRADES] == p.calls[BRZ_PROF_TRADE]);
+    TEST_ASSERT(p.count[BRZ_PROF_TRADES] > 0);
+    TEST_ASSERT(p.ns[BRZ_PROF_STEP] >= p.ns[BRZ_PROF_RULE]);
+
+    /* parallel step: worker slots are folded in when the pool exits */
+    BrzProfile q;
+    TEST_EQ_INT(brz_sim_init(&sim, &cfg), 0);
+    TEST_EQ_INT(brz_sim_run_days(&sim, 4, 3, NULL, NULL), 0);
+    brz_sim_free(&sim);
+    brz_profile_totals(&q);
+    TEST_ASSERT(q.calls[BRZ_PROF_STEP] == p.calls[BRZ_PROF_STEP] + 4 * 40);
+    TEST_ASSERT(q.calls[BRZ_PROF_COMMIT] == 4);
+    TEST_ASSERT(q.count[BRZ_PROF_TRADES] > p.count[BRZ_PROF_TRADES]);
+
+    brz_profile_end(NULL);
+    TEST_EQ_INT(count_lines(csv), 1 + 6); /* header + one row per day */
+
+    /* stopped: further runs are not recorded */
+    TEST_EQ_INT(brz_sim_init(&sim, &cfg), 0);
+    TEST_EQ_INT(brz_sim_run_days(&sim, 2, 0, NULL, NULL), 0);
+    brz_sim_free(&sim);
+    brz_profile_totals(&p);
+    TEST_ASSERT(p.calls[BRZ_PROF_STEP] == q.calls[BRZ_PROF_STEP]);
+
+    /* a new session starts from zero */
+    TEST_ASSERT(brz_profile_begin(NULL));
+    brz_profile_totals(&p);
+    TEST_ASSERT(p.calls[BRZ_PROF_STEP] == 0);
+    brz_profile_end(NULL);
+
+    brz_test_unlink(csv);
+    free(csv);
+    brz_cfg_free(&cfg);
+}
+
+void test_profile_run(void)
+{
+    test_names();
+    test_recording();
+}
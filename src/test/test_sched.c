@@ -0,0 +1,238 @@
+#include "test_common.h"
+#include "../brz_parser.h"
+#include "../brz_sim.h"
+#include "../brz_util.h"
+
+/* Farmers only act when hungry or tired, so most of them sleep for days
+   between decisions; traders roll chance() every day and never sleep. */
+static const char* k_src_fmt =
+    "sim { seed 5 days 90 map_w 40 map_h 24 schedule %s }\n"
+    "agents { count 90 }\n"
+    "settlements { count 3 }\n"
+    "kinds { resources { grain fish } }\n"
+    "vocations {\n"
+    "  vocation farmer {\n"
+    "    task farm {\n"
+    "      move_to field\n"
+    "      gather grain 3\n"
+    "    }\n"
+    "    task nap { rest }\n"
+    "    rule hungry { when hunger > 0.6 do farm }\n"
+    "    rule tired { when fatigue > 0.5 and hunger < 0.3 do nap }\n"
+    "  }\n"
+    "  vocation trader {\n"
+    "    task sell { trade grain fish }\n"
+    "    rule market { when chance(0.3) do sell }\n"
+    "  }\n"
+    "}\n";
+
+static bool load_src(const char* src, ParsedConfig* cfg)
+{
+    char* path = brz_test_write_temp("brz_sched_", src);
+    if(!path) return false;
+    brz_cfg_init(cfg);
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+static bool load_mode(const char* mode, ParsedConfig* cfg)
+{
+    char src[2048];
+    snprintf(src, sizeof(src), k_src_fmt, mode);
+    return load_src(src, cfg);
+}
+
+static bool same_agents(const BrzSim* a, const BrzSim* b)
+{
+    size_t an = (size_t)a->agents.n;
+    if(a->agents.n != b->agents.n || a->rng.state != b->rng.state) return false;
+    if(memcmp(a->agents.pos, b->agents.pos, an*sizeof(BrzPos)) != 0) return false;
+    if(memcmp(a->agents.target, b->agents.target, an*sizeof(BrzPos)) != 0) return false;
+    if(memcmp(a->agents.has_target, b->agents.has_target, an) != 0) return false;
+    if(memcmp(a->agents.hunger, b->agents.hunger, an*sizeof(double)) != 0) return false;
+    if(memcmp(a->agents.fatigue, b->agents.fatigue, an*sizeof(double)) != 0) return false;
+    if(memcmp(a->agents.res, b->agents.res, an*a->agents.res_n*sizeof(double)) != 0) return false;
+    if(memcmp(a->agents.item, b->agents.item, an*a->agents.item_n*sizeof(double)) != 0) return false;
+    for(int s=0;s<a->sett_n;s++)
+        if(memcmp(a->setts[s].res_inv, b->setts[s].res_inv, a->agents.res_n*sizeof(double)) != 0) return false;
+    return true;
+}
+
+typedef struct {
+    double hunger[128]; /* synced average hunger per day */
+    int max_asleep;
+} DayLog;
+
+static bool log_day(void* ctx, BrzSim* sim)
+{
+    DayLog* l = (DayLog*)ctx;
+    if(sim->sched.asleep > l->max_asleep) l->max_asleep = sim->sched.asleep;
+    brz_sim_sync(sim);
+    double h = 0;
+    for(int i=0;i<sim->agents.n;i++) h += sim->agents.hunger[i];
+    if(sim->day < 128) l->hunger[sim->day] = h;
+    return true;
+}
+
+static void test_may_idle(void)
+{
+    ParsedConfig cfg;
+    TEST_ASSERT(load_mode("skip", &cfg));
+    const VocationDef* v = (const VocationDef*)cfg.vocations.data;
+    TEST_ASSERT(cfg.vocations.len == 2);
+    TEST_ASSERT(brz_voc_may_idle(&v[0]));  /* threshold boxes only */
+    TEST_ASSERT(!brz_voc_may_idle(&v[1])); /* chance() has to run */
+    brz_cfg_free(&cfg);
+
+    /* grain is outside the box, so the rule may match on any day */
+    TEST_ASSERT(load_src(
+        "vocations { vocation v { task t { rest } rule r { when grain < 2 do t } } }\n", &cfg));
+    v = (const VocationDef*)cfg.vocations.data;
+    TEST_ASSERT(!brz_voc_may_idle(&v[0]));
+    brz_cfg_free(&cfg);
+}
+
+static void test_skip_matches_full(int threads)
+{
+    ParsedConfig full_cfg, skip_cfg, val_cfg;
+    TEST_ASSERT(load_mode("full", &full_cfg));
+    TEST_ASSERT(load_mode("skip", &skip_cfg));
+    TEST_ASSERT(load_mode("validate", &val_cfg));
+
+    BrzSim full, skip, val;
+    DayLog lf, ls, lv;
+    memset(&lf, 0, sizeof(lf));
+    memset(&ls, 0, sizeof(ls));
+    memset(&lv, 0, sizeof(lv));
+    TEST_EQ_INT(brz_sim_init(&full, &full_cfg), 0);
+    TEST_EQ_INT(brz_sim_init(&skip, &skip_cfg), 0);
+    TEST_EQ_INT(brz_sim_init(&val, &val_cfg), 0);
+
+    /* in two pieces, so that sleepers carry over between runs */
+    TEST_EQ_INT(brz_sim_run_days(&full, 40, threads, log_day, &lf), 0);
+    TEST_EQ_INT(brz_sim_run_days(&skip, 40, threads, log_day, &ls), 0);
+    TEST_ASSERT(same_agents(&full, &skip));
+    TEST_EQ_INT(brz_sim_run_days(&full, 90, threads, log_day, &lf), 0);
+    TEST_EQ_INT(brz_sim_run_days(&skip, 90, threads, log_day, &ls), 0);
+    TEST_EQ_INT(brz_sim_run_days(&val, 90, threads, log_day, &lv), 0);
+
+    TEST_EQ_INT(lf.max_asleep, 0);
+    TEST_ASSERT(ls.max_asleep > 0);
+    TEST_ASSERT(lv.max_asleep > 0);
+    TEST_ASSERT(same_agents(&full, &skip));
+    TEST_ASSERT(same_agents(&full, &val));
+    TEST_ASSERT(memcmp(lf.hunger, ls.hunger, sizeof(lf.hunger)) == 0);
+    TEST_ASSERT(memcmp(lf.hunger, lv.hunger, sizeof(lf.hunger)) == 0);
+
+    brz_sim_free(&full);
+    brz_sim_free(&skip);
+    brz_sim_free(&val);
+    brz_cfg_free(&full_cfg);
+    brz_cfg_free(&skip_cfg);
+    brz_cfg_free(&val_cfg);
+}
+
+/* the shipped example, with the schedule mode appended */
+static bool load_example(const char* mode, ParsedConfig* cfg)
+{
+    size_t n = 0;
+    char* text = brz_read_entire_file("../example.bronze", &n);
+    if(!text) return false;
+    char* src = (char*)malloc(n + 64);
+    bool ok = false;
+    if(src){
+        snprintf(src, n + 64, "%s\nsim { schedule %s }\n", text, mode);
+        ok = load_src(src, cfg);
+    }
+    free(src);
+    free(text);
+    return ok;
+}
+
+/* example.bronze has only threshold rules, so its agents do sleep */
+static void test_example_validates(void)
+{
+    ParsedConfig full_cfg, val_cfg;
+    TEST_ASSERT(load_example("full", &full_cfg));
+    TEST_ASSERT(load_example("validate", &val_cfg));
+    const VocationDef* v = (const VocationDef*)val_cfg.vocations.data;
+    int idle = 0;
+    for(size_t i=0;i<val_cfg.vocations.len;i++) idle += brz_voc_may_idle(&v[i]);
+    TEST_ASSERT(idle > 0);
+
+    BrzSim full, val;
+    DayLog lf, lv;
+    memset(&lf, 0, sizeof(lf));
+    memset(&lv, 0, sizeof(lv));
+    TEST_EQ_INT(brz_sim_init(&full, &full_cfg), 0);
+    TEST_EQ_INT(brz_sim_init(&val, &val_cfg), 0);
+    TEST_EQ_INT(brz_sim_run_days(&full, 30, 0, log_day, &lf), 0);
+    TEST_EQ_INT(brz_sim_run_days(&val, 30, 0, log_day, &lv), 0);
+
+    TEST_EQ_INT(lf.max_asleep, 0);
+    TEST_ASSERT(lv.max_asleep > 0);
+    TEST_ASSERT(same_agents(&full, &val));
+    TEST_ASSERT(memcmp(lf.hunger, lv.hunger, sizeof(lf.hunger)) == 0);
+
+    brz_sim_free(&full);
+    brz_sim_free(&val);
+    brz_cfg_free(&full_cfg);
+    brz_cfg_free(&val_cfg);
+}
+
+static void test_quiet_days(void)
+{
+    ParsedConfig cfg;
+    TEST_ASSERT(load_mode("full", &cfg));
+    BrzSim sim;
+    TEST_EQ_INT(brz_sim_init(&sim, &cfg), 0);
+
+    /* a farmer well below both thresholds, idle at home */
+    sim.agents.hunger[0] = 0.1;
+    sim.agents.fatigue[0] = 0.2;
+    sim.agents.has_target[0] = 0;
+    /* hunger passes 0.6 after metabolism on day 25 (0.1 + 25*0.02) */
+    int q = brz_agent_quiet_days(&sim.agents, 0, &cfg, &sim.world, sim.setts, sim.sett_n, 64);
+    TEST_ASSERT(q >= 20 && q <= 25);
+    TEST_EQ_INT(brz_agent_quiet_days(&sim.agents, 0, &cfg, &sim.world, sim.setts, sim.sett_n, 3), 3);
+
+    /* skipping equals stepping, day by day */
+    BrzAgentStore* ag = &sim.agents;
+    const double h0 = ag->hunger[0], f0 = ag->fatigue[0];
+    TEST_EQ_INT(brz_agent_skip_days(ag, 0, &cfg, &sim.world, sim.setts, sim.sett_n, q + 5), q);
+    const double hs = ag->hunger[0], fs = ag->fatigue[0];
+    ag->hunger[0] = h0;
+    ag->fatigue[0] = f0;
+    for(int d=0; d<q; d++) brz_agent_step(ag, 0, &cfg, &sim.world, sim.setts, sim.sett_n, &sim.rng);
+    TEST_ASSERT(ag->hunger[0] == hs && ag->fatigue[0] == fs);
+
+    /* a trader never idles */
+    TEST_EQ_INT(brz_agent_quiet_days(&sim.agents, 1, &cfg, &sim.world, sim.setts, sim.sett_n, 64), 0);
+
+    brz_sim_free(&sim);
+    brz_cfg_free(&cfg);
+}
+
+static void test_unknown_mode(void)
+{
+    ParsedConfig cfg;
+    TEST_ASSERT(load_mode("sometimes", &cfg));
+    BrzSim sim;
+    TEST_EQ_INT(brz_sim_init(&sim, &cfg), 0);
+    TEST_EQ_INT(brz_sim_run_days(&sim, 3, 0, NULL, NULL), 1); /* prints the error */
+    TEST_EQ_INT(sim.day, 0);
+    brz_sim_free(&sim);
+    brz_cfg_free(&cfg);
+}
+
+void test_sched_run(void)
+{
+    test_may_idle();
+    test_quiet_days();
+    test_skip_matches_full(0);
+    test_skip_matches_full(3);
+    test_example_validates();
+    test_unknown_mode();
+}
@@ -0,0 +1,160 @@
+#include "test_common.h"
+#include "../brz_snapshot.h"
+#include "../brz_parser.h"
+
+static bool load_cfg(const char* s, ParsedConfig* cfg)
+{
+    char* path = brz_test_write_temp("brz_snap_", s);
+    if(!path) return false;
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+/* whole contents of f as a malloc'd string */
+static char* slurp(FILE* f)
+{
+    long n = ftell(f);
+    if(n < 0) return NULL;
+    char* buf = (char*)malloc((size_t)n + 1);
+    if(!buf) return NULL;
+    rewind(f);
+    size_t got = fread(buf, 1, (size_t)n, f);
+    buf[got] = 0;
+    return buf;
+}
+
+static char* json_of(const BrzSnapshot* s)
+{
+    FILE* f = tmpfile();
+    if(!f) return NULL;
+    char* out = brz_snapshot_write_json(s, f) ? slurp(f) : NULL;
+    fclose(f);
+    return out;
+}
+
+static void test_binary_round_trip(void)
+{
+    const char* src =
+        "kinds { resources { grain fish wood } items { bronze } }\n"
+        "vocations {\n"
+        "  vocation farmer { task t { rest } rule r { when hunger > 0 do t } }\n"
+        "  vocation smith { task t { rest } rule r { when hunger > 0 do t } }\n"
+        "}\n";
+    ParsedConfig cfg;
+    brz_cfg_init(&cfg);
+    TEST_ASSERT(load_cfg(src, &cfg));
+
+    BrzSettlement* setts = NULL;
+    TEST_EQ_INT(brz_settlements_alloc(&setts, 2, 3, 1), 0);
+    brz_settlements_place(setts, 2, 20, 10, 5u);
+    setts[1].population = 7;
+    setts[1].res_inv[2] = 12.5;
+    setts[0].item_inv[0] = 3.0;
+
+    BrzAgentStore agents;
+    TEST_EQ_INT(brz_agents_alloc_and_spawn(&agents, 5, &cfg, setts, 2, 3, 1, 9u), 0);
+    brz_agents_res(&agents, 3)[1] = 4.25;
+    brz_agents_item(&agents, 4)[0] = -1.0;
+
+    BrzWorld world;
+    memset(&world, 0, sizeof(world));
+    world.w = 20; world.h = 10;
+    world.res = (brz_res_t*)calloc(20*10*3, sizeof(brz_res_t));
+    TEST_ASSERT(world.res != NULL);
+    for(int i=0;i<20*10*3;i++) world.res[i] = (brz_res_t)(i % 7);
+    world.res_tot = (BrzSum*)calloc(3, sizeof(BrzSum));
+    TEST_ASSERT(world.res_tot != NULL);
+    brz_world_recount(&world, 3);
+
+    BrzSnapshot a, b;
+    TEST_ASSERT(brz_snapshot_capture(&a, &cfg, &world, setts, 2, &agents, 42));
+    TEST_EQ_INT(a.agent_n, 5);
+    TEST_EQ_INT(a.voc_n, 2);
+    TEST_STREQ(a.voc_names[a.agent_voc[1]], "smith");
+    TEST_ASSERT(a.agent_res[3*3+1] == 4.25);
+
+    char* path = brz_test_write_temp("brz_snap_bin_", "");
+    TEST_ASSERT(path != NULL);
+    FILE* f = fopen(path, "wb");
+    TEST_ASSERT(f != NULL);
+    TEST_ASSERT(brz_snapshot_write_bin(&a, f));
+    fclose(f);
+
+    char err[128];
+    TEST_ASSERT(brz_snapshot_read(&b, path, err, sizeof(err)));
+    TEST_EQ_INT(b.day, 42);
+    TEST_EQ_INT(b.world_w, 20);
+    TEST_EQ_SIZE(b.res_n, 3);
+    TEST_EQ_SIZE(b.item_n, 1);
+    TEST_STREQ(b.item_names[0], "bronze");
+    TEST_EQ_INT(b.sett_pop[1], 7);
+    TEST_ASSERT(memcmp(a.agent_res, b.agent_res, 5*3*sizeof(double)) == 0);
+    TEST_ASSERT(memcmp(a.world_tot, b.world_tot, 3*sizeof(double)) == 0);
+
+    /* the converter prints exactly what the JSON writer would have */
+    char* ja = json_of(&a);
+    char* jb = json_of(&b);
+    TEST_ASSERT(ja && jb);
+    if(ja && jb) TEST_STREQ(ja, jb);
+    TEST_ASSERT(ja && strstr(ja, "\"vocation\": \"smith\"") != NULL);
+    free(ja);
+    free(jb);
+    brz_snapshot_free(&b);
+
+    /* truncated file is rejected */
+    size_t size = 0;
+    char* data = brz_read_entire_file(path, &size);
+    TEST_ASSERT(data != NULL && size > 16);
+    f = fopen(path, "wb");
+    TEST_ASSERT(f != NULL);
+    fwrite(data, 1, size - 9, f);
+    fclose(f);
+    TEST_ASSERT(!brz_snapshot_read(&b, path, err, sizeof(err)));
+    TEST_ASSERT(err[0] != 0);
+    TEST_ASSERT(b.agent_res == NULL);
+
+    /* counts that only fit the file once they wrap in 32 bits (voc_n
+       at byte 36, after magic, version, flags, day, w, h, res_n, item_n) */
+    static const uint32_t bad_voc[] = { 0xFFFFFFFCu, 0x80000000u };
+    for(size_t k=0;k<sizeof(bad_voc)/sizeof(bad_voc[0]);k++)
+    {
+        TEST_ASSERT(data[36] == 2 && data[37] == 0);
+        data[36] = (char)(bad_voc[k] & 0xFFu);
+        data[37] = (char)((bad_voc[k] >> 8) & 0xFFu);
+        data[38] = (char)((bad_voc[k] >> 16) & 0xFFu);
+        data[39] = (char)((bad_voc[k] >> 24) & 0xFFu);
+        f = fopen(path, "wb");
+        TEST_ASSERT(f != NULL);
+        fwrite(data, 1, size, f);
+        fclose(f);
+        TEST_ASSERT(!brz_snapshot_read(&b, path, err, sizeof(err)));
+        TEST_ASSERT(strstr(err, "corrupt") != NULL);
+        TEST_ASSERT(b.voc_names == NULL);
+        data[36] = 2; data[37] = 0; data[38] = 0; data[39] = 0;
+    }
+
+    /* so is something that is not a snapshot */
+    f = fopen(path, "wb");
+    TEST_ASSERT(f != NULL);
+    fputs("{ \"day\": 1 }\n", f);
+    fclose(f);
+    TEST_ASSERT(!brz_snapshot_read(&b, path, err, sizeof(err)));
+    TEST_ASSERT(strstr(err, "snapshot") != NULL);
+
+    free(data);
+    brz_test_unlink(path);
+    free(path);
+    brz_snapshot_free(&a);
+    free(world.res);
+    free(world.res_tot);
+    brz_agents_free(&agents);
+    brz_settlements_free(setts, 2);
+    brz_cfg_free(&cfg);
+}
+
+void test_snapshot_run(void)
+{
+    test_binary_round_trip();
+}
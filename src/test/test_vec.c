@@ -1,6 +1,7 @@
 
 #include "test_common.h"
 #include "../brz_vec.h"
+#include "../brz_arena.h"
 
 typedef struct { int a; int b; } Pair;
 BRZ_VEC_DECL(Pair, PairVec)
@@ -123,6 +124,55 @@ static void test_typed_wrapper(void)
     PairVec_destroy(&pv);
 }
 
+static void test_arena_backed(void)
+{
+    BrzArena a;
+    brz_arena_init(&a);
+
+    BrzVec v;
+    brz_vec_init_arena(&v, sizeof(int), &a);
+    TEST_ASSERT(v.arena == &a);
+    int bad = 0;
+    for(int i=0;i<100;i++)
+    {
+        if(!brz_vec_push(&v, &i)) bad++;
+    }
+    TEST_EQ_INT(bad, 0);
+    TEST_EQ_SIZE(v.len, 100);
+    for(int i=0;i<100;i++)
+    {
+        if(*(int*)brz_vec_at(&v, (size_t)i) != i) bad++;
+    }
+    TEST_EQ_INT(bad, 0);
+    TEST_ASSERT(a.bytes >= 100 * sizeof(int));
+
+    /* exact-size copy, also in place */
+    BrzVec c;
+    TEST_ASSERT(brz_vec_copy_arena(&c, &v, &a));
+    TEST_EQ_SIZE(c.len, 100);
+    TEST_EQ_SIZE(c.cap, 100);
+    TEST_ASSERT(c.data != v.data);
+    TEST_EQ_INT(*(int*)brz_vec_at(&c, 99), 99);
+    void* old = c.data;
+    TEST_ASSERT(brz_vec_copy_arena(&c, &c, &a));
+    TEST_ASSERT(c.data != old);
+    TEST_EQ_INT(*(int*)brz_vec_at(&c, 42), 42);
+
+    BrzVec e, ec;
+    brz_vec_init(&e, sizeof(int));
+    TEST_ASSERT(brz_vec_copy_arena(&ec, &e, &a));
+    TEST_EQ_SIZE(ec.len, 0);
+    TEST_ASSERT(ec.data == NULL);
+
+    /* destroy releases nothing; the arena owns the blocks */
+    brz_vec_destroy(&v);
+    TEST_ASSERT(v.data == NULL);
+    TEST_ASSERT(v.arena == NULL);
+    TEST_EQ_INT(*(int*)brz_vec_at(&c, 7), 7);
+    brz_vec_destroy(&c);
+    brz_arena_destroy(&a);
+}
+
 void test_vec_run(void)
 {
     test_init_destroy();
@@ -131,4 +181,5 @@ void test_vec_run(void)
     test_pop();
     test_elem_size_guards();
     test_typed_wrapper();
+    test_arena_backed();
 }
@@ -0,0 +1,511 @@
+#include "test_common.h"
+#include "../brz_world.h"
+#include "../brz_util.h"
+#include "../brz_settlement.h"
+#include "../brz_parser.h"
+#include "../brz_kinds.h"
+#include <math.h>
+#include <limits.h>
+
+/* the original expanding-square search, kept as the reference */
+static BrzPos ref_find_nearest(const BrzWorld* world, BrzPos from, uint16_t tag, int max_r)
+{
+    BrzPos best = from;
+    int W=world->w,H=world->h;
+    if(from.x<0) from.x=0;
+    if(from.y<0) from.y=0;
+    if(from.x>=W) from.x=W-1;
+    if(from.y>=H) from.y=H-1;
+    for(int r=0; r<=max_r; r++){
+        for(int y=from.y-r; y<=from.y+r; y++){
+            for(int x=from.x-r; x<=from.x+r; x++){
+                if(x<0||y<0||x>=W||y>=H) continue;
+                if(world->tags[y*W+x] & tag){ best.x=x; best.y=y; return best; }
+            }
+        }
+    }
+    return best;
+}
+
+static bool make_world(BrzWorld* w, int W, int H, unsigned seed, unsigned sparsity)
+{
+    memset(w, 0, sizeof(*w));
+    w->w = W; w->h = H;
+    w->tags = (uint16_t*)calloc((size_t)W*H, sizeof(uint16_t));
+    if(!w->tags) return false;
+    BrzRng rng; brz_rng_seed(&rng, seed);
+    for(int i=0;i<W*H;i++)
+    {
+        uint16_t t = 0;
+        for(int b=0;b<BRZ_TAG_COUNT;b++)
+            if(brz_rng_u32(&rng) % (sparsity << b) == 0u) t |= (uint16_t)(1u<<b);
+        w->tags[i] = t;
+    }
+    return brz_world_index_tags(w) == 0;
+}
+
+static int count_mismatches(const BrzWorld* w, unsigned seed, int queries)
+{
+    BrzRng rng; brz_rng_seed(&rng, seed);
+    int bad = 0;
+    for(int q=0;q<queries;q++)
+    {
+        BrzPos from = { brz_rng_range(&rng, -3, w->w+2), brz_rng_range(&rng, -3, w->h+2) };
+        uint16_t tag = (uint16_t)(1u << (brz_rng_u32(&rng) % BRZ_TAG_COUNT));
+        if(q % 7 == 0) tag |= BRZ_TAG_FIRE;
+        int max_r = brz_rng_range(&rng, 0, 40);
+        BrzPos a = brz_world_find_nearest_tag(w, from, tag, max_r);
+        BrzPos b = ref_find_nearest(w, from, tag, max_r);
+        if(a.x != b.x || a.y != b.y) bad++;
+    }
+    return bad;
+}
+
+static void test_nearest_matches_scan(void)
+{
+    /* widths around word boundaries, dense and sparse tags */
+    const int dims[][2] = { {1,1}, {63,17}, {64,64}, {65,9}, {160,80}, {200,130} };
+    for(size_t d=0; d<sizeof(dims)/sizeof(dims[0]); d++)
+    {
+        for(unsigned sp=1; sp<=64; sp*=8)
+        {
+            BrzWorld w;
+            TEST_ASSERT(make_world(&w, dims[d][0], dims[d][1], 11u + (unsigned)d, sp));
+            TEST_EQ_INT(count_mismatches(&w, 5u + sp, 400), 0);
+            brz_world_free(&w);
+        }
+    }
+}
+
+static void test_set_tags_updates_index(void)
+{
+    BrzWorld w;
+    TEST_ASSERT(make_world(&w, 100, 50, 3u, 100000u)); /* practically empty */
+    for(int i=0;i<100*50;i++) brz_world_set_tags(&w, i%100, i/100, 0);
+
+    BrzPos from = { 10, 10 };
+    BrzPos p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_MINE_SN, 32);
+    TEST_EQ_INT(p.x, 10); TEST_EQ_INT(p.y, 10);
+
+    brz_world_set_tags(&w, 30, 25, BRZ_TAG_MINE_SN);
+    brz_world_set_tags(&w, 4, 14, BRZ_TAG_MINE_SN | BRZ_TAG_FOREST);
+    p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_MINE_SN, 32);
+    TEST_EQ_INT(p.x, 4); TEST_EQ_INT(p.y, 14);
+
+    /* equal Chebyshev distance: row-major first wins */
+    brz_world_set_tags(&w, 16, 4, BRZ_TAG_MINE_SN);
+    p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_MINE_SN, 32);
+    TEST_EQ_INT(p.x, 16); TEST_EQ_INT(p.y, 4);
+
+    brz_world_set_tags(&w, 16, 4, 0);
+    brz_world_set_tags(&w, 4, 14, BRZ_TAG_FOREST);
+    p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_MINE_SN, 32);
+    TEST_EQ_INT(p.x, 30); TEST_EQ_INT(p.y, 25);
+    TEST_EQ_INT(count_mismatches(&w, 9u, 200), 0);
+
+    brz_world_free(&w);
+    TEST_ASSERT(w.tag_bits == NULL);
+}
+
+static bool make_regen_world(BrzWorld* w, int W, int H, size_t res_n, int dense)
+{
+    memset(w, 0, sizeof(*w));
+    w->w = W; w->h = H;
+    size_t n = (size_t)W*H;
+    w->res = (brz_res_t*)calloc(n*res_n, sizeof(brz_res_t));
+    w->cap = (brz_res_t*)calloc(n*res_n, sizeof(brz_res_t));
+    w->regen = (double*)calloc(res_n, sizeof(double));
+    w->dirty = (uint32_t*)malloc(n*sizeof(uint32_t));
+    w->dirty_mark = (uint8_t*)malloc(n);
+    w->res_tot = (BrzSum*)calloc(res_n, sizeof(BrzSum));
+    if(!w->res || !w->cap || !w->regen || !w->dirty || !w->dirty_mark || !w->res_tot) return false;
+    BrzRng rng; brz_rng_seed(&rng, 21u);
+    for(size_t i=0;i<n*res_n;i++)
+    {
+        w->cap[i] = (brz_res_t)((brz_rng_u32(&rng) % 3u == 0u) ? 0 : brz_rng_range(&rng, 1, 80));
+        w->res[i] = w->cap[i] * (brz_res_t)0.5;
+    }
+    /* includes a zero and a negative rate */
+    const double rates[] = { 0.01, 0.0, 0.2, -0.05 };
+    for(size_t r=0;r<res_n;r++) w->regen[r] = rates[r % 4];
+    for(size_t i=0;i<n;i++){ w->dirty[i] = (uint32_t)i; w->dirty_mark[i] = 1; }
+    w->dirty_n = n;
+    w->regen_dense = dense;
+    brz_world_recount(w, res_n);
+    return true;
+}
+
+/* |running total - fresh sum| over every plane, largest */
+static double total_drift(const BrzWorld* w, size_t res_n)
+{
+    const size_t n = (size_t)w->w * (size_t)w->h;
+    double worst = 0.0;
+    for(size_t r=0;r<res_n;r++){
+        const brz_res_t* plane = brz_world_res_plane(w, (int)r);
+        double tot = 0.0;
+        for(size_t t=0;t<n;t++) tot += plane[t];
+        double d = fabs(brz_world_res_total(w, (int)r) - tot);
+        if(d > worst) worst = d;
+    }
+    return worst;
+}
+
+static void test_sparse_regen_matches_dense(void)
+{
+    const int W = 70, H = 40;
+    const size_t res_n = 5;
+    BrzWorld a, b;
+    TEST_ASSERT(make_regen_world(&a, W, H, res_n, 1));
+    TEST_ASSERT(make_regen_world(&b, W, H, res_n, 0));
+
+    BrzRng rng; brz_rng_seed(&rng, 8u);
+    int mismatches = 0;
+    for(int day=0; day<400; day++)
+    {
+        int takes = (day % 50 < 10) ? 40 : 0;  /* bursts, then long quiet spells */
+        for(int t=0;t<takes;t++)
+        {
+            BrzPos p = { brz_rng_range(&rng, 0, W-1), brz_rng_range(&rng, 0, H-1) };
+            int rid = brz_rng_range(&rng, 0, (int)res_n-1);
+            double amt = brz_rng_range(&rng, 1, 30);
+            double ta = brz_world_take(&a, p, res_n, rid, amt);
+            double tb = brz_world_take(&b, p, res_n, rid, amt);
+            if(ta != tb) mismatches++;
+        }
+        brz_world_step_regen(&a, res_n);
+        brz_world_step_regen(&b, res_n);
+        if(memcmp(a.res, b.res, (size_t)W*H*res_n*sizeof(brz_res_t)) != 0) mismatches++;
+        /* take and sparse regen keep the totals by deltas; the dense sweep recounts */
+        if(total_drift(&a, res_n) != 0.0 || total_drift(&b, res_n) > 1e-6) mismatches++;
+    }
+    TEST_EQ_INT(mismatches, 0);
+    /* quiet spell at the end: everything has settled */
+    TEST_ASSERT(b.dirty_n < (size_t)W*H);
+
+    brz_world_free(&a);
+    brz_world_free(&b);
+}
+
+/* with a field the lookup still answers what the square scan does */
+static void test_flow_field_matches_scan(void)
+{
+    const int dims[][2] = { {1,1}, {65,9}, {120,70} };
+    for(size_t d=0; d<sizeof(dims)/sizeof(dims[0]); d++)
+    {
+        BrzWorld w;
+        TEST_ASSERT(make_world(&w, dims[d][0], dims[d][1], 40u + (unsigned)d, 32));
+        for(int b=0;b<BRZ_TAG_COUNT;b++)
+            TEST_EQ_INT(brz_world_flow_prepare(&w, (uint16_t)(1u << b)), 0);
+        TEST_EQ_INT(brz_world_flow_prepare(&w, BRZ_TAG_FIELD | BRZ_TAG_COAST), 0);
+        TEST_EQ_INT(brz_world_flow_prepare(&w, BRZ_TAG_FIELD), 0); /* already there */
+        TEST_EQ_INT(w.flow_n, BRZ_TAG_COUNT + 1);
+
+        BrzRng rng; brz_rng_seed(&rng, 2u + (unsigned)d);
+        int bad = 0;
+        for(int q=0;q<600;q++)
+        {
+            BrzPos from = { brz_rng_range(&rng, 0, w.w-1), brz_rng_range(&rng, 0, w.h-1) };
+            uint16_t tag = (q % 5 == 0) ? (uint16_t)(BRZ_TAG_FIELD | BRZ_TAG_COAST)
+                                        : (uint16_t)(1u << (brz_rng_u32(&rng) % BRZ_TAG_COUNT));
+            int max_r = brz_rng_range(&rng, 0, 40);
+            BrzPos a = brz_world_find_nearest_tag(&w, from, tag, max_r);
+            BrzPos r = ref_find_nearest(&w, from, tag, max_r);
+            if(a.x != r.x || a.y != r.y) bad++;
+            /* a radius past the map finds the nearest tile anywhere */
+            a = brz_world_find_nearest_tag(&w, from, tag, INT_MAX);
+            r = ref_find_nearest(&w, from, tag, w.w > w.h ? w.w : w.h);
+            if(a.x != r.x || a.y != r.y) bad++;
+        }
+        TEST_EQ_INT(bad, 0);
+
+        /* a tag change leaves the fields stale until refreshed */
+        TEST_ASSERT(w.flow_n > 0);
+        BrzPos c = { w.w / 2, w.h / 2 };
+        brz_world_set_tags(&w, c.x, c.y, (uint16_t)(w.tags[c.y*w.w + c.x] ^ BRZ_TAG_FIELD));
+        TEST_ASSERT(w.flow_stale);
+        BrzPos a = brz_world_find_nearest_tag(&w, c, BRZ_TAG_FIELD, 40);
+        BrzPos r = ref_find_nearest(&w, c, BRZ_TAG_FIELD, 40);
+        TEST_ASSERT(a.x == r.x && a.y == r.y);
+        TEST_EQ_INT(brz_world_flow_refresh(&w), 0);
+        TEST_ASSERT(!w.flow_stale);
+        a = brz_world_find_nearest_tag(&w, c, BRZ_TAG_FIELD, 40);
+        TEST_ASSERT(a.x == r.x && a.y == r.y);
+        brz_world_free(&w);
+    }
+}
+
+/* past the 16-bit field distance the lookup falls back to the search */
+static void test_flow_field_saturated(void)
+{
+    BrzWorld w;
+    const int W = 70000;
+    TEST_ASSERT(make_world(&w, W, 1, 7u, 32));
+    for(int x=0;x<W;x++) brz_world_set_tags(&w, x, 0, 0);
+    brz_world_set_tags(&w, 0, 0, BRZ_TAG_FIELD);
+    TEST_EQ_INT(brz_world_flow_prepare(&w, BRZ_TAG_FIELD), 0);
+    TEST_EQ_INT(w.flow_n, 1);
+    TEST_EQ_INT(brz_world_flow_refresh(&w), 0);
+    TEST_ASSERT(!w.flow_stale);
+
+    BrzPos from = { W - 1, 0 };
+    BrzPos p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_FIELD, INT_MAX);
+    TEST_ASSERT(p.x == 0 && p.y == 0);
+    p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_FIELD, W - 1);
+    TEST_ASSERT(p.x == 0 && p.y == 0);
+    p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_FIELD, W - 2);
+    TEST_ASSERT(p.x == from.x && p.y == from.y);
+    p = brz_world_find_nearest_tag(&w, from, BRZ_TAG_FIELD, 1000);
+    TEST_ASSERT(p.x == from.x && p.y == from.y);
+    brz_world_free(&w);
+}
+
+static void place_random(BrzSettlement* s, int n, int W, int H, BrzRng* rng)
+{
+    memset(s, 0, (size_t)n * sizeof(*s));
+    for(int i=0;i<n;i++)
+    {
+        s[i].pos.x = brz_rng_range(rng, 0, W - 1);
+        s[i].pos.y = brz_rng_range(rng, 0, H - 1);
+        if(i > 0 && i % 5 == 0) s[i].pos = s[i - 1].pos; /* shared tiles */
+    }
+}
+
+/* the owner map answers exactly what the linear scan does, ties included */
+static void test_settlement_index_matches_scan(void)
+{
+    const int dims[][3] = { {1,1,1}, {17,9,2}, {64,40,7}, {33,70,60}, {128,96,400} };
+    BrzRng rng; brz_rng_seed(&rng, 21u);
+    for(size_t d=0; d<sizeof(dims)/sizeof(dims[0]); d++)
+    {
+        const int W = dims[d][0], H = dims[d][1], n = dims[d][2];
+        BrzSettlement* s = (BrzSettlement*)malloc((size_t)n * sizeof(BrzSettlement));
+        TEST_ASSERT(s != NULL);
+        if(!s) return;
+        place_random(s, n, W, H, &rng);
+        BrzWorld w;
+        TEST_ASSERT(make_world(&w, W, H, 3u, 8));
+        TEST_EQ_INT(brz_world_index_settlements(&w, s, n), 0);
+        TEST_ASSERT(w.sett_owner != NULL);
+        int bad = 0;
+        for(int y=0;y<H;y++)
+            for(int x=0;x<W;x++)
+            {
+                BrzPos p = { x, y };
+                if(brz_world_nearest_settlement(&w, s, n, p) != brz_find_nearest_settlement(s, n, p)) bad++;
+            }
+        TEST_EQ_INT(bad, 0);
+        /* off the map the scan answers */
+        BrzPos off = { -4, H + 2 };
+        TEST_EQ_INT(brz_world_nearest_settlement(&w, s, n, off), brz_find_nearest_settlement(s, n, off));
+
+        /* a settlement off the map leaves the index unbuilt */
+        s[0].pos.x = W + 3;
+        TEST_EQ_INT(brz_world_index_settlements(&w, s, n), 0);
+        TEST_ASSERT(w.sett_owner == NULL);
+        BrzPos p0 = { 0, 0 };
+        TEST_EQ_INT(brz_world_nearest_settlement(&w, s, n, p0), brz_find_nearest_settlement(s, n, p0));
+        brz_world_free(&w);
+        free(s);
+    }
+}
+
+/* stamping by merged row spans covers exactly the discs */
+static void test_stamp_fields_matches_discs(void)
+{
+    const int radii[] = { 0, 1, 3, 8 };
+    BrzRng rng; brz_rng_seed(&rng, 8u);
+    for(size_t ri=0; ri<sizeof(radii)/sizeof(radii[0]); ri++)
+    {
+        const int W = 90, H = 50, n = 40, r = radii[ri];
+        BrzSettlement s[40];
+        place_random(s, n, W, H, &rng);
+        s[1].pos.x = -2; /* partly off the map */
+        BrzWorld w;
+        TEST_ASSERT(make_world(&w, W, H, 17u + (unsigned)ri, 4));
+        uint16_t* want = (uint16_t*)malloc((size_t)W * H * sizeof(uint16_t));
+        TEST_ASSERT(want != NULL);
+        if(!want){ brz_world_free(&w); return; }
+        memcpy(want, w.tags, (size_t)W * H * sizeof(uint16_t));
+        for(int i=0;i<n;i++)
+            for(int y=0;y<H;y++)
+                for(int x=0;x<W;x++)
+                {
+                    int dx = x - s[i].pos.x, dy = y - s[i].pos.y;
+                    if(dx*dx + dy*dy > r*r) continue;
+                    if(!(want[y*W+x] & BRZ_TAG_COAST)) want[y*W+x] |= BRZ_TAG_FIELD;
+                }
+        brz_world_stamp_fields_around_settlements(&w, s, n, r);
+        TEST_EQ_INT(memcmp(want, w.tags, (size_t)W * H * sizeof(uint16_t)), 0);
+        /* the tag index followed */
+        BrzWorld fresh;
+        memset(&fresh, 0, sizeof(fresh));
+        fresh.w = W; fresh.h = H; fresh.tags = want;
+        TEST_EQ_INT(brz_world_index_tags(&fresh), 0);
+        size_t words = (size_t)BRZ_TAG_COUNT * H * fresh.tag_words;
+        TEST_EQ_INT(memcmp(fresh.tag_bits, w.tag_bits, words * sizeof(uint64_t)), 0);
+        brz_world_free(&fresh);
+        brz_world_free(&w);
+    }
+}
+
+static bool parse_cfg(ParsedConfig* cfg, const char* src)
+{
+    char* path = brz_test_write_temp("brz_world_", src);
+    if(!path) return false;
+    brz_cfg_init(cfg);
+    bool ok = brz_parse_file(path, cfg);
+    brz_test_unlink(path);
+    free(path);
+    return ok;
+}
+
+static const char* k_cap_kinds =
+    "kinds { resources { grain fish wood clay } }\n"
+    "resources { fish_renew 0.2 clay_renew 0 }\n";
+
+/* init worlds from two configs, run the same takes and regen on both for
+   120 days and count every take, total or peek that differs. Takes stay in
+   the top-left 100x50 tiles; the rest of the map is only ever peeked at. */
+static int worlds_diverge(BrzWorld* a, BrzWorld* b, const ParsedConfig* ca, const ParsedConfig* cb, int dense)
+{
+    const int W = 150, H = 100;
+    const size_t res_n = kind_table_count(&ca->resource_kinds);
+    if(brz_world_init_seed(a, ca, 5u, W, H, res_n) != 0) return -1;
+    if(brz_world_init_seed(b, cb, 5u, W, H, res_n) != 0) return -1;
+    a->regen_dense = b->regen_dense = dense;
+    /* caps come from the generated tags, not later stamps */
+    BrzSettlement st;
+    memset(&st, 0, sizeof(st));
+    st.pos.x = 30; st.pos.y = 30;
+    brz_world_stamp_fields_around_settlements(a, &st, 1, 8);
+    brz_world_stamp_fields_around_settlements(b, &st, 1, 8);
+
+    BrzRng rng; brz_rng_seed(&rng, 12u);
+    int mismatches = 0;
+    for(int day=0; day<120; day++)
+    {
+        int takes = (day % 30 < 5) ? 60 : 0;
+        for(int t=0;t<takes;t++)
+        {
+            BrzPos p = { brz_rng_range(&rng, 0, 100), brz_rng_range(&rng, 0, 50) };
+            int rid = brz_rng_range(&rng, 0, (int)res_n-1);
+            double amt = brz_rng_range(&rng, 1, 120);
+            if(brz_world_take(a, p, res_n, rid, amt) != brz_world_take(b, p, res_n, rid, amt)) mismatches++;
+        }
+        brz_world_step_regen(a, res_n);
+        brz_world_step_regen(b, res_n);
+        for(size_t r=0;r<res_n;r++)
+            if(fabs(brz_world_res_total(a, (int)r) - brz_world_res_total(b, (int)r)) > 1e-6) mismatches++;
+        if(day % 10 != 9) continue;
+        for(int y=0;y<H;y++)
+            for(int x=0;x<W;x++)
+                for(size_t r=0;r<res_n;r++){
+                    BrzPos p = { x, y };
+                    if(brz_world_peek(a, p, res_n, (int)r) != brz_world_peek(b, p, res_n, (int)r)) mismatches++;
+                }
+    }
+    return mismatches;
+}
+
+/* a chunked world takes and regenerates like the flat one, and only
+   allocates the chunks something was taken from */
+static void test_chunked_matches_flat(void)
+{
+    ParsedConfig cf, cc;
+    char src[512];
+    snprintf(src, sizeof(src), "sim { map_w 150 map_h 100 }\n%s", k_cap_kinds);
+    TEST_ASSERT(parse_cfg(&cf, src));
+    snprintf(src, sizeof(src), "sim { map_w 150 map_h 100 world chunked }\n%s", k_cap_kinds);
+    TEST_ASSERT(parse_cfg(&cc, src));
+
+    for(int dense=0; dense<2; dense++)
+    {
+        BrzWorld a, b;
+        TEST_EQ_INT(worlds_diverge(&a, &b, &cf, &cc, dense), 0);
+        TEST_ASSERT(b.chunks != NULL && b.res == NULL && b.cap == NULL);
+        TEST_EQ_INT(b.chunk_w, 3); TEST_EQ_INT(b.chunk_h, 2);
+        TEST_EQ_INT((int)b.chunk_live, 2);
+        TEST_ASSERT(b.chunks[2] == NULL && b.chunks[3] == NULL);
+        TEST_EQ_INT(b.oom, 0);
+
+        /* no dense lookup planes on the chunked world; its searches still
+           find what the flat world's fields do */
+        BrzSettlement st[3];
+        memset(st, 0, sizeof(st));
+        st[0].pos.x = 30;  st[0].pos.y = 30;
+        st[1].pos.x = 120; st[1].pos.y = 10;
+        st[2].pos.x = 75;  st[2].pos.y = 90;
+        TEST_EQ_INT(brz_world_flow_prepare(&a, BRZ_TAG_FIELD), 0);
+        TEST_EQ_INT(brz_world_flow_prepare(&b, BRZ_TAG_FIELD), 0);
+        TEST_EQ_INT(brz_world_index_settlements(&a, st, 3), 0);
+        TEST_EQ_INT(brz_world_index_settlements(&b, st, 3), 0);
+        TEST_EQ_INT(a.flow_n, 1);
+        TEST_EQ_INT(b.flow_n, 0);
+        TEST_ASSERT(a.sett_owner != NULL && b.sett_owner == NULL);
+        int lookup_diff = 0;
+        for(int y=0;y<b.h;y++)
+            for(int x=0;x<b.w;x++){
+                BrzPos p = { x, y };
+                BrzPos pa = brz_world_find_nearest_tag(&a, p, BRZ_TAG_FIELD, 32);
+                BrzPos pb = brz_world_find_nearest_tag(&b, p, BRZ_TAG_FIELD, 32);
+                if(pa.x != pb.x || pa.y != pb.y) lookup_diff++;
+                if(brz_world_nearest_settlement(&a, st, 3, p) != brz_world_nearest_settlement(&b, st, 3, p)) lookup_diff++;
+            }
+        TEST_EQ_INT(lookup_diff, 0);
+        brz_world_free(&a);
+        brz_world_free(&b);
+    }
+    brz_cfg_free(&cf);
+    brz_cfg_free(&cc);
+}
+
+/* caps looked up in the cap table give the same run as cap planes, flat
+   and chunked */
+static void test_cap_table_matches_planes(void)
+{
+    for(int chunked=0; chunked<2; chunked++)
+    {
+        ParsedConfig ct, cp;
+        char src[512];
+        const char* world = chunked ? "world chunked" : "";
+        snprintf(src, sizeof(src), "sim { map_w 150 map_h 100 %s }\n%s", world, k_cap_kinds);
+        TEST_ASSERT(parse_cfg(&ct, src));
+        snprintf(src, sizeof(src), "sim { map_w 150 map_h 100 caps plane %s }\n%s", world, k_cap_kinds);
+        TEST_ASSERT(parse_cfg(&cp, src));
+
+        for(int dense=0; dense<2; dense++)
+        {
+            BrzWorld a, b;
+            TEST_EQ_INT(worlds_diverge(&a, &b, &ct, &cp, dense), 0);
+            TEST_ASSERT(a.cap == NULL && a.cap_key != NULL && a.cap_tab != NULL);
+            TEST_ASSERT(b.cap_key == NULL && b.cap_tab == NULL);
+            if(chunked){
+                TEST_ASSERT(a.chunks[0] && a.chunks[0]->cap == NULL);
+                TEST_ASSERT(b.chunks[0] && b.chunks[0]->cap != NULL);
+            }else{
+                TEST_ASSERT(b.cap != NULL);
+                int cap_diff = 0;
+                for(size_t t=0;t<(size_t)a.w*(size_t)a.h;t++)
+                    for(int r=0;r<4;r++) cap_diff += brz_world_cap_tile(&a, t, r) != brz_world_cap_tile(&b, t, r);
+                TEST_EQ_INT(cap_diff, 0);
+            }
+            brz_world_free(&a);
+            brz_world_free(&b);
+        }
+        brz_cfg_free(&ct);
+        brz_cfg_free(&cp);
+    }
+}
+
+void test_world_run(void)
+{
+    test_nearest_matches_scan();
+    test_set_tags_updates_index();
+    test_sparse_regen_matches_dense();
+    test_flow_field_matches_scan();
+    test_flow_field_saturated();
+    test_settlement_index_matches_scan();
+    test_stamp_fields_matches_discs();
+    test_chunked_matches_flat();
+    test_cap_table_matches_planes();
+}
@@ -0,0 +1,89 @@
+#include "test_common.h"
+#include "../brz_writer.h"
+#include "../brz_util.h"
+
+typedef struct {
+    int seq;
+    int* released;
+    int* order;      /* write order, shared by all jobs */
+    int* order_n;
+} Job;
+
+static bool job_write(void* payload, FILE* f)
+{
+    Job* j = (Job*)payload;
+    j->order[(*j->order_n)++] = j->seq;
+    return fprintf(f, "job %d\n", j->seq) > 0;
+}
+
+static void job_release(void* payload)
+{
+    Job* j = (Job*)payload;
+    (*j->released)++;
+    free(j);
+}
+
+static void run_jobs(int depth)
+{
+    enum { N = 16 };
+    char* paths[N];
+    int released = 0, order[N], order_n = 0;
+
+    BrzWriter* w = brz_writer_create(depth);
+    TEST_ASSERT(w != NULL);
+    for(int i=0;i<N;i++)
+    {
+        paths[i] = brz_test_write_temp("brz_writer_", "");
+        TEST_ASSERT(paths[i] != NULL);
+        Job* j = (Job*)calloc(1, sizeof(Job));
+        j->seq = i;
+        j->released = &released;
+        j->order = order;
+        j->order_n = &order_n;
+        TEST_ASSERT(brz_writer_submit(w, paths[i], job_write, job_release, j));
+    }
+    brz_writer_flush(w);
+    TEST_EQ_INT(released, N);
+    TEST_EQ_INT(brz_writer_failures(w), 0);
+
+    /* files are written in submission order */
+    TEST_EQ_INT(order_n, N);
+    for(int i=0;i<N;i++) TEST_EQ_INT(order[i], i);
+
+    for(int i=0;i<N;i++)
+    {
+        size_t n = 0;
+        char* text = brz_read_entire_file(paths[i], &n);
+        char want[32];
+        snprintf(want, sizeof(want), "job %d\n", i);
+        TEST_STREQ(text, want);
+        free(text);
+        brz_test_unlink(paths[i]);
+        free(paths[i]);
+    }
+
+    /* an unwritable path is reported and the payload still released */
+    Job* j = (Job*)calloc(1, sizeof(Job));
+    j->released = &released;
+    j->order = order;
+    j->order_n = &order_n;
+    order_n = 0;
+    TEST_ASSERT(brz_writer_submit(w, "/nonexistent-dir/x/y.json", job_write, job_release, j));
+    brz_writer_flush(w);
+    TEST_EQ_INT(brz_writer_failures(w), 1);
+    brz_writer_destroy(w);
+    TEST_EQ_INT(released, N + 1);
+    TEST_EQ_INT(order_n, 0);
+}
+
+static void test_writer_queue(void)
+{
+    run_jobs(0);  /* synchronous */
+    run_jobs(1);  /* every submit waits for the previous file */
+    run_jobs(3);
+}
+
+void test_writer_run(void)
+{
+    test_writer_queue();
+}